@@ -0,0 +1,20 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+
+// must match simple_shader.vert bit for bit, the main pass tests against this depth with EQUAL
+invariant gl_Position;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projection;
+    mat4 view;
+} ubo;
+
+layout(push_constant) uniform Push {
+    mat4 modelMatrix;
+} push;
+
+void main() {
+    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+    gl_Position = ubo.projection * ubo.view * positionWorld;
+}
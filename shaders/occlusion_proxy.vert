@@ -0,0 +1,31 @@
+#version 450
+
+// Bounding box of an object, drawn inside an occlusion query, see GlorpOcclusionQueries.
+// 12 triangles from gl_VertexIndex alone, the pipeline has no vertex input.
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projection;
+    mat4 view;
+} ubo;
+
+layout(push_constant) uniform Push {
+    mat4 modelMatrix;
+    vec4 boundsMin;
+    vec4 boundsMax;
+} push;
+
+// corner i takes boundsMax on the axes whose bit is set, x = 1, y = 2, z = 4
+const int CORNERS[36] = int[](
+    0, 2, 1, 1, 2, 3,
+    4, 5, 6, 5, 7, 6,
+    0, 1, 4, 1, 5, 4,
+    2, 6, 3, 3, 6, 7,
+    0, 4, 2, 2, 4, 6,
+    1, 3, 5, 3, 7, 5
+);
+
+void main() {
+    int corner = CORNERS[gl_VertexIndex];
+    vec3 position = mix(push.boundsMin.xyz, push.boundsMax.xyz, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+    gl_Position = ubo.projection * ubo.view * push.modelMatrix * vec4(position, 1.0);
+}
@@ -1,6 +1,7 @@
 #version 450
 
 layout (location = 0) in vec2 fragOffset;
+layout (location = 1) in vec4 fragColor;
 layout (location = 0) out vec4 outColor;
 
 struct PointLight {
@@ -13,16 +14,11 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
+    vec4 clusterScale;
+    uvec4 clusterCounts;
     int numLights;
 } ubo;
 
-layout (push_constant) uniform Push {
-  vec4 position;
-  vec4 color;
-  float radius;
-} push;
-
 const float M_PI = 3.1415926538;
 void main() {
     float dist = sqrt(dot(fragOffset, fragOffset)); 
@@ -30,5 +26,5 @@ void main() {
         discard;
     }
     float cosDis = 0.5 * (cos(dist * M_PI) + 1.0);
-    outColor = vec4(push.color.xyz + cosDis, cosDis);
+    outColor = vec4(fragColor.xyz + cosDis, cosDis);
 }
\ No newline at end of file
@@ -9,7 +9,11 @@ const vec2 OFFSETS[6] = vec2[](
   vec2(1.0, 1.0)
 );
 
+layout (location = 0) in vec4 lightPosition; // w is the billboard radius
+layout (location = 1) in vec4 lightColor;
+
 layout (location = 0) out vec2 fragOffset;
+layout (location = 1) out vec4 fragColor;
 
 struct PointLight {
   vec4 position;
@@ -21,24 +25,20 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
+    vec4 clusterScale;
+    uvec4 clusterCounts;
     int numLights;
 } ubo;
 
-layout (push_constant) uniform Push {
-  vec4 position;
-  vec4 color;
-  float radius;
-} push;
-
 void main() {
   fragOffset = OFFSETS[gl_VertexIndex];
+  fragColor = lightColor;
   vec3 cameraRightWorld = {ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]};
   vec3 cameraUpWorld = {ubo.view[0][1], ubo.view[1][1], ubo.view[2][1]};
 
-  vec3 posionWorld = push.position.xyz 
-  + push.radius * fragOffset.x * cameraRightWorld
-  + push.radius * fragOffset.y * cameraUpWorld;
+  vec3 posionWorld = lightPosition.xyz
+  + lightPosition.w * fragOffset.x * cameraRightWorld
+  + lightPosition.w * fragOffset.y * cameraUpWorld;
 
   gl_Position = ubo.projection * ubo.view * vec4(posionWorld, 1.0);
 }
\ No newline at end of file
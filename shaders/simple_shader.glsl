@@ -0,0 +1,202 @@
+// Shared body of simple_shader.frag and simple_shader_virtual.frag, which defines VIRTUAL_ALBEDO to
+// sample the albedo through a virtual texture instead of albedoMap.
+// Material features are specialization constants, chosen per material by SimpleRenderSystem. Every feature a
+// material lacks is folded away by the driver, so its texture is never fetched.
+layout(constant_id = 0) const bool HAS_NORMAL_MAP = true;
+layout(constant_id = 1) const bool HAS_ALBEDO_MAP = true;
+layout(constant_id = 2) const bool HAS_EMISSIVE_MAP = true;
+layout(constant_id = 3) const bool HAS_ORM_MAP = true;
+layout(constant_id = 4) const bool USE_OCCLUSION = true;
+layout(constant_id = 5) const bool ALPHA_MASK = false;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragPosWorld;
+layout(location = 2) in vec3 fragNormalWorld;
+layout(location = 3) in vec2 fragUV;
+layout(location = 4) in vec3 fragTangent;
+layout(location = 5) in vec3 fragBitangent;
+
+layout(push_constant) uniform Push {
+    mat4 modelMatrix; // Projection * view * model
+    mat4 normalMatrix; // w of the last column is the material's alpha cutoff
+} push;
+
+struct PointLight {
+    vec4 position; // w is the light's range
+    vec4 color;    // w is the intensity
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projection;
+    mat4 view;
+    mat4 invView;
+    vec4 ambientLightColor;
+    vec4 clusterScale;
+    uvec4 clusterCounts;
+    int numLights;
+} ubo;
+
+layout(set = 0, binding = 1) uniform samplerCube skybox;
+
+// light clusters of GlorpLightClusters, every cluster lists the lights whose range overlaps it
+layout(set = 0, binding = 2) readonly buffer LightBuffer {
+    PointLight lights[];
+} lightBuffer;
+layout(set = 0, binding = 3) readonly buffer ClusterBuffer {
+    uvec2 clusters[]; // first light index, light count
+} clusterBuffer;
+layout(set = 0, binding = 4) readonly buffer LightIndexBuffer {
+    uint indices[];
+} lightIndexBuffer;
+
+layout(set = 1, binding = 0) uniform sampler2D albedoMap;
+layout(set = 1, binding = 1) uniform sampler2D normalMap;
+layout(set = 1, binding = 2) uniform sampler2D emissiveMap;
+layout(set = 1, binding = 3) uniform sampler2D ormMap;
+
+#ifdef VIRTUAL_ALBEDO
+#include "virtual_texture.glsl"
+#endif
+
+const float PI = 3.1415926538;
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH * NdotH;
+
+    float num = a2;
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return num / denom;
+}
+
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r * r) / 8.0;
+
+    float num = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+
+    return num / denom;
+}
+uvec2 lightCluster(vec3 positionWorld) {
+    float depth = (ubo.view * vec4(positionWorld, 1.0)).z;
+    uvec3 cluster = uvec3(
+        uvec2(gl_FragCoord.xy * ubo.clusterScale.xy),
+        uint(max(log(depth) * ubo.clusterScale.z + ubo.clusterScale.w, 0.0))
+    );
+    cluster = min(cluster, ubo.clusterCounts.xyz - 1u);
+    return clusterBuffer.clusters[(cluster.z * ubo.clusterCounts.y + cluster.y) * ubo.clusterCounts.x + cluster.x];
+}
+
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+
+void main() {
+    vec4 baseColor = vec4(1.0);
+    if (HAS_ALBEDO_MAP) {
+#ifdef VIRTUAL_ALBEDO
+        baseColor = sampleVirtualTexture(fragUV);
+#else
+        baseColor = texture(albedoMap, fragUV);
+#endif
+    }
+    if (ALPHA_MASK && baseColor.a < push.normalMatrix[3][3]) {
+        discard;
+    }
+    vec3 albedo = baseColor.rgb;
+
+    // without a map the surface is a rough dielectric, as with glTF's default factors on a white texture
+    vec3 orm = vec3(1.0, 1.0, 0.0);
+    if (HAS_ORM_MAP) {
+        orm = texture(ormMap, fragUV).rgb;
+    }
+    float ao = USE_OCCLUSION ? orm.r : 1.0;
+
+    float metallic = orm.b;
+    float roughness = orm.g;
+
+    vec3 surfaceNormal = fragNormalWorld;
+
+    if (HAS_NORMAL_MAP) {
+        // only XY is stored for BC5 normal maps, Z is rebuilt for every format
+        vec2 xy = texture(normalMap, fragUV).rg * 2.0 - 1.0;
+        vec3 normal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+
+        vec3 T = normalize(fragTangent);
+        vec3 B = normalize(fragBitangent);
+        vec3 N = normalize(fragNormalWorld);
+
+        mat3 TBN = mat3(T, B, N);
+        surfaceNormal = normalize(TBN * normal);
+    }
+
+    vec3 cameraPositionWorld = ubo.invView[3].xyz;
+    vec3 V = normalize(cameraPositionWorld - fragPosWorld);
+
+    vec3 F0 = vec3(0.04);
+    F0 = mix(F0, albedo, metallic);
+
+    vec3 Lo = vec3(0.0);
+    uvec2 cluster = lightCluster(fragPosWorld);
+    for (uint i = 0; i < cluster.y; i++) {
+        PointLight light = lightBuffer.lights[lightIndexBuffer.indices[cluster.x + i]];
+        vec3 L = normalize(light.position.xyz - fragPosWorld);
+        vec3 H = normalize(V + L);
+        float distance = length(light.position.xyz - fragPosWorld);
+        // fades out towards the range, past it the light is not in the cluster anyway
+        float falloff = clamp(1.0 - pow(distance / light.position.w, 4.0), 0.0, 1.0);
+        vec3 radiance = light.color.xyz * light.color.w * falloff * falloff;
+
+        // cook-torrance brdf
+        float NDF = DistributionGGX(surfaceNormal, H, roughness);
+        float G = GeometrySmith(surfaceNormal, V, L, roughness);
+        vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+        vec3 numerator = NDF * G * F;
+        float denominator = 4.0 * max(dot(surfaceNormal, V), 0.0) * max(dot(surfaceNormal, L), 0.0) + 0.0001;
+        vec3 specular = numerator / denominator;
+
+        vec3 kS = F;
+        vec3 kD = vec3(1.0) - kS;
+        kD *= 1.0 - metallic;
+
+        // add to outgoing radiance Lo
+        float NdotL = max(dot(surfaceNormal, L), 0.0);
+        Lo += (kD * albedo / PI + specular) * radiance * NdotL;
+    }
+
+    vec3 ambient = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w * albedo * ao;
+
+    vec3 R = reflect(-V, surfaceNormal);
+    // rougher surfaces reflect blurrier mips of the environment
+    float envLod = roughness * float(textureQueryLevels(skybox) - 1);
+    vec3 reflectionColor = textureLod(skybox, R, envLod).rgb;
+    vec3 F_env = fresnelSchlick(max(dot(surfaceNormal, V), 0.0), F0);
+    vec3 envSpecular = F_env * reflectionColor * (1.0 - roughness) * ao;
+
+    vec3 color = ambient + Lo + envSpecular;
+
+    if (HAS_EMISSIVE_MAP) {
+        color += texture(emissiveMap, fragUV).rgb;
+    }
+    outColor = vec4(color, 1.0);
+}
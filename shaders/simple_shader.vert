@@ -14,6 +14,9 @@ layout(location = 3) out vec2 fragUV;
 layout(location = 4) out vec3 fragTangent;
 layout(location = 5) out vec3 fragBitangent;
 
+// the depth pre-pass computes the same position, see depth_prepass.vert
+invariant gl_Position;
+
 struct PointLight {
     vec4 position;
     vec4 color;
@@ -24,14 +27,14 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 ambientLightColor;
-    PointLight pointLights[10];
+    vec4 clusterScale;
+    uvec4 clusterCounts;
     int numLights;
 } ubo;
 
 layout(push_constant) uniform Push {
     mat4 modelMatrix; // Projection * view * model
     mat4 normalMatrix;
-    vec4 useMaps;
 } push;
 
 void main() {
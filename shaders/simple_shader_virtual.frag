@@ -0,0 +1,5 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#define VIRTUAL_ALBEDO
+#include "simple_shader.glsl"
@@ -0,0 +1,60 @@
+// Virtual texture lookup, see GlorpVirtualTexture. Page layout constants match GlorpVirtualTextureFile.
+
+const uint VT_PAGE_SIZE = 128;
+const uint VT_PAGE_BORDER = 4;
+const uint VT_PAGE_PAYLOAD = VT_PAGE_SIZE - 2 * VT_PAGE_BORDER;
+const uint VT_MAX_LEVELS = 16;
+
+layout(set = 2, binding = 0) uniform sampler2D vtPageCache;
+layout(set = 2, binding = 1) readonly buffer VirtualPageTable {
+    // slot x | slot y << 8 | resident level << 16
+    uint entries[];
+} vtPageTable;
+layout(set = 2, binding = 2) buffer VirtualFeedback {
+    uint requested[];
+} vtFeedback;
+layout(set = 2, binding = 3) uniform VirtualTextureInfo {
+    uvec2 size;
+    uint levelCount;
+    uint cachePagesPerSide;
+    // pagesX, pagesY, firstPage, unused
+    uvec4 levels[VT_MAX_LEVELS];
+} vtInfo;
+
+uint vtPageIndex(vec2 uv, uint level, out vec2 levelTexel) {
+    uvec4 info = vtInfo.levels[level];
+    levelTexel = uv * vec2(max(vtInfo.size >> level, uvec2(1)));
+    uvec2 page = min(uvec2(levelTexel) / VT_PAGE_PAYLOAD, info.xy - 1);
+    return info.z + page.y * info.x + page.x;
+}
+
+vec4 sampleVirtualTexture(vec2 uv) {
+    // the level the hardware would pick for a texture of the full virtual size
+    vec2 texel = uv * vec2(vtInfo.size);
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(lod + 0.5, 0.0, float(vtInfo.levelCount - 1)));
+
+    uv = fract(uv);
+    vec2 levelTexel;
+    uint index = vtPageIndex(uv, level, levelTexel);
+
+    // a quarter of the fragments is enough to find every page, and most bits are already set
+    uint word = index >> 5;
+    uint bit = 1u << (index & 31u);
+    if (all(equal(uvec2(gl_FragCoord.xy) & 1u, uvec2(0))) && (vtFeedback.requested[word] & bit) == 0u) {
+        atomicOr(vtFeedback.requested[word], bit);
+    }
+
+    // the entry points at the page itself or its closest resident ancestor
+    uint entry = vtPageTable.entries[index];
+    uvec2 slot = uvec2(entry & 0xffu, (entry >> 8) & 0xffu);
+    uint residentLevel = entry >> 16;
+    vtPageIndex(uv, residentLevel, levelTexel);
+    uvec4 residentInfo = vtInfo.levels[residentLevel];
+    vec2 page = min(floor(levelTexel / float(VT_PAGE_PAYLOAD)), vec2(residentInfo.xy - 1));
+    vec2 inPage = levelTexel - page * float(VT_PAGE_PAYLOAD);
+    vec2 cacheTexel = vec2(slot * VT_PAGE_SIZE + VT_PAGE_BORDER) + inPage;
+    return textureLod(vtPageCache, cacheTexel / float(vtInfo.cachePagesPerSide * VT_PAGE_SIZE), 0.0);
+}
@@ -6,14 +6,29 @@
 #include "systems/cubemap_render_system.hpp"
 #include "systems/simple_render_system.hpp"
 #include "systems/point_light_system.hpp"
+#include "systems/depth_prepass_system.hpp"
 
 #include "glorp_camera.hpp"
 #include "keyboard_movement_controller.hpp"
 #include "glorp_buffer.hpp"
+#include "glorp_upload_context.hpp"
+#include "glorp_sampler_cache.hpp"
+#include "glorp_texture_streamer.hpp"
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_pipeline_registry.hpp"
+#include "glorp_light_clusters.hpp"
+#include "glorp_hzb_culler.hpp"
+#include "glorp_occlusion_queries.hpp"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <random>
 #include <chrono>
 #include <cassert>
+#include <filesystem>
 #include <thread>
 #include <vulkan/vulkan_core.h>
 
@@ -34,13 +49,30 @@ FirstApp::FirstApp() {
         .setMaxSets(GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
         .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
         .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
         .build();
     
-    loadGameObjects();
-
     texturePool = GlorpDescriptorPool::Builder(m_glorpDevice)
-        .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT * 5 * m_gameObjects.size())
+        .setMaxSets(MAX_MATERIAL_SETS * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 * MAX_MATERIAL_SETS * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .build();
+
+    m_textureSetLayout = GlorpDescriptorSetLayout::Builder(m_glorpDevice)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Albedo
+        .addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Normal Map
+        .addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Emissive Map
+        .addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Occlusion Roughness Metallic Map
         .build();
+
+    virtualTexturePool = GlorpDescriptorPool::Builder(m_glorpDevice)
+        .setMaxSets(MAX_VIRTUAL_TEXTURES * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_VIRTUAL_TEXTURES * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * MAX_VIRTUAL_TEXTURES * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MAX_VIRTUAL_TEXTURES * GlorpSwapChain::MAX_FRAMES_IN_FLIGHT)
+        .build();
+    m_virtualTextureSetLayout = GlorpVirtualTexture::createSetLayout(m_glorpDevice);
+
+    loadGameObjects();
     //glfwSetWindowUserPointer(m_glorpWindow.getGLFWwindow(), this);
     //glfwSetFramebufferSizeCallback(m_glorpWindow.getGLFWwindow(), frameBufferResizeCallback);
 }
@@ -63,7 +95,11 @@ void FirstApp::run() {
     auto globalSetLayout = GlorpDescriptorSetLayout::Builder(m_glorpDevice)
         .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
         .addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT) // Lights
+        .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT) // Light clusters
+        .addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT) // Cluster light indices
         .build();
+    GlorpLightClusters lightClusters{m_glorpDevice};
 
     GlorpCubeMap cubemap = GlorpCubeMap(m_glorpDevice, {
         std::string(RESOURCE_LOCATIONS) + "cubemap/skybox/right.jpg",
@@ -75,72 +111,62 @@ void FirstApp::run() {
     });
 
     std::vector<VkDescriptorSet> globalDescriptorSets(GlorpSwapChain::MAX_FRAMES_IN_FLIGHT);
-    for(int i = 0; i < globalDescriptorSets.size(); i++) {
-        auto bufferInfo = uboBuffers[i]->descriptorInfo();
-        VkDescriptorImageInfo skyboxInfo{
-            .sampler = cubemap.getSampler(),
-            .imageView = cubemap.getImageView(),
-            .imageLayout = cubemap.getImageLayout()
-        };
-        GlorpDescriptorWriter(*globalSetLayout, *globalPool)
-            .writeBuffer(0, &bufferInfo)
-            .writeImage(1, &skyboxInfo)
-            .build(globalDescriptorSets[i]);
-    }
-
-    auto textureSetLayout = GlorpDescriptorSetLayout::Builder(m_glorpDevice)
-        .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Albedo
-        .addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Normal Map
-        .addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Emissive Map
-        .addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // AO Map
-        .addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT) // Metallic Roughness Map
-        .build();
+    auto writeGlobalDescriptors = [&](bool allocate) {
+        for(int i = 0; i < globalDescriptorSets.size(); i++) {
+            auto bufferInfo = uboBuffers[i]->descriptorInfo();
+            VkDescriptorImageInfo skyboxInfo{
+                .sampler = cubemap.getSampler(),
+                .imageView = cubemap.getImageView(),
+                .imageLayout = cubemap.getImageLayout()
+            };
+            auto lightsInfo = lightClusters.lightsInfo(i);
+            auto clustersInfo = lightClusters.clustersInfo(i);
+            auto lightIndicesInfo = lightClusters.lightIndicesInfo(i);
+            GlorpDescriptorWriter writer(*globalSetLayout, *globalPool);
+            writer.writeBuffer(0, &bufferInfo).writeImage(1, &skyboxInfo)
+                .writeBuffer(2, &lightsInfo).writeBuffer(3, &clustersInfo).writeBuffer(4, &lightIndicesInfo);
+            if (allocate) {
+                writer.build(globalDescriptorSets[i]);
+            } else {
+                writer.overwrite(globalDescriptorSets[i]);
+            }
+        }
+    };
+    writeGlobalDescriptors(true);
 
     for (auto &kv : m_gameObjects) {
-        auto& obj = kv.second;
-        if (obj.model == nullptr) continue;
-        if (obj.material == nullptr) continue;
-
-        // auto& material = obj.material;
-        VkDescriptorImageInfo albedoImageInfo {};
-        albedoImageInfo.sampler = obj.material->albedoTexture->getSampler();
-        albedoImageInfo.imageView = obj.material->albedoTexture->getImageView();
-        albedoImageInfo.imageLayout = obj.material->albedoTexture->getImageLayout();
-
-        VkDescriptorImageInfo normalImageInfo {};
-        normalImageInfo.sampler = obj.material->normalTexture->getSampler();
-        normalImageInfo.imageView = obj.material->normalTexture->getImageView();
-        normalImageInfo.imageLayout = obj.material->normalTexture->getImageLayout();
-
-        VkDescriptorImageInfo emissiveImageInfo {};
-        emissiveImageInfo.sampler = obj.material->emissiveTexture->getSampler();
-        emissiveImageInfo.imageView = obj.material->emissiveTexture->getImageView();
-        emissiveImageInfo.imageLayout = obj.material->emissiveTexture->getImageLayout();
-
-        VkDescriptorImageInfo aoImageInfo {};
-        aoImageInfo.sampler = obj.material->aoTexture->getSampler();
-        aoImageInfo.imageView = obj.material->aoTexture->getImageView();
-        aoImageInfo.imageLayout = obj.material->aoTexture->getImageLayout();
-
-        VkDescriptorImageInfo metallicImageInfo {};
-        metallicImageInfo.sampler = obj.material->metallicRoughnessTexture->getSampler();
-        metallicImageInfo.imageView = obj.material->metallicRoughnessTexture->getImageView();
-        metallicImageInfo.imageLayout = obj.material->metallicRoughnessTexture->getImageLayout();
-
-        GlorpDescriptorWriter(*textureSetLayout, *texturePool)
-            .writeImage(0, &albedoImageInfo)
-            .writeImage(1, &normalImageInfo)
-            .writeImage(2, &emissiveImageInfo)
-            .writeImage(3, &aoImageInfo)
-            .writeImage(4, &metallicImageInfo)
-            .build(obj.descriptorSet);
+        writeMaterialDescriptors(kv.second);
     }
 
-
-    SimpleRenderSystem simpleRenderSystem{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), textureSetLayout->getDescriptorSetLayout()};
+    auto pipelinesStart = std::chrono::high_resolution_clock::now();
+    SimpleRenderSystem simpleRenderSystem{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(),
+        m_textureSetLayout->getDescriptorSetLayout(), m_virtualTextureSetLayout->getDescriptorSetLayout()};
+    DepthPrepassSystem depthPrepassSystem{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
     PointLightSystem pointLightSystem{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
     CubeMapRenderSystem cubemapRenderSystem{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+    GlorpOcclusionQueries occlusionQueries{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+    // the render systems only queued their pipelines, they compile side by side here
+    m_glorpDevice.getPipelineRegistry().compilePending();
+    for (auto &kv : m_gameObjects) {
+        simpleRenderSystem.queueMaterialVariants(kv.second);
+    }
     GlorpImgui glorpImgui{m_glorpDevice, m_glorpRenderer.getSwapChainRenderPass(), m_glorpWindow};
+    auto pipelinesEnd = std::chrono::high_resolution_clock::now();
+    auto pipelineStats = m_glorpDevice.getPipelineCache().getStats();
+    std::cout << "Created " << pipelineStats.pipelinesCreated << " pipelines, " << pipelineStats.creationTimeMs << "ms of driver time in "
+        << std::chrono::duration<float, std::milli>(pipelinesEnd - pipelinesStart).count() << "ms, "
+        << (pipelineStats.loadedSize > 0 ? "warm" : "cold") << " pipeline cache of " << pipelineStats.loadedSize << " bytes" << std::endl;
+    for (auto &virtualTexture : m_virtualTextures) {
+        glorpImgui.addVirtualTexture(virtualTexture.get());
+    }
+    glorpImgui.setLightClusters(&lightClusters);
+    std::vector<PointLight> lights;
+    GlorpOcclusionCuller occlusionCuller{};
+    std::unordered_set<GlorpGameObject::id_t> culledObjects;
+    glorpImgui.setOcclusionCuller(&occlusionCuller);
+    GlorpHzbCuller hzbCuller{m_glorpDevice};
+    glorpImgui.setHzbCuller(&hzbCuller);
+    glorpImgui.setOcclusionQueries(&occlusionQueries);
 
     GlorpCamera camera{};
 
@@ -148,6 +174,14 @@ void FirstApp::run() {
     viewerObject.transform.translation.z = -2.5f;
     KeyboardMovementController cameraController(m_glorpWindow);
     
+    auto &samplerCache = m_glorpDevice.getSamplerCache();
+    uint64_t samplerGeneration = samplerCache.getGeneration();
+    auto &textureStreamer = m_glorpDevice.getTextureStreamer();
+    // generation of the streamed texture images each frame's material sets were last written with
+    std::array<uint64_t, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> materialGenerations{};
+    materialGenerations.fill(textureStreamer.getGeneration());
+    const float fovY = glm::radians(50.f);
+
     std::thread renderThread([&] {
         auto currentTime = std::chrono::high_resolution_clock::now();
 
@@ -156,14 +190,41 @@ void FirstApp::run() {
             float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
             currentTime = newTime;
 
+            collectStreamedObjects(simpleRenderSystem);
+            scatterLights(glorpImgui.scatteredLights);
+
+            // Samplers are baked into the descriptor sets, which frames in flight may still be reading
+            if (samplerCache.getGeneration() != samplerGeneration) {
+                samplerGeneration = samplerCache.getGeneration();
+                m_glorpDevice.waitIdle();
+                writeGlobalDescriptors(false);
+                for (auto &kv : m_gameObjects) {
+                    writeMaterialDescriptors(kv.second);
+                }
+            }
+
             cameraController.moveInPlaneXZ(frameTime, viewerObject);
             camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
             float aspect = m_glorpRenderer.getAspectRatio();
-            camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 1000.f);
+            camera.setPerspectiveProjection(fovY, aspect, 0.1f, 1000.f);
 
             if (auto commandBuffer = m_glorpRenderer.beginFrame()) {
                 int frameIndex = m_glorpRenderer.getFrameIndex();
 
+                // the frame that last used this slot's sets has finished, so they can be rewritten
+                requestTextureResidency(camera, fovY, static_cast<float>(m_glorpRenderer.getSwapChainExtent().height));
+                textureStreamer.update();
+                if (materialGenerations[frameIndex] != textureStreamer.getGeneration()) {
+                    materialGenerations[frameIndex] = textureStreamer.getGeneration();
+                    for (auto &kv : m_gameObjects) {
+                        writeMaterialDescriptors(kv.second, frameIndex);
+                    }
+                }
+                // page uploads have to land before the render pass samples the cache
+                for (auto &virtualTexture : m_virtualTextures) {
+                    virtualTexture->update(commandBuffer, frameIndex);
+                }
+
                 FrameInfo frameInfo {
                     frameIndex,
                     frameTime,
@@ -179,19 +240,48 @@ void FirstApp::run() {
                     glorpImgui.useAOMap,
                     glorpImgui.lightPosition
                 };
+                frameInfo.depthPrepass = glorpImgui.depthPrepass;
+                if (glorpImgui.occlusionCulling) {
+                    cullOccludedObjects(occlusionCuller, camera, culledObjects);
+                    frameInfo.culledObjects = &culledObjects;
+                }
                 //update
                 GlobalUbo ubo{};
                 ubo.projection = camera.getProjection();
                 ubo.view = camera.getView();
                 ubo.inverseView = camera.getInverseView();
-                pointLightSystem.update(frameInfo, ubo);
+                pointLightSystem.update(frameInfo, lights);
+                lightClusters.build(frameIndex, camera, m_glorpRenderer.getSwapChainExtent(), lights, ubo);
 
                 uboBuffers[frameIndex]->writeToBuffer(&ubo);
                 uboBuffers[frameIndex]->flush();
 
                 // render
-                m_glorpRenderer.beginSwapChainRenderPass(commandBuffer);
-
+                occlusionQueries.beginFrame(commandBuffer, frameIndex);
+                bool hzbCulling = glorpImgui.gpuOcclusionCulling && hzbCuller.isSupported();
+                // both phases of the HZB culler would draw the queried objects' boxes
+                if (glorpImgui.occlusionQueries && !hzbCulling) {
+                    frameInfo.occlusionQueries = &occlusionQueries;
+                }
+                if (hzbCulling) {
+                    // last frame's visible objects lay down the depth the rest is tested against
+                    frameInfo.hzbCuller = &hzbCuller;
+                    hzbCuller.beginFrame(commandBuffer, frameIndex, camera, m_glorpRenderer.getSwapChainExtent(), m_gameObjects);
+                    m_glorpRenderer.beginSwapChainRenderPass(commandBuffer, GlorpSwapChain::Pass::Early);
+                    if (frameInfo.depthPrepass) {
+                        depthPrepassSystem.render(frameInfo);
+                    }
+                    simpleRenderSystem.renderGameObjects(frameInfo);
+                    m_glorpRenderer.endSwapChainRenderPass(commandBuffer);
+                    hzbCuller.cullLate(commandBuffer, frameIndex, m_glorpRenderer.getDepthImageView());
+                    m_glorpRenderer.beginSwapChainRenderPass(commandBuffer, GlorpSwapChain::Pass::Late);
+                } else {
+                    m_glorpRenderer.beginSwapChainRenderPass(commandBuffer);
+                }
+
+                if (frameInfo.depthPrepass) {
+                    depthPrepassSystem.render(frameInfo);
+                }
 
                 simpleRenderSystem.renderGameObjects(frameInfo);
                 cubemapRenderSystem.renderCubemap(frameInfo);
@@ -200,10 +290,14 @@ void FirstApp::run() {
                 glorpImgui.drawUI(frameInfo);
 
                 m_glorpRenderer.endSwapChainRenderPass(commandBuffer);
+                occlusionQueries.endFrame(commandBuffer, frameIndex);
+                for (auto &virtualTexture : m_virtualTextures) {
+                    virtualTexture->finishFrame(commandBuffer, frameIndex);
+                }
                 m_glorpRenderer.endFrame();
             }
         }
-        vkDeviceWaitIdle(m_glorpDevice.device());
+        m_glorpDevice.waitIdle();
     });
 
     // Polling loop
@@ -213,12 +307,119 @@ void FirstApp::run() {
     renderThread.join();
 }
 
+void FirstApp::writeMaterialDescriptors(GlorpGameObject &obj) {
+    for (int i = 0; i < GlorpSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        writeMaterialDescriptors(obj, i);
+    }
+}
+
+void FirstApp::writeMaterialDescriptors(GlorpGameObject &obj, int frameIndex) {
+    if (obj.model == nullptr) return;
+    if (obj.material == nullptr) return;
+
+    auto imageInfo = [&](const std::shared_ptr<GlorpTexture> &materialTexture) {
+        const auto &texture = materialTexture ? materialTexture : m_placeholderTexture;
+        VkDescriptorImageInfo info {};
+        info.sampler = texture->getSampler();
+        info.imageView = texture->getImageView();
+        info.imageLayout = texture->getImageLayout();
+        return info;
+    };
+    VkDescriptorImageInfo albedoImageInfo = imageInfo(obj.material->albedoTexture);
+    VkDescriptorImageInfo normalImageInfo = imageInfo(obj.material->normalTexture);
+    VkDescriptorImageInfo emissiveImageInfo = imageInfo(obj.material->emissiveTexture);
+    VkDescriptorImageInfo ormImageInfo = imageInfo(obj.material->ormTexture);
+
+    GlorpDescriptorWriter writer(*m_textureSetLayout, *texturePool);
+    writer.writeImage(0, &albedoImageInfo)
+        .writeImage(1, &normalImageInfo)
+        .writeImage(2, &emissiveImageInfo)
+        .writeImage(3, &ormImageInfo);
+    if (obj.descriptorSets[frameIndex] == VK_NULL_HANDLE) {
+        writer.build(obj.descriptorSets[frameIndex]);
+    } else {
+        writer.overwrite(obj.descriptorSets[frameIndex]);
+    }
+}
+
+void FirstApp::requestTextureResidency(const GlorpCamera &camera, float fovY, float screenHeight) {
+    auto &textureStreamer = m_glorpDevice.getTextureStreamer();
+    glm::vec3 cameraPosition = camera.getPosition();
+    float projection = screenHeight / std::tan(fovY * 0.5f);
+    for (auto &kv : m_gameObjects) {
+        auto &obj = kv.second;
+        if (obj.model == nullptr || obj.material == nullptr) continue;
+
+        // bounding sphere diameter in pixels, the textures are assumed to span the whole object
+        const auto &scale = obj.transform.scale;
+        float radius = obj.model->getBoundingRadius() * std::max({std::abs(scale.x), std::abs(scale.y), std::abs(scale.z)});
+        glm::vec3 center = obj.transform.mat4() * glm::vec4(obj.model->getBoundingCenter(), 1.f);
+        float distance = glm::length(center - cameraPosition);
+        float pixels = distance > radius ? radius / distance * projection : std::numeric_limits<float>::max();
+
+        for (auto *texture : {&obj.material->albedoTexture, &obj.material->normalTexture,
+                &obj.material->emissiveTexture, &obj.material->ormTexture}) {
+            if (*texture) {
+                textureStreamer.request(texture->get(), pixels);
+            }
+        }
+    }
+}
+
+void FirstApp::cullOccludedObjects(GlorpOcclusionCuller &culler, const GlorpCamera &camera, std::unordered_set<GlorpGameObject::id_t> &culled) {
+    culled.clear();
+    culler.beginFrame(camera.getProjection() * camera.getView());
+    glm::vec3 cameraPosition = camera.getPosition();
+    for (auto &kv : m_gameObjects) {
+        auto &obj = kv.second;
+        // alpha tested surfaces have holes, they never occlude
+        if (!DepthPrepassSystem::writesDepth(obj) || obj.model->getOccluder().triangleCount() == 0) continue;
+
+        const auto &scale = obj.transform.scale;
+        float radius = obj.model->getBoundingRadius() * std::max({std::abs(scale.x), std::abs(scale.y), std::abs(scale.z)});
+        glm::vec3 center = obj.transform.mat4() * glm::vec4(obj.model->getBoundingCenter(), 1.f);
+        float distance = glm::length(center - cameraPosition);
+        if (distance > radius && radius / distance < MIN_OCCLUDER_SIZE) continue;
+
+        culler.addOccluder(obj.model->getOccluder(), obj.transform.mat4());
+    }
+    culler.rasterize();
+
+    for (auto &kv : m_gameObjects) {
+        auto &obj = kv.second;
+        if (obj.model == nullptr) continue;
+        if (!culler.isVisible(obj.model->getBoundsMin(), obj.model->getBoundsMax(), obj.transform.mat4())) {
+            culled.insert(kv.first);
+        }
+    }
+}
+
+void FirstApp::collectStreamedObjects(SimpleRenderSystem &simpleRenderSystem) {
+    for (auto it = m_pendingObjects.begin(); it != m_pendingObjects.end();) {
+        if (it->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        GlorpGameObject obj = it->get();
+        writeMaterialDescriptors(obj);
+        if (obj.model != nullptr && obj.model->getDrawCount() >= MIN_QUERIED_DRAW_COUNT) {
+            obj.occlusionPolicy = GlorpGameObject::OcclusionPolicy::Query;
+        }
+        simpleRenderSystem.queueMaterialVariants(obj);
+        m_gameObjects.emplace(obj.getId(), std::move(obj));
+        it = m_pendingObjects.erase(it);
+    }
+}
+
 void FirstApp::loadGameObjects() {
+    // The helmet is streamed in and shows up once its uploads have landed
+    m_pendingObjects.push_back(GlorpGameObject::createGameObjectFromAsciiAsync(m_assetStreamer, "models/DamagedHelmet/DamagedHelmet.gltf"));
+
+    auto &uploadContext = m_glorpDevice.getUploadContext();
+    uploadContext.beginBatch();
 
-    GlorpGameObject helmet = GlorpGameObject::createGameObjectFromAscii(m_glorpDevice, "models/DamagedHelmet/DamagedHelmet.gltf");
-    helmet.transform.translation = {.0f, .0f, .0f};
-    helmet.transform.scale = {1.f, 1.f, 1.f};
-    m_gameObjects.emplace(helmet.getId(), std::move(helmet));
+    const uint8_t white[4] = {255, 255, 255, 255};
+    m_placeholderTexture = std::make_shared<GlorpTexture>(m_glorpDevice, white, 1, 1);
 
     std::vector<glm::vec3> lightColors{
         {1.f, .1f, .1f},
@@ -236,5 +437,70 @@ void FirstApp::loadGameObjects() {
         pl.transform.translation = glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f));
         m_gameObjects.emplace(pl.getId(), std::move(pl));
     }
+
+    loadVirtualTerrain();
+
+    uploadContext.endBatch();
+}
+
+void FirstApp::scatterLights(int count) {
+    while (m_scatteredLights.size() > static_cast<size_t>(count)) {
+        m_gameObjects.erase(m_scatteredLights.back());
+        m_scatteredLights.pop_back();
+    }
+    if (m_scatteredLights.size() == static_cast<size_t>(count)) {
+        return;
+    }
+    std::mt19937 random{static_cast<uint32_t>(m_scatteredLights.size())};
+    std::uniform_real_distribution<float> unit{0.f, 1.f};
+    while (m_scatteredLights.size() < static_cast<size_t>(count)) {
+        auto light = GlorpGameObject::makePointLight(0.5f, 0.05f, glm::vec3{unit(random), unit(random), unit(random)});
+        light.pointLight->range = 1.f + 2.f * unit(random);
+        // uniform over a disc, the point light system keeps every light at the same height
+        float angle = unit(random) * glm::two_pi<float>();
+        float distance = std::sqrt(unit(random)) * 25.f;
+        light.transform.translation = {std::cos(angle) * distance, 0.f, std::sin(angle) * distance};
+        m_scatteredLights.push_back(light.getId());
+        m_gameObjects.emplace(light.getId(), std::move(light));
+    }
+}
+
+void FirstApp::loadVirtualTerrain() {
+    std::string path = std::string(RESOURCE_LOCATIONS) + "models/terrain.gvt";
+    if (!std::filesystem::exists(path)) {
+        return;
+    }
+    if (!m_glorpDevice.supportsFragmentStoresAndAtomics()) {
+        std::cerr << "Skipping " << path << ", the device cannot write virtual texture feedback" << std::endl;
+        return;
+    }
+    auto virtualTexture = std::make_shared<GlorpVirtualTexture>(m_glorpDevice, path);
+    virtualTexture->writeDescriptors(*m_virtualTextureSetLayout, *virtualTexturePool);
+    m_virtualTextures.push_back(virtualTexture);
+
+    // the virtual texture covers the plane once and is the only map of its material
+    constexpr float HALF_EXTENT = 50.f;
+    GlorpModel::Builder builder{};
+    for (int i = 0; i < 4; i++) {
+        GlorpModel::Vertex vertex{};
+        glm::vec2 corner{static_cast<float>(i & 1), static_cast<float>(i >> 1)};
+        vertex.position = {(corner.x * 2.f - 1.f) * HALF_EXTENT, 0.f, (corner.y * 2.f - 1.f) * HALF_EXTENT};
+        vertex.color = glm::vec3(1.f);
+        vertex.normal = {0.f, -1.f, 0.f};
+        vertex.uv = corner;
+        vertex.tangent = {1.f, 0.f, 0.f};
+        vertex.bitangent = {0.f, 0.f, 1.f};
+        builder.vertices.push_back(vertex);
+    }
+    builder.indices = {0, 1, 2, 2, 1, 3};
+
+    auto material = std::make_unique<MaterialComponent>();
+    material->virtualAlbedo = virtualTexture;
+
+    auto terrain = GlorpGameObject::createGameObject();
+    terrain.model = std::make_shared<GlorpModel>(m_glorpDevice, builder);
+    terrain.material = std::move(material);
+    terrain.transform.translation.y = 1.5f;
+    m_gameObjects.emplace(terrain.getId(), std::move(terrain));
 }
 }
@@ -6,19 +6,35 @@
 #include "glorp_renderer.hpp"
 #include "glorp_descriptors.hpp"
 #include "glorp_texture.hpp"
+#include "glorp_virtual_texture.hpp"
+#include "glorp_asset_streamer.hpp"
+#include "glorp_camera.hpp"
+#include "glorp_occlusion_culler.hpp"
 
 #include <memory>
 #include <atomic>
+#include <future>
+#include <unordered_set>
+#include <vector>
 
 #ifndef RESOURCE_LOCATIONS
 #define RESOURCE_LOCATIONS ""
 #endif
 
 namespace Glorp {
+class SimpleRenderSystem;
+
 class FirstApp {
     public:
         static constexpr int WIDTH = 800;
         static constexpr int HEIGHT = 600;
+        // objects are streamed in after startup, so the material pool cannot be sized from the initial scene
+        static constexpr uint32_t MAX_MATERIAL_SETS = 64;
+        static constexpr uint32_t MAX_VIRTUAL_TEXTURES = 4;
+        // bounding sphere radius over distance an object needs to be rasterized as an occluder
+        static constexpr float MIN_OCCLUDER_SIZE = 0.05f;
+        // index or vertex count from which a streamed object is drawn behind a hardware occlusion query
+        static constexpr uint32_t MIN_QUERIED_DRAW_COUNT = 16384;
 
         FirstApp();
         ~FirstApp();
@@ -30,6 +46,18 @@ class FirstApp {
     private:
         void loadGameObjects();
         void initImgui();
+        void writeMaterialDescriptors(GlorpGameObject &obj);
+        void writeMaterialDescriptors(GlorpGameObject &obj, int frameIndex);
+        // Reports the on screen size of every object's textures to the texture streamer
+        void requestTextureResidency(const GlorpCamera &camera, float fovY, float screenHeight);
+        // Moves finished streamed objects into the scene and queues their pipeline variants
+        void collectStreamedObjects(SimpleRenderSystem &simpleRenderSystem);
+        // Rasterizes the big opaque objects as occluders and collects the objects hidden behind them
+        void cullOccludedObjects(GlorpOcclusionCuller &culler, const GlorpCamera &camera, std::unordered_set<GlorpGameObject::id_t> &culled);
+        // Adds or removes randomly placed lights until count of them are in the scene
+        void scatterLights(int count);
+        // Ground plane textured with models/terrain.gvt, skipped when the file has not been cooked
+        void loadVirtualTerrain();
     private:
         GlorpWindow m_glorpWindow {WIDTH, HEIGHT, "Glorp Engine"};
         GlorpDevice m_glorpDevice {m_glorpWindow};
@@ -38,8 +66,18 @@ class FirstApp {
         std::unique_ptr<GlorpDescriptorPool> globalPool {};
         std::unique_ptr<GlorpDescriptorPool> texturePool {};
         std::unique_ptr<GlorpDescriptorPool> cubemapPool {};
-        std::shared_ptr<GlorpTexture> m_globalTexture;
+        std::unique_ptr<GlorpDescriptorPool> virtualTexturePool {};
+        std::unique_ptr<GlorpDescriptorSetLayout> m_textureSetLayout {};
+        std::unique_ptr<GlorpDescriptorSetLayout> m_virtualTextureSetLayout {};
+        std::vector<std::shared_ptr<GlorpVirtualTexture>> m_virtualTextures;
+        // bound in place of the textures a material lacks, its shader variant never samples them
+        std::shared_ptr<GlorpTexture> m_placeholderTexture;
         GlorpGameObject::Map m_gameObjects;
+        std::vector<GlorpGameObject::id_t> m_scatteredLights;
+
+        // destroyed before the objects so loads still in flight finish first
+        GlorpAssetStreamer m_assetStreamer {m_glorpDevice};
+        std::vector<std::future<GlorpGameObject>> m_pendingObjects;
 };
 
 }
@@ -0,0 +1,19 @@
+#include "glorp_asset_streamer.hpp"
+
+namespace Glorp {
+
+GlorpAssetStreamer::GlorpAssetStreamer(GlorpDevice &device, uint32_t workerCount) : m_device{device} {
+    workerCount = std::max(workerCount, 1u);
+    m_uploadContexts.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        m_uploadContexts.push_back(std::make_unique<GlorpUploadContext>(m_device, WORKER_RING_SIZE));
+    }
+    m_threadPool = std::make_unique<GlorpThreadPool>(workerCount);
+}
+
+GlorpAssetStreamer::~GlorpAssetStreamer() {
+    // finishes every queued load before the upload contexts go away
+    m_threadPool.reset();
+}
+
+}
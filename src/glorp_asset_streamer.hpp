@@ -0,0 +1,46 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_thread_pool.hpp"
+#include "glorp_upload_context.hpp"
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Glorp {
+
+// Runs asset loads on a small worker pool. Every worker records its uploads into its own upload
+// context, and a load's future only becomes ready once its uploads have completed on the GPU,
+// so whatever it returns can be handed straight to the render loop.
+class GlorpAssetStreamer {
+    public:
+        static constexpr VkDeviceSize WORKER_RING_SIZE = 16 * 1024 * 1024;
+
+        GlorpAssetStreamer(GlorpDevice &device, uint32_t workerCount = defaultWorkerCount());
+        ~GlorpAssetStreamer();
+
+        GlorpAssetStreamer(const GlorpAssetStreamer&) = delete;
+        GlorpAssetStreamer &operator=(const GlorpAssetStreamer&) = delete;
+
+        template <typename F>
+        auto stream(F &&load) -> std::future<std::invoke_result_t<F, GlorpDevice&>> {
+            return m_threadPool->submit([this, load = std::forward<F>(load)]() mutable {
+                GlorpUploadContext &uploadContext = *m_uploadContexts[GlorpThreadPool::currentWorkerIndex()];
+                GlorpDevice::setThreadUploadContext(&uploadContext);
+                auto result = load(m_device);
+                uploadContext.waitIdle();
+                return result;
+            });
+        }
+
+        static uint32_t defaultWorkerCount() { return std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u); }
+    private:
+        GlorpDevice &m_device;
+        // declared before the pool so the contexts outlive the workers that record into them
+        std::vector<std::unique_ptr<GlorpUploadContext>> m_uploadContexts;
+        std::unique_ptr<GlorpThreadPool> m_threadPool;
+};
+}
@@ -0,0 +1,466 @@
+#include "glorp_bc_encoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr int BLOCK_TEXELS = 16;
+
+struct Block {
+    float texels[BLOCK_TEXELS][4];
+};
+
+// BC7 4 bit index interpolation weights, out of 64
+constexpr int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+void loadBlock(const uint8_t *rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Block &block) {
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t sourceY = std::min(blockY * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t sourceX = std::min(blockX * 4 + x, width - 1);
+            const uint8_t *texel = rgba + (static_cast<size_t>(sourceY) * width + sourceX) * 4;
+            for (int c = 0; c < 4; c++) {
+                block.texels[y * 4 + x][c] = static_cast<float>(texel[c]);
+            }
+        }
+    }
+}
+
+// Endpoints at the extremes of the block projected on its principal axis
+void fitPrincipalAxis(const Block &block, int channels, float lo[4], float hi[4]) {
+    float mean[4] = {};
+    float minimum[4] = {255.0f, 255.0f, 255.0f, 255.0f};
+    float maximum[4] = {};
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        for (int c = 0; c < 4; c++) {
+            mean[c] += block.texels[i][c];
+            minimum[c] = std::min(minimum[c], block.texels[i][c]);
+            maximum[c] = std::max(maximum[c], block.texels[i][c]);
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        mean[c] /= BLOCK_TEXELS;
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        float d[4];
+        for (int c = 0; c < 4; c++) {
+            d[c] = c < channels ? block.texels[i][c] - mean[c] : 0.0f;
+        }
+        for (int a = 0; a < 4; a++) {
+            for (int b = 0; b < 4; b++) {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+
+    // power iteration seeded with the bounding box diagonal
+    float axis[4];
+    for (int c = 0; c < 4; c++) {
+        axis[c] = c < channels ? maximum[c] - minimum[c] : 0.0f;
+    }
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        for (int a = 0; a < 4; a++) {
+            for (int b = 0; b < 4; b++) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 4; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3]);
+    if (length < 1e-6f) {
+        for (int c = 0; c < 4; c++) {
+            lo[c] = hi[c] = mean[c];
+        }
+        return;
+    }
+    for (int c = 0; c < 4; c++) {
+        axis[c] /= length;
+    }
+
+    float tMin = std::numeric_limits<float>::max();
+    float tMax = std::numeric_limits<float>::lowest();
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            t += (block.texels[i][c] - mean[c]) * axis[c];
+        }
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < 4; c++) {
+        lo[c] = std::clamp(mean[c] + tMin * axis[c], 0.0f, 255.0f);
+        hi[c] = std::clamp(mean[c] + tMax * axis[c], 0.0f, 255.0f);
+    }
+}
+
+// Picks the closest palette entry for every texel and returns the summed squared error
+float selectIndices(const Block &block, int channels, const float (*palette)[4], int paletteSize, uint8_t indices[BLOCK_TEXELS]) {
+    float totalError = 0.0f;
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        float bestError = std::numeric_limits<float>::max();
+        for (int p = 0; p < paletteSize; p++) {
+            float error = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                float d = block.texels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+// Least squares endpoints for fixed indices, weights[index] is the blend factor towards e1
+bool refineEndpoints(const Block &block, int channels, const uint8_t indices[BLOCK_TEXELS], const float *weights, float e0[4], float e1[4]) {
+    float a = 0.0f, b = 0.0f, d = 0.0f;
+    float rhs0[4] = {};
+    float rhs1[4] = {};
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        float w = weights[indices[i]];
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        d += w * w;
+        for (int c = 0; c < channels; c++) {
+            rhs0[c] += (1.0f - w) * block.texels[i][c];
+            rhs1[c] += w * block.texels[i][c];
+        }
+    }
+    float determinant = a * d - b * b;
+    if (std::abs(determinant) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < channels; c++) {
+        e0[c] = std::clamp((d * rhs0[c] - b * rhs1[c]) / determinant, 0.0f, 255.0f);
+        e1[c] = std::clamp((a * rhs1[c] - b * rhs0[c]) / determinant, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+void writeLittleEndian16(std::byte *out, uint16_t value) {
+    out[0] = static_cast<std::byte>(value & 0xff);
+    out[1] = static_cast<std::byte>(value >> 8);
+}
+
+// LSB first bit packing into a 128 bit block
+void writeBits(std::byte *out, uint32_t &position, uint32_t value, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, position++) {
+        if ((value >> i) & 1) {
+            out[position / 8] |= static_cast<std::byte>(1u << (position % 8));
+        }
+    }
+}
+
+uint16_t packRgb565(const float color[4]) {
+    uint32_t r = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+    uint32_t g = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+    uint32_t b = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(uint16_t packed, float color[4]) {
+    uint32_t r = (packed >> 11) & 31;
+    uint32_t g = (packed >> 5) & 63;
+    uint32_t b = packed & 31;
+    color[0] = static_cast<float>((r << 3) | (r >> 2));
+    color[1] = static_cast<float>((g << 2) | (g >> 4));
+    color[2] = static_cast<float>((b << 3) | (b >> 2));
+    color[3] = 255.0f;
+}
+
+void encodeBc1(const Block &block, std::byte *out) {
+    // palette order of the 4 color mode, index 2 and 3 sit at 1/3 and 2/3 towards color1
+    constexpr float WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+    float e0[4], e1[4];
+    fitPrincipalAxis(block, 3, e1, e0);
+
+    float bestError = std::numeric_limits<float>::max();
+    uint16_t bestColor0 = 0, bestColor1 = 0;
+    uint8_t bestIndices[BLOCK_TEXELS] = {};
+    for (int pass = 0; pass < 2; pass++) {
+        uint16_t color0 = packRgb565(e0);
+        uint16_t color1 = packRgb565(e1);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        float palette[4][4];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 4; c++) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        uint8_t indices[BLOCK_TEXELS];
+        // equal endpoints select the 3 color mode, index 0 still decodes to color0
+        float error = selectIndices(block, 3, palette, color0 == color1 ? 1 : 4, indices);
+        if (error < bestError) {
+            bestError = error;
+            bestColor0 = color0;
+            bestColor1 = color1;
+            std::memcpy(bestIndices, indices, sizeof(indices));
+        }
+        if (color0 == color1 || !refineEndpoints(block, 3, indices, WEIGHTS, e0, e1)) {
+            break;
+        }
+    }
+
+    uint32_t packedIndices = 0;
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        packedIndices |= static_cast<uint32_t>(bestIndices[i]) << (i * 2);
+    }
+    writeLittleEndian16(out, bestColor0);
+    writeLittleEndian16(out + 2, bestColor1);
+    writeLittleEndian16(out + 4, static_cast<uint16_t>(packedIndices & 0xffff));
+    writeLittleEndian16(out + 6, static_cast<uint16_t>(packedIndices >> 16));
+}
+
+void encodeBc4Channel(const Block &block, int channel, std::byte *out) {
+    float minimum = 255.0f, maximum = 0.0f;
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        minimum = std::min(minimum, block.texels[i][channel]);
+        maximum = std::max(maximum, block.texels[i][channel]);
+    }
+    // red0 > red1 selects the 8 value mode
+    uint8_t red0 = static_cast<uint8_t>(std::lround(maximum));
+    uint8_t red1 = static_cast<uint8_t>(std::lround(minimum));
+
+    std::memset(out, 0, 8);
+    out[0] = static_cast<std::byte>(red0);
+    out[1] = static_cast<std::byte>(red1);
+    if (red0 == red1) {
+        return;
+    }
+
+    float palette[8];
+    palette[0] = red0;
+    palette[1] = red1;
+    for (int i = 2; i < 8; i++) {
+        palette[i] = ((8 - i) * static_cast<float>(red0) + (i - 1) * static_cast<float>(red1)) / 7.0f;
+    }
+
+    uint64_t packedIndices = 0;
+    for (int i = 0; i < BLOCK_TEXELS; i++) {
+        float value = block.texels[i][channel];
+        int bestIndex = 0;
+        float bestError = std::numeric_limits<float>::max();
+        for (int p = 0; p < 8; p++) {
+            float error = std::abs(value - palette[p]);
+            if (error < bestError) {
+                bestError = error;
+                bestIndex = p;
+            }
+        }
+        packedIndices |= static_cast<uint64_t>(bestIndex) << (i * 3);
+    }
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = static_cast<std::byte>((packedIndices >> (i * 8)) & 0xff);
+    }
+}
+
+// 7 bit endpoint plus a p-bit shared by all four channels of the endpoint
+void quantizeBc7Endpoint(const float endpoint[4], uint8_t quantized[4], uint8_t &pBit) {
+    float bestError = std::numeric_limits<float>::max();
+    for (uint8_t p = 0; p < 2; p++) {
+        uint8_t candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            int q = static_cast<int>(std::lround((endpoint[c] - p) / 2.0f));
+            candidate[c] = static_cast<uint8_t>(std::clamp(q, 0, 127));
+            float d = static_cast<float>((candidate[c] << 1) | p) - endpoint[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pBit = p;
+            std::memcpy(quantized, candidate, 4);
+        }
+    }
+}
+
+void encodeBc7Mode6(const Block &block, std::byte *out) {
+    float weights[16];
+    for (int i = 0; i < 16; i++) {
+        weights[i] = BC7_WEIGHTS[i] / 64.0f;
+    }
+
+    float e0[4], e1[4];
+    fitPrincipalAxis(block, 4, e0, e1);
+
+    float bestError = std::numeric_limits<float>::max();
+    uint8_t best0[4] = {}, best1[4] = {};
+    uint8_t bestP0 = 0, bestP1 = 0;
+    uint8_t bestIndices[BLOCK_TEXELS] = {};
+    for (int pass = 0; pass < 2; pass++) {
+        uint8_t q0[4], q1[4];
+        uint8_t p0, p1;
+        quantizeBc7Endpoint(e0, q0, p0);
+        quantizeBc7Endpoint(e1, q1, p1);
+
+        float palette[16][4];
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                int v0 = (q0[c] << 1) | p0;
+                int v1 = (q1[c] << 1) | p1;
+                palette[i][c] = static_cast<float>(((64 - BC7_WEIGHTS[i]) * v0 + BC7_WEIGHTS[i] * v1 + 32) >> 6);
+            }
+        }
+
+        uint8_t indices[BLOCK_TEXELS];
+        float error = selectIndices(block, 4, palette, 16, indices);
+        if (error < bestError) {
+            bestError = error;
+            std::memcpy(best0, q0, 4);
+            std::memcpy(best1, q1, 4);
+            bestP0 = p0;
+            bestP1 = p1;
+            std::memcpy(bestIndices, indices, sizeof(indices));
+        }
+        if (!refineEndpoints(block, 4, indices, weights, e0, e1)) {
+            break;
+        }
+    }
+
+    // the anchor index is stored without its top bit, which must therefore be zero
+    if (bestIndices[0] >= 8) {
+        std::swap(best0, best1);
+        std::swap(bestP0, bestP1);
+        for (auto &index : bestIndices) {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    std::memset(out, 0, 16);
+    uint32_t position = 0;
+    writeBits(out, position, 1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writeBits(out, position, best0[c], 7);
+        writeBits(out, position, best1[c], 7);
+    }
+    writeBits(out, position, bestP0, 1);
+    writeBits(out, position, bestP1, 1);
+    writeBits(out, position, bestIndices[0], 3);
+    for (int i = 1; i < BLOCK_TEXELS; i++) {
+        writeBits(out, position, bestIndices[i], 4);
+    }
+}
+}
+
+namespace Glorp {
+
+GlorpBcEncoder::GlorpBcEncoder(uint32_t workerCount) {
+    m_threadPool = std::make_unique<GlorpThreadPool>(workerCount);
+}
+
+GlorpBcEncoder &GlorpBcEncoder::shared() {
+    static GlorpBcEncoder encoder;
+    return encoder;
+}
+
+size_t GlorpBcEncoder::blockSize(Format format) {
+    switch (format) {
+        case Format::BC1:
+        case Format::BC4:
+            return 8;
+        case Format::BC5:
+        case Format::BC7:
+            return 16;
+    }
+    throw std::runtime_error("Unknown block compressed format.");
+}
+
+size_t GlorpBcEncoder::encodedSize(Format format, uint32_t width, uint32_t height) {
+    size_t blocksX = (width + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+    size_t blocksY = (height + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+    return blocksX * blocksY * blockSize(format);
+}
+
+void GlorpBcEncoder::encode(Format format, const uint8_t *rgba, uint32_t width, uint32_t height, std::byte *out) {
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("Cannot encode an empty image.");
+    }
+    uint32_t blockRows = (height + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+    // a few chunks per worker so uneven rows still balance out
+    uint32_t chunkRows = std::max(1u, blockRows / (m_threadPool->getWorkerCount() * 4));
+
+    std::vector<std::future<void>> pending;
+    uint32_t firstRow = 0;
+    for (; firstRow + chunkRows < blockRows; firstRow += chunkRows) {
+        uint32_t lastRow = firstRow + chunkRows;
+        pending.push_back(m_threadPool->submit([=]() {
+            encodeBlockRows(format, rgba, width, height, firstRow, lastRow, out);
+        }));
+    }
+
+    // the calling thread takes the last chunk instead of idling
+    std::exception_ptr failure;
+    try {
+        encodeBlockRows(format, rgba, width, height, firstRow, blockRows, out);
+    } catch (...) {
+        failure = std::current_exception();
+    }
+    for (auto &future : pending) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void GlorpBcEncoder::encodeBlockRows(Format format, const uint8_t *rgba, uint32_t width, uint32_t height,
+    uint32_t firstRow, uint32_t lastRow, std::byte *out) {
+    uint32_t blocksX = (width + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+    size_t size = blockSize(format);
+
+    Block block;
+    for (uint32_t blockY = firstRow; blockY < lastRow; blockY++) {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+            loadBlock(rgba, width, height, blockX, blockY, block);
+            std::byte *blockOut = out + (static_cast<size_t>(blockY) * blocksX + blockX) * size;
+            switch (format) {
+                case Format::BC1:
+                    encodeBc1(block, blockOut);
+                    break;
+                case Format::BC4:
+                    encodeBc4Channel(block, 0, blockOut);
+                    break;
+                case Format::BC5:
+                    encodeBc4Channel(block, 0, blockOut);
+                    encodeBc4Channel(block, 1, blockOut + 8);
+                    break;
+                case Format::BC7:
+                    encodeBc7Mode6(block, blockOut);
+                    break;
+            }
+        }
+    }
+}
+
+}
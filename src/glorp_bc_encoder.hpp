@@ -0,0 +1,49 @@
+#pragma once
+
+#include "glorp_thread_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Glorp {
+
+// CPU encoder for the BCn block compressed formats used by cooked textures. Every format stores
+// 4x4 texel blocks; BC1 and BC4 take 8 bytes per block, BC5 and BC7 take 16. The block loops work
+// on fixed size float arrays so the compiler can vectorize them, and rows of blocks are spread
+// over a worker pool.
+class GlorpBcEncoder {
+    public:
+        enum class Format : uint8_t {
+            // RGB, 4 bits per texel
+            BC1 = 0,
+            // single channel (red), 4 bits per texel
+            BC4 = 1,
+            // two channels (red, green), 8 bits per texel
+            BC5 = 2,
+            // RGBA, 8 bits per texel, encoded with mode 6
+            BC7 = 3
+        };
+
+        static constexpr uint32_t BLOCK_DIMENSION = 4;
+
+        explicit GlorpBcEncoder(uint32_t workerCount = std::thread::hardware_concurrency());
+
+        GlorpBcEncoder(const GlorpBcEncoder&) = delete;
+        GlorpBcEncoder &operator=(const GlorpBcEncoder&) = delete;
+
+        static GlorpBcEncoder &shared();
+
+        static size_t blockSize(Format format);
+        static size_t encodedSize(Format format, uint32_t width, uint32_t height);
+
+        // rgba is tightly packed RGBA8, out must hold encodedSize bytes. Blocks hanging over the
+        // right or bottom edge repeat the last column and row.
+        void encode(Format format, const uint8_t *rgba, uint32_t width, uint32_t height, std::byte *out);
+    private:
+        static void encodeBlockRows(Format format, const uint8_t *rgba, uint32_t width, uint32_t height,
+            uint32_t firstRow, uint32_t lastRow, std::byte *out);
+    private:
+        std::unique_ptr<GlorpThreadPool> m_threadPool;
+};
+}
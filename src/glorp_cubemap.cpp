@@ -1,27 +1,37 @@
 #include "glorp_cubemap.hpp"
-#include "stb_image.h"
 #include "glorp_buffer.hpp"
+#include "glorp_image_decoder.hpp"
+#include "glorp_mip_generator.hpp"
+#include "glorp_texture_processing.hpp"
+#include "glorp_sampler_cache.hpp"
+#include "glorp_upload_context.hpp"
+#include "glorp_file_io.hpp"
+#include <future>
 #include <stdexcept>
 #include <cstring>
 
 namespace Glorp {
 
 GlorpCubeMap::GlorpCubeMap(GlorpDevice &device, const std::vector<std::string> &filenames) : m_device(device) {
+    auto &uploadContext = m_device.getUploadContext();
+    uploadContext.beginBatch();
     createCubemapImage(filenames);
     createImageView();
     createSampler();
+    uploadContext.endBatch();
 }
 
 GlorpCubeMap::~GlorpCubeMap(){
     vkDestroyImage(m_device.device(), m_image, nullptr);
     vkFreeMemory(m_device.device(), m_imageMemory, nullptr);
     vkDestroyImageView(m_device.device(), m_imageView, nullptr);
-    vkDestroySampler(m_device.device(), m_sampler, nullptr);
 }
 
 
 void GlorpCubeMap::transitionImageLayout(VkImageLayout oldLayout, VkImageLayout newLayout) {
-    VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
+    // The first transition happens on the queue that performs the copy
+    auto &uploadContext = m_device.getUploadContext();
+    VkCommandBuffer commandBuffer = oldLayout == VK_IMAGE_LAYOUT_UNDEFINED ? uploadContext.getTransferCommandBuffer() : uploadContext.getCommandBuffer();
 
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -32,7 +42,7 @@ void GlorpCubeMap::transitionImageLayout(VkImageLayout oldLayout, VkImageLayout
     barrier.image = m_image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = m_mipLevels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 6;
     VkPipelineStageFlags srcStage;
@@ -55,22 +65,24 @@ void GlorpCubeMap::transitionImageLayout(VkImageLayout oldLayout, VkImageLayout
     }
     vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-    m_device.endSingleTimeCommands(commandBuffer);
     m_imageLayout = newLayout;
 }
 
 
 void GlorpCubeMap::createSampler() {
-    VkSamplerCreateInfo samplerInfo {};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = VK_FILTER_LINEAR;
-    samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    if(vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create texture sampler.");
-    }
+    m_samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    m_samplerInfo.magFilter = VK_FILTER_LINEAR;
+    m_samplerInfo.minFilter = VK_FILTER_LINEAR;
+    m_samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    m_samplerInfo.maxLod = static_cast<float>(m_mipLevels);
+    m_samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    m_samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    m_samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    getSampler();
+}
+
+VkSampler GlorpCubeMap::getSampler() {
+    return m_device.getSamplerCache().getSampler(m_samplerInfo);
 }
 
 void GlorpCubeMap::createImageView() {
@@ -81,8 +93,15 @@ void GlorpCubeMap::createImageView() {
     viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
     viewInfo.subresourceRange = {
         VK_IMAGE_ASPECT_COLOR_BIT,
-        0, 1, 0, 6
+        0, m_mipLevels, 0, 6
     };
+
+    VkImageViewUsageCreateInfo usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (m_computeMipMaps) {
+        viewInfo.pNext = &usageInfo;
+    }
     if(vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_imageView) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture image view.");
     }
@@ -91,48 +110,69 @@ void GlorpCubeMap::createImageView() {
 
 void GlorpCubeMap::createCubemapImage(const std::vector<std::string> &filenames) {
     // Order should be right, left, top, bottom, front, back
-    std::vector<stbi_uc*> pixels;
+    // All six faces are read at once, decoding starts as soon as they are in memory
+    std::vector<std::future<GlorpFileIo::ReadResult>> reads;
     for(const auto& path: filenames) {
-        stbi_set_flip_vertically_on_load(true);
-        stbi_uc* image = stbi_load(path.c_str(), &m_width, &m_height, &m_channels, STBI_rgb_alpha);
-        pixels.push_back(image);
-    }    
-    
-    VkDeviceSize faceSize = m_width * m_height * 4;
+        reads.push_back(GlorpFileIo::shared().readAsync(path));
+    }
+    std::vector<GlorpFileIo::ReadResult> files;
+    for(size_t i = 0; i < reads.size(); i++) {
+        files.push_back(reads[i].get());
+        if(!files[i].ok()) {
+            throw std::runtime_error("Failed to open file " + filenames[i]);
+        }
+        int width, height;
+        if(!GlorpImageDecoder::getInfo(files[i].data.bytes(), width, height)) {
+            throw std::runtime_error("Unknown image format: " + filenames[i]);
+        }
+        if(i > 0 && (width != m_width || height != m_height)) {
+            throw std::runtime_error("Cubemap faces must all have the same size");
+        }
+        m_width = width;
+        m_height = height;
+    }
+
+    VkDeviceSize faceSize = static_cast<VkDeviceSize>(m_width) * m_height * 4;
     VkDeviceSize bufferSize = faceSize * 6;
 
-    GlorpBuffer stagingBuffer {
-        m_device,
-        1, 
-        static_cast<uint32_t>(bufferSize),
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    };
-    
-    stagingBuffer.map();
+    // Every face decodes on its own worker directly into its slot of the staging allocation
+    auto &uploadContext = m_device.getUploadContext();
+    auto staging = uploadContext.allocateStaging(bufferSize);
+    std::vector<GlorpImageDecoder::Job> jobs;
     for(size_t i = 0; i < 6; i++) {
-        void* offset = static_cast<char*>(stagingBuffer.getMappedMemory()) + (i * faceSize);
-        std::memcpy(offset, pixels[i], faceSize);
+        GlorpImageDecoder::Job job{};
+        job.encoded = files[i].data.bytes();
+        job.destination = static_cast<char*>(staging.mapped) + (i * faceSize);
+        job.destinationSize = faceSize;
+        job.flipVertically = true;
+        jobs.push_back(job);
     }
-    stagingBuffer.unmap();
+    GlorpImageDecoder::shared().decode(jobs);
+
+    auto &mipGenerator = m_device.getMipGenerator();
+    uint32_t fullChain = GlorpTextureProcessing::mipLevelCount(m_width, m_height);
+    m_computeMipMaps = fullChain > 1 && mipGenerator.supports(VK_FORMAT_R8G8B8A8_SRGB, fullChain);
+    m_mipLevels = m_computeMipMaps ? fullChain : 1;
 
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
     imageInfo.extent = {static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), 1};
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = m_mipLevels;
     imageInfo.arrayLayers = 6;
     imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    if (m_computeMipMaps) {
+        imageInfo.flags |= mipGenerator.imageCreateFlags(VK_FORMAT_R8G8B8A8_SRGB);
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     
     m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_imageMemory);
     transitionImageLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
     
-    VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
-
     std::vector<VkBufferImageCopy> regions;
     for(uint32_t i = 0; i < 6; i++) {
         VkBufferImageCopy region{};
@@ -146,22 +186,24 @@ void GlorpCubeMap::createCubemapImage(const std::vector<std::string> &filenames)
         regions.push_back(region);
     }
 
-    vkCmdCopyBufferToImage(
-            commandBuffer,
-            stagingBuffer.getBuffer(),
-            m_image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            static_cast<uint32_t>(regions.size()),
-            regions.data()
-            );
-
-    m_device.endSingleTimeCommands(commandBuffer);
-
-    transitionImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uploadContext.copyBufferToImage(staging, m_image, regions);
+    uploadContext.releaseImage(m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipLevels, 0, 6},
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-    for(auto& pixel : pixels) {
-        stbi_image_free(pixel);
+    if (!m_computeMipMaps) {
+        transitionImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        return;
     }
+    // All six faces are reduced in the same dispatch, one workgroup layer per face
+    GlorpMipGenerator::Target target{};
+    target.image = m_image;
+    target.format = VK_FORMAT_R8G8B8A8_SRGB;
+    target.width = static_cast<uint32_t>(m_width);
+    target.height = static_cast<uint32_t>(m_height);
+    target.levelCount = m_mipLevels;
+    target.layerCount = 6;
+    mipGenerator.generate(target);
+    m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
 
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "glorp_device.hpp"
-#include "stb_image.h"
+
+#include <string>
+#include <vector>
 
 namespace Glorp {
 class GlorpCubeMap {
@@ -12,7 +14,7 @@ class GlorpCubeMap {
         GlorpCubeMap (const GlorpCubeMap&) = delete;
         GlorpCubeMap& operator= (const GlorpCubeMap&) = delete;
 
-        VkSampler getSampler() { return m_sampler; }
+        VkSampler getSampler();
 
         VkImageView getImageView() { return m_imageView; }
         VkImageLayout getImageLayout() { return m_imageLayout; }
@@ -24,12 +26,15 @@ class GlorpCubeMap {
         void createCubemapImage(const std::vector<std::string> &filenames);
     private:
 
-        int m_height, m_width, m_channels;
+        int m_height, m_width;
+        // the full chain when the mip generator can build it, used for roughness based reflections
+        uint32_t m_mipLevels = 1;
+        bool m_computeMipMaps = false;
         GlorpDevice& m_device;
         VkImage m_image;
         VkDeviceMemory m_imageMemory;
         VkImageView m_imageView;
-        VkSampler m_sampler;
+        VkSamplerCreateInfo m_samplerInfo{};
         VkFormat m_imageFormat;
         VkImageLayout m_imageLayout;
 };
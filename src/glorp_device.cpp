@@ -1,4 +1,11 @@
 #include "glorp_device.hpp"
+#include "glorp_upload_context.hpp"
+#include "glorp_texture_cache.hpp"
+#include "glorp_sampler_cache.hpp"
+#include "glorp_mip_generator.hpp"
+#include "glorp_texture_streamer.hpp"
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_pipeline_registry.hpp"
 
 // std headers
 #include <cstring>
@@ -47,17 +54,37 @@ void DestroyDebugUtilsMessengerEXT(
   }
 }
 
+static thread_local GlorpUploadContext *t_threadUploadContext = nullptr;
+
 // class member functions
 GlorpDevice::GlorpDevice(GlorpWindow &window) : m_window{window} {
   createInstance();
   setupDebugMessenger();
   createSurface();
   pickPhysicalDevice();
+  detectDirectUploadMemory();
   createLogicalDevice();
   createCommandPool();
+  m_pipelineCache = std::make_unique<GlorpPipelineCache>(*this);
+  m_pipelineRegistry = std::make_unique<GlorpPipelineRegistry>(*this);
+  m_uploadContext = std::make_unique<GlorpUploadContext>(*this);
+  m_textureCache = std::make_unique<GlorpTextureCache>();
+  m_samplerCache = std::make_unique<GlorpSamplerCache>(*this);
+  m_mipGenerator = std::make_unique<GlorpMipGenerator>(*this);
+  m_textureStreamer = std::make_unique<GlorpTextureStreamer>(*this);
 }
 
 GlorpDevice::~GlorpDevice() {
+  // its worker still records into the services below
+  m_textureStreamer.reset();
+  m_textureCache.reset();
+  m_samplerCache.reset();
+  m_uploadContext.reset();
+  // retiring the last upload batches releases the generator's per dispatch resources
+  m_mipGenerator.reset();
+  // written back once nothing creates pipelines anymore
+  m_pipelineRegistry.reset();
+  m_pipelineCache.reset();
   vkDestroyCommandPool(m_device_, m_commandPool, nullptr);
   vkDestroyDevice(m_device_, nullptr);
 
@@ -80,7 +107,7 @@ void GlorpDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = VK_API_VERSION_1_1;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -138,11 +165,54 @@ void GlorpDevice::pickPhysicalDevice() {
   std::cout << "physical device: " << properties.deviceName << std::endl;
 }
 
+void GlorpDevice::detectDirectUploadMemory() {
+  // Only unified memory or resizable BAR qualifies: the legacy 256 MiB BAR window is too small to
+  // spend on static assets and is better left to the driver for its own use.
+  constexpr VkDeviceSize legacyBarSize = 256ull * 1024 * 1024;
+  const bool unifiedMemory = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+                             properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((memProperties.memoryTypes[i].propertyFlags & DIRECT_UPLOAD_MEMORY_PROPERTIES) !=
+        DIRECT_UPLOAD_MEMORY_PROPERTIES) {
+      continue;
+    }
+    const VkMemoryHeap &heap = memProperties.memoryHeaps[memProperties.memoryTypes[i].heapIndex];
+    if (!unifiedMemory && heap.size <= legacyBarSize) {
+      continue;
+    }
+    // leave most of the heap to render targets and everything that still goes through staging
+    m_directUploadBudget = heap.size / 4;
+    std::cout << "direct upload memory: type " << i << ", budget "
+              << (m_directUploadBudget >> 20) << " MiB" << std::endl;
+    return;
+  }
+}
+
+bool GlorpDevice::reserveDirectUpload(VkDeviceSize size) {
+  VkDeviceSize usage = m_directUploadUsage.load();
+  do {
+    if (usage + size > m_directUploadBudget) {
+      return false;
+    }
+  } while (!m_directUploadUsage.compare_exchange_weak(usage, usage + size));
+  return true;
+}
+
+void GlorpDevice::releaseDirectUpload(VkDeviceSize size) {
+  m_directUploadUsage -= size;
+}
+
 void GlorpDevice::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  if (indices.hasDedicatedTransferFamily()) {
+    uniqueQueueFamilies.insert(indices.transferFamily);
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -158,15 +228,79 @@ void GlorpDevice::createLogicalDevice() {
   deviceFeatures.samplerAnisotropy = VK_TRUE;
   deviceFeatures.sampleRateShading = VK_TRUE;
 
+  // cooked textures are BCn, without the feature the loaders decode the source images instead
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+  m_textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+  deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+  // virtual textures write their page feedback from the fragment shader
+  m_fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics == VK_TRUE;
+  deviceFeatures.fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics;
+
+  // extended dynamic state lets pipelines that only differ in cull and depth state share one VkPipeline
+  std::vector<const char *> enabledExtensions = m_deviceExtensions;
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures{};
+  extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features{};
+  extendedDynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  void *featureChain = nullptr;
+  if (isDeviceExtensionAvailable(m_physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &extendedDynamicStateFeatures;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+    if (extendedDynamicStateFeatures.extendedDynamicState == VK_TRUE) {
+      enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+      extendedDynamicStateFeatures.pNext = nullptr;
+      featureChain = &extendedDynamicStateFeatures;
+      m_extendedDynamicState.supported = true;
+    }
+  }
+  if (m_extendedDynamicState.supported && isDeviceExtensionAvailable(m_physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &extendedDynamicState3Features;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+    if (extendedDynamicState3Features.extendedDynamicState3RasterizationSamples == VK_TRUE) {
+      enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+      // only the sample count is used, everything else stays disabled
+      extendedDynamicState3Features = {};
+      extendedDynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+      extendedDynamicState3Features.extendedDynamicState3RasterizationSamples = VK_TRUE;
+      extendedDynamicState3Features.pNext = featureChain;
+      featureChain = &extendedDynamicState3Features;
+      m_extendedDynamicState.rasterizationSamples = true;
+    }
+  }
+
+  // lets occlusion queried draws be skipped on the GPU, GlorpOcclusionQueries reads the results back otherwise
+  VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{};
+  conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+  if (isDeviceExtensionAvailable(m_physicalDevice, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &conditionalRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+    if (conditionalRenderingFeatures.conditionalRendering == VK_TRUE) {
+      enabledExtensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+      // inherited conditional rendering is only for secondary command buffers, which are never used
+      conditionalRenderingFeatures.inheritedConditionalRendering = VK_FALSE;
+      conditionalRenderingFeatures.pNext = featureChain;
+      featureChain = &conditionalRenderingFeatures;
+      m_conditionalRendering.supported = true;
+    }
+  }
+
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+  createInfo.pNext = featureChain;
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(m_deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = m_deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -181,8 +315,50 @@ void GlorpDevice::createLogicalDevice() {
     throw std::runtime_error("failed to create logical device!");
   }
 
+  if (m_extendedDynamicState.supported) {
+    auto &eds = m_extendedDynamicState;
+    eds.setCullMode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdSetCullModeEXT"));
+    eds.setFrontFace = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdSetFrontFaceEXT"));
+    eds.setDepthTestEnable = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdSetDepthTestEnableEXT"));
+    eds.setDepthWriteEnable = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdSetDepthWriteEnableEXT"));
+    eds.setDepthCompareOp = reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdSetDepthCompareOpEXT"));
+    eds.supported = eds.setCullMode && eds.setFrontFace && eds.setDepthTestEnable && eds.setDepthWriteEnable && eds.setDepthCompareOp;
+    if (eds.rasterizationSamples) {
+      eds.setRasterizationSamples = reinterpret_cast<PFN_vkCmdSetRasterizationSamplesEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdSetRasterizationSamplesEXT"));
+      eds.rasterizationSamples = eds.supported && eds.setRasterizationSamples != nullptr;
+    }
+    std::cout << "extended dynamic state: yes, dynamic sample count: " << (eds.rasterizationSamples ? "yes" : "no") << std::endl;
+  }
+
+  if (m_conditionalRendering.supported) {
+    auto &conditional = m_conditionalRendering;
+    conditional.begin = reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdBeginConditionalRenderingEXT"));
+    conditional.end = reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(vkGetDeviceProcAddr(m_device_, "vkCmdEndConditionalRenderingEXT"));
+    conditional.supported = conditional.begin && conditional.end;
+  }
+
   vkGetDeviceQueue(m_device_, indices.graphicsFamily, 0, &m_graphicsQueue_);
   vkGetDeviceQueue(m_device_, indices.presentFamily, 0, &m_presentQueue_);
+  if (indices.hasDedicatedTransferFamily()) {
+    vkGetDeviceQueue(m_device_, indices.transferFamily, 0, &m_transferQueue_);
+    std::cout << "dedicated transfer queue family: " << indices.transferFamily << std::endl;
+  } else {
+    m_transferQueue_ = m_graphicsQueue_;
+  }
+}
+
+GlorpUploadContext &GlorpDevice::getUploadContext() {
+  return t_threadUploadContext != nullptr ? *t_threadUploadContext : *m_uploadContext;
+}
+
+void GlorpDevice::setThreadUploadContext(GlorpUploadContext *uploadContext) {
+  t_threadUploadContext = uploadContext;
+}
+
+void GlorpDevice::waitIdle() {
+  // vkDeviceWaitIdle requires every queue of the device to be externally synchronized
+  std::scoped_lock lock{m_graphicsQueueMutex, m_transferQueueMutex};
+  vkDeviceWaitIdle(m_device_);
 }
 
 void GlorpDevice::createCommandPool() {
@@ -305,6 +481,19 @@ void GlorpDevice::hasGflwRequiredInstanceExtensions() {
   }
 }
 
+bool GlorpDevice::isDeviceExtensionAvailable(VkPhysicalDevice device, const char *extensionName) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+  for (const auto &extension : availableExtensions) {
+    if (std::strcmp(extension.extensionName, extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool GlorpDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   uint32_t extensionCount;
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -352,6 +541,27 @@ QueueFamilyIndices GlorpDevice::findQueueFamilies(VkPhysicalDevice device) {
     i++;
   }
 
+  // Prefer a transfer-only family (the copy engine), then any non-graphics family that can transfer
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    const auto &queueFamily = queueFamilies[family];
+    if (queueFamily.queueCount == 0 || !(queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) ||
+        (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      continue;
+    }
+    bool transferOnly = !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT);
+    if (!indices.transferFamilyHasValue || transferOnly) {
+      indices.transferFamily = family;
+      indices.transferFamilyHasValue = true;
+    }
+    if (transferOnly) {
+      break;
+    }
+  }
+  if (!indices.transferFamilyHasValue && indices.graphicsFamilyHasValue) {
+    indices.transferFamily = indices.graphicsFamily;
+    indices.transferFamilyHasValue = true;
+  }
+
   return indices;
 }
 
@@ -467,8 +677,11 @@ void GlorpDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(m_graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(m_graphicsQueue_);
+  {
+    std::lock_guard<std::mutex> lock{m_graphicsQueueMutex};
+    vkQueueSubmit(m_graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(m_graphicsQueue_);
+  }
 
   vkFreeCommandBuffers(m_device_, m_commandPool, 1, &commandBuffer);
 }
@@ -3,10 +3,42 @@
 #include "glorp_window.hpp"
 
 // std lib headers
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace Glorp {
 
+class GlorpUploadContext;
+class GlorpTextureCache;
+class GlorpSamplerCache;
+class GlorpMipGenerator;
+class GlorpTextureStreamer;
+class GlorpPipelineCache;
+class GlorpPipelineRegistry;
+
+// Optional VK_EXT_extended_dynamic_state(3) entry points, null when the device lacks them
+struct ExtendedDynamicState {
+  // cull mode, front face and the depth test state
+  bool supported = false;
+  // VK_EXT_extended_dynamic_state3, only its rasterization sample count is enabled
+  bool rasterizationSamples = false;
+  PFN_vkCmdSetCullModeEXT setCullMode = nullptr;
+  PFN_vkCmdSetFrontFaceEXT setFrontFace = nullptr;
+  PFN_vkCmdSetDepthTestEnableEXT setDepthTestEnable = nullptr;
+  PFN_vkCmdSetDepthWriteEnableEXT setDepthWriteEnable = nullptr;
+  PFN_vkCmdSetDepthCompareOpEXT setDepthCompareOp = nullptr;
+  PFN_vkCmdSetRasterizationSamplesEXT setRasterizationSamples = nullptr;
+};
+
+// Optional VK_EXT_conditional_rendering entry points, null when the device lacks them
+struct ConditionalRendering {
+  bool supported = false;
+  PFN_vkCmdBeginConditionalRenderingEXT begin = nullptr;
+  PFN_vkCmdEndConditionalRenderingEXT end = nullptr;
+};
+
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector<VkSurfaceFormatKHR> formats;
@@ -16,9 +48,12 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  uint32_t transferFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool transferFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+  bool hasDedicatedTransferFamily() { return transferFamilyHasValue && transferFamily != graphicsFamily; }
 };
 
 class GlorpDevice {
@@ -43,6 +78,13 @@ class GlorpDevice {
   VkSurfaceKHR surface() { return m_surface_; }
   VkQueue graphicsQueue() { return m_graphicsQueue_; }
   VkQueue presentQueue() { return m_presentQueue_; }
+  // Falls back to the graphics queue when the device has no dedicated transfer family
+  VkQueue transferQueue() { return m_transferQueue_; }
+  bool hasDedicatedTransferQueue() { return m_transferQueue_ != m_graphicsQueue_; }
+  // Queues are submitted to from the render thread and from asset streaming workers
+  std::mutex &graphicsQueueMutex() { return m_graphicsQueueMutex; }
+  std::mutex &transferQueueMutex() { return hasDedicatedTransferQueue() ? m_transferQueueMutex : m_graphicsQueueMutex; }
+  void waitIdle();
   VkInstance instance() { return m_instance; }
   VkPhysicalDevice physicalDevice() { return m_physicalDevice; }
   VkPhysicalDevice getPhysicalDevice() { return m_physicalDevice; }
@@ -68,6 +110,29 @@ class GlorpDevice {
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
   VkSampleCountFlagBits getSupportedSampleCount() { return m_msaaSamples; }
+  // Streaming workers install their own context so uploads from different threads never share a command buffer
+  GlorpUploadContext &getUploadContext();
+  static void setThreadUploadContext(GlorpUploadContext *uploadContext);
+  // Shared by every loader so an image referenced from several materials or models is uploaded once
+  GlorpTextureCache &getTextureCache() { return *m_textureCache; }
+  GlorpSamplerCache &getSamplerCache() { return *m_samplerCache; }
+  GlorpMipGenerator &getMipGenerator() { return *m_mipGenerator; }
+  GlorpTextureStreamer &getTextureStreamer() { return *m_textureStreamer; }
+  // Persisted between runs, pass it to every vkCreate*Pipelines
+  GlorpPipelineCache &getPipelineCache() { return *m_pipelineCache; }
+  GlorpPipelineRegistry &getPipelineRegistry() { return *m_pipelineRegistry; }
+
+  // Direct uploads write straight into DEVICE_LOCAL | HOST_VISIBLE memory (UMA, ReBAR, software ICDs)
+  // and skip the staging copy. reserve fails once the budget is spent, callers then fall back to staging.
+  static constexpr VkMemoryPropertyFlags DIRECT_UPLOAD_MEMORY_PROPERTIES =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  bool supportsDirectUpload() const { return m_directUploadBudget > 0; }
+  bool supportsTextureCompressionBC() const { return m_textureCompressionBC; }
+  bool supportsFragmentStoresAndAtomics() const { return m_fragmentStoresAndAtomics; }
+  const ExtendedDynamicState &extendedDynamicState() const { return m_extendedDynamicState; }
+  const ConditionalRendering &conditionalRendering() const { return m_conditionalRendering; }
+  bool reserveDirectUpload(VkDeviceSize size);
+  void releaseDirectUpload(VkDeviceSize size);
 
   void createImageWithInfo(
       const VkImageCreateInfo &imageInfo,
@@ -85,6 +150,7 @@ class GlorpDevice {
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void detectDirectUploadMemory();
 
   VkSampleCountFlagBits getMaxSampleCount();
 
@@ -96,6 +162,7 @@ class GlorpDevice {
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char *extensionName);
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
  private:
@@ -109,9 +176,27 @@ class GlorpDevice {
   VkSurfaceKHR m_surface_;
   VkQueue m_graphicsQueue_;
   VkQueue m_presentQueue_;
+  VkQueue m_transferQueue_;
+  std::mutex m_graphicsQueueMutex;
+  std::mutex m_transferQueueMutex;
 
   VkSampleCountFlagBits m_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
+  std::unique_ptr<GlorpPipelineCache> m_pipelineCache;
+  std::unique_ptr<GlorpPipelineRegistry> m_pipelineRegistry;
+  std::unique_ptr<GlorpUploadContext> m_uploadContext;
+  std::unique_ptr<GlorpTextureCache> m_textureCache;
+  std::unique_ptr<GlorpSamplerCache> m_samplerCache;
+  std::unique_ptr<GlorpMipGenerator> m_mipGenerator;
+  std::unique_ptr<GlorpTextureStreamer> m_textureStreamer;
+
+  VkDeviceSize m_directUploadBudget = 0;
+  bool m_textureCompressionBC = false;
+  bool m_fragmentStoresAndAtomics = false;
+  ExtendedDynamicState m_extendedDynamicState;
+  ConditionalRendering m_conditionalRendering;
+  std::atomic<VkDeviceSize> m_directUploadUsage = 0;
+
   const std::vector<const char *> m_validationLayers = {"VK_LAYER_KHRONOS_validation"};
   #ifdef APPLE
   const std::vector<const char *> m_deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME,"VK_KHR_portability_subset"};
@@ -0,0 +1,651 @@
+#include "glorp_file_io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define GLORP_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace Glorp {
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+GlorpFileIo::FileBuffer::FileBuffer(size_t capacity, size_t alignment) : m_capacity{capacity} {
+    auto *data = static_cast<std::byte *>(::operator new(capacity, std::align_val_t{alignment}));
+    m_data = std::unique_ptr<std::byte, AlignedDelete>(data, AlignedDelete{alignment});
+}
+
+void GlorpFileIo::FileBuffer::AlignedDelete::operator()(std::byte *data) const {
+    ::operator delete(data, std::align_val_t{alignment});
+}
+
+#ifndef _WIN32
+// Returns the descriptor or -errno. O_DIRECT is dropped on filesystems that refuse it.
+static int openForRead(const std::string &path, bool direct, size_t &fileSize) {
+    int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (direct) {
+        flags |= O_DIRECT;
+    }
+#endif
+    int fd = open(path.c_str(), flags);
+    if (fd < 0 && direct && errno == EINVAL) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        return -errno;
+    }
+#ifdef __APPLE__
+    if (direct) {
+        fcntl(fd, F_NOCACHE, 1);
+    }
+#endif
+
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0) {
+        int error = errno;
+        close(fd);
+        return -error;
+    }
+    fileSize = static_cast<size_t>(fileStat.st_size);
+    return fd;
+}
+#endif
+
+// Bytes of the requested range that exist in a file of fileSize bytes
+static size_t rangeSize(const GlorpFileIo::ReadRequest &request, size_t fileSize) {
+    if (request.offset >= fileSize) {
+        return 0;
+    }
+    size_t available = fileSize - static_cast<size_t>(request.offset);
+    return request.length == 0 ? available : std::min(available, request.length);
+}
+
+static bool readsDirect(const GlorpFileIo::ReadRequest &request) {
+    return request.direct && request.offset % GlorpFileIo::DIRECT_IO_ALIGNMENT == 0;
+}
+
+static GlorpFileIo::FileBuffer allocateFileBuffer(size_t fileSize, bool direct) {
+    if (direct) {
+        return GlorpFileIo::FileBuffer(alignUp(fileSize, GlorpFileIo::DIRECT_IO_ALIGNMENT), GlorpFileIo::DIRECT_IO_ALIGNMENT);
+    }
+    return GlorpFileIo::FileBuffer(fileSize, alignof(std::max_align_t));
+}
+
+#ifdef GLORP_HAS_IO_URING
+struct GlorpFileIo::IoUring {
+    static constexpr uint64_t WAKE_TAG = ~0ull;
+    static constexpr uint64_t CANCEL_TAG = ~0ull - 1;
+
+    int fd = -1;
+    int wakeFd = -1;
+    io_uring_params params{};
+
+    void *sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void *cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    uint32_t *sqHead = nullptr;
+    uint32_t *sqTail = nullptr;
+    uint32_t *sqArray = nullptr;
+    uint32_t sqMask = 0;
+    uint32_t *cqHead = nullptr;
+    uint32_t *cqTail = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    uint32_t cqMask = 0;
+
+    uint32_t toSubmit = 0;
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (wakeFd >= 0) close(wakeFd);
+        if (fd >= 0) close(fd);
+    }
+
+    bool setup(uint32_t entries) {
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        cqRing = singleMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        auto *sq = static_cast<char *>(sqRing);
+        sqHead = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+        sqArray = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+        sqMask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+        auto *cq = static_cast<char *>(cqRing);
+        cqHead = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        cqMask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        return wakeFd >= 0;
+    }
+
+    // Only the submission thread touches the ring, so the tail can be read without synchronisation
+    io_uring_sqe *nextSqe() {
+        uint32_t head = std::atomic_ref<uint32_t>(*sqHead).load(std::memory_order_acquire);
+        uint32_t tail = *sqTail;
+        if (tail - head >= params.sq_entries) {
+            return nullptr;
+        }
+        io_uring_sqe *sqe = &sqes[tail & sqMask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void push() {
+        uint32_t tail = *sqTail;
+        sqArray[tail & sqMask] = tail & sqMask;
+        std::atomic_ref<uint32_t>(*sqTail).store(tail + 1, std::memory_order_release);
+        toSubmit++;
+    }
+
+    void enter(uint32_t minComplete) {
+        unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long submitted = syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+        if (submitted > 0) {
+            toSubmit -= std::min(static_cast<uint32_t>(submitted), toSubmit);
+        }
+    }
+};
+#else
+struct GlorpFileIo::IoUring {};
+#endif
+
+GlorpFileIo::GlorpFileIo() {
+    if (createRing()) {
+        std::cout << "file io: io_uring backend, queue depth " << QUEUE_DEPTH << std::endl;
+        m_callbackPool = std::make_unique<GlorpThreadPool>(2);
+        m_threads.emplace_back([this]() { ringLoop(); });
+        return;
+    }
+
+    std::cout << "file io: blocking read backend, " << FALLBACK_WORKER_COUNT << " workers" << std::endl;
+    for (uint32_t i = 0; i < FALLBACK_WORKER_COUNT; i++) {
+        m_threads.emplace_back([this]() { fallbackLoop(); });
+    }
+}
+
+GlorpFileIo::~GlorpFileIo() {
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    wakeRing();
+    // queued reads are drained so no callback is dropped
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+    m_callbackPool.reset();
+}
+
+GlorpFileIo &GlorpFileIo::shared() {
+    static GlorpFileIo fileIo;
+    return fileIo;
+}
+
+GlorpFileIo::RequestId GlorpFileIo::read(ReadRequest request) {
+    RequestId id = m_nextId++;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_queues[static_cast<size_t>(request.priority)].push_back({id, std::move(request)});
+    }
+    m_condition.notify_one();
+    wakeRing();
+    return id;
+}
+
+std::vector<GlorpFileIo::RequestId> GlorpFileIo::readBatch(std::vector<ReadRequest> requests) {
+    std::vector<RequestId> ids;
+    ids.reserve(requests.size());
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        for (auto &request : requests) {
+            RequestId id = m_nextId++;
+            ids.push_back(id);
+            m_queues[static_cast<size_t>(request.priority)].push_back({id, std::move(request)});
+        }
+    }
+    m_condition.notify_all();
+    wakeRing();
+    return ids;
+}
+
+std::future<GlorpFileIo::ReadResult> GlorpFileIo::readAsync(const std::string &path, Priority priority, bool direct) {
+    auto promise = std::make_shared<std::promise<ReadResult>>();
+    std::future<ReadResult> future = promise->get_future();
+
+    ReadRequest request{};
+    request.path = path;
+    request.priority = priority;
+    request.direct = direct;
+    request.onComplete = [promise](ReadResult result) { promise->set_value(std::move(result)); };
+    read(std::move(request));
+    return future;
+}
+
+std::future<GlorpFileIo::ReadResult> GlorpFileIo::readRangeAsync(const std::string &path, uint64_t offset, size_t length, Priority priority) {
+    auto promise = std::make_shared<std::promise<ReadResult>>();
+    std::future<ReadResult> future = promise->get_future();
+
+    ReadRequest request{};
+    request.path = path;
+    request.priority = priority;
+    request.offset = offset;
+    request.length = length;
+    request.onComplete = [promise](ReadResult result) { promise->set_value(std::move(result)); };
+    read(std::move(request));
+    return future;
+}
+
+GlorpFileIo::FileBuffer GlorpFileIo::readFile(const std::string &path, Priority priority) {
+    ReadResult result = readAsync(path, priority).get();
+    if (!result.ok()) {
+        throw std::runtime_error("Failed to open file " + path + ": " + std::strerror(result.error));
+    }
+    return std::move(result.data);
+}
+
+void GlorpFileIo::writeFileAtomically(const std::string &path, const std::function<void(std::ostream &)> &write) {
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out{temporaryPath, std::ios::binary | std::ios::trunc};
+        if (!out.is_open()) {
+            throw std::runtime_error("Failed to open file: " + temporaryPath);
+        }
+        write(out);
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("Failed to write file: " + temporaryPath);
+        }
+    }
+    // replaces an existing target, there is no moment without a file at path
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Failed to write file: " + path);
+    }
+}
+
+bool GlorpFileIo::cancel(RequestId id) {
+    std::unique_lock<std::mutex> lock{m_mutex};
+    for (auto &queue : m_queues) {
+        auto it = std::find_if(queue.begin(), queue.end(), [id](const PendingRead &pending) { return pending.id == id; });
+        if (it == queue.end()) {
+            continue;
+        }
+        PendingRead pending = std::move(*it);
+        queue.erase(it);
+        lock.unlock();
+
+        ReadResult result{};
+        result.id = id;
+        result.path = pending.request.path;
+        result.error = ECANCELED;
+        result.cancelled = true;
+        complete(pending.request.onComplete, std::move(result));
+        return true;
+    }
+
+    if (m_inFlight.count(id) == 0) {
+        return false;
+    }
+    m_cancelled.insert(id);
+    // the fallback workers poll m_cancelled between reads, only the ring has a read to cancel in the kernel
+    if (m_ring == nullptr) {
+        return true;
+    }
+    m_pendingCancels.push_back(id);
+    lock.unlock();
+    wakeRing();
+    return true;
+}
+
+bool GlorpFileIo::popPending(PendingRead &pending) {
+    // highest priority first, FIFO within a priority
+    for (auto queue = m_queues.rbegin(); queue != m_queues.rend(); ++queue) {
+        if (!queue->empty()) {
+            pending = std::move(queue->front());
+            queue->pop_front();
+            m_inFlight.insert(pending.id);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GlorpFileIo::isCancelled(RequestId id) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_cancelled.count(id) > 0;
+}
+
+void GlorpFileIo::finish(PendingRead &pending, ReadResult result) {
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_inFlight.erase(pending.id);
+        if (m_cancelled.erase(pending.id) > 0) {
+            result.data = {};
+            result.error = ECANCELED;
+            result.cancelled = true;
+        }
+    }
+    complete(pending.request.onComplete, std::move(result));
+}
+
+void GlorpFileIo::complete(Callback &callback, ReadResult result) {
+    if (!callback) {
+        return;
+    }
+    if (m_callbackPool == nullptr) {
+        callback(std::move(result));
+        return;
+    }
+    m_callbackPool->submit([callback = std::move(callback), result = std::move(result)]() mutable {
+        callback(std::move(result));
+    });
+}
+
+void GlorpFileIo::fallbackLoop() {
+    while (true) {
+        PendingRead pending;
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_condition.wait(lock, [this]() {
+                return m_stopping || std::any_of(m_queues.begin(), m_queues.end(), [](const auto &queue) { return !queue.empty(); });
+            });
+            if (!popPending(pending)) {
+                return;
+            }
+        }
+        readBlocking(pending);
+    }
+}
+
+void GlorpFileIo::readBlocking(PendingRead &pending) {
+    ReadResult result{};
+    result.id = pending.id;
+    result.path = pending.request.path;
+
+#ifdef _WIN32
+    std::ifstream file{pending.request.path, std::ios::ate | std::ios::binary};
+    if (!file.is_open()) {
+        result.error = ENOENT;
+        finish(pending, std::move(result));
+        return;
+    }
+    size_t fileSize = rangeSize(pending.request, static_cast<size_t>(file.tellg()));
+    result.data = allocateFileBuffer(fileSize, false);
+    file.seekg(static_cast<std::streamoff>(pending.request.offset));
+    file.read(reinterpret_cast<char *>(result.data.data()), static_cast<std::streamsize>(fileSize));
+    result.data.setSize(static_cast<size_t>(file.gcount()));
+    if (result.data.size() != fileSize) {
+        result.error = EIO;
+    }
+#else
+    size_t fileSize = 0;
+    bool direct = readsDirect(pending.request);
+    int fd = openForRead(pending.request.path, direct, fileSize);
+    if (fd < 0) {
+        result.error = -fd;
+        finish(pending, std::move(result));
+        return;
+    }
+
+    fileSize = rangeSize(pending.request, fileSize);
+    result.data = allocateFileBuffer(fileSize, direct);
+    size_t offset = 0;
+    while (offset < fileSize && !isCancelled(pending.id)) {
+        ssize_t bytesRead = pread(fd, result.data.data() + offset, result.data.capacity() - offset,
+            static_cast<off_t>(pending.request.offset + offset));
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result.error = errno;
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        offset += static_cast<size_t>(bytesRead);
+    }
+    close(fd);
+    result.data.setSize(std::min(offset, fileSize));
+#endif
+
+    finish(pending, std::move(result));
+}
+
+bool GlorpFileIo::createRing() {
+#ifdef GLORP_HAS_IO_URING
+    auto ring = std::make_unique<IoUring>();
+    // fails on kernels without io_uring or where it is disabled by policy
+    if (!ring->setup(QUEUE_DEPTH)) {
+        return false;
+    }
+    m_ring = std::move(ring);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GlorpFileIo::wakeRing() {
+#ifdef GLORP_HAS_IO_URING
+    if (m_ring != nullptr) {
+        uint64_t value = 1;
+        [[maybe_unused]] ssize_t written = write(m_ring->wakeFd, &value, sizeof(value));
+    }
+#endif
+}
+
+void GlorpFileIo::ringLoop() {
+#ifdef GLORP_HAS_IO_URING
+    struct ActiveRead {
+        PendingRead pending;
+        int fd;
+        ReadResult result;
+        size_t fileSize;
+        size_t offset;
+        iovec iov;
+    };
+
+    IoUring &ring = *m_ring;
+    // every active read holds at most one sqe, the rest is left for wakeups and cancels
+    const size_t maxActive = ring.params.sq_entries / 2 - 1;
+    std::unordered_map<RequestId, ActiveRead> active;
+    bool wakeArmed = false;
+
+    auto acquireSqe = [&ring]() {
+        io_uring_sqe *sqe = ring.nextSqe();
+        while (sqe == nullptr) {
+            ring.enter(0);
+            sqe = ring.nextSqe();
+        }
+        return sqe;
+    };
+
+    auto submitRead = [&](ActiveRead &read) {
+        read.iov.iov_base = read.result.data.data() + read.offset;
+        read.iov.iov_len = read.result.data.capacity() - read.offset;
+
+        io_uring_sqe *sqe = acquireSqe();
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = read.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&read.iov);
+        sqe->len = 1;
+        sqe->off = read.pending.request.offset + read.offset;
+        sqe->user_data = read.pending.id;
+        ring.push();
+    };
+
+    auto finishRead = [&](std::unordered_map<RequestId, ActiveRead>::iterator it, int error) {
+        ActiveRead &read = it->second;
+        close(read.fd);
+        read.result.error = error;
+        read.result.data.setSize(std::min(read.offset, read.fileSize));
+        PendingRead pending = std::move(read.pending);
+        ReadResult result = std::move(read.result);
+        active.erase(it);
+        finish(pending, std::move(result));
+    };
+
+    while (true) {
+        std::vector<PendingRead> started;
+        std::vector<RequestId> cancels;
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            bool queuesEmpty = std::all_of(m_queues.begin(), m_queues.end(), [](const auto &queue) { return queue.empty(); });
+            if (m_stopping && queuesEmpty && active.empty()) {
+                break;
+            }
+            PendingRead pending;
+            while (active.size() + started.size() < maxActive && popPending(pending)) {
+                started.push_back(std::move(pending));
+            }
+            cancels.swap(m_pendingCancels);
+        }
+
+        if (!wakeArmed) {
+            io_uring_sqe *sqe = acquireSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = ring.wakeFd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data = IoUring::WAKE_TAG;
+            ring.push();
+            wakeArmed = true;
+        }
+
+        for (auto &pending : started) {
+            ReadResult result{};
+            result.id = pending.id;
+            result.path = pending.request.path;
+
+            size_t fileSize = 0;
+            bool direct = readsDirect(pending.request);
+            int fd = openForRead(pending.request.path, direct, fileSize);
+            if (fd < 0) {
+                result.error = -fd;
+                finish(pending, std::move(result));
+                continue;
+            }
+            fileSize = rangeSize(pending.request, fileSize);
+            result.data = allocateFileBuffer(fileSize, direct);
+            if (fileSize == 0) {
+                close(fd);
+                finish(pending, std::move(result));
+                continue;
+            }
+
+            RequestId id = pending.id;
+            auto [it, inserted] = active.emplace(id, ActiveRead{std::move(pending), fd, std::move(result), fileSize, 0, {}});
+            submitRead(it->second);
+        }
+
+        for (RequestId id : cancels) {
+            if (active.count(id) == 0) {
+                continue;
+            }
+            io_uring_sqe *sqe = acquireSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = id;
+            sqe->user_data = IoUring::CANCEL_TAG;
+            ring.push();
+        }
+
+        ring.enter(1);
+
+        uint32_t head = *ring.cqHead;
+        uint32_t tail = std::atomic_ref<uint32_t>(*ring.cqTail).load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const io_uring_cqe &cqe = ring.cqes[head & ring.cqMask];
+            if (cqe.user_data == IoUring::WAKE_TAG) {
+                uint64_t value;
+                [[maybe_unused]] ssize_t bytesRead = ::read(ring.wakeFd, &value, sizeof(value));
+                wakeArmed = false;
+                continue;
+            }
+            if (cqe.user_data == IoUring::CANCEL_TAG) {
+                continue;
+            }
+
+            auto it = active.find(cqe.user_data);
+            if (it == active.end()) {
+                continue;
+            }
+            if (cqe.res < 0) {
+                if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                    submitRead(it->second);
+                } else {
+                    finishRead(it, -cqe.res);
+                }
+                continue;
+            }
+
+            ActiveRead &read = it->second;
+            read.offset += static_cast<size_t>(cqe.res);
+            // a zero length read means the file shrank underneath us
+            if (cqe.res == 0 || read.offset >= read.fileSize || isCancelled(read.pending.id)) {
+                finishRead(it, 0);
+            } else {
+                submitRead(read);
+            }
+        }
+        std::atomic_ref<uint32_t>(*ring.cqHead).store(head, std::memory_order_release);
+    }
+#endif
+}
+
+}
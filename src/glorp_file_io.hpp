@@ -0,0 +1,147 @@
+#pragma once
+
+#include "glorp_thread_pool.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace Glorp {
+
+// Asynchronous whole-file reads for asset loading. On Linux the reads go through an io_uring
+// owned by a single submission thread so hundreds of files can be queued on the disk at once;
+// elsewhere, or when io_uring is unavailable, a few worker threads fall back to blocking reads.
+// Completion callbacks run on a service worker and should hand heavy work off to another pool.
+class GlorpFileIo {
+    public:
+        using RequestId = uint64_t;
+
+        static constexpr uint32_t QUEUE_DEPTH = 256;
+        static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+        static constexpr uint32_t FALLBACK_WORKER_COUNT = 4;
+
+        enum class Priority : uint8_t {
+            Low = 0,
+            Normal = 1,
+            High = 2
+        };
+
+        // File contents in a buffer aligned for O_DIRECT
+        class FileBuffer {
+            public:
+                FileBuffer() = default;
+                FileBuffer(size_t capacity, size_t alignment);
+
+                std::byte *data() { return m_data.get(); }
+                const std::byte *data() const { return m_data.get(); }
+                size_t size() const { return m_size; }
+                size_t capacity() const { return m_capacity; }
+                void setSize(size_t size) { m_size = size; }
+                std::span<const std::byte> bytes() const { return {m_data.get(), m_size}; }
+            private:
+                struct AlignedDelete {
+                    size_t alignment;
+                    void operator()(std::byte *data) const;
+                };
+
+                std::unique_ptr<std::byte, AlignedDelete> m_data;
+                size_t m_size = 0;
+                size_t m_capacity = 0;
+        };
+
+        struct ReadResult {
+            RequestId id = 0;
+            std::string path;
+            FileBuffer data;
+            // errno style code, 0 on success
+            int error = 0;
+            bool cancelled = false;
+
+            bool ok() const { return error == 0 && !cancelled; }
+        };
+
+        using Callback = std::function<void(ReadResult)>;
+
+        struct ReadRequest {
+            std::string path;
+            Callback onComplete;
+            Priority priority = Priority::Normal;
+            // Bypass the page cache, meant for large blobs that are read exactly once
+            bool direct = false;
+            // Byte range to read, length 0 reads to the end of the file. A range past the end comes back
+            // short. Unaligned ranges are never read direct.
+            uint64_t offset = 0;
+            size_t length = 0;
+        };
+
+        GlorpFileIo();
+        ~GlorpFileIo();
+
+        GlorpFileIo(const GlorpFileIo&) = delete;
+        GlorpFileIo &operator=(const GlorpFileIo&) = delete;
+
+        // Process wide instance used by the asset loaders
+        static GlorpFileIo &shared();
+
+        RequestId read(ReadRequest request);
+        // Queues every request under a single lock so the submission thread sees them together
+        std::vector<RequestId> readBatch(std::vector<ReadRequest> requests);
+        std::future<ReadResult> readAsync(const std::string &path, Priority priority = Priority::Normal, bool direct = false);
+        std::future<ReadResult> readRangeAsync(const std::string &path, uint64_t offset, size_t length, Priority priority = Priority::Normal);
+        // Blocking convenience wrapper, throws when the file cannot be read
+        FileBuffer readFile(const std::string &path, Priority priority = Priority::High);
+        // Writes next to path and renames over it in one step, so path holds either the old or the
+        // new contents whenever the process dies. Throws when the file cannot be written.
+        static void writeFileAtomically(const std::string &path, const std::function<void(std::ostream &)> &write);
+
+        // Completes the request with cancelled set. Returns false if it already finished.
+        bool cancel(RequestId id);
+
+        bool usesIoUring() const { return m_ring != nullptr; }
+    private:
+        struct PendingRead {
+            RequestId id;
+            ReadRequest request;
+        };
+        struct IoUring;
+
+        bool popPending(PendingRead &pending);
+        bool isCancelled(RequestId id);
+        void finish(PendingRead &pending, ReadResult result);
+        void complete(Callback &callback, ReadResult result);
+
+        void fallbackLoop();
+        void readBlocking(PendingRead &pending);
+
+        bool createRing();
+        void ringLoop();
+        void wakeRing();
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::array<std::deque<PendingRead>, 3> m_queues;
+        // requests taken off the queues that have not completed yet, and the ones cancelled meanwhile
+        std::unordered_set<RequestId> m_inFlight;
+        std::unordered_set<RequestId> m_cancelled;
+        // cancels for the ring thread to submit, unused by the fallback workers
+        std::vector<RequestId> m_pendingCancels;
+        bool m_stopping = false;
+        std::atomic<RequestId> m_nextId = 1;
+
+        std::unique_ptr<IoUring> m_ring;
+        std::unique_ptr<GlorpThreadPool> m_callbackPool;
+        std::vector<std::thread> m_threads;
+};
+}
@@ -2,15 +2,22 @@
 
 #include "glorp_camera.hpp"
 #include "glorp_game_object.hpp"
+#include "glorp_hzb_culler.hpp"
 
 #include <vulkan/vulkan.h>
 
+#include <unordered_set>
+
 namespace Glorp {
+class GlorpOcclusionQueries;
 
-#define MAX_LIGHTS 10
+// capacity of the light storage buffer, see GlorpLightClusters
+#define MAX_LIGHTS 8192
 
 struct PointLight {
+    // w is the range past which the light no longer contributes
     glm::vec4 position{};
+    // w is the intensity
     glm::vec4 color{};
 };
 
@@ -19,7 +26,9 @@ struct GlobalUbo {
     glm::mat4 view{1.f};
     glm::mat4 inverseView{1.f};
     glm::vec4 ambientLightColor {1.f, 1.f, 1.f, 0.02f};
-    PointLight pointLights[MAX_LIGHTS];
+    // maps a fragment to its light cluster, written by GlorpLightClusters::build
+    glm::vec4 clusterScale{};
+    glm::uvec4 clusterCounts{};
     int numLights;
 };
 
@@ -39,6 +48,24 @@ struct FrameInfo {
     bool useAOMap{true};
 
     float lightVerticalPosition;
+    // opaque objects were drawn by DepthPrepassSystem, the main pass only shades the visible fragments
+    bool depthPrepass{false};
+    // objects GlorpOcclusionCuller found hidden, null when occlusion culling is off
+    const std::unordered_set<GlorpGameObject::id_t> *culledObjects{nullptr};
+
+    // draws objects through its indirect commands when GPU occlusion culling is on, see drawModel
+    const GlorpHzbCuller *hzbCuller{nullptr};
+    // skips the draws of objects with OcclusionPolicy::Query whose boxes were hidden, null when off
+    GlorpOcclusionQueries *occlusionQueries{nullptr};
+
+    bool isCulled(GlorpGameObject::id_t id) const { return culledObjects != nullptr && culledObjects->contains(id); }
+    void drawModel(GlorpGameObject &obj) const {
+        if (hzbCuller != nullptr) {
+            hzbCuller->draw(commandBuffer, frameIndex, obj);
+        } else {
+            obj.model->draw(commandBuffer);
+        }
+    }
 };
 
 }
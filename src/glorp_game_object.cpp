@@ -1,8 +1,19 @@
 #include "glorp_game_object.hpp"
+#include "glorp_asset_streamer.hpp"
+#include "glorp_ktx2_file.hpp"
+#include "glorp_file_io.hpp"
+#include "glorp_image_decoder.hpp"
+#include "glorp_texture_cache.hpp"
+#include "glorp_texture_cooker.hpp"
+#include "glorp_texture_processing.hpp"
+#include "glorp_texture_streamer.hpp"
+#include "glorp_upload_context.hpp"
+#include <array>
+#include <cstring>
 #include <memory>
+#include <unordered_map>
 
 #define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "tiny_gltf.h"
 #include <iostream>
@@ -70,28 +81,56 @@ GlorpGameObject GlorpGameObject::createGameObjectFromAscii(GlorpDevice &device,
     tinygltf::Model gameObjectModel;
     loadAsciiGLTF(gameObjectModel, filepath);
 
+    std::string fullPath = RESOURCE_LOCATIONS + filepath;
     GlorpGameObject gameObject = GlorpGameObject::createGameObject();
-    assembleGameObject(device, gameObject, gameObjectModel);
+    assembleGameObject(device, gameObject, gameObjectModel, fullPath.substr(0, fullPath.find_last_of("/\\") + 1));
 
     return gameObject;
 }
 
-void GlorpGameObject::loadBinaryGLTF(tinygltf::Model &model, const std::string &filepath) {
-    std::string fullPath = RESOURCE_LOCATIONS + filepath;
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-    auto start = std::chrono::high_resolution_clock::now();
-    bool res = loader.LoadBinaryFromFile(&model, &err, &warn, fullPath);
-    if(!warn.empty()) {
-        std::cout << "Warning from loading gltf file: " << warn << std::endl;
+// Only the image header is read while parsing, the pixels are decoded later straight into staging memory
+static bool deferImageDecode(tinygltf::Image *image, const int imageIndex, std::string *err, std::string *warn,
+    int reqWidth, int reqHeight, const unsigned char *bytes, int size, void *userData) {
+    int width, height;
+    if (!GlorpImageDecoder::getInfo({reinterpret_cast<const std::byte *>(bytes), static_cast<size_t>(size)}, width, height)) {
+        if (err) {
+            (*err) += "Unknown image format for image[" + std::to_string(imageIndex) + "]\n";
+        }
+        return false;
     }
-    if(!err.empty()) {
-        std::cout << "Error loading gltf file: " << err << std::endl;
+    image->width = width;
+    image->height = height;
+    image->component = 4;
+    image->bits = 8;
+    image->pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    image->as_is = true;
+    image->image.assign(bytes, bytes + size);
+    return true;
+}
+
+using PrefetchedFiles = std::unordered_map<std::string, std::future<GlorpFileIo::ReadResult>>;
+
+// Serves tinygltf's file reads from the reads issued up front, anything else goes through the I/O service directly
+static bool readPrefetchedFile(std::vector<unsigned char> *out, std::string *err, const std::string &filepath, void *userData) {
+    auto &prefetched = *static_cast<PrefetchedFiles *>(userData);
+    GlorpFileIo::ReadResult result;
+    auto it = prefetched.find(filepath);
+    if (it != prefetched.end()) {
+        result = it->second.get();
+        prefetched.erase(it);
+    } else {
+        result = GlorpFileIo::shared().readAsync(filepath, GlorpFileIo::Priority::High).get();
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> duration = end - start;
-    std::cout << "Time taken to load gltf file " << fullPath << ": " << duration.count() << " seconds" << std::endl;
+
+    if (!result.ok()) {
+        if (err) {
+            (*err) += "File read error : " + filepath + " : " + std::strerror(result.error) + "\n";
+        }
+        return false;
+    }
+    const auto *data = reinterpret_cast<const unsigned char *>(result.data.data());
+    out->assign(data, data + result.data.size());
+    return true;
 }
 
 void GlorpGameObject::loadAsciiGLTF(tinygltf::Model &model, const std::string &filepath) {
@@ -100,7 +139,38 @@ void GlorpGameObject::loadAsciiGLTF(tinygltf::Model &model, const std::string &f
     std::string err;
     std::string warn;
     auto start = std::chrono::high_resolution_clock::now();
-    bool res = loader.LoadASCIIFromFile(&model, &err, &warn, fullPath);
+
+    auto &fileIo = GlorpFileIo::shared();
+    auto gltfFile = fileIo.readFile(fullPath);
+    const char *gltfText = reinterpret_cast<const char *>(gltfFile.data());
+    std::string baseDir = fullPath.substr(0, fullPath.find_last_of("/\\") + 1);
+
+    // Queue every external buffer and image at once instead of letting tinygltf read them one by one
+    PrefetchedFiles prefetched;
+    auto json = nlohmann::json::parse(gltfText, gltfText + gltfFile.size(), nullptr, false);
+    if (!json.is_discarded()) {
+        for (const char *section : {"buffers", "images"}) {
+            for (const auto &entry : json.value(section, nlohmann::json::array())) {
+                std::string uri = entry.value("uri", "");
+                if (uri.empty() || uri.starts_with("data:") || prefetched.count(baseDir + uri)) {
+                    continue;
+                }
+                prefetched.emplace(baseDir + uri, fileIo.readAsync(baseDir + uri));
+            }
+        }
+    }
+
+    tinygltf::FsCallbacks callbacks{};
+    callbacks.FileExists = &tinygltf::FileExists;
+    callbacks.ExpandFilePath = &tinygltf::ExpandFilePath;
+    callbacks.ReadWholeFile = &readPrefetchedFile;
+    callbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+    callbacks.GetFileSizeInBytes = &tinygltf::GetFileSizeInBytes;
+    callbacks.user_data = &prefetched;
+    loader.SetFsCallbacks(callbacks);
+    loader.SetImageLoader(&deferImageDecode, nullptr);
+
+    bool res = loader.LoadASCIIFromString(&model, &err, &warn, gltfText, static_cast<unsigned int>(gltfFile.size()), baseDir);
     if(!warn.empty()) {
         std::cout << "Warning from loading gltf file: " << warn << std::endl;
     }
@@ -113,19 +183,351 @@ void GlorpGameObject::loadAsciiGLTF(tinygltf::Model &model, const std::string &f
 }
 
 GlorpGameObject GlorpGameObject::createGameObjectFromBin(GlorpDevice &device, const std::string &filepath) {
-    tinygltf::Model gameObjectModel;
-    loadBinaryGLTF(gameObjectModel, filepath);
-    
+    // The glb is mapped rather than read, vertices and images are decoded straight out of the page cache
+    std::string fullPath = RESOURCE_LOCATIONS + filepath;
+    auto start = std::chrono::high_resolution_clock::now();
+    GlorpGlbFile glbFile{fullPath};
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    std::cout << "Time taken to map glb file " << fullPath << ": " << duration.count() << " seconds" << std::endl;
+
     GlorpGameObject gameObject = GlorpGameObject::createGameObject();
-    assembleGameObject(device, gameObject, gameObjectModel);
+    assembleGameObject(device, gameObject, glbFile);
 
     return gameObject;
 }
 
-void GlorpGameObject::assembleGameObject(GlorpDevice &device, GlorpGameObject &gameObject, tinygltf::Model &gltfModel) {
+std::future<GlorpGameObject> GlorpGameObject::createGameObjectFromAsciiAsync(GlorpAssetStreamer &streamer, const std::string &filepath) {
+    return streamer.stream([filepath](GlorpDevice &device) {
+        return createGameObjectFromAscii(device, filepath);
+    });
+}
+
+std::future<GlorpGameObject> GlorpGameObject::createGameObjectFromBinAsync(GlorpAssetStreamer &streamer, const std::string &filepath) {
+    return streamer.stream([filepath](GlorpDevice &device) {
+        return createGameObjectFromBin(device, filepath);
+    });
+}
+
+namespace {
+// Gathers the textures of one object. Images already in the device texture cache, or referenced
+// twice by the object, are shared. Cooked KTX2 files next to the source images are used when the
+// device can sample their format; everything else decodes concurrently, each image into its own
+// staging slot. Occlusion, roughness and metalness from separate images are packed into one ORM texture.
+// New textures only reach the cache through publish(), once the batch uploading them has been submitted,
+// so no other loader can bind an image whose copy has not been recorded ahead of its draws.
+class TextureBatch {
+    public:
+        using Usage = GlorpTextureCooker::Usage;
+
+        TextureBatch(GlorpDevice &device, std::string baseDir = "")
+            : m_device{device}, m_cache{device.getTextureCache()}, m_baseDir{std::move(baseDir)} {}
+
+        static VkFormat uncompressedFormat(Usage usage) {
+            return GlorpTextureCooker::isSrgb(usage) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        }
+
+        void add(std::shared_ptr<GlorpTexture> &texture, std::span<const std::byte> encoded, Usage usage, const std::string &cookedPath = "") {
+            enqueue(texture, encoded, {}, false, usage, cookedPath);
+        }
+
+        // Either image may be empty when the material lacks it
+        void addOrm(std::shared_ptr<GlorpTexture> &texture, std::span<const std::byte> occlusion, std::span<const std::byte> metallicRoughness,
+            const std::string &cookedPath = "") {
+            if (occlusion.empty() && metallicRoughness.empty()) {
+                return;
+            }
+            // glTF allows occlusion to live in the red channel of the metallic roughness image already
+            if (occlusion.data() == metallicRoughness.data() && occlusion.size() == metallicRoughness.size()) {
+                enqueue(texture, metallicRoughness, {}, false, Usage::OcclusionRoughnessMetallic, cookedPath);
+                return;
+            }
+            enqueue(texture, metallicRoughness, occlusion, true, Usage::OcclusionRoughnessMetallic, cookedPath);
+        }
+
+        void add(std::shared_ptr<GlorpTexture> &texture, const tinygltf::Image &image, Usage usage) {
+            if (image.as_is) {
+                std::string path = sourcePath(&image);
+                add(texture, std::as_bytes(std::span{image.image}), usage, path.empty() ? "" : GlorpTextureCooker::cookedPath(path));
+                return;
+            }
+            auto key = GlorpTextureCache::makeKey(std::as_bytes(std::span{image.image}), uncompressedFormat(usage));
+            texture = find(key);
+            if (!texture) {
+                texture = track(key, std::make_shared<GlorpTexture>(m_device, image, uncompressedFormat(usage)));
+            }
+        }
+
+        void addOrm(std::shared_ptr<GlorpTexture> &texture, const tinygltf::Image *occlusion, const tinygltf::Image *metallicRoughness) {
+            if (occlusion == metallicRoughness) {
+                if (occlusion) {
+                    add(texture, *occlusion, Usage::OcclusionRoughnessMetallic);
+                }
+                return;
+            }
+            if ((occlusion && !occlusion->as_is) || (metallicRoughness && !metallicRoughness->as_is)) {
+                addDecodedOrm(texture, occlusion, metallicRoughness);
+                return;
+            }
+            std::string cookedOrmPath;
+            std::string occlusionPath = sourcePath(occlusion);
+            std::string metallicRoughnessPath = sourcePath(metallicRoughness);
+            if ((!occlusion || !occlusionPath.empty()) && (!metallicRoughness || !metallicRoughnessPath.empty())) {
+                cookedOrmPath = GlorpTextureCooker::cookedOrmPath(occlusionPath, metallicRoughnessPath);
+            }
+            auto bytes = [](const tinygltf::Image *image) {
+                return image ? std::as_bytes(std::span{image->image}) : std::span<const std::byte>{};
+            };
+            addOrm(texture, bytes(occlusion), bytes(metallicRoughness), cookedOrmPath);
+        }
+
+        void build() {
+            // cooked files that exist replace the decode, missing ones fall back to the source image
+            std::vector<PendingTexture *> decodes;
+            for (auto &pending : m_pending) {
+                if (!pending.cookedFile.valid() || !buildCooked(pending)) {
+                    decodes.push_back(&pending);
+                }
+            }
+
+            auto &uploadContext = m_device.getUploadContext();
+            std::vector<GlorpImageDecoder::Job> jobs;
+            std::vector<GlorpUploadContext::StagingRegion> staging;
+            std::vector<std::pair<int, int>> extents;
+            // ORM sources decode into temporaries and are packed into staging afterwards
+            std::vector<std::vector<uint8_t>> packSources;
+            std::vector<std::array<GlorpTextureProcessing::Source, 2>> packInputs(decodes.size());
+            auto decodeInto = [&](std::span<const std::byte> encoded, void *destination, size_t size) {
+                GlorpImageDecoder::Job job{};
+                job.encoded = encoded;
+                job.destination = destination;
+                job.destinationSize = size;
+                jobs.push_back(job);
+            };
+            for (size_t i = 0; i < decodes.size(); i++) {
+                const auto *pending = decodes[i];
+                int width = 0, height = 0;
+                if (pending->packOrm) {
+                    std::span<const std::byte> sources[2] = {pending->occlusion, pending->encoded};
+                    for (int s = 0; s < 2; s++) {
+                        if (sources[s].empty()) {
+                            continue;
+                        }
+                        int sourceWidth, sourceHeight;
+                        if (!GlorpImageDecoder::getInfo(sources[s], sourceWidth, sourceHeight)) {
+                            throw std::runtime_error("Unknown texture image format.");
+                        }
+                        packSources.emplace_back(static_cast<size_t>(sourceWidth) * sourceHeight * 4);
+                        packInputs[i][s] = {packSources.back().data(), static_cast<uint32_t>(sourceWidth), static_cast<uint32_t>(sourceHeight)};
+                        decodeInto(sources[s], packSources.back().data(), packSources.back().size());
+                        width = std::max(width, sourceWidth);
+                        height = std::max(height, sourceHeight);
+                    }
+                } else if (!GlorpImageDecoder::getInfo(pending->encoded, width, height)) {
+                    throw std::runtime_error("Unknown texture image format.");
+                }
+                VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+                staging.push_back(uploadContext.allocateStaging(size));
+                extents.emplace_back(width, height);
+                if (!pending->packOrm) {
+                    decodeInto(pending->encoded, staging.back().mapped, static_cast<size_t>(size));
+                }
+            }
+
+            if (!jobs.empty()) {
+                auto start = std::chrono::high_resolution_clock::now();
+                GlorpImageDecoder::shared().decode(jobs);
+                auto end = std::chrono::high_resolution_clock::now();
+                std::chrono::duration<double> duration = end - start;
+                std::cout << "Decoded " << jobs.size() << " texture images in " << duration.count() << " seconds" << std::endl;
+            }
+
+            for (size_t i = 0; i < decodes.size(); i++) {
+                if (decodes[i]->packOrm) {
+                    GlorpTextureProcessing::packOrm(packInputs[i][0], packInputs[i][1], extents[i].first, extents[i].second,
+                        static_cast<uint8_t *>(staging[i].mapped));
+                }
+                auto texture = track(decodes[i]->key, std::make_shared<GlorpTexture>(
+                    m_device, staging[i], extents[i].first, extents[i].second, uncompressedFormat(decodes[i]->usage)));
+                for (auto *slot : decodes[i]->textures) {
+                    *slot = texture;
+                }
+            }
+            m_pending.clear();
+        }
+
+        // After the upload batch has been submitted. A texture another loader cached meanwhile wins
+        // the cache slot, this object keeps the copy it uploaded itself.
+        void publish() {
+            for (auto &[key, texture] : m_uploaded) {
+                m_cache.insert(key, texture);
+            }
+            for (auto &texture : m_streamed) {
+                m_device.getTextureStreamer().add(texture);
+            }
+            m_uploaded.clear();
+            m_streamed.clear();
+        }
+    private:
+        struct PendingTexture {
+            GlorpTextureCache::Key key;
+            // the metallic roughness image when packing ORM
+            std::span<const std::byte> encoded;
+            std::span<const std::byte> occlusion;
+            bool packOrm;
+            Usage usage;
+            std::vector<std::shared_ptr<GlorpTexture> *> textures;
+            std::future<GlorpFileIo::ReadResult> cookedFile;
+        };
+
+        static GlorpTextureCache::Key makeKey(std::span<const std::byte> encoded, std::span<const std::byte> occlusion, bool packOrm, VkFormat format) {
+            return packOrm ? GlorpTextureCache::makeKey({occlusion, encoded}, format) : GlorpTextureCache::makeKey(encoded, format);
+        }
+
+        // textures uploaded by this batch first, they are not in the cache before publish()
+        std::shared_ptr<GlorpTexture> find(const GlorpTextureCache::Key &key) {
+            for (auto &[uploadedKey, texture] : m_uploaded) {
+                if (uploadedKey == key) {
+                    return texture;
+                }
+            }
+            return m_cache.find(key);
+        }
+
+        std::shared_ptr<GlorpTexture> track(const GlorpTextureCache::Key &key, std::shared_ptr<GlorpTexture> texture) {
+            m_uploaded.emplace_back(key, texture);
+            return texture;
+        }
+
+        // Empty for embedded images and when no base directory is known, those are never cooked
+        std::string sourcePath(const tinygltf::Image *image) const {
+            if (!image || m_baseDir.empty() || image->uri.empty() || image->uri.starts_with("data:")) {
+                return "";
+            }
+            return m_baseDir + image->uri;
+        }
+
+        void enqueue(std::shared_ptr<GlorpTexture> &texture, std::span<const std::byte> encoded, std::span<const std::byte> occlusion,
+            bool packOrm, Usage usage, const std::string &cookedPath) {
+            if (!cookedPath.empty() && m_device.supportsTextureCompressionBC()) {
+                VkFormat format = GlorpKtx2File::blockCompressedFormat(GlorpTextureCooker::formatFor(usage), GlorpTextureCooker::isSrgb(usage));
+                if (auto cached = find(makeKey(encoded, occlusion, packOrm, format))) {
+                    texture = std::move(cached);
+                    return;
+                }
+            }
+            auto key = makeKey(encoded, occlusion, packOrm, uncompressedFormat(usage));
+            if (auto cached = find(key)) {
+                texture = std::move(cached);
+                return;
+            }
+            for (auto &pending : m_pending) {
+                if (pending.key == key) {
+                    pending.textures.push_back(&texture);
+                    return;
+                }
+            }
+
+            PendingTexture pending{key, encoded, occlusion, packOrm, usage, {&texture}};
+            if (!cookedPath.empty()) {
+                pending.cookedFile = GlorpFileIo::shared().readRangeAsync(cookedPath, 0, GlorpKtx2File::HEADER_READ_SIZE, GlorpFileIo::Priority::High);
+            }
+            m_pending.push_back(std::move(pending));
+        }
+
+        // Images tinygltf decoded itself are already RGBA8 pixels and are packed right away
+        void addDecodedOrm(std::shared_ptr<GlorpTexture> &texture, const tinygltf::Image *occlusion, const tinygltf::Image *metallicRoughness) {
+            GlorpTextureProcessing::Source sources[2]{};
+            const tinygltf::Image *images[2] = {occlusion, metallicRoughness};
+            std::vector<uint8_t> decoded[2];
+            uint32_t width = 0, height = 0;
+            for (int i = 0; i < 2; i++) {
+                if (!images[i]) {
+                    continue;
+                }
+                const auto &image = *images[i];
+                if (image.as_is) {
+                    int imageWidth, imageHeight;
+                    GlorpImageDecoder::getInfo(std::as_bytes(std::span{image.image}), imageWidth, imageHeight);
+                    decoded[i].resize(static_cast<size_t>(imageWidth) * imageHeight * 4);
+                    GlorpImageDecoder::Job job{};
+                    job.encoded = std::as_bytes(std::span{image.image});
+                    job.destination = decoded[i].data();
+                    job.destinationSize = decoded[i].size();
+                    GlorpImageDecoder::shared().decode({&job, 1});
+                    sources[i] = {decoded[i].data(), static_cast<uint32_t>(imageWidth), static_cast<uint32_t>(imageHeight)};
+                } else {
+                    if (image.component != 4 || image.bits != 8) {
+                        throw std::runtime_error("ORM packing expects RGBA8 images.");
+                    }
+                    sources[i] = {image.image.data(), static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height)};
+                }
+                width = std::max(width, sources[i].width);
+                height = std::max(height, sources[i].height);
+            }
+
+            auto bytes = [](const tinygltf::Image *image) {
+                return image ? std::as_bytes(std::span{image->image}) : std::span<const std::byte>{};
+            };
+            auto key = makeKey(bytes(metallicRoughness), bytes(occlusion), true, uncompressedFormat(Usage::OcclusionRoughnessMetallic));
+            texture = find(key);
+            if (texture) {
+                return;
+            }
+            auto staging = m_device.getUploadContext().allocateStaging(static_cast<VkDeviceSize>(width) * height * 4);
+            GlorpTextureProcessing::packOrm(sources[0], sources[1], width, height, static_cast<uint8_t *>(staging.mapped));
+            texture = track(key, std::make_shared<GlorpTexture>(m_device, staging, static_cast<int>(width), static_cast<int>(height),
+                uncompressedFormat(Usage::OcclusionRoughnessMetallic)));
+        }
+
+        // Only the coarse levels are read here, the texture streamer fetches the finer ones once the
+        // texture is seen close enough to need them
+        bool buildCooked(PendingTexture &pending) {
+            auto header = pending.cookedFile.get();
+            GlorpKtx2File::Image layout;
+            if (!header.ok() || !GlorpKtx2File::parseHeader(header.data.bytes(), layout)) {
+                return false;
+            }
+            if (GlorpKtx2File::isBlockCompressed(layout.format) && !m_device.supportsTextureCompressionBC()) {
+                return false;
+            }
+            uint32_t baseLevel = GlorpTextureStreamer::initialBaseLevel(layout);
+            size_t offset, size;
+            GlorpKtx2File::levelRange(layout, baseLevel, offset, size);
+            auto levels = GlorpFileIo::shared().readRangeAsync(header.path, offset, size, GlorpFileIo::Priority::High).get();
+            if (!levels.ok() || levels.data.size() != size) {
+                return false;
+            }
+            std::cout << "Loaded cooked texture: " << header.path << " from level " << baseLevel << std::endl;
+            // keyed by the format actually in the file, which may differ from what the usage asks for
+            auto key = makeKey(pending.encoded, pending.occlusion, pending.packOrm, layout.format);
+            auto texture = track(key, std::make_shared<GlorpTexture>(m_device, header.path, layout, baseLevel, levels.data.bytes()));
+            // the streamer records finer levels on its own batches, which must not overtake this one
+            m_streamed.push_back(texture);
+            for (auto *slot : pending.textures) {
+                *slot = texture;
+            }
+            return true;
+        }
+
+        GlorpDevice &m_device;
+        GlorpTextureCache &m_cache;
+        std::string m_baseDir;
+        std::vector<PendingTexture> m_pending;
+        std::vector<std::pair<GlorpTextureCache::Key, std::shared_ptr<GlorpTexture>>> m_uploaded;
+        std::vector<std::shared_ptr<GlorpTexture>> m_streamed;
+};
+}
+
+void GlorpGameObject::assembleGameObject(GlorpDevice &device, GlorpGameObject &gameObject, tinygltf::Model &gltfModel, const std::string &baseDir) {
+    // Mesh and every texture of the object go out in a single submission
+    auto &uploadContext = device.getUploadContext();
+    uploadContext.beginBatch();
+
     gameObject.model = GlorpModel::createModelFromGLTF(device, gltfModel);
     //TODO:: Add more error checking for missing emmision for example.
     auto materialComponent = std::make_unique<MaterialComponent>();
+    TextureBatch textures{device, baseDir};
     for (const auto& material : gltfModel.materials) {
         // Handle baseColorTexture
         if (material.values.find("baseColorTexture") != material.values.end()) {
@@ -134,46 +536,104 @@ void GlorpGameObject::assembleGameObject(GlorpDevice &device, GlorpGameObject &g
             if(baseColorTexture.TextureIndex() >= 0) {
                 const tinygltf::Texture& texture = gltfModel.textures[baseColorTexture.TextureIndex()];
                 const tinygltf::Image& image = gltfModel.images[texture.source];
-                materialComponent->albedoTexture = std::make_shared<GlorpTexture>(device, image);
+                textures.add(materialComponent->albedoTexture, image, TextureBatch::Usage::Color);
             }
         }
 
-        // Handle metallic roughness 
-        for (const auto&material : gltfModel.materials) {
-            if(material.values.find("metallicRoughnessTexture") != material.values.end()) {
-                std::cout << "Found metallic roughness texture" << std::endl;
-                const auto& metallicRoughnessTexture = material.values.at("metallicRoughnessTexture");
-                if(metallicRoughnessTexture.TextureIndex() >= 0) {
-                    const tinygltf::Texture& texture = gltfModel.textures[metallicRoughnessTexture.TextureIndex()];
-                    const tinygltf::Image& image = gltfModel.images[texture.source];
-                    materialComponent->metallicRoughnessTexture = std::make_shared<GlorpTexture>(device, image);
-            }   
+        // Handle metallic roughness and occlusion, packed into one ORM texture
+        const tinygltf::Image *metallicRoughnessImage = nullptr;
+        if (material.values.find("metallicRoughnessTexture") != material.values.end()) {
+            std::cout << "Found metallic roughness texture" << std::endl;
+            const auto& metallicRoughnessTexture = material.values.at("metallicRoughnessTexture");
+            if(metallicRoughnessTexture.TextureIndex() >= 0) {
+                const tinygltf::Texture& texture = gltfModel.textures[metallicRoughnessTexture.TextureIndex()];
+                metallicRoughnessImage = &gltfModel.images[texture.source];
             }
         }
-
-
-        // Handle occlusionTexture
-        {
+        const tinygltf::Image *occlusionImage = nullptr;
+        if (material.occlusionTexture.index >= 0) {
             const tinygltf::Texture& texture = gltfModel.textures[material.occlusionTexture.index];
-            const tinygltf::Image& image = gltfModel.images[texture.source];
-            materialComponent->aoTexture = std::make_shared<GlorpTexture>(device, image);
+            occlusionImage = &gltfModel.images[texture.source];
         }
+        textures.addOrm(materialComponent->ormTexture, occlusionImage, metallicRoughnessImage);
+        materialComponent->hasOcclusion = occlusionImage != nullptr;
 
         // Handle emissiveTexture
-        {
+        if (material.emissiveTexture.index >= 0) {
             const tinygltf::Texture& texture = gltfModel.textures[material.emissiveTexture.index];
             const tinygltf::Image& image = gltfModel.images[texture.source];
-            materialComponent->emissiveTexture = std::make_shared<GlorpTexture>(device, image);
+            textures.add(materialComponent->emissiveTexture, image, TextureBatch::Usage::Color);
         }
 
         // Handle normalTexture
-        {
+        if (material.normalTexture.index >= 0) {
             const tinygltf::Texture& texture = gltfModel.textures[material.normalTexture.index];
             const tinygltf::Image& image = gltfModel.images[texture.source];
-            materialComponent->normalTexture = std::make_shared<GlorpTexture>(device, image);
+            textures.add(materialComponent->normalTexture, image, TextureBatch::Usage::Normal);
+        }
+
+        if (material.alphaMode != "OPAQUE") {
+            materialComponent->alphaMode = MaterialComponent::AlphaMode::Mask;
+            materialComponent->alphaCutoff = material.alphaMode == "MASK" ? static_cast<float>(material.alphaCutoff) : 0.5f;
         }
     }
+    textures.build();
     gameObject.material = std::move(materialComponent);
+
+    uploadContext.endBatch();
+    textures.publish();
+}
+
+static std::span<const std::byte> textureImageFromGLB(const GlorpGlbFile &glbFile, const nlohmann::json &textureInfo) {
+    const auto &json = glbFile.json();
+    size_t textureIndex = textureInfo.at("index").get<size_t>();
+    size_t imageIndex = json.at("textures").at(textureIndex).at("source").get<size_t>();
+    return glbFile.image(imageIndex);
+}
+
+void GlorpGameObject::assembleGameObject(GlorpDevice &device, GlorpGameObject &gameObject, const GlorpGlbFile &glbFile) {
+    auto &uploadContext = device.getUploadContext();
+    uploadContext.beginBatch();
+
+    gameObject.model = GlorpModel::createModelFromGLB(device, glbFile);
+    auto materialComponent = std::make_unique<MaterialComponent>();
+    TextureBatch textures{device};
+    const auto &json = glbFile.json();
+    for (const auto &material : json.value("materials", nlohmann::json::array())) {
+        std::span<const std::byte> metallicRoughness;
+        if (material.contains("pbrMetallicRoughness")) {
+            const auto &pbr = material.at("pbrMetallicRoughness");
+            if (pbr.contains("baseColorTexture")) {
+                textures.add(materialComponent->albedoTexture, textureImageFromGLB(glbFile, pbr.at("baseColorTexture")), TextureBatch::Usage::Color);
+            }
+            if (pbr.contains("metallicRoughnessTexture")) {
+                metallicRoughness = textureImageFromGLB(glbFile, pbr.at("metallicRoughnessTexture"));
+            }
+        }
+        std::span<const std::byte> occlusion;
+        if (material.contains("occlusionTexture")) {
+            occlusion = textureImageFromGLB(glbFile, material.at("occlusionTexture"));
+        }
+        textures.addOrm(materialComponent->ormTexture, occlusion, metallicRoughness);
+        materialComponent->hasOcclusion = !occlusion.empty();
+        if (material.contains("emissiveTexture")) {
+            textures.add(materialComponent->emissiveTexture, textureImageFromGLB(glbFile, material.at("emissiveTexture")), TextureBatch::Usage::Color);
+        }
+        if (material.contains("normalTexture")) {
+            textures.add(materialComponent->normalTexture, textureImageFromGLB(glbFile, material.at("normalTexture")), TextureBatch::Usage::Normal);
+        }
+
+        std::string alphaMode = material.value("alphaMode", "OPAQUE");
+        if (alphaMode != "OPAQUE") {
+            materialComponent->alphaMode = MaterialComponent::AlphaMode::Mask;
+            materialComponent->alphaCutoff = alphaMode == "MASK" ? material.value("alphaCutoff", 0.5f) : 0.5f;
+        }
+    }
+    textures.build();
+    gameObject.material = std::move(materialComponent);
+
+    uploadContext.endBatch();
+    textures.publish();
 }
 
 GlorpGameObject GlorpGameObject::makePointLight(float intensity, float radius, glm::vec3 color) {
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "glorp_model.hpp"
+#include "glorp_swap_chain.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include "glorp_texture.hpp"
+#include <array>
+#include <atomic>
+#include <future>
 #include <memory>
 #include <unordered_map>
 
@@ -12,6 +16,9 @@
 #endif
 
 namespace Glorp {
+class GlorpAssetStreamer;
+class GlorpVirtualTexture;
+
 struct TransformComponent {
     glm::vec3 translation {};
     glm::vec3 scale{1.f, 1.f, 1.f};
@@ -23,14 +30,29 @@ struct TransformComponent {
 
 struct PointLightComponent {
     float lightIntensity = 1.0f;
+    // distance at which the light fades out, lights are only shaded within the clusters it reaches
+    float range = 10.f;
 };
 
 struct MaterialComponent {
+    enum class AlphaMode : uint32_t {
+        Opaque,
+        // glTF BLEND materials are drawn as masked too, there is no sorted transparent pass
+        Mask
+    };
+
+    // any texture may be null, the shader variant of the material then skips it
     std::shared_ptr<GlorpTexture> albedoTexture;
-    std::shared_ptr<GlorpTexture> aoTexture;
     std::shared_ptr<GlorpTexture> emissiveTexture;
     std::shared_ptr<GlorpTexture> normalTexture;
-    std::shared_ptr<GlorpTexture> metallicRoughnessTexture;
+    // occlusion in R, roughness in G, metalness in B
+    std::shared_ptr<GlorpTexture> ormTexture;
+    // sampled instead of albedoTexture when set, for textures too large to keep resident
+    std::shared_ptr<GlorpVirtualTexture> virtualAlbedo;
+    // whether the red channel of ormTexture holds occlusion
+    bool hasOcclusion = false;
+    AlphaMode alphaMode = AlphaMode::Opaque;
+    float alphaCutoff = 0.5f;
 };
 
 class GlorpGameObject {
@@ -38,14 +60,24 @@ class GlorpGameObject {
     using id_t = unsigned int;
     using Map = std::unordered_map<id_t, GlorpGameObject>;
 
+    // Query draws the object only while its bounding box passed a recent hardware occlusion query, which
+    // pays off for large, expensive objects, see GlorpOcclusionQueries
+    enum class OcclusionPolicy {
+        Always,
+        Query
+    };
+
     static GlorpGameObject createGameObject() {
-        static id_t currentId = 0;
+        // objects are also created on asset streaming workers
+        static std::atomic<id_t> currentId = 0;
         return GlorpGameObject(currentId++);
     }
 
     static GlorpGameObject createGameObjectFromAscii(GlorpDevice &device, const std::string &filepath);
     static GlorpGameObject createGameObjectFromBin(GlorpDevice &device, const std::string &filepath);
-    static void loadBinaryGLTF(tinygltf::Model &model, const std::string &filepath);
+    // Parsing and uploads run on the streamer's workers, the future is ready once the object is resident on the GPU
+    static std::future<GlorpGameObject> createGameObjectFromAsciiAsync(GlorpAssetStreamer &streamer, const std::string &filepath);
+    static std::future<GlorpGameObject> createGameObjectFromBinAsync(GlorpAssetStreamer &streamer, const std::string &filepath);
     static void loadAsciiGLTF(tinygltf::Model &model, const std::string &filepath);
 
     GlorpGameObject(const GlorpGameObject&) = delete;
@@ -61,14 +93,18 @@ class GlorpGameObject {
 
     glm::vec3 color;
     TransformComponent transform {};
-    VkDescriptorSet descriptorSet;
+    // one material set per frame in flight, so a set can be rewritten while older frames still read theirs
+    std::array<VkDescriptorSet, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> descriptorSets{};
 
     std::shared_ptr<GlorpModel> model;
     std::unique_ptr<PointLightComponent> pointLight = nullptr;
     std::unique_ptr<MaterialComponent> material = nullptr;
+    OcclusionPolicy occlusionPolicy = OcclusionPolicy::Always;
     private:
         GlorpGameObject(id_t objId) : id {objId} {};
-        static void assembleGameObject(GlorpDevice &device, GlorpGameObject &gameObject, tinygltf::Model &gltfModel);
+        // baseDir locates cooked textures next to the source images
+        static void assembleGameObject(GlorpDevice &device, GlorpGameObject &gameObject, tinygltf::Model &gltfModel, const std::string &baseDir);
+        static void assembleGameObject(GlorpDevice &device, GlorpGameObject &gameObject, const GlorpGlbFile &glbFile);
         id_t id;
 
 };
@@ -0,0 +1,238 @@
+#include "glorp_glb_file.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Glorp {
+
+static constexpr uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+static constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;  // "JSON"
+static constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;   // "BIN\0"
+static constexpr size_t GLB_HEADER_SIZE = 12;
+static constexpr size_t GLB_CHUNK_HEADER_SIZE = 8;
+
+static uint32_t readU32(const std::byte *data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static int componentCountForType(const std::string &type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
+    throw std::runtime_error("Unknown accessor type: " + type);
+}
+
+// offset + length <= size, without offset + length wrapping around first
+static bool fitsIn(size_t offset, size_t length, size_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+static size_t componentSize(int componentType) {
+    switch (componentType) {
+        case GlorpGlbFile::COMPONENT_TYPE_BYTE:
+        case GlorpGlbFile::COMPONENT_TYPE_UNSIGNED_BYTE:
+            return 1;
+        case GlorpGlbFile::COMPONENT_TYPE_SHORT:
+        case GlorpGlbFile::COMPONENT_TYPE_UNSIGNED_SHORT:
+            return 2;
+        case GlorpGlbFile::COMPONENT_TYPE_UNSIGNED_INT:
+        case GlorpGlbFile::COMPONENT_TYPE_FLOAT:
+            return 4;
+        default:
+            throw std::runtime_error("Unknown accessor component type");
+    }
+}
+
+GlorpGlbFile::GlorpGlbFile(const std::string &filepath) {
+    map(filepath);
+    try {
+        parseChunks(filepath);
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+GlorpGlbFile::~GlorpGlbFile() {
+    unmap();
+}
+
+#ifdef _WIN32
+void GlorpGlbFile::map(const std::string &filepath) {
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open glb file: " + filepath);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to read size of glb file: " + filepath);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map glb file: " + filepath);
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map glb file: " + filepath);
+    }
+
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+    m_data = static_cast<const std::byte *>(view);
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+}
+
+void GlorpGlbFile::unmap() {
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mappingHandle);
+        CloseHandle(m_fileHandle);
+        m_data = nullptr;
+    }
+}
+#else
+void GlorpGlbFile::map(const std::string &filepath) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open glb file: " + filepath);
+    }
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Failed to read size of glb file: " + filepath);
+    }
+    void *mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map glb file: " + filepath);
+    }
+    // the whole file is consumed front to back right after this
+    madvise(mapping, static_cast<size_t>(fileStat.st_size), MADV_WILLNEED);
+
+    m_data = static_cast<const std::byte *>(mapping);
+    m_size = static_cast<size_t>(fileStat.st_size);
+}
+
+void GlorpGlbFile::unmap() {
+    if (m_data != nullptr) {
+        munmap(const_cast<std::byte *>(m_data), m_size);
+        m_data = nullptr;
+    }
+}
+#endif
+
+void GlorpGlbFile::parseChunks(const std::string &filepath) {
+    if (m_size < GLB_HEADER_SIZE || readU32(m_data) != GLB_MAGIC) {
+        throw std::runtime_error("Not a binary glTF file: " + filepath);
+    }
+    if (readU32(m_data + 4) != 2) {
+        throw std::runtime_error("Unsupported glb version in: " + filepath);
+    }
+    size_t length = readU32(m_data + 8);
+    if (length > m_size) {
+        throw std::runtime_error("Truncated glb file: " + filepath);
+    }
+
+    bool hasJson = false;
+    size_t offset = GLB_HEADER_SIZE;
+    while (offset + GLB_CHUNK_HEADER_SIZE <= length) {
+        size_t chunkLength = readU32(m_data + offset);
+        uint32_t chunkType = readU32(m_data + offset + 4);
+        const std::byte *chunkData = m_data + offset + GLB_CHUNK_HEADER_SIZE;
+        if (offset + GLB_CHUNK_HEADER_SIZE + chunkLength > length) {
+            throw std::runtime_error("Corrupt glb chunk in: " + filepath);
+        }
+
+        if (chunkType == GLB_CHUNK_JSON && !hasJson) {
+            const char *json = reinterpret_cast<const char *>(chunkData);
+            m_json = nlohmann::json::parse(json, json + chunkLength);
+            hasJson = true;
+        } else if (chunkType == GLB_CHUNK_BIN && m_binaryChunk.empty()) {
+            m_binaryChunk = {chunkData, chunkLength};
+        }
+        // chunks are 4 byte aligned, unknown chunk types are skipped
+        offset += GLB_CHUNK_HEADER_SIZE + ((chunkLength + 3) & ~size_t(3));
+    }
+
+    if (!hasJson) {
+        throw std::runtime_error("glb file has no JSON chunk: " + filepath);
+    }
+}
+
+std::span<const std::byte> GlorpGlbFile::bufferView(size_t index) const {
+    const auto &view = m_json.at("bufferViews").at(index);
+    if (view.value("buffer", 0) != 0 || m_json.at("buffers").at(0).contains("uri")) {
+        throw std::runtime_error("Only buffer views into the glb BIN chunk are supported");
+    }
+    size_t byteOffset = view.value("byteOffset", size_t(0));
+    size_t byteLength = view.at("byteLength").get<size_t>();
+    if (!fitsIn(byteOffset, byteLength, m_binaryChunk.size())) {
+        throw std::runtime_error("Buffer view out of range of the glb BIN chunk");
+    }
+    return m_binaryChunk.subspan(byteOffset, byteLength);
+}
+
+GlorpGlbFile::Accessor GlorpGlbFile::accessor(size_t index) const {
+    const auto &json = m_json.at("accessors").at(index);
+    if (!json.contains("bufferView")) {
+        throw std::runtime_error("Sparse or zero-initialised accessors are not supported");
+    }
+
+    Accessor result{};
+    result.count = json.at("count").get<size_t>();
+    result.componentType = json.at("componentType").get<int>();
+    result.componentCount = componentCountForType(json.at("type").get<std::string>());
+
+    size_t viewIndex = json.at("bufferView").get<size_t>();
+    size_t elementSize = componentSize(result.componentType) * result.componentCount;
+    result.stride = m_json.at("bufferViews").at(viewIndex).value("byteStride", elementSize);
+    // readers step through the elements tightly packed or at the stride, both have to stay inside the view
+    if (result.stride < elementSize) {
+        throw std::runtime_error("Accessor stride is smaller than its elements");
+    }
+
+    auto view = bufferView(viewIndex);
+    size_t byteOffset = json.value("byteOffset", size_t(0));
+    if (byteOffset > view.size() || (result.count > 0 && (result.count - 1 > (view.size() - byteOffset) / result.stride))) {
+        throw std::runtime_error("Accessor out of range of its buffer view");
+    }
+    size_t byteLength = result.count == 0 ? 0 : result.stride * (result.count - 1) + elementSize;
+    if (!fitsIn(byteOffset, byteLength, view.size())) {
+        throw std::runtime_error("Accessor out of range of its buffer view");
+    }
+    result.data = view.subspan(byteOffset, byteLength);
+    return result;
+}
+
+std::span<const std::byte> GlorpGlbFile::image(size_t index) const {
+    const auto &json = m_json.at("images").at(index);
+    if (!json.contains("bufferView")) {
+        throw std::runtime_error("Only images embedded in the glb BIN chunk are supported");
+    }
+    return bufferView(json.at("bufferView").get<size_t>());
+}
+
+}
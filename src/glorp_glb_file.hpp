@@ -0,0 +1,60 @@
+#pragma once
+
+#include "json.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace Glorp {
+
+// Read-only view of a binary glTF (.glb) file. The file is memory mapped and only the JSON chunk
+// is parsed; accessor, buffer view and image data are handed out as spans into the mapping so the
+// BIN chunk is never copied.
+class GlorpGlbFile {
+    public:
+        static constexpr int COMPONENT_TYPE_BYTE = 5120;
+        static constexpr int COMPONENT_TYPE_UNSIGNED_BYTE = 5121;
+        static constexpr int COMPONENT_TYPE_SHORT = 5122;
+        static constexpr int COMPONENT_TYPE_UNSIGNED_SHORT = 5123;
+        static constexpr int COMPONENT_TYPE_UNSIGNED_INT = 5125;
+        static constexpr int COMPONENT_TYPE_FLOAT = 5126;
+
+        struct Accessor {
+            std::span<const std::byte> data;
+            size_t count = 0;
+            size_t stride = 0;
+            int componentType = 0;
+            int componentCount = 0;
+        };
+
+        explicit GlorpGlbFile(const std::string &filepath);
+        ~GlorpGlbFile();
+
+        GlorpGlbFile(const GlorpGlbFile&) = delete;
+        GlorpGlbFile &operator=(const GlorpGlbFile&) = delete;
+
+        const nlohmann::json &json() const { return m_json; }
+        std::span<const std::byte> binaryChunk() const { return m_binaryChunk; }
+
+        std::span<const std::byte> bufferView(size_t index) const;
+        Accessor accessor(size_t index) const;
+        // Encoded (png/jpeg) bytes of an image stored in the BIN chunk
+        std::span<const std::byte> image(size_t index) const;
+    private:
+        void map(const std::string &filepath);
+        void unmap();
+        void parseChunks(const std::string &filepath);
+    private:
+        const std::byte *m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void *m_fileHandle = nullptr;
+        void *m_mappingHandle = nullptr;
+#endif
+
+        nlohmann::json m_json;
+        std::span<const std::byte> m_binaryChunk;
+};
+}
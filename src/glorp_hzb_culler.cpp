@@ -0,0 +1,442 @@
+#include "glorp_hzb_culler.hpp"
+
+#include "glorp_file_io.hpp"
+#include "glorp_model.hpp"
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_sampler_cache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace Glorp {
+
+namespace {
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+constexpr uint32_t REDUCE_GROUP_SIZE = 8;
+// room for a VkDrawIndexedIndirectCommand, a VkDrawIndirectCommand uses the first four words
+constexpr VkDeviceSize DRAW_COMMAND_SIZE = sizeof(VkDrawIndexedIndirectCommand);
+
+// std430 layout of the cull shader's Object
+struct ObjectData {
+    glm::mat4 model{1.f};
+    glm::vec4 boundsMin{0.f};
+    glm::vec4 boundsMax{0.f};
+    // x index or vertex count, y 1 while the slot holds an object
+    glm::uvec4 draw{0};
+};
+
+struct ReducePushConstants {
+    glm::ivec2 sourceSize;
+    glm::ivec2 destinationSize;
+    uint32_t sampleCount;
+};
+
+struct CullPushConstants {
+    glm::mat4 viewProjection;
+    uint32_t objectCount;
+    uint32_t phase;
+    uint32_t levelCount;
+    uint32_t padding;
+    glm::vec2 depthSize;
+};
+
+VkPipeline createComputePipeline(GlorpDevice &device, VkPipelineLayout layout, const std::string &shaderPath) {
+    auto code = GlorpFileIo::shared().readFile(shaderPath);
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+    VkShaderModule module;
+    if (vkCreateShaderModule(device.device(), &moduleInfo, nullptr, &module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create HZB shader module");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = layout;
+    auto &pipelineCache = device.getPipelineCache();
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(device.device(), pipelineCache.getCache(), 1, &pipelineInfo, nullptr, &pipeline);
+    pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+    vkDestroyShaderModule(device.device(), module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create HZB pipeline");
+    }
+    return pipeline;
+}
+
+VkPipelineLayout createPipelineLayout(GlorpDevice &device, VkDescriptorSetLayout setLayout, uint32_t pushConstantSize) {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create HZB pipeline layout");
+    }
+    return layout;
+}
+
+void computeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+}
+
+GlorpHzbCuller::GlorpHzbCuller(GlorpDevice &device) : m_glorpDevice{device} {
+    auto indices = m_glorpDevice.findPhysicalQueueFamilies();
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_glorpDevice.getPhysicalDevice(), &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_glorpDevice.getPhysicalDevice(), &familyCount, families.data());
+    // the passes around the culling are recorded into the frame's graphics command buffer
+    m_supported = (families[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    if (!m_supported) {
+        return;
+    }
+
+    m_slotObjects.resize(MAX_OBJECTS);
+    m_slotFrames.resize(MAX_OBJECTS, 0);
+    createDescriptors();
+    createPipelines();
+    createBuffers();
+}
+
+GlorpHzbCuller::~GlorpHzbCuller() {
+    destroyHzb();
+    vkDestroyPipeline(m_glorpDevice.device(), m_cullPipeline, nullptr);
+    vkDestroyPipeline(m_glorpDevice.device(), m_reducePipeline, nullptr);
+    vkDestroyPipeline(m_glorpDevice.device(), m_depthReducePipeline, nullptr);
+    vkDestroyPipelineLayout(m_glorpDevice.device(), m_cullPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(m_glorpDevice.device(), m_reducePipelineLayout, nullptr);
+}
+
+void GlorpHzbCuller::createDescriptors() {
+    m_reduceSetLayout = GlorpDescriptorSetLayout::Builder(m_glorpDevice)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+        .build();
+    m_cullSetLayout = GlorpDescriptorSetLayout::Builder(m_glorpDevice)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .build();
+
+    // one reduce set per level past the first, the first level reads a different depth attachment each frame
+    constexpr uint32_t frames = GlorpSwapChain::MAX_FRAMES_IN_FLIGHT;
+    m_descriptorPool = GlorpDescriptorPool::Builder(m_glorpDevice)
+        .setMaxSets(2 * frames + MAX_LEVELS)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * frames + MAX_LEVELS)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, frames + MAX_LEVELS)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * frames)
+        .build();
+    m_reduceSets.resize(MAX_LEVELS);
+    bool allocated = true;
+    for (uint32_t i = 0; i < frames; i++) {
+        allocated &= m_descriptorPool->allocateDescriptor(m_cullSetLayout->getDescriptorSetLayout(), m_cullSets[i]);
+        allocated &= m_descriptorPool->allocateDescriptor(m_reduceSetLayout->getDescriptorSetLayout(), m_depthReduceSets[i]);
+    }
+    for (auto &set : m_reduceSets) {
+        allocated &= m_descriptorPool->allocateDescriptor(m_reduceSetLayout->getDescriptorSetLayout(), set);
+    }
+    if (!allocated) {
+        throw std::runtime_error("Failed to allocate HZB descriptor sets");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    m_sampler = m_glorpDevice.getSamplerCache().getSampler(samplerInfo);
+}
+
+void GlorpHzbCuller::createPipelines() {
+    m_reducePipelineLayout = createPipelineLayout(m_glorpDevice, m_reduceSetLayout->getDescriptorSetLayout(), sizeof(ReducePushConstants));
+    m_cullPipelineLayout = createPipelineLayout(m_glorpDevice, m_cullSetLayout->getDescriptorSetLayout(), sizeof(CullPushConstants));
+
+    const std::string shaders = std::string(RESOURCE_LOCATIONS) + "shaders/";
+    bool multisampled = m_glorpDevice.getSupportedSampleCount() != VK_SAMPLE_COUNT_1_BIT;
+    m_depthReducePipeline = createComputePipeline(m_glorpDevice, m_reducePipelineLayout,
+        shaders + (multisampled ? "hzb_reduce_ms.comp.spv" : "hzb_reduce.comp.spv"));
+    m_reducePipeline = createComputePipeline(m_glorpDevice, m_reducePipelineLayout, shaders + "hzb_reduce.comp.spv");
+    m_cullPipeline = createComputePipeline(m_glorpDevice, m_cullPipelineLayout, shaders + "hzb_cull.comp.spv");
+}
+
+void GlorpHzbCuller::createBuffers() {
+    for (int i = 0; i < GlorpSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        m_objectBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(ObjectData), MAX_OBJECTS,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_objectBuffers[i]->map();
+        std::memset(m_objectBuffers[i]->getMappedMemory(), 0, m_objectBuffers[i]->getBufferSize());
+        m_earlyDrawBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, DRAW_COMMAND_SIZE, MAX_OBJECTS,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        m_lateDrawBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, DRAW_COMMAND_SIZE, MAX_OBJECTS,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        m_statsBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(Stats), 1,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_statsBuffers[i]->map();
+        std::memset(m_statsBuffers[i]->getMappedMemory(), 0, sizeof(Stats));
+    }
+    m_visibilityBuffer = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(uint32_t), MAX_OBJECTS,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void GlorpHzbCuller::createHzb(VkExtent2D extent) {
+    if (m_hzbImage != VK_NULL_HANDLE) {
+        // the previous frame may still be reading it
+        m_glorpDevice.waitIdle();
+        destroyHzb();
+    }
+    m_extent = extent;
+    // Half the depth's resolution rounded up to powers of two, so every level halves exactly and
+    // texel x of level n covers depth pixels [x, x + 1) * 2^(n + 1)
+    m_hzbExtent = {std::bit_ceil(std::max((extent.width + 1) / 2, 1u)), std::bit_ceil(std::max((extent.height + 1) / 2, 1u))};
+    m_levelCount = std::min(static_cast<uint32_t>(std::bit_width(std::max(m_hzbExtent.width, m_hzbExtent.height))), MAX_LEVELS);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {m_hzbExtent.width, m_hzbExtent.height, 1};
+    imageInfo.mipLevels = m_levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    m_glorpDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_hzbImage, m_hzbMemory);
+
+    auto createView = [&](uint32_t baseLevel, uint32_t levelCount) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_hzbImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1};
+        VkImageView view;
+        if (vkCreateImageView(m_glorpDevice.device(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create HZB image view");
+        }
+        return view;
+    };
+    m_hzbView = createView(0, m_levelCount);
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        m_levelViews.push_back(createView(level, 1));
+    }
+    m_hzbInitialized = false;
+
+    // the HZB stays in GENERAL, written as storage image and read as sampled image
+    for (uint32_t level = 1; level < m_levelCount; level++) {
+        VkDescriptorImageInfo sourceInfo{m_sampler, m_levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL};
+        VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, m_levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+        GlorpDescriptorWriter(*m_reduceSetLayout, *m_descriptorPool)
+            .writeImage(0, &sourceInfo)
+            .writeImage(1, &destinationInfo)
+            .overwrite(m_reduceSets[level]);
+    }
+    VkDescriptorImageInfo hzbInfo{m_sampler, m_hzbView, VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorImageInfo levelZeroInfo{VK_NULL_HANDLE, m_levelViews[0], VK_IMAGE_LAYOUT_GENERAL};
+    for (int i = 0; i < GlorpSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        auto objectsInfo = m_objectBuffers[i]->descriptorInfo();
+        auto visibilityInfo = m_visibilityBuffer->descriptorInfo();
+        auto earlyInfo = m_earlyDrawBuffers[i]->descriptorInfo();
+        auto lateInfo = m_lateDrawBuffers[i]->descriptorInfo();
+        auto statsInfo = m_statsBuffers[i]->descriptorInfo();
+        GlorpDescriptorWriter(*m_cullSetLayout, *m_descriptorPool)
+            .writeBuffer(0, &objectsInfo)
+            .writeBuffer(1, &visibilityInfo)
+            .writeBuffer(2, &earlyInfo)
+            .writeBuffer(3, &lateInfo)
+            .writeBuffer(4, &statsInfo)
+            .writeImage(5, &hzbInfo)
+            .overwrite(m_cullSets[i]);
+        GlorpDescriptorWriter(*m_reduceSetLayout, *m_descriptorPool)
+            .writeImage(1, &levelZeroInfo)
+            .overwrite(m_depthReduceSets[i]);
+    }
+}
+
+void GlorpHzbCuller::destroyHzb() {
+    for (VkImageView view : m_levelViews) {
+        vkDestroyImageView(m_glorpDevice.device(), view, nullptr);
+    }
+    m_levelViews.clear();
+    vkDestroyImageView(m_glorpDevice.device(), m_hzbView, nullptr);
+    vkDestroyImage(m_glorpDevice.device(), m_hzbImage, nullptr);
+    vkFreeMemory(m_glorpDevice.device(), m_hzbMemory, nullptr);
+    m_hzbView = VK_NULL_HANDLE;
+    m_hzbImage = VK_NULL_HANDLE;
+    m_hzbMemory = VK_NULL_HANDLE;
+}
+
+uint32_t GlorpHzbCuller::acquireSlot(GlorpGameObject::id_t id) {
+    auto it = m_slots.find(id);
+    if (it != m_slots.end()) {
+        return it->second;
+    }
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else if (m_slotCount < MAX_OBJECTS) {
+        slot = m_slotCount++;
+    } else {
+        return INVALID_SLOT;
+    }
+    m_slots.emplace(id, slot);
+    m_slotObjects[slot] = id;
+    return slot;
+}
+
+void GlorpHzbCuller::beginFrame(VkCommandBuffer commandBuffer, int frameIndex, const GlorpCamera &camera, VkExtent2D extent, GlorpGameObject::Map &objects) {
+    m_phase = Phase::Early;
+    m_frame++;
+    if (extent.width != m_extent.width || extent.height != m_extent.height) {
+        createHzb(extent);
+    }
+    // this frame slot's fence has been waited on, so the counts it last wrote are complete
+    std::memcpy(&m_stats, m_statsBuffers[frameIndex]->getMappedMemory(), sizeof(Stats));
+    m_viewProjection = camera.getProjection() * camera.getView();
+
+    auto *objectData = static_cast<ObjectData *>(m_objectBuffers[frameIndex]->getMappedMemory());
+    for (auto &kv : objects) {
+        auto &obj = kv.second;
+        if (obj.model == nullptr) continue;
+        uint32_t slot = acquireSlot(kv.first);
+        if (slot == INVALID_SLOT) continue;
+
+        m_slotFrames[slot] = m_frame;
+        objectData[slot].model = obj.transform.mat4();
+        objectData[slot].boundsMin = glm::vec4(obj.model->getBoundsMin(), 0.f);
+        objectData[slot].boundsMax = glm::vec4(obj.model->getBoundsMax(), 0.f);
+        objectData[slot].draw = {obj.model->getDrawCount(), 1, 0, 0};
+    }
+    // slots of objects that left the scene are recycled from the next frame on, they draw nothing meanwhile
+    for (uint32_t slot = 0; slot < m_slotCount; slot++) {
+        if (m_slotFrames[slot] == m_frame) continue;
+        if (m_slotFrames[slot] != 0) {
+            m_slots.erase(m_slotObjects[slot]);
+            m_freeSlots.push_back(slot);
+            m_slotFrames[slot] = 0;
+        }
+        objectData[slot] = {};
+    }
+
+    vkCmdFillBuffer(commandBuffer, m_statsBuffers[frameIndex]->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+    if (!m_visibilityCleared) {
+        // nothing has been tested yet, everything starts out visible
+        vkCmdFillBuffer(commandBuffer, m_visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 1);
+        m_visibilityCleared = true;
+    }
+    if (!m_hzbInitialized) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_hzbImage;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_levelCount, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+        m_hzbInitialized = true;
+    }
+    // the fills above and the visibility the previous frame's late cull wrote
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    dispatchCull(commandBuffer, frameIndex, Phase::Early);
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void GlorpHzbCuller::cullLate(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthView) {
+    m_phase = Phase::Late;
+
+    // the first level reads the depth attachment, every sample of it with MSAA
+    VkDescriptorImageInfo depthInfo{m_sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    GlorpDescriptorWriter(*m_reduceSetLayout, *m_descriptorPool)
+        .writeImage(0, &depthInfo)
+        .overwrite(m_depthReduceSets[frameIndex]);
+
+    glm::ivec2 sourceSize{static_cast<int>(m_extent.width), static_cast<int>(m_extent.height)};
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        glm::ivec2 destinationSize{static_cast<int>(std::max(m_hzbExtent.width >> level, 1u)), static_cast<int>(std::max(m_hzbExtent.height >> level, 1u))};
+        ReducePushConstants push{sourceSize, destinationSize, static_cast<uint32_t>(m_glorpDevice.getSupportedSampleCount())};
+        VkDescriptorSet set = level == 0 ? m_depthReduceSets[frameIndex] : m_reduceSets[level];
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, level == 0 ? m_depthReducePipeline : m_reducePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipelineLayout, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_reducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReducePushConstants), &push);
+        vkCmdDispatch(commandBuffer, (destinationSize.x + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+            (destinationSize.y + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+        computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        sourceSize = destinationSize;
+    }
+
+    dispatchCull(commandBuffer, frameIndex, Phase::Late);
+    computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+}
+
+void GlorpHzbCuller::dispatchCull(VkCommandBuffer commandBuffer, int frameIndex, Phase phase) {
+    if (m_slotCount == 0) {
+        return;
+    }
+    CullPushConstants push{};
+    push.viewProjection = m_viewProjection;
+    push.objectCount = m_slotCount;
+    push.phase = phase == Phase::Early ? 0 : 1;
+    push.levelCount = m_levelCount;
+    push.depthSize = {static_cast<float>(m_extent.width), static_cast<float>(m_extent.height)};
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 1, &m_cullSets[frameIndex], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push);
+    vkCmdDispatch(commandBuffer, (m_slotCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void GlorpHzbCuller::draw(VkCommandBuffer commandBuffer, int frameIndex, GlorpGameObject &obj) const {
+    auto it = m_slots.find(obj.getId());
+    if (it == m_slots.end()) {
+        if (m_phase == Phase::Early) {
+            obj.model->draw(commandBuffer);
+        }
+        return;
+    }
+    const auto &commands = m_phase == Phase::Early ? m_earlyDrawBuffers[frameIndex] : m_lateDrawBuffers[frameIndex];
+    obj.model->drawIndirect(commandBuffer, commands->getBuffer(), it->second * DRAW_COMMAND_SIZE);
+}
+}
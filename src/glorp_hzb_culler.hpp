@@ -0,0 +1,128 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_buffer.hpp"
+#include "glorp_camera.hpp"
+#include "glorp_descriptors.hpp"
+#include "glorp_game_object.hpp"
+#include "glorp_swap_chain.hpp"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#ifndef RESOURCE_LOCATIONS
+#define RESOURCE_LOCATIONS ""
+#endif
+
+namespace Glorp {
+
+// GPU occlusion culling against a hierarchical depth buffer (HZB), a mip chain in which every texel
+// keeps the farthest depth below it. A frame is split around it in two phases:
+//   early  objects that were visible last frame and are inside the frustum are drawn in the Early pass
+//   build  the HZB is reduced from the early pass's depth, MSAA depth resolving to its farthest sample
+//   late   every object's bounds are tested against the HZB, the visible ones not drawn yet are drawn
+//          in the Late pass, and the result is next frame's visible set
+// Last frame's visible set stands in for its reprojected depth, whatever was visible a frame ago most
+// likely still is, and it fills the depth everything else is tested against.
+//
+// Objects draw through indirect commands the cull shader writes, one per object with an instance count
+// of 0 or 1, so a hidden object still costs its binds on the CPU but no vertex work on the GPU.
+class GlorpHzbCuller {
+    public:
+        static constexpr uint32_t MAX_OBJECTS = 4096;
+        static constexpr uint32_t MAX_LEVELS = 16;
+
+        enum class Phase {
+            Early,
+            Late
+        };
+
+        // Counted on the GPU and read back once the frame is done, MAX_FRAMES_IN_FLIGHT frames late
+        struct Stats {
+            uint32_t earlyDraws = 0;
+            uint32_t lateDraws = 0;
+            uint32_t outsideFrustum = 0;
+            uint32_t occluded = 0;
+        };
+
+        explicit GlorpHzbCuller(GlorpDevice &device);
+        ~GlorpHzbCuller();
+
+        GlorpHzbCuller(const GlorpHzbCuller&) = delete;
+        GlorpHzbCuller &operator=(const GlorpHzbCuller&) = delete;
+
+        bool isSupported() const { return m_supported; }
+
+        // Outside a render pass, before the Early pass. Uploads the objects' bounds and transforms and
+        // writes the early draws. extent is the swap chain's, the HZB is resized to match.
+        void beginFrame(VkCommandBuffer commandBuffer, int frameIndex, const GlorpCamera &camera, VkExtent2D extent, GlorpGameObject::Map &objects);
+        // Between the Early and the Late pass. Builds the HZB from depthView, the depth attachment the
+        // early pass just wrote, and writes the late draws.
+        void cullLate(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthView);
+        // Records obj's draw for the current phase. Objects past MAX_OBJECTS are drawn directly in the early phase.
+        void draw(VkCommandBuffer commandBuffer, int frameIndex, GlorpGameObject &obj) const;
+
+        Phase getPhase() const { return m_phase; }
+        const Stats &getStats() const { return m_stats; }
+        uint32_t getObjectCount() const { return static_cast<uint32_t>(m_slots.size()); }
+    private:
+        void createDescriptors();
+        void createPipelines();
+        void createBuffers();
+        void createHzb(VkExtent2D extent);
+        void destroyHzb();
+        uint32_t acquireSlot(GlorpGameObject::id_t id);
+        void dispatchCull(VkCommandBuffer commandBuffer, int frameIndex, Phase phase);
+    private:
+        static constexpr uint32_t INVALID_SLOT = ~0u;
+
+        GlorpDevice &m_glorpDevice;
+        bool m_supported = false;
+
+        std::unique_ptr<GlorpDescriptorSetLayout> m_reduceSetLayout;
+        std::unique_ptr<GlorpDescriptorSetLayout> m_cullSetLayout;
+        std::unique_ptr<GlorpDescriptorPool> m_descriptorPool;
+        VkPipelineLayout m_reducePipelineLayout = VK_NULL_HANDLE;
+        VkPipelineLayout m_cullPipelineLayout = VK_NULL_HANDLE;
+        // reads the depth attachment, multisampled or not, and every HZB level after the first
+        VkPipeline m_depthReducePipeline = VK_NULL_HANDLE;
+        VkPipeline m_reducePipeline = VK_NULL_HANDLE;
+        VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+        VkSampler m_sampler = VK_NULL_HANDLE;
+
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_objectBuffers;
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_earlyDrawBuffers;
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_lateDrawBuffers;
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_statsBuffers;
+        // one bit of history per slot, carried from every frame's late phase to the next frame's early one
+        std::unique_ptr<GlorpBuffer> m_visibilityBuffer;
+        bool m_visibilityCleared = false;
+
+        VkExtent2D m_extent{0, 0};
+        VkExtent2D m_hzbExtent{0, 0};
+        uint32_t m_levelCount = 0;
+        VkImage m_hzbImage = VK_NULL_HANDLE;
+        VkDeviceMemory m_hzbMemory = VK_NULL_HANDLE;
+        VkImageView m_hzbView = VK_NULL_HANDLE;
+        std::vector<VkImageView> m_levelViews;
+        bool m_hzbInitialized = false;
+
+        std::array<VkDescriptorSet, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_cullSets{};
+        std::array<VkDescriptorSet, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_depthReduceSets{};
+        std::vector<VkDescriptorSet> m_reduceSets;
+
+        // slots are stable so the visibility history follows the object
+        std::unordered_map<GlorpGameObject::id_t, uint32_t> m_slots;
+        std::vector<GlorpGameObject::id_t> m_slotObjects;
+        std::vector<uint64_t> m_slotFrames;
+        std::vector<uint32_t> m_freeSlots;
+        uint32_t m_slotCount = 0;
+        uint64_t m_frame = 0;
+
+        glm::mat4 m_viewProjection{1.f};
+        Phase m_phase = Phase::Early;
+        Stats m_stats;
+};
+}
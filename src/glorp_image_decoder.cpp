@@ -0,0 +1,178 @@
+#include "glorp_image_decoder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+// Bump allocator used by stb_image while a worker decodes. Anything that does not fit falls back
+// to malloc and the arena is resized to the observed demand before the next decode.
+struct ScratchArena {
+    static constexpr size_t ALIGNMENT = 16;
+
+    std::byte *base = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t lastOffset = 0;
+    size_t demand = 0;
+    bool active = false;
+
+    ~ScratchArena() { std::free(base); }
+
+    static size_t alignUp(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    bool owns(const void *pointer) const {
+        auto *bytes = static_cast<const std::byte *>(pointer);
+        return base != nullptr && bytes >= base && bytes < base + capacity;
+    }
+
+    void begin() {
+        if (demand > capacity) {
+            std::free(base);
+            capacity = alignUp(demand + demand / 4);
+            base = static_cast<std::byte *>(std::malloc(capacity));
+            if (base == nullptr) {
+                capacity = 0;
+            }
+        }
+        used = 0;
+        lastOffset = 0;
+        demand = 0;
+        active = true;
+    }
+
+    void end() { active = false; }
+
+    void *allocate(size_t size) {
+        size = alignUp(size);
+        demand += size;
+        if (active && used + size <= capacity) {
+            lastOffset = used;
+            used += size;
+            return base + lastOffset;
+        }
+        return std::malloc(size);
+    }
+
+    void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
+        if (pointer == nullptr) {
+            return allocate(newSize);
+        }
+        if (!owns(pointer)) {
+            demand += alignUp(newSize);
+            return std::realloc(pointer, newSize);
+        }
+        // growing the most recent allocation happens in place, zlib doubles its output this way
+        if (base + lastOffset == pointer && lastOffset + alignUp(newSize) <= capacity) {
+            demand += alignUp(newSize) - (used - lastOffset);
+            used = lastOffset + alignUp(newSize);
+            return pointer;
+        }
+        void *moved = allocate(newSize);
+        if (moved != nullptr) {
+            std::memcpy(moved, pointer, std::min(oldSize, newSize));
+        }
+        return moved;
+    }
+
+    void release(void *pointer) {
+        if (!owns(pointer)) {
+            std::free(pointer);
+        }
+    }
+};
+
+thread_local ScratchArena t_scratchArena;
+
+void *scratchMalloc(size_t size) { return t_scratchArena.allocate(size); }
+void *scratchRealloc(void *pointer, size_t oldSize, size_t newSize) { return t_scratchArena.reallocate(pointer, oldSize, newSize); }
+void scratchFree(void *pointer) { t_scratchArena.release(pointer); }
+}
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_MALLOC(size) scratchMalloc(size)
+#define STBI_REALLOC_SIZED(pointer, oldSize, newSize) scratchRealloc(pointer, oldSize, newSize)
+#define STBI_FREE(pointer) scratchFree(pointer)
+#include "stb_image.h"
+
+namespace Glorp {
+
+GlorpImageDecoder::GlorpImageDecoder(uint32_t workerCount) {
+    m_threadPool = std::make_unique<GlorpThreadPool>(workerCount);
+}
+
+GlorpImageDecoder &GlorpImageDecoder::shared() {
+    static GlorpImageDecoder imageDecoder;
+    return imageDecoder;
+}
+
+bool GlorpImageDecoder::getInfo(std::span<const std::byte> encoded, int &width, int &height) {
+    int channels;
+    return stbi_info_from_memory(
+        reinterpret_cast<const stbi_uc *>(encoded.data()),
+        static_cast<int>(encoded.size()),
+        &width, &height, &channels
+    ) != 0;
+}
+
+void GlorpImageDecoder::decode(std::span<const Job> jobs) {
+    // the calling thread takes the last job instead of idling
+    std::vector<std::future<void>> pending;
+    pending.reserve(jobs.size());
+    for (size_t i = 0; i + 1 < jobs.size(); i++) {
+        const Job &job = jobs[i];
+        pending.push_back(m_threadPool->submit([&job]() { decodeJob(job); }));
+    }
+    std::exception_ptr failure;
+    if (!jobs.empty()) {
+        try {
+            decodeJob(jobs.back());
+        } catch (...) {
+            failure = std::current_exception();
+        }
+    }
+    for (auto &future : pending) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void GlorpImageDecoder::decodeJob(const Job &job) {
+    stbi_set_flip_vertically_on_load_thread(job.flipVertically);
+    t_scratchArena.begin();
+
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load_from_memory(
+        reinterpret_cast<const stbi_uc *>(job.encoded.data()),
+        static_cast<int>(job.encoded.size()),
+        &width, &height, &channels, STBI_rgb_alpha
+    );
+    if (pixels == nullptr) {
+        t_scratchArena.end();
+        throw std::runtime_error(std::string("Failed to decode image: ") + stbi_failure_reason());
+    }
+
+    size_t size = static_cast<size_t>(width) * height * 4;
+    if (size != job.destinationSize) {
+        stbi_image_free(pixels);
+        t_scratchArena.end();
+        throw std::runtime_error("Decoded image does not match the size of its destination");
+    }
+    std::memcpy(job.destination, pixels, size);
+    stbi_image_free(pixels);
+    t_scratchArena.end();
+}
+
+}
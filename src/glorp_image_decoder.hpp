@@ -0,0 +1,41 @@
+#pragma once
+
+#include "glorp_thread_pool.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace Glorp {
+
+// Decodes PNG/JPEG images to RGBA8 on a dedicated worker pool. Each worker keeps a scratch arena
+// for stb_image's intermediate allocations that grows to the working set and is then reused, and
+// the decoded pixels are written straight into the caller's destination, usually a staging slot.
+class GlorpImageDecoder {
+    public:
+        struct Job {
+            std::span<const std::byte> encoded;
+            // width * height * 4 bytes
+            void *destination = nullptr;
+            size_t destinationSize = 0;
+            bool flipVertically = false;
+        };
+
+        explicit GlorpImageDecoder(uint32_t workerCount = std::thread::hardware_concurrency());
+
+        GlorpImageDecoder(const GlorpImageDecoder&) = delete;
+        GlorpImageDecoder &operator=(const GlorpImageDecoder&) = delete;
+
+        static GlorpImageDecoder &shared();
+
+        // Reads the dimensions from the image header without decoding it
+        static bool getInfo(std::span<const std::byte> encoded, int &width, int &height);
+
+        // Decodes every job concurrently and returns once all of them are done, throws if any fails
+        void decode(std::span<const Job> jobs);
+    private:
+        static void decodeJob(const Job &job);
+    private:
+        std::unique_ptr<GlorpThreadPool> m_threadPool;
+};
+}
@@ -1,10 +1,19 @@
 #include "glorp_imgui.hpp"
 #include "glorp_swap_chain.hpp"
+#include "glorp_sampler_cache.hpp"
+#include "glorp_texture_streamer.hpp"
+#include "glorp_virtual_texture.hpp"
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_light_clusters.hpp"
+#include "glorp_occlusion_culler.hpp"
+#include "glorp_hzb_culler.hpp"
+#include "glorp_occlusion_queries.hpp"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
 
+#include <algorithm>
 #include <cmath>
 #include <numeric>
 
@@ -36,19 +45,24 @@ void GlorpImgui::initImgui(VkRenderPass renderPass) {
     init_info.Device = m_glorpDevice.device();
     init_info.QueueFamily = m_glorpDevice.findPhysicalQueueFamilies().graphicsFamily;
     init_info.Queue = m_glorpDevice.graphicsQueue();
-    init_info.PipelineCache = VK_NULL_HANDLE;
+    init_info.PipelineCache = m_glorpDevice.getPipelineCache().getCache();
     init_info.DescriptorPool = imguiPool->getRawPool();
     init_info.RenderPass = renderPass;
     init_info.Subpass = 0;
     init_info.MinImageCount = GlorpSwapChain::MAX_FRAMES_IN_FLIGHT;
     init_info.ImageCount = GlorpSwapChain::MAX_FRAMES_IN_FLIGHT;
     init_info.MSAASamples = m_glorpDevice.getSupportedSampleCount();
+    std::lock_guard<std::mutex> lock{m_glorpDevice.graphicsQueueMutex()};
     ImGui_ImplVulkan_Init(&init_info);
 }
 
 void GlorpImgui::drawUI(FrameInfo &frameInfo) {
     updateFPS();
-    ImGui_ImplVulkan_NewFrame();
+    {
+        // may submit the font upload on the graphics queue
+        std::lock_guard<std::mutex> lock{m_glorpDevice.graphicsQueueMutex()};
+        ImGui_ImplVulkan_NewFrame();
+    }
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
     defaultWindow(frameInfo);
@@ -77,6 +91,65 @@ void GlorpImgui::updateFPS() {
     }
 }
 
+void GlorpImgui::streamingStats() {
+    constexpr float MIB = 1024.f * 1024.f;
+    auto &textureStreamer = m_glorpDevice.getTextureStreamer();
+    int budget = static_cast<int>(textureStreamer.getBudget() / (1024 * 1024));
+    if (ImGui::SliderInt("Budget (MiB)", &budget, 16, 4096)) {
+        textureStreamer.setBudget(static_cast<VkDeviceSize>(budget) * 1024 * 1024);
+    }
+
+    auto stats = textureStreamer.getStats();
+    VkDeviceSize resident = 0;
+    for (const auto &stat : stats) {
+        resident += stat.residentSize;
+    }
+    ImGui::Text("Resident: %.1f / %.1f MiB", resident / MIB, textureStreamer.getBudget() / MIB);
+
+    if (ImGui::BeginTable("Residency", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+            ImVec2(0.f, 200.f))) {
+        ImGui::TableSetupColumn("Texture");
+        ImGui::TableSetupColumn("Level");
+        ImGui::TableSetupColumn("Wanted");
+        ImGui::TableSetupColumn("Resident (MiB)");
+        ImGui::TableHeadersRow();
+        for (const auto &stat : stats) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            size_t slash = stat.path.find_last_of("/\\");
+            ImGui::TextUnformatted(slash == std::string::npos ? stat.path.c_str() : stat.path.c_str() + slash + 1);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u / %u%s", stat.baseLevel, stat.levelCount, stat.loading ? " *" : "");
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", stat.wantedLevel);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f / %.2f", stat.residentSize / MIB, stat.fullSize / MIB);
+        }
+        ImGui::EndTable();
+    }
+}
+
+void GlorpImgui::virtualTextureStats() {
+    for (auto *virtualTexture : m_virtualTextures) {
+        ImGui::PushID(virtualTexture);
+        const auto &path = virtualTexture->getPath();
+        size_t slash = path.find_last_of("/\\");
+        ImGui::SeparatorText(slash == std::string::npos ? path.c_str() : path.c_str() + slash + 1);
+
+        auto stats = virtualTexture->getStats();
+        ImGui::Text("Hit rate: %.2f%% (%llu / %llu pages)", stats.hitRate() * 100.f,
+            static_cast<unsigned long long>(stats.cacheHits), static_cast<unsigned long long>(stats.requestedPages));
+        ImGui::Text("Page faults: %llu, uploaded %llu, evicted %llu", static_cast<unsigned long long>(stats.pageFaults),
+            static_cast<unsigned long long>(stats.pagesUploaded), static_cast<unsigned long long>(stats.pagesEvicted));
+        ImGui::Text("Fault latency (ms): %.2f avg, %.2f max", stats.averageFaultLatencyMs, stats.maxFaultLatencyMs);
+        ImGui::Text("Cache: %u / %u pages, %u pending", stats.residentPages, stats.cachePages, stats.pendingPages);
+        if (ImGui::Button("Reset")) {
+            virtualTexture->resetStats();
+        }
+        ImGui::PopID();
+    }
+}
+
 void GlorpImgui::defaultWindow(FrameInfo &frameInfo) {
     ImGui::Begin("Debug");
     ImGui::Text("Frame time (ms): %f",frameInfo.frameTime * 1000);
@@ -87,12 +160,65 @@ void GlorpImgui::defaultWindow(FrameInfo &frameInfo) {
         ImGui::SliderFloat("Brightness", &m_lightBrightness, 0.0f, 1.0f);
         ImGui::SliderFloat("Rotation Multiplier", &m_rotationMultiplier, 0.0f, 10.f);
         ImGui::SliderFloat("Vertical position", &lightPosition, -5.f, 5.f);
+        ImGui::SliderInt("Scattered lights", &scatteredLights, 0, MAX_LIGHTS - 16);
+        if (m_lightClusters != nullptr) {
+            const auto &stats = m_lightClusters->getStats();
+            ImGui::Text("Lights: %u, %u in view", stats.lights, stats.visibleLights);
+            ImGui::Text("Cluster lists: %u entries, %u dropped, at most %u lights", stats.lightIndices, stats.droppedIndices,
+                stats.maxLightsPerCluster);
+            ImGui::Text("Cluster build (ms): %.3f", stats.buildTimeMs);
+        }
     }
     if(ImGui::CollapsingHeader("Texture Control")) {
         ImGui::Checkbox("Use Albedo", &useAlbedoMap);
         ImGui::Checkbox("Use Normal", &useNormalMap);
         ImGui::Checkbox("Use Emmisive", &useEmissiveMap);
         ImGui::Checkbox("Use AO", &useAOMap);
+
+        auto &samplerCache = m_glorpDevice.getSamplerCache();
+        auto quality = samplerCache.getQuality();
+        const char *anisotropyLevels[] = {"Off", "2x", "4x", "8x", "16x"};
+        int maxLevel = static_cast<int>(std::log2(samplerCache.getMaxSupportedAnisotropy()));
+        int level = static_cast<int>(std::log2(quality.maxAnisotropy));
+        bool changed = ImGui::Combo("Anisotropy", &level, anisotropyLevels, std::clamp(maxLevel + 1, 1, 5));
+        changed |= ImGui::SliderFloat("LOD Bias", &quality.mipLodBias, -2.0f, 2.0f, "%.2f");
+        if (changed) {
+            quality.maxAnisotropy = std::exp2(static_cast<float>(level));
+            samplerCache.setQuality(quality);
+        }
+    }
+    if(ImGui::CollapsingHeader("Rendering")) {
+        ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+        ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+        if (occlusionCulling && m_occlusionCuller != nullptr) {
+            const auto &stats = m_occlusionCuller->getStats();
+            ImGui::Text("Occluders: %u, %u of %u triangles rasterized", stats.occluders, stats.rasterizedTriangles, stats.occluderTriangles);
+            ImGui::Text("Culled: %u outside the view, %u occluded of %u (%.1f%%)", stats.outsideFrustum, stats.occluded, stats.tested,
+                stats.cullRate() * 100.f);
+            ImGui::Text("Setup / raster / test (ms): %.3f / %.3f / %.3f", stats.setupTimeMs, stats.rasterizeTimeMs, stats.testTimeMs);
+        }
+        if (m_hzbCuller != nullptr && m_hzbCuller->isSupported()) {
+            ImGui::Checkbox("GPU occlusion culling", &gpuOcclusionCulling);
+        }
+        if (gpuOcclusionCulling && m_hzbCuller != nullptr && m_hzbCuller->isSupported()) {
+            const auto &stats = m_hzbCuller->getStats();
+            ImGui::Text("Drawn: %u early, %u late of %u", stats.earlyDraws, stats.lateDraws, m_hzbCuller->getObjectCount());
+            ImGui::Text("Culled: %u outside the view, %u occluded", stats.outsideFrustum, stats.occluded);
+        }
+        ImGui::Checkbox("Occlusion queries", &occlusionQueries);
+        if (occlusionQueries && m_occlusionQueries != nullptr) {
+            const auto &stats = m_occlusionQueries->getStats();
+            ImGui::Text("Queries: %u of %u, %u objects (%s)", stats.queried, GlorpOcclusionQueries::MAX_QUERIES,
+                m_occlusionQueries->getSlotCount(), m_occlusionQueries->usesConditionalRendering() ? "conditional rendering" : "CPU readback");
+            ImGui::Text("Occluded: %u of %u results (%.1f%%), %u draws skipped on the CPU", stats.occluded, stats.resultsRead,
+                stats.hitRate() * 100.f, stats.skipped);
+        }
+    }
+    if(ImGui::CollapsingHeader("Texture Streaming")) {
+        streamingStats();
+    }
+    if(!m_virtualTextures.empty() && ImGui::CollapsingHeader("Virtual Texturing")) {
+        virtualTextureStats();
     }
 
     ImGui::End();
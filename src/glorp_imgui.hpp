@@ -6,8 +6,14 @@
 
 #include <memory>
 #include <chrono>
+#include <vector>
 
 namespace Glorp {
+class GlorpVirtualTexture;
+class GlorpLightClusters;
+class GlorpOcclusionCuller;
+class GlorpHzbCuller;
+class GlorpOcclusionQueries;
 
 class GlorpImgui {
     public:
@@ -15,6 +21,12 @@ class GlorpImgui {
         ~GlorpImgui();
 
         void drawUI(FrameInfo &frameInfo);
+        // texture has to outlive the UI
+        void addVirtualTexture(GlorpVirtualTexture *texture) { m_virtualTextures.push_back(texture); }
+        void setLightClusters(const GlorpLightClusters *lightClusters) { m_lightClusters = lightClusters; }
+        void setOcclusionCuller(const GlorpOcclusionCuller *occlusionCuller) { m_occlusionCuller = occlusionCuller; }
+        void setHzbCuller(const GlorpHzbCuller *hzbCuller) { m_hzbCuller = hzbCuller; }
+        void setOcclusionQueries(const GlorpOcclusionQueries *occlusionQueries) { m_occlusionQueries = occlusionQueries; }
         float getLightIntensity() { return m_lightBrightness; }
         float getRotationMultiplier() { return m_rotationMultiplier; }
 
@@ -24,14 +36,29 @@ class GlorpImgui {
         bool useAOMap{true};
 
         float lightPosition{1.f};
+        bool depthPrepass{false};
+        bool occlusionCulling{false};
+        bool gpuOcclusionCulling{false};
+        bool occlusionQueries{false};
+        // extra lights scattered around the scene to stress the light clusters
+        int scatteredLights{0};
     private:
         void initImgui(VkRenderPass renderPass);
         void defaultWindow(FrameInfo &frameInfo);
+        // Per texture residency of the texture streamer, loads in flight are marked with *
+        void streamingStats();
+        // Cache hit rate and page fault latency of every virtual texture
+        void virtualTextureStats();
         void updateFPS();
     private:
         GlorpDevice &m_glorpDevice;
         GlorpWindow &m_glorpWindow;
         std::unique_ptr<GlorpDescriptorPool> imguiPool {};
+        std::vector<GlorpVirtualTexture *> m_virtualTextures;
+        const GlorpLightClusters *m_lightClusters = nullptr;
+        const GlorpOcclusionCuller *m_occlusionCuller = nullptr;
+        const GlorpHzbCuller *m_hzbCuller = nullptr;
+        const GlorpOcclusionQueries *m_occlusionQueries = nullptr;
 
         float m_lightBrightness = .5f;
         float m_rotationMultiplier = 1.f;
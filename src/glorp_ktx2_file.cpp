@@ -0,0 +1,299 @@
+#include "glorp_ktx2_file.hpp"
+#include "glorp_file_io.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr size_t HEADER_SIZE = 80;
+constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+constexpr uint32_t SUPERCOMPRESSION_NONE = 0;
+
+// Khronos data format descriptor values used by the basic descriptor block
+constexpr uint32_t KHR_DF_VERSION = 2;
+constexpr uint32_t KHR_DF_MODEL_RGBSDA = 1;
+constexpr uint32_t KHR_DF_MODEL_BC1A = 128;
+constexpr uint32_t KHR_DF_MODEL_BC4 = 131;
+constexpr uint32_t KHR_DF_MODEL_BC5 = 132;
+constexpr uint32_t KHR_DF_MODEL_BC7 = 134;
+constexpr uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+constexpr uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+constexpr uint32_t KHR_DF_TRANSFER_SRGB = 2;
+constexpr uint32_t KHR_DF_CHANNEL_ALPHA = 15;
+constexpr uint32_t KHR_DF_SAMPLE_DATATYPE_LINEAR = 0x10;
+
+struct FormatInfo {
+    // bytes per texel block and the block edge, 1 for plain texel formats
+    uint32_t blockBytes;
+    uint32_t blockDimension;
+    uint32_t colorModel;
+    bool srgb;
+};
+
+bool formatInfo(VkFormat format, FormatInfo &info) {
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK: info = {8, 4, KHR_DF_MODEL_BC1A, false}; return true;
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK: info = {8, 4, KHR_DF_MODEL_BC1A, true}; return true;
+        case VK_FORMAT_BC4_UNORM_BLOCK: info = {8, 4, KHR_DF_MODEL_BC4, false}; return true;
+        case VK_FORMAT_BC5_UNORM_BLOCK: info = {16, 4, KHR_DF_MODEL_BC5, false}; return true;
+        case VK_FORMAT_BC7_UNORM_BLOCK: info = {16, 4, KHR_DF_MODEL_BC7, false}; return true;
+        case VK_FORMAT_BC7_SRGB_BLOCK: info = {16, 4, KHR_DF_MODEL_BC7, true}; return true;
+        case VK_FORMAT_R8G8B8A8_UNORM: info = {4, 1, KHR_DF_MODEL_RGBSDA, false}; return true;
+        case VK_FORMAT_R8G8B8A8_SRGB: info = {4, 1, KHR_DF_MODEL_RGBSDA, true}; return true;
+        default: return false;
+    }
+}
+
+template <typename T>
+T read(std::span<const std::byte> file, size_t offset) {
+    T value;
+    std::memcpy(&value, file.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void append(std::vector<std::byte> &out, T value) {
+    size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+uint32_t sampleWord(uint32_t bitOffset, uint32_t bitLength, uint32_t channel) {
+    return bitOffset | ((bitLength - 1) << 16) | (channel << 24);
+}
+
+// One basic descriptor block, the loader itself only looks at vkFormat
+std::vector<uint32_t> dataFormatDescriptor(const FormatInfo &info) {
+    std::vector<uint32_t> samples;
+    auto addSample = [&](uint32_t bitOffset, uint32_t bitLength, uint32_t channel, uint32_t upper) {
+        samples.insert(samples.end(), {sampleWord(bitOffset, bitLength, channel), 0, 0, upper});
+    };
+    if (info.colorModel == KHR_DF_MODEL_RGBSDA) {
+        for (uint32_t channel = 0; channel < 3; channel++) {
+            addSample(channel * 8, 8, channel, 255);
+        }
+        addSample(24, 8, KHR_DF_CHANNEL_ALPHA | (info.srgb ? KHR_DF_SAMPLE_DATATYPE_LINEAR : 0), 255);
+    } else if (info.colorModel == KHR_DF_MODEL_BC5) {
+        addSample(0, 64, 0, UINT32_MAX);
+        addSample(64, 64, 1, UINT32_MAX);
+    } else {
+        addSample(0, info.blockBytes * 8, 0, UINT32_MAX);
+    }
+
+    uint32_t blockSize = 24 + static_cast<uint32_t>(samples.size()) * 4;
+    uint32_t texelBlock = info.blockDimension > 1 ? (info.blockDimension - 1) | ((info.blockDimension - 1) << 8) : 0;
+    std::vector<uint32_t> descriptor = {
+        4 + blockSize,
+        0,
+        KHR_DF_VERSION | (blockSize << 16),
+        info.colorModel | (KHR_DF_PRIMARIES_BT709 << 8) | ((info.srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16),
+        texelBlock,
+        info.blockBytes,
+        0
+    };
+    descriptor.insert(descriptor.end(), samples.begin(), samples.end());
+    return descriptor;
+}
+}
+
+namespace Glorp {
+
+bool GlorpKtx2File::parse(std::span<const std::byte> file, Image &image) {
+    Image header;
+    if (!parseHeader(file, header)) {
+        return false;
+    }
+    for (const auto &level : header.levels) {
+        if (level.offset > file.size() || level.size > file.size() - level.offset) {
+            return false;
+        }
+    }
+    size_t offset, size;
+    levelRange(header, 0, offset, size);
+    image = slice(header, 0, file.subspan(offset, size));
+    return true;
+}
+
+bool GlorpKtx2File::parseHeader(std::span<const std::byte> header, Image &image) {
+    if (header.size() < HEADER_SIZE || std::memcmp(header.data(), KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size()) != 0) {
+        return false;
+    }
+    auto format = static_cast<VkFormat>(read<uint32_t>(header, 12));
+    uint32_t width = read<uint32_t>(header, 20);
+    uint32_t height = read<uint32_t>(header, 24);
+    uint32_t depth = read<uint32_t>(header, 28);
+    uint32_t layerCount = read<uint32_t>(header, 32);
+    uint32_t faceCount = read<uint32_t>(header, 36);
+    uint32_t levelCount = read<uint32_t>(header, 40);
+    uint32_t supercompression = read<uint32_t>(header, 44);
+
+    FormatInfo info;
+    if (!formatInfo(format, info) || supercompression != SUPERCOMPRESSION_NONE) {
+        return false;
+    }
+    // level count 0 asks the reader to generate the mips, those files take the decode path
+    if (width == 0 || height == 0 || depth != 0 || layerCount > 1 || faceCount != 1 || levelCount == 0) {
+        return false;
+    }
+    if (header.size() < HEADER_SIZE + levelCount * LEVEL_INDEX_ENTRY_SIZE) {
+        return false;
+    }
+
+    auto layout = levelLayout(format, width, height, levelCount);
+    if (layout.size() != levelCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < levelCount; i++) {
+        size_t entry = HEADER_SIZE + i * LEVEL_INDEX_ENTRY_SIZE;
+        uint64_t offset = read<uint64_t>(header, entry);
+        uint64_t size = read<uint64_t>(header, entry + 8);
+        if (size != layout[i].size || offset % info.blockBytes != 0 || offset > SIZE_MAX - size) {
+            return false;
+        }
+        layout[i].offset = static_cast<size_t>(offset);
+    }
+
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.levels = std::move(layout);
+    image.payload = {};
+    return true;
+}
+
+void GlorpKtx2File::levelRange(const Image &header, uint32_t firstLevel, size_t &offset, size_t &size) {
+    // levels are normally stored smallest first, but any order is accepted
+    size_t begin = SIZE_MAX;
+    size_t end = 0;
+    for (size_t i = firstLevel; i < header.levels.size(); i++) {
+        begin = std::min(begin, header.levels[i].offset);
+        end = std::max(end, header.levels[i].offset + header.levels[i].size);
+    }
+    offset = begin == SIZE_MAX ? 0 : begin;
+    size = end - offset;
+}
+
+GlorpKtx2File::Image GlorpKtx2File::slice(const Image &header, uint32_t firstLevel, std::span<const std::byte> data) {
+    size_t rangeOffset, rangeSize;
+    levelRange(header, firstLevel, rangeOffset, rangeSize);
+
+    Image image;
+    image.format = header.format;
+    image.width = header.levels[firstLevel].width;
+    image.height = header.levels[firstLevel].height;
+    for (size_t i = firstLevel; i < header.levels.size(); i++) {
+        Level level = header.levels[i];
+        level.offset -= rangeOffset;
+        image.levels.push_back(level);
+    }
+    image.payload = data.first(std::min(rangeSize, data.size()));
+    return image;
+}
+
+std::vector<GlorpKtx2File::Level> GlorpKtx2File::levelLayout(VkFormat format, uint32_t width, uint32_t height, uint32_t levelCount) {
+    FormatInfo info;
+    if (!formatInfo(format, info)) {
+        throw std::runtime_error("Unsupported KTX2 format.");
+    }
+    std::vector<Level> levels;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < levelCount; i++) {
+        Level level{};
+        level.width = std::max(width >> i, 1u);
+        level.height = std::max(height >> i, 1u);
+        level.offset = offset;
+        size_t blocksWide = (level.width + info.blockDimension - 1) / info.blockDimension;
+        size_t blocksHigh = (level.height + info.blockDimension - 1) / info.blockDimension;
+        level.size = blocksWide * blocksHigh * info.blockBytes;
+        offset += level.size;
+        levels.push_back(level);
+        if (level.width == 1 && level.height == 1) {
+            break;
+        }
+    }
+    return levels;
+}
+
+void GlorpKtx2File::write(const std::string &path, const Image &image) {
+    FormatInfo info;
+    if (!formatInfo(image.format, info) || image.levels.empty()) {
+        throw std::runtime_error("Unsupported KTX2 image: " + path);
+    }
+    auto descriptor = dataFormatDescriptor(info);
+    uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+    size_t descriptorOffset = HEADER_SIZE + levelCount * LEVEL_INDEX_ENTRY_SIZE;
+    size_t descriptorSize = descriptor.size() * sizeof(uint32_t);
+
+    // level data goes smallest first, each level aligned to its texel block size
+    std::vector<uint64_t> fileOffsets(levelCount);
+    size_t offset = descriptorOffset + descriptorSize;
+    for (uint32_t i = levelCount; i-- > 0;) {
+        offset = (offset + info.blockBytes - 1) / info.blockBytes * info.blockBytes;
+        fileOffsets[i] = offset;
+        offset += image.levels[i].size;
+    }
+
+    std::vector<std::byte> header;
+    header.reserve(descriptorOffset + descriptorSize);
+    for (uint8_t byte : KTX2_IDENTIFIER) {
+        append(header, byte);
+    }
+    append<uint32_t>(header, image.format);
+    append<uint32_t>(header, 1);
+    append<uint32_t>(header, image.width);
+    append<uint32_t>(header, image.height);
+    append<uint32_t>(header, 0);
+    append<uint32_t>(header, 0);
+    append<uint32_t>(header, 1);
+    append<uint32_t>(header, levelCount);
+    append<uint32_t>(header, SUPERCOMPRESSION_NONE);
+    append<uint32_t>(header, static_cast<uint32_t>(descriptorOffset));
+    append<uint32_t>(header, static_cast<uint32_t>(descriptorSize));
+    append<uint32_t>(header, 0);
+    append<uint32_t>(header, 0);
+    append<uint64_t>(header, 0);
+    append<uint64_t>(header, 0);
+    for (uint32_t i = 0; i < levelCount; i++) {
+        append<uint64_t>(header, fileOffsets[i]);
+        append<uint64_t>(header, image.levels[i].size);
+        append<uint64_t>(header, image.levels[i].size);
+    }
+    for (uint32_t word : descriptor) {
+        append(header, word);
+    }
+
+    std::vector<std::byte> file(offset);
+    std::memcpy(file.data(), header.data(), header.size());
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const auto &level = image.levels[i];
+        std::memcpy(file.data() + fileOffsets[i], image.payload.data() + level.offset, level.size);
+    }
+
+    GlorpFileIo::writeFileAtomically(path, [&](std::ostream &out) {
+        out.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()));
+    });
+}
+
+VkFormat GlorpKtx2File::blockCompressedFormat(GlorpBcEncoder::Format format, bool srgb) {
+    switch (format) {
+        case GlorpBcEncoder::Format::BC1:
+            return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case GlorpBcEncoder::Format::BC4:
+            return VK_FORMAT_BC4_UNORM_BLOCK;
+        case GlorpBcEncoder::Format::BC5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        case GlorpBcEncoder::Format::BC7:
+            return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    throw std::runtime_error("Unknown block compressed format.");
+}
+
+bool GlorpKtx2File::isBlockCompressed(VkFormat format) {
+    FormatInfo info;
+    return formatInfo(format, info) && info.blockDimension > 1;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "glorp_bc_encoder.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Glorp {
+
+// Reads and writes KTX2 files holding a single 2D image with its whole mip chain. The format is
+// stored as a VkFormat, so a parsed image uploads without any translation. Only the block
+// compressed formats the cooker emits and RGBA8 are accepted, and supercompressed files are
+// rejected so the caller falls back to the source image.
+//
+// This is the only cooked container. DDS, which the BC cooker wrote first, needs a DXGI to VkFormat
+// table and has no per-level offsets, so single levels could not be read on their own for streaming.
+class GlorpKtx2File {
+    public:
+        struct Level {
+            // relative to the start of the payload
+            size_t offset = 0;
+            size_t size = 0;
+            uint32_t width = 0;
+            uint32_t height = 0;
+        };
+
+        struct Image {
+            VkFormat format = VK_FORMAT_UNDEFINED;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            // level 0 is the full size image
+            std::vector<Level> levels;
+            // covers every level, views into the parsed file
+            std::span<const std::byte> payload;
+        };
+
+        // Enough for the header and level index of any chain this loader accepts
+        static constexpr size_t HEADER_READ_SIZE = 1024;
+
+        // Returns false when the file is not a KTX2 this loader understands
+        static bool parse(std::span<const std::byte> file, Image &image);
+        // Reads only the header and level index from the start of the file, so the levels can be
+        // fetched separately. Level offsets are file offsets and the payload stays empty.
+        static bool parseHeader(std::span<const std::byte> header, Image &image);
+        // File range holding levels firstLevel to the end of the chain of a parsed header
+        static void levelRange(const Image &header, uint32_t firstLevel, size_t &offset, size_t &size);
+        // The chain starting at firstLevel as its own image, data holds the bytes of levelRange()
+        static Image slice(const Image &header, uint32_t firstLevel, std::span<const std::byte> data);
+        // Computes the level layout of a mip chain packed back to back, level 0 first
+        static std::vector<Level> levelLayout(VkFormat format, uint32_t width, uint32_t height, uint32_t levelCount);
+        static void write(const std::string &path, const Image &image);
+
+        static VkFormat blockCompressedFormat(GlorpBcEncoder::Format format, bool srgb);
+        static bool isBlockCompressed(VkFormat format);
+};
+}
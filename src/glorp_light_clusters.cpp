@@ -0,0 +1,141 @@
+#include "glorp_light_clusters.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace Glorp {
+
+GlorpLightClusters::GlorpLightClusters(GlorpDevice &device) : m_glorpDevice{device} {
+    // rewritten every frame, so they stay in host visible memory
+    for (int i = 0; i < GlorpSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        m_lightBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(PointLight), MAX_LIGHTS,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_lightBuffers[i]->map();
+        m_clusterBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, 2 * sizeof(uint32_t), CLUSTER_COUNT,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_clusterBuffers[i]->map();
+        m_lightIndexBuffers[i] = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(uint32_t), MAX_LIGHT_INDICES,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_lightIndexBuffers[i]->map();
+    }
+    m_clusterCounts.resize(CLUSTER_COUNT);
+    m_clusterCursors.resize(CLUSTER_COUNT);
+}
+
+void GlorpLightClusters::build(int frameIndex, const GlorpCamera &camera, VkExtent2D extent, std::span<const PointLight> lights, GlobalUbo &ubo) {
+    auto start = std::chrono::steady_clock::now();
+
+    // near and far planes are read back from GlorpCamera::setPerspectiveProjection's matrix
+    const auto &projection = camera.getProjection();
+    assert(projection[2][3] == 1.f && "Light clusters need a perspective projection");
+    float near = -projection[3][2] / projection[2][2];
+    float far = projection[3][2] / (1.f - projection[2][2]);
+    float logDepthRange = std::log(far / near);
+    m_projectionX = projection[0][0];
+    m_projectionY = projection[1][1];
+    for (uint32_t i = 0; i <= CLUSTERS_Z; i++) {
+        m_sliceDepths[i] = near * std::exp(logDepthRange * i / CLUSTERS_Z);
+    }
+
+    uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), MAX_LIGHTS));
+    std::memcpy(m_lightBuffers[frameIndex]->getMappedMemory(), lights.data(), lightCount * sizeof(PointLight));
+
+    m_stats = {};
+    m_stats.lights = lightCount;
+    m_assignments.clear();
+    std::fill(m_clusterCounts.begin(), m_clusterCounts.end(), 0);
+    const auto &view = camera.getView();
+    for (uint32_t i = 0; i < lightCount; i++) {
+        size_t assigned = m_assignments.size();
+        assignLight(glm::vec3(view * glm::vec4(glm::vec3(lights[i].position), 1.f)), lights[i].position.w, i);
+        if (m_assignments.size() != assigned) {
+            m_stats.visibleLights++;
+        }
+    }
+
+    // counting sort of the assignments by froxel, every froxel's list keeps the lights' order
+    auto *clusters = static_cast<uint32_t *>(m_clusterBuffers[frameIndex]->getMappedMemory());
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < CLUSTER_COUNT; i++) {
+        uint32_t count = m_clusterCounts[i];
+        uint32_t kept = std::min(count, MAX_LIGHT_INDICES - offset);
+        clusters[2 * i] = offset;
+        clusters[2 * i + 1] = kept;
+        m_clusterCursors[i] = offset;
+        m_clusterCounts[i] = kept;
+        offset += kept;
+        m_stats.droppedIndices += count - kept;
+        m_stats.maxLightsPerCluster = std::max(m_stats.maxLightsPerCluster, count);
+    }
+    auto *indices = static_cast<uint32_t *>(m_lightIndexBuffers[frameIndex]->getMappedMemory());
+    for (const auto &assignment : m_assignments) {
+        if (m_clusterCounts[assignment.cluster] > 0) {
+            m_clusterCounts[assignment.cluster]--;
+            indices[m_clusterCursors[assignment.cluster]++] = assignment.light;
+        }
+    }
+    m_stats.lightIndices = offset;
+
+    // the fragment shader finds its froxel with gl_FragCoord.xy * scale.xy and log(depth) * scale.z + scale.w
+    ubo.clusterScale = {
+        static_cast<float>(CLUSTERS_X) / extent.width,
+        static_cast<float>(CLUSTERS_Y) / extent.height,
+        CLUSTERS_Z / logDepthRange,
+        -CLUSTERS_Z * std::log(near) / logDepthRange
+    };
+    ubo.clusterCounts = {CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, 0};
+    ubo.numLights = static_cast<int>(lightCount);
+
+    m_stats.buildTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void GlorpLightClusters::assignLight(const glm::vec3 &center, float range, uint32_t light) {
+    if (range <= 0.f || center.z + range < m_sliceDepths.front() || center.z - range > m_sliceDepths.back()) {
+        return;
+    }
+    auto slice = [&](float depth) {
+        auto it = std::upper_bound(m_sliceDepths.begin(), m_sliceDepths.end(), depth);
+        return static_cast<uint32_t>(std::clamp<ptrdiff_t>(it - m_sliceDepths.begin() - 1, 0, CLUSTERS_Z - 1));
+    };
+    uint32_t firstSlice = slice(center.z - range);
+    uint32_t lastSlice = slice(center.z + range);
+
+    for (uint32_t z = firstSlice; z <= lastSlice; z++) {
+        float sliceNear = std::max(m_sliceDepths[z], center.z - range);
+        float sliceFar = std::min(m_sliceDepths[z + 1], center.z + range);
+        if (sliceNear > sliceFar) {
+            continue;
+        }
+        // the sphere's widest cross section within the slice
+        float dz = center.z < sliceNear ? sliceNear - center.z : (center.z > sliceFar ? center.z - sliceFar : 0.f);
+        float radius = std::sqrt(std::max(range * range - dz * dz, 0.f));
+
+        // x / z only grows or shrinks with z, so the corners of the cross section box at the slice's
+        // near and far depth bound its projection
+        auto tiles = [&](float c, float scale, uint32_t tileCount, uint32_t &first, uint32_t &last) {
+            float low = scale * std::min((c - radius) / sliceNear, (c - radius) / sliceFar);
+            float high = scale * std::max((c + radius) / sliceNear, (c + radius) / sliceFar);
+            if (high < -1.f || low > 1.f) {
+                return false;
+            }
+            first = static_cast<uint32_t>(std::clamp((low * .5f + .5f) * tileCount, 0.f, tileCount - 1.f));
+            last = static_cast<uint32_t>(std::clamp((high * .5f + .5f) * tileCount, 0.f, tileCount - 1.f));
+            return true;
+        };
+        uint32_t firstX, lastX, firstY, lastY;
+        if (!tiles(center.x, m_projectionX, CLUSTERS_X, firstX, lastX) || !tiles(center.y, m_projectionY, CLUSTERS_Y, firstY, lastY)) {
+            continue;
+        }
+        for (uint32_t y = firstY; y <= lastY; y++) {
+            for (uint32_t x = firstX; x <= lastX; x++) {
+                uint32_t cluster = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+                m_clusterCounts[cluster]++;
+                m_assignments.push_back({cluster, light});
+            }
+        }
+    }
+}
+}
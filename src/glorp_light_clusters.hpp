@@ -0,0 +1,84 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_buffer.hpp"
+#include "glorp_camera.hpp"
+#include "glorp_frame_info.hpp"
+#include "glorp_swap_chain.hpp"
+
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Glorp {
+
+// Clustered forward lighting. The view frustum is cut into a grid of froxels, screen tiles in x and y
+// and logarithmic depth slices in z, and every frame each point light is binned into the froxels its
+// range overlaps. The fragment shader then looks up the froxel it falls into and only shades the
+// lights listed there, so the per fragment cost follows the local light density instead of the scene's
+// light count.
+//
+// Buffers of the global descriptor set, one of each per frame in flight:
+//   2 lights, storage buffer of PointLight
+//   3 froxels, storage buffer of (first light index, light count)
+//   4 light indices, storage buffer of uint, the lists of all froxels back to back
+class GlorpLightClusters {
+    public:
+        static constexpr uint32_t CLUSTERS_X = 16;
+        static constexpr uint32_t CLUSTERS_Y = 9;
+        static constexpr uint32_t CLUSTERS_Z = 24;
+        static constexpr uint32_t CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+        // froxel light lists past this many entries in total are cut short
+        static constexpr uint32_t MAX_LIGHT_INDICES = 1 << 18;
+
+        struct Stats {
+            uint32_t lights = 0;
+            // lights overlapping at least one froxel
+            uint32_t visibleLights = 0;
+            uint32_t lightIndices = 0;
+            uint32_t droppedIndices = 0;
+            uint32_t maxLightsPerCluster = 0;
+            float buildTimeMs = 0.f;
+        };
+
+        explicit GlorpLightClusters(GlorpDevice &device);
+
+        GlorpLightClusters(const GlorpLightClusters&) = delete;
+        GlorpLightClusters &operator=(const GlorpLightClusters&) = delete;
+
+        VkDescriptorBufferInfo lightsInfo(int frameIndex) { return m_lightBuffers[frameIndex]->descriptorInfo(); }
+        VkDescriptorBufferInfo clustersInfo(int frameIndex) { return m_clusterBuffers[frameIndex]->descriptorInfo(); }
+        VkDescriptorBufferInfo lightIndicesInfo(int frameIndex) { return m_lightIndexBuffers[frameIndex]->descriptorInfo(); }
+
+        // Bins lights into the froxels of camera's perspective projection over a framebuffer of extent and
+        // writes them to the buffers of frameIndex, which the GPU may no longer be reading. Fills in the
+        // cluster fields and numLights of ubo. Lights past MAX_LIGHTS are ignored.
+        void build(int frameIndex, const GlorpCamera &camera, VkExtent2D extent, std::span<const PointLight> lights, GlobalUbo &ubo);
+
+        const Stats &getStats() const { return m_stats; }
+    private:
+        struct Assignment {
+            uint32_t cluster;
+            uint32_t light;
+        };
+
+        void assignLight(const glm::vec3 &center, float range, uint32_t light);
+    private:
+        GlorpDevice &m_glorpDevice;
+
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_lightBuffers;
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_clusterBuffers;
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_lightIndexBuffers;
+
+        // state of the build in progress, kept to reuse the allocations
+        float m_projectionX = 1.f;
+        float m_projectionY = 1.f;
+        std::array<float, CLUSTERS_Z + 1> m_sliceDepths{};
+        std::vector<Assignment> m_assignments;
+        std::vector<uint32_t> m_clusterCounts;
+        std::vector<uint32_t> m_clusterCursors;
+
+        Stats m_stats;
+};
+}
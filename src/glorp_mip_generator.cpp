@@ -0,0 +1,264 @@
+#include "glorp_mip_generator.hpp"
+
+#include "glorp_buffer.hpp"
+#include "glorp_file_io.hpp"
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_upload_context.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+namespace Glorp {
+
+namespace {
+constexpr uint32_t TILE_SIZE = 64;
+constexpr uint32_t SETS_PER_POOL = 64;
+
+struct PushConstants {
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t srgb;
+    uint32_t workgroupCount;
+};
+}
+
+GlorpMipGenerator::GlorpMipGenerator(GlorpDevice &device) : m_device{device} {
+    auto indices = m_device.findPhysicalQueueFamilies();
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_device.getPhysicalDevice(), &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_device.getPhysicalDevice(), &familyCount, families.data());
+
+    m_supported = (families[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 &&
+        m_device.properties.limits.maxPerStageDescriptorStorageImages >= MAX_LEVELS &&
+        m_device.properties.limits.maxComputeWorkGroupInvocations >= 256;
+    // A storage view of an sRGB image needs VK_IMAGE_CREATE_EXTENDED_USAGE_BIT, core since 1.1
+    m_srgbViews = m_device.properties.apiVersion >= VK_API_VERSION_1_1;
+    if (!m_supported) {
+        return;
+    }
+
+    createDescriptors();
+    createPipeline();
+}
+
+GlorpMipGenerator::~GlorpMipGenerator() {
+    vkDestroyPipeline(m_device.device(), m_pipeline, nullptr);
+    vkDestroyShaderModule(m_device.device(), m_shaderModule, nullptr);
+    vkDestroyPipelineLayout(m_device.device(), m_pipelineLayout, nullptr);
+}
+
+void GlorpMipGenerator::createDescriptors() {
+    m_setLayout = GlorpDescriptorSetLayout::Builder(m_device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, MAX_LEVELS)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .build();
+}
+
+GlorpDescriptorPool &GlorpMipGenerator::allocateSet(VkDescriptorSet &set) {
+    std::lock_guard lock{m_descriptorMutex};
+    for (auto &pool : m_descriptorPools) {
+        if (pool->allocateDescriptor(m_setLayout->getDescriptorSetLayout(), set)) {
+            return *pool;
+        }
+    }
+    // A single batch can generate mips for more textures than one pool holds
+    m_descriptorPools.push_back(GlorpDescriptorPool::Builder(m_device)
+        .setMaxSets(SETS_PER_POOL)
+        .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, SETS_PER_POOL * MAX_LEVELS)
+        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SETS_PER_POOL)
+        .build());
+    if (!m_descriptorPools.back()->allocateDescriptor(m_setLayout->getDescriptorSetLayout(), set)) {
+        throw std::runtime_error("Failed to allocate mip generator descriptor set");
+    }
+    return *m_descriptorPools.back();
+}
+
+void GlorpMipGenerator::createPipeline() {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkDescriptorSetLayout setLayout = m_setLayout->getDescriptorSetLayout();
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create mip generator pipeline layout");
+    }
+
+    auto code = GlorpFileIo::shared().readFile(std::string(RESOURCE_LOCATIONS) + "shaders/mip_downsample.comp.spv");
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+    if (vkCreateShaderModule(m_device.device(), &moduleInfo, nullptr, &m_shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create mip generator shader module");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = m_shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_pipelineLayout;
+    auto &pipelineCache = m_device.getPipelineCache();
+    auto start = std::chrono::steady_clock::now();
+    if (vkCreateComputePipelines(m_device.device(), pipelineCache.getCache(), 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create mip generator pipeline");
+    }
+    pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+}
+
+bool GlorpMipGenerator::supports(VkFormat format, uint32_t levelCount) const {
+    if (!m_supported || levelCount > MAX_LEVELS) {
+        return false;
+    }
+    return format == VK_FORMAT_R8G8B8A8_UNORM || (format == VK_FORMAT_R8G8B8A8_SRGB && m_srgbViews);
+}
+
+VkImageCreateFlags GlorpMipGenerator::imageCreateFlags(VkFormat format) const {
+    if (format == VK_FORMAT_R8G8B8A8_SRGB) {
+        return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+    }
+    return 0;
+}
+
+void GlorpMipGenerator::generate(const Target &target) {
+    if (!supports(target.format, target.levelCount)) {
+        throw std::runtime_error("Mip generator does not support this image");
+    }
+
+    auto &uploadContext = m_device.getUploadContext();
+    VkCommandBuffer commandBuffer = uploadContext.getCommandBuffer();
+
+    // Storage views are always UNORM, the shader does the sRGB conversion itself
+    std::vector<VkImageView> views;
+    for (uint32_t i = 0; i < target.levelCount; i++) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = target.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, target.layerCount};
+        VkImageView view;
+        if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            for (VkImageView created : views) {
+                vkDestroyImageView(m_device.device(), created, nullptr);
+            }
+            throw std::runtime_error("Failed to create mip generator image view");
+        }
+        views.push_back(view);
+    }
+
+    auto counters = std::make_unique<GlorpBuffer>(
+        m_device,
+        sizeof(uint32_t),
+        target.layerCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+
+    VkDescriptorSet set;
+    GlorpDescriptorPool *pool;
+    try {
+        pool = &allocateSet(set);
+    } catch (...) {
+        for (VkImageView view : views) {
+            vkDestroyImageView(m_device.device(), view, nullptr);
+        }
+        throw;
+    }
+
+    // Slots past the last level still need a valid descriptor, the shader never touches them
+    std::array<VkDescriptorImageInfo, MAX_LEVELS> imageInfos{};
+    for (uint32_t i = 0; i < MAX_LEVELS; i++) {
+        imageInfos[i].imageView = views[std::min(i, target.levelCount - 1)];
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    VkDescriptorBufferInfo bufferInfo = counters->descriptorInfo();
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = MAX_LEVELS;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = imageInfos.data();
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(m_device.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    vkCmdFillBuffer(commandBuffer, counters->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+
+    VkBufferMemoryBarrier counterBarrier{};
+    counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.buffer = counters->getBuffer();
+    counterBarrier.offset = 0;
+    counterBarrier.size = VK_WHOLE_SIZE;
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = target.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, target.levelCount, 0, target.layerCount};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr, 1, &counterBarrier, 1, &barrier);
+
+    uint32_t groupsX = (target.width + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t groupsY = (target.height + TILE_SIZE - 1) / TILE_SIZE;
+    PushConstants push{};
+    push.width = target.width;
+    push.height = target.height;
+    push.levelCount = target.levelCount;
+    push.srgb = target.format == VK_FORMAT_R8G8B8A8_SRGB ? 1 : 0;
+    push.workgroupCount = groupsX * groupsY;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &push);
+    vkCmdDispatch(commandBuffer, groupsX, groupsY, target.layerCount);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    // The views, the set and the counters are referenced by the batch until it completes
+    std::shared_ptr<GlorpBuffer> counterBuffer = std::move(counters);
+    uploadContext.deferRelease([this, views = std::move(views), set, pool, counterBuffer]() mutable {
+        for (VkImageView view : views) {
+            vkDestroyImageView(m_device.device(), view, nullptr);
+        }
+        std::vector<VkDescriptorSet> sets{set};
+        std::lock_guard lock{m_descriptorMutex};
+        pool->freeDescriptors(sets);
+        counterBuffer.reset();
+    });
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_descriptors.hpp"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef RESOURCE_LOCATIONS
+#define RESOURCE_LOCATIONS ""
+#endif
+
+namespace Glorp {
+
+// Builds a whole mip chain in one compute dispatch instead of a blit and a barrier per level. Every
+// workgroup reduces a 64x64 tile down to six levels in shared memory, and the last workgroup of each
+// layer to finish, found through an atomic counter, reduces the remaining levels. sRGB images are
+// written through UNORM views and converted in the shader, since sRGB storage images are rarely
+// supported. Commands are recorded into the current upload batch.
+class GlorpMipGenerator {
+    public:
+        static constexpr uint32_t MAX_LEVELS = 13;
+
+        struct Target {
+            VkImage image = VK_NULL_HANDLE;
+            VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t levelCount = 1;
+            uint32_t layerCount = 1;
+        };
+
+        explicit GlorpMipGenerator(GlorpDevice &device);
+        ~GlorpMipGenerator();
+
+        GlorpMipGenerator(const GlorpMipGenerator&) = delete;
+        GlorpMipGenerator &operator=(const GlorpMipGenerator&) = delete;
+
+        bool supports(VkFormat format, uint32_t levelCount) const;
+        // Images passed to generate() need these create flags and VK_IMAGE_USAGE_STORAGE_BIT
+        VkImageCreateFlags imageCreateFlags(VkFormat format) const;
+
+        // Level 0 must be in TRANSFER_DST_OPTIMAL with the transfer writes done, the other levels in
+        // TRANSFER_DST_OPTIMAL or UNDEFINED. Every level ends up in SHADER_READ_ONLY_OPTIMAL.
+        void generate(const Target &target);
+    private:
+        void createDescriptors();
+        void createPipeline();
+        GlorpDescriptorPool &allocateSet(VkDescriptorSet &set);
+    private:
+        GlorpDevice &m_device;
+        bool m_supported = false;
+        bool m_srgbViews = false;
+
+        std::unique_ptr<GlorpDescriptorSetLayout> m_setLayout;
+        std::vector<std::unique_ptr<GlorpDescriptorPool>> m_descriptorPools;
+        std::mutex m_descriptorMutex;
+        VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+        VkShaderModule m_shaderModule = VK_NULL_HANDLE;
+        VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
+}
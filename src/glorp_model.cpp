@@ -2,11 +2,16 @@
 
 #include "first_app.hpp"
 #include "glorp_utils.hpp"
+#include "glorp_upload_context.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
+#include <iostream>
 #include <unordered_map>
 #include <memory>
+#include <numeric>
 #include <stdexcept>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -25,10 +30,54 @@ struct hash<Glorp::GlorpModel::Vertex> {
 
 namespace Glorp {
 GlorpModel::GlorpModel(GlorpDevice &device,const GlorpModel::Builder &builder) : m_glorpDevice{device} {
+    auto &uploadContext = m_glorpDevice.getUploadContext();
+    uploadContext.beginBatch();
     createVertexBuffers(builder.vertices);
     createIndexBuffers(builder.indices);
+    uploadContext.endBatch();
+    computeBounds(builder.vertices);
+    createOccluder(builder);
+}
+GlorpModel::~GlorpModel() {
+    m_glorpDevice.releaseDirectUpload(m_directUploadSize);
+}
+
+void GlorpModel::computeBounds(const std::vector<Vertex> &vertices) {
+    if (vertices.empty()) {
+        return;
+    }
+    // centered on the bounding box, not minimal but close enough for LOD and culling decisions
+    glm::vec3 minimum = vertices[0].position;
+    glm::vec3 maximum = vertices[0].position;
+    for (const auto &vertex : vertices) {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    m_boundsMin = minimum;
+    m_boundsMax = maximum;
+    m_boundingCenter = (minimum + maximum) * 0.5f;
+    float radiusSquared = 0.f;
+    for (const auto &vertex : vertices) {
+        glm::vec3 offset = vertex.position - m_boundingCenter;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    m_boundingRadius = std::sqrt(radiusSquared);
+}
+
+void GlorpModel::createOccluder(const Builder &builder) {
+    std::vector<glm::vec3> positions(builder.vertices.size());
+    std::transform(builder.vertices.begin(), builder.vertices.end(), positions.begin(), [](const Vertex &vertex) { return vertex.position; });
+    if (builder.indices.empty()) {
+        std::vector<uint32_t> indices(positions.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        m_occluder = GlorpOccluderMesh::fromTriangles(positions, indices, MAX_OCCLUDER_TRIANGLES);
+    } else {
+        m_occluder = GlorpOccluderMesh::fromTriangles(positions, builder.indices, MAX_OCCLUDER_TRIANGLES);
+    }
+    if (m_occluder.triangleCount() == 0 && !positions.empty()) {
+        std::cout << "Model of " << positions.size() << " vertices encloses no volume to occlude with, it is never an occluder" << std::endl;
+    }
 }
-GlorpModel::~GlorpModel() {}
 
 void computeTangentsAndBitangents(std::vector<GlorpModel::Vertex>& vertices, std::vector<uint32_t>& indices) {
     std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
@@ -76,33 +125,60 @@ void computeTangentsAndBitangents(std::vector<GlorpModel::Vertex>& vertices, std
     }
 }
 
-void GlorpModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
-    m_vertexCount = static_cast<uint32_t>(vertices.size());
-    assert(m_vertexCount >= 3 && "Vertex count must be at least 3");
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * m_vertexCount;
-
-    uint32_t vertexSize = sizeof(vertices[0]);
-
-    GlorpBuffer stagingBuffer {
-        m_glorpDevice,
-        vertexSize,
-        m_vertexCount,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
-
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *)vertices.data());
+std::unique_ptr<GlorpBuffer> GlorpModel::createDeviceBuffer(const void *data, uint32_t elementSize, uint32_t elementCount, VkBufferUsageFlags usage) {
+    VkDeviceSize bufferSize = static_cast<VkDeviceSize>(elementSize) * elementCount;
+
+    // On UMA / ReBAR devices the final allocation is host visible, so write it in place
+    if (m_glorpDevice.reserveDirectUpload(bufferSize)) {
+        auto buffer = std::make_unique<GlorpBuffer>(
+            m_glorpDevice,
+            elementSize,
+            elementCount,
+            usage,
+            GlorpDevice::DIRECT_UPLOAD_MEMORY_PROPERTIES
+        );
+        buffer->map();
+        buffer->writeToBuffer(const_cast<void *>(data));
+        buffer->unmap();
+        m_directUploadSize += bufferSize;
+        return buffer;
+    }
 
-    m_vertexBuffer = std::make_unique<GlorpBuffer>(
+    auto buffer = std::make_unique<GlorpBuffer>(
         m_glorpDevice,
-        vertexSize,
-        m_vertexCount,
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        elementSize,
+        elementCount,
+        usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
     );
 
-    m_glorpDevice.copyBuffer(stagingBuffer.getBuffer(), m_vertexBuffer->getBuffer(), bufferSize);
+    auto &uploadContext = m_glorpDevice.getUploadContext();
+    uploadContext.beginBatch();
+    auto staging = uploadContext.stage(data, bufferSize);
+    uploadContext.copyBuffer(staging, buffer->getBuffer());
+    uploadContext.releaseBuffer(
+        buffer->getBuffer(),
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+    );
+    uploadContext.endBatch();
+    return buffer;
+}
+
+void GlorpModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
+    m_vertexCount = static_cast<uint32_t>(vertices.size());
+    assert(m_vertexCount >= 3 && "Vertex count must be at least 3");
+
+    std::vector<glm::vec3> positions;
+    std::vector<VertexAttributes> attributes;
+    positions.reserve(vertices.size());
+    attributes.reserve(vertices.size());
+    for (const auto &vertex : vertices) {
+        positions.push_back(vertex.position);
+        attributes.push_back({vertex.color, vertex.normal, vertex.uv, vertex.tangent, vertex.bitangent});
+    }
+    m_positionBuffer = createDeviceBuffer(positions.data(), sizeof(glm::vec3), m_vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    m_attributeBuffer = createDeviceBuffer(attributes.data(), sizeof(VertexAttributes), m_vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
 }
 
 void GlorpModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
@@ -113,36 +189,14 @@ void GlorpModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
         return;
     }
 
-    VkDeviceSize bufferSize = sizeof(indices[0]) * m_indexCount;
-
     uint32_t indexSize = sizeof(indices[0]);
-
-    GlorpBuffer stagingBuffer {
-        m_glorpDevice,
-        indexSize,
-        m_indexCount,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    };
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *) indices.data());
-
-    m_indexBuffer = std::make_unique<GlorpBuffer> (
-        m_glorpDevice,
-        indexSize,
-        m_indexCount,
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    );
-
-
-    m_glorpDevice.copyBuffer(stagingBuffer.getBuffer(), m_indexBuffer->getBuffer(), bufferSize);
+    m_indexBuffer = createDeviceBuffer(indices.data(), indexSize, m_indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 }
 
-void GlorpModel::bind(VkCommandBuffer commandBuffer) {
-    VkBuffer buffers[] = {m_vertexBuffer->getBuffer()};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+void GlorpModel::bind(VkCommandBuffer commandBuffer, Streams streams) {
+    VkBuffer buffers[] = {m_positionBuffer->getBuffer(), m_attributeBuffer->getBuffer()};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, streams == Streams::All ? 2 : 1, buffers, offsets);
 
     if(m_hasIndexBuffer) {
         vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
@@ -157,22 +211,33 @@ void GlorpModel::draw(VkCommandBuffer commandBuffer) {
     }
 }
 
-std::vector<VkVertexInputBindingDescription> GlorpModel::Vertex::getBindingDescriptions() {
-    std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-    bindingDescriptions[0].binding = 0;
-    bindingDescriptions[0].stride = sizeof(Vertex);
-    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+void GlorpModel::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset) {
+    if(m_hasIndexBuffer) {
+        vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+        vkCmdDrawIndirect(commandBuffer, buffer, offset, 1, sizeof(VkDrawIndirectCommand));
+    }
+}
+
+std::vector<VkVertexInputBindingDescription> GlorpModel::Vertex::getBindingDescriptions(Streams streams) {
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+    bindingDescriptions.push_back({0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX});
+    if (streams == Streams::All) {
+        bindingDescriptions.push_back({1, sizeof(VertexAttributes), VK_VERTEX_INPUT_RATE_VERTEX});
+    }
     return bindingDescriptions;
 }
-std::vector<VkVertexInputAttributeDescription> GlorpModel::Vertex::getAttributeDescriptions() {
+std::vector<VkVertexInputAttributeDescription> GlorpModel::Vertex::getAttributeDescriptions(Streams streams) {
     std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 
-    attributeDescriptions.push_back({0,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)});
-    attributeDescriptions.push_back({1,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)});
-    attributeDescriptions.push_back({2,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)});
-    attributeDescriptions.push_back({3,0,VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)});
-    attributeDescriptions.push_back({4,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, tangent)});
-    attributeDescriptions.push_back({5,0,VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, bitangent)});
+    attributeDescriptions.push_back({0,0,VK_FORMAT_R32G32B32_SFLOAT, 0});
+    if (streams == Streams::All) {
+        attributeDescriptions.push_back({1,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexAttributes, color)});
+        attributeDescriptions.push_back({2,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexAttributes, normal)});
+        attributeDescriptions.push_back({3,1,VK_FORMAT_R32G32_SFLOAT, offsetof(VertexAttributes, uv)});
+        attributeDescriptions.push_back({4,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexAttributes, tangent)});
+        attributeDescriptions.push_back({5,1,VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexAttributes, bitangent)});
+    }
 
     return attributeDescriptions;
 }
@@ -184,6 +249,106 @@ std::unique_ptr<GlorpModel> GlorpModel::createModelFromGLTF(GlorpDevice &device,
     return std::make_unique<GlorpModel>(device, builder);
 }
 
+std::unique_ptr<GlorpModel> GlorpModel::createModelFromGLB(GlorpDevice &device, const GlorpGlbFile &file) {
+    Builder builder{};
+    builder.loadModelFromGLB(file);
+
+    return std::make_unique<GlorpModel>(device, builder);
+}
+
+namespace {
+// Strided view of one vertex attribute, pointing straight into the source buffer
+struct AttributeStream {
+    const std::byte *data = nullptr;
+    size_t stride = 0;
+    size_t count = 0;
+
+    bool empty() const { return data == nullptr; }
+    bool contains(size_t index) const { return empty() || index < count; }
+
+    template <typename T>
+    T read(size_t index) const {
+        T value;
+        std::memcpy(&value, data + index * stride, sizeof(T));
+        return value;
+    }
+};
+
+struct PrimitiveStreams {
+    AttributeStream positions;
+    AttributeStream normals;
+    AttributeStream uvs;
+    AttributeStream colors;
+};
+
+template <typename IndexType>
+void appendIndexedVertices(GlorpModel::Builder &builder, const PrimitiveStreams &streams, const std::byte *indexData, size_t indexCount,
+                           std::unordered_map<GlorpModel::Vertex, uint32_t> &uniqueVertices) {
+    for (size_t i = 0; i < indexCount; ++i) {
+        IndexType index;
+        std::memcpy(&index, indexData + i * sizeof(IndexType), sizeof(IndexType));
+        if (index >= streams.positions.count || !streams.normals.contains(index) || !streams.uvs.contains(index) || !streams.colors.contains(index)) {
+            throw std::runtime_error("Vertex index out of range of its attributes");
+        }
+
+        GlorpModel::Vertex vertex{};
+        glm::vec3 position = streams.positions.read<glm::vec3>(index);
+        vertex.position = {position.x, position.z, -position.y};
+        if (!streams.normals.empty()) {
+            glm::vec3 normal = streams.normals.read<glm::vec3>(index);
+            vertex.normal = {normal.x, normal.z, -normal.y};
+        } else {
+            vertex.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+        vertex.uv = !streams.uvs.empty() ? streams.uvs.read<glm::vec2>(index) : glm::vec2(0.0f, 0.0f);
+        vertex.color = !streams.colors.empty() ? streams.colors.read<glm::vec3>(index) : glm::vec3(1.0f, 1.0f, 1.0f);
+
+        if (uniqueVertices.count(vertex) == 0) {
+            uniqueVertices[vertex] = static_cast<uint32_t>(builder.vertices.size());
+            builder.vertices.push_back(vertex);
+        }
+        builder.indices.push_back(uniqueVertices[vertex]);
+    }
+}
+
+// glTF component type enums, shared by tinygltf and raw glb JSON
+void appendPrimitive(GlorpModel::Builder &builder, const PrimitiveStreams &streams, int indexComponentType, const std::byte *indexData, size_t indexCount,
+                     std::unordered_map<GlorpModel::Vertex, uint32_t> &uniqueVertices) {
+    switch (indexComponentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            appendIndexedVertices<uint8_t>(builder, streams, indexData, indexCount, uniqueVertices);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            appendIndexedVertices<uint16_t>(builder, streams, indexData, indexCount, uniqueVertices);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            appendIndexedVertices<uint32_t>(builder, streams, indexData, indexCount, uniqueVertices);
+            break;
+        default:
+            throw std::runtime_error("Unsupported index type");
+    }
+}
+
+AttributeStream gltfAttributeStream(const tinygltf::Model &model, int accessorIndex) {
+    const auto& accessor = model.accessors.at(accessorIndex);
+    const auto& bufferView = model.bufferViews.at(accessor.bufferView);
+    const auto& buffer = model.buffers.at(bufferView.buffer);
+    return {
+        reinterpret_cast<const std::byte*>(&buffer.data[bufferView.byteOffset + accessor.byteOffset]),
+        static_cast<size_t>(accessor.ByteStride(bufferView)),
+        accessor.count
+    };
+}
+
+AttributeStream glbAttributeStream(const GlorpGlbFile &file, const nlohmann::json &attributes, const char *name) {
+    if (!attributes.contains(name)) {
+        return {};
+    }
+    auto accessor = file.accessor(attributes.at(name).get<size_t>());
+    return {accessor.data.data(), accessor.stride, accessor.count};
+}
+}
+
 void GlorpModel::Builder::loadModelFromGLTF(tinygltf::Model &model) {
     vertices.clear();
     indices.clear();
@@ -192,49 +357,16 @@ void GlorpModel::Builder::loadModelFromGLTF(tinygltf::Model &model) {
 
     for (const auto& mesh : model.meshes) {
         for (const auto& primitive : mesh.primitives) {
-            // Load vertex positions
-            const auto& positionAccessor = model.accessors.at(primitive.attributes.at("POSITION"));
-            const auto& positionBufferView = model.bufferViews.at(positionAccessor.bufferView);
-            const auto& positionBuffer = model.buffers.at(positionBufferView.buffer);
-            const float* positions = reinterpret_cast<const float*>(&positionBuffer.data[positionBufferView.byteOffset + positionAccessor.byteOffset]);
-
-            // Load normals
-            std::vector<glm::vec3> normals;
+            PrimitiveStreams streams{};
+            streams.positions = gltfAttributeStream(model, primitive.attributes.at("POSITION"));
             if (primitive.attributes.count("NORMAL")) {
-                const auto& normalAccessor = model.accessors.at(primitive.attributes.at("NORMAL"));
-                const auto& normalBufferView = model.bufferViews.at(normalAccessor.bufferView);
-                const auto& normalBuffer = model.buffers.at(normalBufferView.buffer);
-                const float* normalData = reinterpret_cast<const float*>(&normalBuffer.data[normalBufferView.byteOffset + normalAccessor.byteOffset]);
-                normals.resize(normalAccessor.count);
-                for (size_t i = 0; i < normalAccessor.count; ++i) {
-                    normals[i] = { normalData[i * 3 + 0], normalData[i * 3 + 1], normalData[i * 3 + 2] };
-                }
+                streams.normals = gltfAttributeStream(model, primitive.attributes.at("NORMAL"));
             }
-
-            // Load UVs
-            std::vector<glm::vec2> uvs;
             if (primitive.attributes.count("TEXCOORD_0")) {
-                const auto& uvAccessor = model.accessors.at(primitive.attributes.at("TEXCOORD_0"));
-                const auto& uvBufferView = model.bufferViews.at(uvAccessor.bufferView);
-                const auto& uvBuffer = model.buffers.at(uvBufferView.buffer);
-                const float* uvData = reinterpret_cast<const float*>(&uvBuffer.data[uvBufferView.byteOffset + uvAccessor.byteOffset]);
-                uvs.resize(uvAccessor.count);
-                for (size_t i = 0; i < uvAccessor.count; ++i) {
-                    uvs[i] = { uvData[i * 2 + 0], uvData[i * 2 + 1] };
-                }
+                streams.uvs = gltfAttributeStream(model, primitive.attributes.at("TEXCOORD_0"));
             }
-
-            // Load Colors
-            std::vector<glm::vec3> colors;
             if (primitive.attributes.count("COLOR_0")) {
-                const auto& colorAccessor = model.accessors.at(primitive.attributes.at("COLOR_0"));
-                const auto& colorBufferView = model.bufferViews.at(colorAccessor.bufferView);
-                const auto& colorBuffer = model.buffers.at(colorBufferView.buffer);
-                const float* colorData = reinterpret_cast<const float*>(&colorBuffer.data[colorBufferView.byteOffset + colorAccessor.byteOffset]);
-                colors.resize(colorAccessor.count);
-                for (size_t i = 0; i < colorAccessor.count; ++i) {
-                    colors[i] = { colorData[i * 3 + 0], colorData[i * 3 + 1], colorData[i * 3 + 2] };
-                }
+                streams.colors = gltfAttributeStream(model, primitive.attributes.at("COLOR_0"));
             }
 
             // Process indices
@@ -242,89 +374,39 @@ void GlorpModel::Builder::loadModelFromGLTF(tinygltf::Model &model) {
                 const auto& indexAccessor = model.accessors.at(primitive.indices);
                 const auto& indexBufferView = model.bufferViews.at(indexAccessor.bufferView);
                 const auto& indexBuffer = model.buffers.at(indexBufferView.buffer);
-                const uint8_t* indexData = &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset];
-
-                switch (indexAccessor.componentType) {
-                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
-                        const uint8_t* indicesUByte = reinterpret_cast<const uint8_t*>(indexData);
-                        for (size_t i = 0; i < indexAccessor.count; ++i) {
-                            Vertex vertex{};
-                            vertex.position = {
-                                positions[indicesUByte[i] * 3 + 0],
-                                positions[indicesUByte[i] * 3 + 2],
-                                -positions[indicesUByte[i] * 3 + 1]
-                            };
-                            vertex.normal = vertex.normal = !normals.empty() ? glm::vec3(
-                                    normals[indicesUByte[i]].x,
-                                    normals[indicesUByte[i]].z,
-                                    -normals[indicesUByte[i]].y
-                                ) : glm::vec3(0.0f, 0.0f, 1.0f);
-
-                            vertex.uv = !uvs.empty() ? uvs[indicesUByte[i]] : glm::vec2(0.0f, 0.0f);
-                            vertex.color = !colors.empty() ? colors[indicesUByte[i]] : glm::vec3(1.0f, 1.0f, 1.0f);
-
-                            if (uniqueVertices.count(vertex) == 0) {
-                                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                                vertices.push_back(vertex);
-                            }
-                            indices.push_back(uniqueVertices[vertex]);
-                        }
-                        break;
-                    }
-                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
-                        const uint16_t* indicesUShort = reinterpret_cast<const uint16_t*>(indexData);
-                        for (size_t i = 0; i < indexAccessor.count; ++i) {
-                            Vertex vertex{};
-                            vertex.position = {
-                                positions[indicesUShort[i] * 3 + 0],
-                                positions[indicesUShort[i] * 3 + 2],
-                                -positions[indicesUShort[i] * 3 + 1]
-                            };
-                            vertex.normal = vertex.normal = !normals.empty() ? glm::vec3(
-                                    normals[indicesUShort[i]].x,
-                                    normals[indicesUShort[i]].z,
-                                    -normals[indicesUShort[i]].y
-                                ) : glm::vec3(0.0f, 0.0f, 1.0f);
-
-                            vertex.uv = !uvs.empty() ? uvs[indicesUShort[i]] : glm::vec2(0.0f, 0.0f);
-                            vertex.color = !colors.empty() ? colors[indicesUShort[i]] : glm::vec3(1.0f, 1.0f, 1.0f);
-
-                            if (uniqueVertices.count(vertex) == 0) {
-                                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                                vertices.push_back(vertex);
-                            }
-                            indices.push_back(uniqueVertices[vertex]);
-                        }
-                        break;
-                    }
-                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
-                        const uint32_t* indicesUInt = reinterpret_cast<const uint32_t*>(indexData);
-                        for (size_t i = 0; i < indexAccessor.count; ++i) {
-                            Vertex vertex{};
-                            vertex.position = {
-                                positions[indicesUInt[i] * 3 + 0],
-                                positions[indicesUInt[i] * 3 + 2],
-                                -positions[indicesUInt[i] * 3 + 1]
-                            };
-                            vertex.normal = vertex.normal = !normals.empty() ? glm::vec3(
-                                normals[indicesUInt[i]].x,
-                                normals[indicesUInt[i]].z,
-                                -normals[indicesUInt[i]].y
-                            ) : glm::vec3(0.0f, 0.0f, 1.0f);
-                            vertex.uv = !uvs.empty() ? uvs[indicesUInt[i]] : glm::vec2(0.0f, 0.0f);
-                            vertex.color = !colors.empty() ? colors[indicesUInt[i]] : glm::vec3(1.0f, 1.0f, 1.0f);
-
-                            if (uniqueVertices.count(vertex) == 0) {
-                                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                                vertices.push_back(vertex);
-                            }
-                            indices.push_back(uniqueVertices[vertex]);
-                        }
-                        break;
-                    }
-                    default:
-                        throw std::runtime_error("Unsupported index type");
-                }
+                const auto* indexData = reinterpret_cast<const std::byte*>(&indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset]);
+                appendPrimitive(*this, streams, indexAccessor.componentType, indexData, indexAccessor.count, uniqueVertices);
+            }
+        }
+    }
+    computeTangentsAndBitangents(vertices, indices);
+}
+
+void GlorpModel::Builder::loadModelFromGLB(const GlorpGlbFile &file) {
+    vertices.clear();
+    indices.clear();
+
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+
+    const auto &json = file.json();
+    if (!json.contains("meshes")) {
+        return;
+    }
+    for (const auto& mesh : json.at("meshes")) {
+        for (const auto& primitive : mesh.at("primitives")) {
+            const auto& attributes = primitive.at("attributes");
+            PrimitiveStreams streams{};
+            streams.positions = glbAttributeStream(file, attributes, "POSITION");
+            streams.normals = glbAttributeStream(file, attributes, "NORMAL");
+            streams.uvs = glbAttributeStream(file, attributes, "TEXCOORD_0");
+            streams.colors = glbAttributeStream(file, attributes, "COLOR_0");
+            if (streams.positions.empty()) {
+                throw std::runtime_error("glb primitive has no POSITION attribute");
+            }
+
+            if (primitive.contains("indices")) {
+                auto indexAccessor = file.accessor(primitive.at("indices").get<size_t>());
+                appendPrimitive(*this, streams, indexAccessor.componentType, indexAccessor.data.data(), indexAccessor.count, uniqueVertices);
             }
         }
     }
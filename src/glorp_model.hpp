@@ -2,6 +2,8 @@
 
 #include "glorp_device.hpp"
 #include "glorp_buffer.hpp"
+#include "glorp_glb_file.hpp"
+#include "glorp_occlusion_culler.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -16,6 +18,26 @@
 namespace Glorp {
 class GlorpModel {
     public:
+        // models with more triangles occlude with boxes inside their volume instead
+        static constexpr uint32_t MAX_OCCLUDER_TRIANGLES = 1024;
+
+        // Vertex buffers a pipeline reads. Positions live in binding 0 on their own, everything else is
+        // interleaved in binding 1, so geometry only passes never fetch the shading attributes.
+        enum class Streams {
+            Positions,
+            All
+        };
+
+        // Layout of binding 1
+        struct VertexAttributes {
+          glm::vec3 color {};
+          glm::vec3 normal {};
+          glm::vec2 uv {};
+          glm::vec3 tangent {};
+          glm::vec3 bitangent {};
+        };
+
+        // What the loaders build, split into the two streams on upload
         struct Vertex {
           glm::vec3 position {};
           glm::vec3 color {};
@@ -24,8 +46,9 @@ class GlorpModel {
           glm::vec3 tangent {};
           glm::vec3 bitangent {};
 
-          static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-          static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+          // position at location 0, then color, normal, uv, tangent and bitangent with Streams::All
+          static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(Streams streams = Streams::All);
+          static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(Streams streams = Streams::All);
 
           bool operator==(const Vertex &other) const {
             return position == other.position && color == other.color && normal == other.normal && uv == other.uv;
@@ -37,6 +60,8 @@ class GlorpModel {
             std::vector<uint32_t> indices{};
 
             void loadModelFromGLTF(tinygltf::Model &model);
+            // Decodes vertices straight out of the mapped BIN chunk
+            void loadModelFromGLB(const GlorpGlbFile &file);
         };
 
         GlorpModel(GlorpDevice &device, const GlorpModel::Builder &builder);
@@ -46,22 +71,50 @@ class GlorpModel {
         GlorpModel &operator=(const GlorpModel &) = delete;
 
         static std::unique_ptr<GlorpModel> createModelFromGLTF(GlorpDevice &device, tinygltf::Model &model);
+        static std::unique_ptr<GlorpModel> createModelFromGLB(GlorpDevice &device, const GlorpGlbFile &file);
 
-        void bind(VkCommandBuffer commandBuffer);
+        // streams has to match the vertex input of the bound pipeline
+        void bind(VkCommandBuffer commandBuffer, Streams streams = Streams::All);
         void draw(VkCommandBuffer commandBuffer);
+        // Draws with the command at offset, a VkDrawIndexedIndirectCommand when the model is indexed and a
+        // VkDrawIndirectCommand otherwise. Both start with the count getDrawCount returns and the instance count.
+        void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset);
+        uint32_t getDrawCount() const { return m_hasIndexBuffer ? m_indexCount : m_vertexCount; }
+
+        // Model space sphere around every vertex
+        glm::vec3 getBoundingCenter() const { return m_boundingCenter; }
+        float getBoundingRadius() const { return m_boundingRadius; }
+        // Model space box around every vertex
+        glm::vec3 getBoundsMin() const { return m_boundsMin; }
+        glm::vec3 getBoundsMax() const { return m_boundsMax; }
+
+        const GlorpOccluderMesh &getOccluder() const { return m_occluder; }
     private:
+        void computeBounds(const std::vector<Vertex> &vertices);
+        void createOccluder(const Builder &builder);
         void createVertexBuffers(const std::vector<Vertex> &vertices);
         void createIndexBuffers(const std::vector<uint32_t> &indices);
+        std::unique_ptr<GlorpBuffer> createDeviceBuffer(const void *data, uint32_t elementSize, uint32_t elementCount, VkBufferUsageFlags usage);
 
 
     private:
         GlorpDevice& m_glorpDevice;
 
-        std::unique_ptr<GlorpBuffer> m_vertexBuffer;
+        std::unique_ptr<GlorpBuffer> m_positionBuffer;
+        std::unique_ptr<GlorpBuffer> m_attributeBuffer;
         uint32_t m_vertexCount;
 
         bool m_hasIndexBuffer = false;
         std::unique_ptr<GlorpBuffer> m_indexBuffer;
         uint32_t m_indexCount;
+
+        VkDeviceSize m_directUploadSize = 0;
+
+        glm::vec3 m_boundingCenter{0.f};
+        float m_boundingRadius = 0.f;
+        glm::vec3 m_boundsMin{0.f};
+        glm::vec3 m_boundsMax{0.f};
+
+        GlorpOccluderMesh m_occluder;
 };
 }
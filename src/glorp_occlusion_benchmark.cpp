@@ -0,0 +1,122 @@
+#include "glorp_occlusion_benchmark.hpp"
+#include "glorp_camera.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace Glorp {
+
+namespace {
+constexpr int BLOCKS = 8;
+constexpr float BLOCK_SPACING = 12.f;
+constexpr float BUILDING_SIZE = 8.f;
+constexpr uint32_t OCCLUDEES = 4096;
+
+// Box with every face cut into subdivisions x subdivisions quads, so the walls cost what real meshes do
+GlorpOccluderMesh makeBox(const glm::vec3 &minimum, const glm::vec3 &maximum, uint32_t subdivisions) {
+    GlorpOccluderMesh mesh;
+    auto face = [&](const glm::vec3 &origin, const glm::vec3 &u, const glm::vec3 &v) {
+        uint32_t first = static_cast<uint32_t>(mesh.positions.size());
+        for (uint32_t y = 0; y <= subdivisions; y++) {
+            for (uint32_t x = 0; x <= subdivisions; x++) {
+                mesh.positions.push_back(origin + u * (static_cast<float>(x) / subdivisions) + v * (static_cast<float>(y) / subdivisions));
+            }
+        }
+        for (uint32_t y = 0; y < subdivisions; y++) {
+            for (uint32_t x = 0; x < subdivisions; x++) {
+                uint32_t i = first + y * (subdivisions + 1) + x;
+                mesh.indices.insert(mesh.indices.end(), {i, i + 1, i + subdivisions + 1, i + 1, i + subdivisions + 2, i + subdivisions + 1});
+            }
+        }
+    };
+    glm::vec3 size = maximum - minimum;
+    glm::vec3 dx{size.x, 0.f, 0.f}, dy{0.f, size.y, 0.f}, dz{0.f, 0.f, size.z};
+    face(minimum, dx, dy);
+    face(minimum + dz, dx, dy);
+    face(minimum, dz, dy);
+    face(minimum + dx, dz, dy);
+    face(minimum, dx, dz);
+    face(minimum + dy, dx, dz);
+    mesh.buildAdjacency();
+    return mesh;
+}
+}
+
+GlorpOcclusionBenchmark::Result GlorpOcclusionBenchmark::run(uint32_t frames, uint32_t workerCount) {
+    std::mt19937 random{1234};
+
+    // buildings centered on a grid, the y axis points down like in the engine's scenes
+    std::vector<GlorpOccluderMesh> buildings;
+    std::uniform_real_distribution<float> height{4.f, 16.f};
+    float extent = BLOCKS * BLOCK_SPACING * .5f;
+    for (int z = 0; z < BLOCKS; z++) {
+        for (int x = 0; x < BLOCKS; x++) {
+            glm::vec3 center{(x + .5f) * BLOCK_SPACING - extent, 0.f, (z + .5f) * BLOCK_SPACING - extent};
+            glm::vec3 half{BUILDING_SIZE * .5f, 0.f, BUILDING_SIZE * .5f};
+            buildings.push_back(makeBox(center - half - glm::vec3{0.f, height(random), 0.f}, center + half, 8));
+        }
+    }
+
+    std::vector<glm::mat4> occludees;
+    std::uniform_real_distribution<float> position{-extent, extent};
+    for (uint32_t i = 0; i < OCCLUDEES; i++) {
+        glm::mat4 model{1.f};
+        model[3] = glm::vec4{position(random), -.5f, position(random), 1.f};
+        occludees.push_back(model);
+    }
+    const glm::vec3 occludeeMin{-.5f}, occludeeMax{.5f};
+
+    GlorpOcclusionCuller culler{workerCount};
+    GlorpCamera camera{};
+    camera.setPerspectiveProjection(glm::radians(50.f), 16.f / 9.f, .1f, 1000.f);
+
+    Result result{};
+    result.frames = frames;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        // down the street between the first two rows of blocks, looking around
+        float t = static_cast<float>(frame) / std::max(frames, 1u);
+        glm::vec3 eye{-extent + t * 2.f * extent, -1.7f, BLOCK_SPACING - extent};
+        camera.setViewYXZ(eye, {0.f, glm::radians(90.f) + std::sin(t * 12.f) * glm::radians(60.f), 0.f});
+
+        culler.beginFrame(camera.getProjection() * camera.getView());
+        for (const auto &building : buildings) {
+            culler.addOccluder(building, glm::mat4{1.f});
+        }
+        culler.rasterize();
+        for (const auto &model : occludees) {
+            culler.isVisible(occludeeMin, occludeeMax, model);
+        }
+
+        const auto &stats = culler.getStats();
+        result.setupTimeMs += stats.setupTimeMs;
+        result.rasterizeTimeMs += stats.rasterizeTimeMs;
+        result.testTimeMs += stats.testTimeMs;
+        result.rasterizedTriangles += stats.rasterizedTriangles;
+        result.tested += stats.tested;
+        result.outsideFrustum += stats.outsideFrustum;
+        result.occluded += stats.occluded;
+    }
+
+    if (frames > 0) {
+        for (float *average : {&result.setupTimeMs, &result.rasterizeTimeMs, &result.testTimeMs, &result.rasterizedTriangles,
+                &result.tested, &result.outsideFrustum, &result.occluded}) {
+            *average /= frames;
+        }
+    }
+    return result;
+}
+
+void GlorpOcclusionBenchmark::report(uint32_t frames) {
+    std::cout << "Occlusion culling, " << frames << " frames, " << GlorpOcclusionCuller::WIDTH << "x" << GlorpOcclusionCuller::HEIGHT
+        << " depth buffer, " << BLOCKS * BLOCKS << " buildings, " << OCCLUDEES << " occludees" << std::endl;
+    for (uint32_t workers : {0u, GlorpOcclusionCuller::BAND_COUNT}) {
+        Result result = run(frames, workers);
+        std::cout << (workers == 0 ? "  calling thread: " : "  worker threads: ")
+            << "setup " << result.setupTimeMs << "ms, raster " << result.rasterizeTimeMs << "ms, test " << result.testTimeMs << "ms, "
+            << result.rasterizedTriangles << " triangles rasterized, culled " << result.cullRate() * 100.f << "% ("
+            << result.outsideFrustum << " outside the view, " << result.occluded << " occluded of " << result.tested << ")" << std::endl;
+    }
+}
+}
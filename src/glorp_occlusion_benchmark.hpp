@@ -0,0 +1,33 @@
+#pragma once
+
+#include "glorp_occlusion_culler.hpp"
+
+#include <cstdint>
+
+namespace Glorp {
+
+// Headless run of GlorpOcclusionCuller over a synthetic city, blocks of buildings as occluders and
+// small boxes scattered in the streets and behind them as occludees, seen by a camera walking down
+// the streets. Reports the cost of rasterizing and testing per frame and how much gets culled.
+class GlorpOcclusionBenchmark {
+    public:
+        struct Result {
+            uint32_t frames = 0;
+            // per frame averages
+            float setupTimeMs = 0.f;
+            float rasterizeTimeMs = 0.f;
+            float testTimeMs = 0.f;
+            float rasterizedTriangles = 0.f;
+            float tested = 0.f;
+            float outsideFrustum = 0.f;
+            float occluded = 0.f;
+
+            float cullRate() const { return tested == 0.f ? 0.f : (outsideFrustum + occluded) / tested; }
+        };
+
+        // workerCount as in GlorpOcclusionCuller, 0 rasterizes on the calling thread
+        static Result run(uint32_t frames, uint32_t workerCount);
+        // Runs single threaded and on the worker threads and prints both
+        static void report(uint32_t frames);
+};
+}
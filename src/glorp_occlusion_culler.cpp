@@ -0,0 +1,720 @@
+#include "glorp_occlusion_culler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLORP_OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#else
+#define GLORP_OCCLUSION_SSE2 0
+#endif
+
+namespace Glorp {
+
+namespace {
+float elapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// A*x + B*y + C, positive on the inner side of the edge from -> to of a counter clockwise triangle
+struct Edge {
+    float a;
+    float b;
+    float c;
+
+    Edge(const glm::vec3 &from, const glm::vec3 &to) : a{from.y - to.y}, b{to.x - from.x}, c{-(a * from.x + b * from.y)} {}
+};
+
+// Absolute depth slopes of a screen space triangle, along x and along y
+glm::vec2 depthSlope(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2) {
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (std::abs(area) < 1e-8f) {
+        return glm::vec2{0.f};
+    }
+    float zx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    float zy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    return glm::abs(glm::vec2{zx, zy});
+}
+
+// Whether p and q land on different sides of the edge from a to b on screen. The determinant of the
+// homogeneous x, y and w has the sign of the orientation on screen as long as every w is positive.
+bool oppositeSides(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &p, const glm::vec4 &q) {
+    if (a.w <= 0.f || b.w <= 0.f || p.w <= 0.f || q.w <= 0.f) {
+        return false;
+    }
+    glm::vec3 edgeNormal = glm::cross(glm::vec3{a.x, a.y, a.w}, glm::vec3{b.x, b.y, b.w});
+    return glm::dot(edgeNormal, glm::vec3{p.x, p.y, p.w}) * glm::dot(edgeNormal, glm::vec3{q.x, q.y, q.w}) < 0.f;
+}
+
+// Separating axis test of a triangle against an axis aligned box, Akenine-Moller
+bool triangleOverlapsBox(const glm::vec3 &center, const glm::vec3 &halfSize, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+    v0 -= center;
+    v1 -= center;
+    v2 -= center;
+    auto separated = [&](const glm::vec3 &axis) {
+        float p0 = glm::dot(v0, axis), p1 = glm::dot(v1, axis), p2 = glm::dot(v2, axis);
+        float r = glm::dot(halfSize, glm::abs(axis));
+        return std::min({p0, p1, p2}) > r || std::max({p0, p1, p2}) < -r;
+    };
+    const glm::vec3 edges[3] = {v1 - v0, v2 - v1, v0 - v2};
+    for (uint32_t i = 0; i < 3; i++) {
+        glm::vec3 axis{0.f};
+        axis[i] = 1.f;
+        if (separated(axis)) {
+            return false;
+        }
+        for (const auto &edge : edges) {
+            if (separated(glm::cross(axis, edge))) {
+                return false;
+            }
+        }
+    }
+    return !separated(glm::cross(edges[0], edges[1]));
+}
+
+void appendBox(GlorpOccluderMesh &mesh, const glm::vec3 &minimum, const glm::vec3 &maximum) {
+    uint32_t base = static_cast<uint32_t>(mesh.positions.size());
+    for (uint32_t i = 0; i < 8; i++) {
+        mesh.positions.push_back({(i & 1) ? maximum.x : minimum.x, (i & 2) ? maximum.y : minimum.y, (i & 4) ? maximum.z : minimum.z});
+    }
+    static constexpr uint32_t BOX_INDICES[36] = {
+        0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+    };
+    for (uint32_t index : BOX_INDICES) {
+        mesh.indices.push_back(base + index);
+    }
+}
+}
+
+GlorpOccluderMesh GlorpOccluderMesh::fromTriangles(std::span<const glm::vec3> positions, std::span<const uint32_t> indices, uint32_t maxTriangles) {
+    GlorpOccluderMesh mesh;
+    if (indices.size() / 3 <= maxTriangles) {
+        mesh.positions.assign(positions.begin(), positions.end());
+        mesh.indices.assign(indices.begin(), indices.end());
+        mesh.buildAdjacency();
+        return mesh;
+    }
+    return innerBoxes(positions, indices, maxTriangles);
+}
+
+GlorpOccluderMesh GlorpOccluderMesh::innerBoxes(std::span<const glm::vec3> positions, std::span<const uint32_t> indices, uint32_t maxTriangles) {
+    GlorpOccluderMesh mesh;
+    if (positions.empty() || maxTriangles < 12) {
+        return mesh;
+    }
+    glm::vec3 minimum = positions[0];
+    glm::vec3 maximum = positions[0];
+    for (const auto &position : positions) {
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    float cellSize = std::max({maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z}) / INNER_BOX_RESOLUTION;
+    if (cellSize <= 0.f) {
+        return mesh;
+    }
+
+    // one empty cell of padding on every side, so the outside is connected all around the mesh
+    glm::ivec3 size = glm::ivec3(glm::ceil((maximum - minimum) / cellSize)) + 2;
+    size = glm::clamp(size, glm::ivec3(3), glm::ivec3(static_cast<int>(INNER_BOX_RESOLUTION) + 3));
+    glm::vec3 origin = minimum - glm::vec3(cellSize);
+    auto cellIndex = [&size](int x, int y, int z) { return (static_cast<size_t>(z) * size.y + y) * size.x + x; };
+    enum Cell : uint8_t { Unknown, Surface, Outside, Taken };
+    std::vector<uint8_t> cells(static_cast<size_t>(size.x) * size.y * size.z, Unknown);
+
+    // every cell the surface touches, boxes grown slightly so float error never lets one slip through
+    glm::vec3 halfSize{cellSize * .5f * 1.001f};
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3 &v0 = positions[indices[i]];
+        const glm::vec3 &v1 = positions[indices[i + 1]];
+        const glm::vec3 &v2 = positions[indices[i + 2]];
+        // one more cell on each side for triangles lying right on a cell boundary
+        glm::ivec3 first = glm::clamp(glm::ivec3(glm::floor((glm::min(glm::min(v0, v1), v2) - origin) / cellSize)) - 1, glm::ivec3(0), size - 1);
+        glm::ivec3 last = glm::clamp(glm::ivec3(glm::floor((glm::max(glm::max(v0, v1), v2) - origin) / cellSize)) + 1, glm::ivec3(0), size - 1);
+        for (int z = first.z; z <= last.z; z++) {
+            for (int y = first.y; y <= last.y; y++) {
+                for (int x = first.x; x <= last.x; x++) {
+                    glm::vec3 center = origin + (glm::vec3(x, y, z) + .5f) * cellSize;
+                    if (cells[cellIndex(x, y, z)] == Unknown && triangleOverlapsBox(center, halfSize, v0, v1, v2)) {
+                        cells[cellIndex(x, y, z)] = Surface;
+                    }
+                }
+            }
+        }
+    }
+
+    // whatever the outside cannot reach without crossing the surface is inside. A mesh with holes
+    // leaks and has no inside, which leaves it without an occluder rather than with a wrong one.
+    std::vector<glm::ivec3> stack;
+    for (int z = 0; z < size.z; z++) {
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                bool border = x == 0 || y == 0 || z == 0 || x == size.x - 1 || y == size.y - 1 || z == size.z - 1;
+                if (border && cells[cellIndex(x, y, z)] == Unknown) {
+                    cells[cellIndex(x, y, z)] = Outside;
+                    stack.push_back({x, y, z});
+                }
+            }
+        }
+    }
+    while (!stack.empty()) {
+        glm::ivec3 cell = stack.back();
+        stack.pop_back();
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            for (int direction : {-1, 1}) {
+                glm::ivec3 next = cell;
+                next[axis] += direction;
+                if (next[axis] < 0 || next[axis] >= size[axis] || cells[cellIndex(next.x, next.y, next.z)] != Unknown) {
+                    continue;
+                }
+                cells[cellIndex(next.x, next.y, next.z)] = Outside;
+                stack.push_back(next);
+            }
+        }
+    }
+
+    // greedy boxes over the inside cells, grown along x, then y, then z
+    struct Box {
+        glm::ivec3 first;
+        glm::ivec3 last;
+        int volume() const { return (last.x - first.x + 1) * (last.y - first.y + 1) * (last.z - first.z + 1); }
+    };
+    auto isFree = [&](const glm::ivec3 &first, const glm::ivec3 &last) {
+        for (int z = first.z; z <= last.z; z++) {
+            for (int y = first.y; y <= last.y; y++) {
+                for (int x = first.x; x <= last.x; x++) {
+                    if (cells[cellIndex(x, y, z)] != Unknown) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    };
+    std::vector<Box> boxes;
+    for (int z = 0; z < size.z; z++) {
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                if (cells[cellIndex(x, y, z)] != Unknown) {
+                    continue;
+                }
+                Box box{{x, y, z}, {x, y, z}};
+                while (box.last.x + 1 < size.x && isFree({box.last.x + 1, y, z}, {box.last.x + 1, y, z})) {
+                    box.last.x++;
+                }
+                while (box.last.y + 1 < size.y && isFree({x, box.last.y + 1, z}, {box.last.x, box.last.y + 1, z})) {
+                    box.last.y++;
+                }
+                while (box.last.z + 1 < size.z && isFree({x, y, box.last.z + 1}, {box.last.x, box.last.y, box.last.z + 1})) {
+                    box.last.z++;
+                }
+                for (int bz = box.first.z; bz <= box.last.z; bz++) {
+                    for (int by = box.first.y; by <= box.last.y; by++) {
+                        for (int bx = box.first.x; bx <= box.last.x; bx++) {
+                            cells[cellIndex(bx, by, bz)] = Taken;
+                        }
+                    }
+                }
+                boxes.push_back(box);
+            }
+        }
+    }
+
+    // the biggest boxes hide the most, the rest are left out once the budget is spent
+    std::sort(boxes.begin(), boxes.end(), [](const Box &a, const Box &b) { return a.volume() > b.volume(); });
+    boxes.resize(std::min<size_t>(boxes.size(), maxTriangles / 12));
+    for (const auto &box : boxes) {
+        appendBox(mesh, origin + glm::vec3(box.first) * cellSize, origin + glm::vec3(box.last + 1) * cellSize);
+    }
+    mesh.buildAdjacency();
+    return mesh;
+}
+
+void GlorpOccluderMesh::buildAdjacency() {
+    auto lessPosition = [this](uint32_t a, uint32_t b) {
+        const glm::vec3 &p = positions[a];
+        const glm::vec3 &q = positions[b];
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    std::vector<uint32_t> order(positions.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), lessPosition);
+    welded.resize(positions.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        bool same = i > 0 && positions[order[i]] == positions[order[i - 1]];
+        welded[order[i]] = same ? welded[order[i - 1]] : order[i];
+    }
+
+    // every edge keyed by its welded ends, an edge with exactly two triangles links them
+    struct HalfEdge {
+        uint32_t first;
+        uint32_t second;
+        uint32_t edge;
+        bool operator<(const HalfEdge &other) const { return first != other.first ? first < other.first : second < other.second; }
+    };
+    std::vector<HalfEdge> edges;
+    edges.reserve(indices.size());
+    for (uint32_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t from = welded[indices[i + k]];
+            uint32_t to = welded[indices[i + (k + 1) % 3]];
+            edges.push_back({std::min(from, to), std::max(from, to), i + k});
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    neighbours.assign(indices.size() / 3 * 3, NO_NEIGHBOUR);
+    for (size_t i = 0; i < edges.size();) {
+        size_t end = i + 1;
+        while (end < edges.size() && edges[end].first == edges[i].first && edges[end].second == edges[i].second) {
+            end++;
+        }
+        if (end - i == 2 && edges[i].first != edges[i].second) {
+            neighbours[edges[i].edge] = edges[i + 1].edge / 3;
+            neighbours[edges[i + 1].edge] = edges[i].edge / 3;
+        }
+        i = end;
+    }
+}
+
+GlorpOcclusionCuller::GlorpOcclusionCuller(uint32_t workerCount) : m_depth(WIDTH * HEIGHT, 1.f), m_coverage(WIDTH * HEIGHT, 1.f), m_tileDepth(TILES_X * TILES_Y, 1.f) {
+    if (workerCount > 0) {
+        m_threadPool = std::make_unique<GlorpThreadPool>(std::min(workerCount, BAND_COUNT));
+    }
+}
+
+GlorpOcclusionCuller::~GlorpOcclusionCuller() {}
+
+void GlorpOcclusionCuller::beginFrame(const glm::mat4 &viewProjection) {
+    m_viewProjection = viewProjection;
+    std::fill(m_depth.begin(), m_depth.end(), 1.f);
+    std::fill(m_tileDepth.begin(), m_tileDepth.end(), 1.f);
+    m_occluders.clear();
+    m_stats = {};
+}
+
+void GlorpOcclusionCuller::addOccluder(const GlorpOccluderMesh &mesh, const glm::mat4 &model) {
+    m_occluders.push_back({&mesh, m_viewProjection * model});
+    m_stats.occluders++;
+    m_stats.occluderTriangles += mesh.triangleCount();
+}
+
+void GlorpOcclusionCuller::rasterize() {
+    auto start = std::chrono::steady_clock::now();
+    setupTriangles();
+    auto setupEnd = std::chrono::steady_clock::now();
+
+    // bands own disjoint rows of the depth and coverage buffers, so they need no synchronization
+    if (m_threadPool) {
+        std::array<std::future<void>, BAND_COUNT> bands;
+        for (uint32_t band = 0; band < BAND_COUNT; band++) {
+            bands[band] = m_threadPool->submit([this, band] { rasterizeBand(band); });
+        }
+        for (auto &band : bands) {
+            band.get();
+        }
+    } else {
+        for (uint32_t band = 0; band < BAND_COUNT; band++) {
+            rasterizeBand(band);
+        }
+    }
+
+    m_stats.setupTimeMs += elapsedMs(start, setupEnd);
+    m_stats.rasterizeTimeMs += elapsedMs(setupEnd, std::chrono::steady_clock::now());
+}
+
+void GlorpOcclusionCuller::setupTriangles() {
+    m_triangles.clear();
+    m_silhouettes.clear();
+    m_spans.clear();
+    for (const auto &occluder : m_occluders) {
+        setupOccluder(occluder);
+    }
+    m_stats.rasterizedTriangles = static_cast<uint32_t>(m_triangles.size());
+}
+
+void GlorpOcclusionCuller::setupOccluder(const Occluder &occluder) {
+    const auto &mesh = *occluder.mesh;
+    const size_t triangleCount = mesh.indices.size() / 3;
+    const bool adjacent = mesh.neighbours.size() == triangleCount * 3 && mesh.welded.size() == mesh.positions.size();
+    auto weldedVertex = [&](size_t i) { return adjacent ? mesh.welded[mesh.indices[i]] : mesh.indices[i]; };
+    OccluderSpan span{m_triangles.size(), 0, m_silhouettes.size(), 0, static_cast<int>(WIDTH), -1, static_cast<int>(HEIGHT), -1};
+
+    m_clipVertices.resize(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        m_clipVertices[i] = occluder.modelViewProjection * glm::vec4(mesh.positions[i], 1.f);
+    }
+    m_onScreen.assign(triangleCount, 0);
+    m_vertexSlopes.assign(mesh.positions.size(), glm::vec2{0.f});
+    for (size_t t = 0; t < triangleCount; t++) {
+        const glm::vec4 &a = m_clipVertices[mesh.indices[t * 3]];
+        const glm::vec4 &b = m_clipVertices[mesh.indices[t * 3 + 1]];
+        const glm::vec4 &c = m_clipVertices[mesh.indices[t * 3 + 2]];
+        // entirely outside one of the frustum planes
+        if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+            (a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+            (a.z > a.w && b.z > b.w && c.z > c.w) || (a.z < 0.f && b.z < 0.f && c.z < 0.f)) {
+            continue;
+        }
+        m_onScreen[t] = 1;
+        glm::vec2 slope = addClippedTriangle(a, b, c, static_cast<uint32_t>(t));
+        for (uint32_t k = 0; k < 3; k++) {
+            glm::vec2 &vertexSlope = m_vertexSlopes[weldedVertex(t * 3 + k)];
+            vertexSlope = glm::max(vertexSlope, slope);
+        }
+    }
+    span.endTriangle = m_triangles.size();
+    if (span.firstTriangle == span.endTriangle) {
+        return;
+    }
+
+    // Within half a pixel of its center a pixel can reach into any triangle sharing a vertex with the
+    // one covering the center, so the farthest depth over the pixel is bounded by their steepest slopes.
+    // The extra 1/16 pixel covers the snapping in addScreenTriangle.
+    for (size_t i = span.firstTriangle; i < span.endTriangle; i++) {
+        auto &triangle = m_triangles[i];
+        glm::vec2 slope{0.f};
+        for (uint32_t k = 0; k < 3; k++) {
+            slope = glm::max(slope, m_vertexSlopes[weldedVertex(triangle.source * 3 + k)]);
+        }
+        triangle.depthOffset = (.5f + 1.f / 16.f) * (slope.x + slope.y);
+        span.minX = std::min(span.minX, triangle.minX);
+        span.maxX = std::max(span.maxX, triangle.maxX);
+        span.minY = std::min(span.minY, triangle.minY);
+        span.maxY = std::max(span.maxY, triangle.maxY);
+    }
+
+    // Coverage ends where an edge has no triangle on screen on its other side, or where the triangle
+    // across folds back over the same side. Every other edge lies inside the occluder's coverage.
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (!m_onScreen[t]) {
+            continue;
+        }
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t neighbour = adjacent ? mesh.neighbours[t * 3 + k] : GlorpOccluderMesh::NO_NEIGHBOUR;
+            bool shared = neighbour != GlorpOccluderMesh::NO_NEIGHBOUR && m_onScreen[neighbour];
+            // the neighbour decides for both of them
+            if (shared && neighbour < t) {
+                continue;
+            }
+            uint32_t from = mesh.indices[t * 3 + k];
+            uint32_t to = mesh.indices[t * 3 + (k + 1) % 3];
+            if (shared) {
+                uint32_t opposite = mesh.indices[neighbour * 3];
+                for (uint32_t j = 0; j < 3; j++) {
+                    uint32_t vertex = mesh.indices[neighbour * 3 + j];
+                    if (mesh.welded[vertex] != mesh.welded[from] && mesh.welded[vertex] != mesh.welded[to]) {
+                        opposite = vertex;
+                    }
+                }
+                if (oppositeSides(m_clipVertices[from], m_clipVertices[to], m_clipVertices[mesh.indices[t * 3 + (k + 2) % 3]], m_clipVertices[opposite])) {
+                    continue;
+                }
+            }
+            addSilhouette(m_clipVertices[from], m_clipVertices[to]);
+        }
+    }
+    span.endSilhouette = m_silhouettes.size();
+    m_spans.push_back(span);
+}
+
+glm::vec2 GlorpOcclusionCuller::addClippedTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c, uint32_t source) {
+    // only the near plane needs clipping, everything else is handled by the screen bounds
+    const glm::vec4 vertices[3] = {a, b, c};
+    std::array<glm::vec4, 4> polygon;
+    std::array<glm::vec4, 2> cut;
+    uint32_t count = 0;
+    uint32_t cutCount = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+        const glm::vec4 &current = vertices[i];
+        const glm::vec4 &next = vertices[(i + 1) % 3];
+        bool currentInside = current.z >= 0.f;
+        if (currentInside) {
+            polygon[count++] = current;
+        }
+        if (currentInside != (next.z >= 0.f)) {
+            polygon[count++] = current + (next - current) * (current.z / (current.z - next.z));
+            cut[cutCount++] = polygon[count - 1];
+        }
+    }
+    // nothing of the occluder is left in front of the near plane
+    if (cutCount == 2) {
+        addSilhouette(cut[0], cut[1]);
+    }
+    glm::vec2 slope{0.f};
+    if (count >= 3) {
+        slope = addScreenTriangle(polygon[0], polygon[1], polygon[2], source);
+    }
+    if (count == 4) {
+        slope = glm::max(slope, addScreenTriangle(polygon[0], polygon[2], polygon[3], source));
+    }
+    return slope;
+}
+
+glm::vec3 GlorpOcclusionCuller::toScreen(const glm::vec4 &clip) const {
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    return {(ndc.x * .5f + .5f) * WIDTH, (ndc.y * .5f + .5f) * HEIGHT, ndc.z};
+}
+
+glm::vec2 GlorpOcclusionCuller::addScreenTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c, uint32_t source) {
+    Triangle triangle{{toScreen(a), toScreen(b), toScreen(c)}, 0.f, source, 0, 0, 0, 0};
+    // on a 1/16 pixel grid the edge functions are exact on screen, so pixel centers on an edge shared
+    // by two triangles pass in both instead of leaving a crack
+    auto &v = triangle.vertices;
+    for (auto &vertex : v) {
+        vertex.x = std::round(vertex.x * 16.f) / 16.f;
+        vertex.y = std::round(vertex.y * 16.f) / 16.f;
+    }
+    glm::vec2 slope = depthSlope(v[0], v[1], v[2]);
+    float minX = std::min({v[0].x, v[1].x, v[2].x});
+    float maxX = std::max({v[0].x, v[1].x, v[2].x});
+    float minY = std::min({v[0].y, v[1].y, v[2].y});
+    float maxY = std::max({v[0].y, v[1].y, v[2].y});
+    if (maxX < 0.f || minX > WIDTH || maxY < 0.f || minY > HEIGHT) {
+        return slope;
+    }
+    // pixels whose centers the triangle can cover
+    triangle.minX = std::max(static_cast<int>(std::ceil(minX - .5f)), 0);
+    triangle.maxX = std::min(static_cast<int>(std::floor(maxX - .5f)), static_cast<int>(WIDTH) - 1);
+    triangle.minY = std::max(static_cast<int>(std::ceil(minY - .5f)), 0);
+    triangle.maxY = std::min(static_cast<int>(std::floor(maxY - .5f)), static_cast<int>(HEIGHT) - 1);
+    if (triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY) {
+        m_triangles.push_back(triangle);
+    }
+    return slope;
+}
+
+void GlorpOcclusionCuller::addSilhouette(glm::vec4 from, glm::vec4 to) {
+    if (from.z < 0.f && to.z < 0.f) {
+        return;
+    }
+    if (from.z < 0.f) {
+        from += (to - from) * (from.z / (from.z - to.z));
+    } else if (to.z < 0.f) {
+        to += (from - to) * (to.z / (to.z - from.z));
+    }
+    m_silhouettes.push_back({glm::vec2(toScreen(from)), glm::vec2(toScreen(to))});
+}
+
+void GlorpOcclusionCuller::rasterizeBand(uint32_t band) {
+    const int bandMinY = static_cast<int>(band * BAND_HEIGHT);
+    const int bandMaxY = bandMinY + static_cast<int>(BAND_HEIGHT) - 1;
+    for (const auto &span : m_spans) {
+        if (span.maxY < bandMinY || span.minY > bandMaxY) {
+            continue;
+        }
+        for (size_t i = span.firstTriangle; i < span.endTriangle; i++) {
+            rasterizeTriangle(m_triangles[i], bandMinY, bandMaxY);
+        }
+        for (size_t i = span.firstSilhouette; i < span.endSilhouette; i++) {
+            clearSilhouette(m_silhouettes[i], span, bandMinY, bandMaxY);
+        }
+        // whatever the occluder still covers joins the other occluders, its pixels start over at 1
+        for (int y = std::max(span.minY, bandMinY); y <= std::min(span.maxY, bandMaxY); y++) {
+            float *coverage = m_coverage.data() + y * WIDTH;
+            float *depth = m_depth.data() + y * WIDTH;
+            for (int x = span.minX; x <= span.maxX; x++) {
+                depth[x] = std::min(depth[x], coverage[x]);
+                coverage[x] = 1.f;
+            }
+        }
+    }
+    updateTileDepth(band);
+}
+
+void GlorpOcclusionCuller::rasterizeTriangle(const Triangle &triangle, int bandMinY, int bandMaxY) {
+    if (triangle.maxY < bandMinY || triangle.minY > bandMaxY) {
+        return;
+    }
+    glm::vec3 v0 = triangle.vertices[0];
+    glm::vec3 v1 = triangle.vertices[1];
+    glm::vec3 v2 = triangle.vertices[2];
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (std::abs(area) < 1e-8f) {
+        return;
+    }
+    // winding of the source meshes is not reliable, both faces occlude
+    if (area < 0.f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    Edge e0{v0, v1};
+    Edge e1{v1, v2};
+    Edge e2{v2, v0};
+    // depth is linear in screen space: z = zx * x + zy * y + zc
+    float zx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    float zy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    float zc = v0.z - zx * v0.x - zy * v0.y + triangle.depthOffset;
+
+    int minX = triangle.minX;
+    int maxX = triangle.maxX;
+    int minY = std::max(triangle.minY, bandMinY);
+    int maxY = std::min(triangle.maxY, bandMaxY);
+    // groups of four pixels, the pixels of a group outside the bounds fail the edge tests
+    int startX = minX & ~3;
+
+#if GLORP_OCCLUSION_SSE2
+    const __m128 pixelOffsets = _mm_setr_ps(.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 a0 = _mm_set1_ps(e0.a), a1 = _mm_set1_ps(e1.a), a2 = _mm_set1_ps(e2.a), zxs = _mm_set1_ps(zx);
+    const __m128 step0 = _mm_set1_ps(4.f * e0.a), step1 = _mm_set1_ps(4.f * e1.a), step2 = _mm_set1_ps(4.f * e2.a);
+    const __m128 stepZ = _mm_set1_ps(4.f * zx);
+    const __m128 x = _mm_add_ps(_mm_set1_ps(static_cast<float>(startX)), pixelOffsets);
+    for (int y = minY; y <= maxY; y++) {
+        float py = y + .5f;
+        __m128 w0 = _mm_add_ps(_mm_mul_ps(a0, x), _mm_set1_ps(e0.b * py + e0.c));
+        __m128 w1 = _mm_add_ps(_mm_mul_ps(a1, x), _mm_set1_ps(e1.b * py + e1.c));
+        __m128 w2 = _mm_add_ps(_mm_mul_ps(a2, x), _mm_set1_ps(e2.b * py + e2.c));
+        __m128 z = _mm_add_ps(_mm_mul_ps(zxs, x), _mm_set1_ps(zy * py + zc));
+        float *row = m_coverage.data() + y * WIDTH;
+        for (int px = startX; px <= maxX; px += 4) {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+            if (_mm_movemask_ps(inside) != 0) {
+                __m128 depth = _mm_loadu_ps(row + px);
+                __m128 nearer = _mm_min_ps(depth, z);
+                _mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth)));
+            }
+            w0 = _mm_add_ps(w0, step0);
+            w1 = _mm_add_ps(w1, step1);
+            w2 = _mm_add_ps(w2, step2);
+            z = _mm_add_ps(z, stepZ);
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; y++) {
+        float py = y + .5f;
+        float *row = m_coverage.data() + y * WIDTH;
+        for (int px = startX; px <= maxX; px++) {
+            float fx = px + .5f;
+            if (e0.a * fx + e0.b * py + e0.c >= 0.f && e1.a * fx + e1.b * py + e1.c >= 0.f && e2.a * fx + e2.b * py + e2.c >= 0.f) {
+                row[px] = std::min(row[px], zx * fx + zy * py + zc);
+            }
+        }
+    }
+#endif
+}
+
+void GlorpOcclusionCuller::clearSilhouette(const Silhouette &silhouette, const OccluderSpan &span, int bandMinY, int bandMaxY) {
+    // a little past the segment, for the snapped triangles and pixels it only grazes
+    constexpr float margin = 1.f / 16.f;
+    glm::vec2 top = silhouette.from.y <= silhouette.to.y ? silhouette.from : silhouette.to;
+    glm::vec2 bottom = silhouette.from.y <= silhouette.to.y ? silhouette.to : silhouette.from;
+    // clamped before the conversion, silhouettes close to the camera reach far off screen
+    auto pixel = [](float coordinate, uint32_t size) { return static_cast<int>(std::floor(std::clamp(coordinate, -1.f, static_cast<float>(size)))); };
+    int minY = std::max({pixel(top.y - margin, HEIGHT), span.minY, bandMinY});
+    int maxY = std::min({pixel(bottom.y + margin, HEIGHT), span.maxY, bandMaxY});
+    for (int y = minY; y <= maxY; y++) {
+        // the part of the segment within the row
+        float x0 = top.x;
+        float x1 = bottom.x;
+        if (bottom.y > top.y) {
+            float inverseSlope = (bottom.x - top.x) / (bottom.y - top.y);
+            x0 = top.x + inverseSlope * (std::clamp(static_cast<float>(y) - margin, top.y, bottom.y) - top.y);
+            x1 = top.x + inverseSlope * (std::clamp(static_cast<float>(y + 1) + margin, top.y, bottom.y) - top.y);
+        }
+        int minX = std::max(pixel(std::min(x0, x1) - margin, WIDTH), span.minX);
+        int maxX = std::min(pixel(std::max(x0, x1) + margin, WIDTH), span.maxX);
+        float *row = m_coverage.data() + y * WIDTH;
+        for (int x = minX; x <= maxX; x++) {
+            row[x] = 1.f;
+        }
+    }
+}
+
+void GlorpOcclusionCuller::updateTileDepth(uint32_t band) {
+    for (uint32_t tileY = band * BAND_HEIGHT / TILE_SIZE; tileY < (band + 1) * BAND_HEIGHT / TILE_SIZE; tileY++) {
+        for (uint32_t tileX = 0; tileX < TILES_X; tileX++) {
+            float farthest = 0.f;
+            for (uint32_t y = tileY * TILE_SIZE; y < (tileY + 1) * TILE_SIZE; y++) {
+                const float *row = m_depth.data() + y * WIDTH + tileX * TILE_SIZE;
+                farthest = std::max(farthest, *std::max_element(row, row + TILE_SIZE));
+            }
+            m_tileDepth[tileY * TILES_X + tileX] = farthest;
+        }
+    }
+}
+
+bool GlorpOcclusionCuller::isVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &model) {
+    auto start = std::chrono::steady_clock::now();
+    m_stats.tested++;
+    auto finish = [&](bool visible) {
+        m_stats.testTimeMs += elapsedMs(start, std::chrono::steady_clock::now());
+        return visible;
+    };
+
+    glm::mat4 modelViewProjection = m_viewProjection * model;
+    glm::vec3 screenMin{std::numeric_limits<float>::max()};
+    glm::vec3 screenMax{std::numeric_limits<float>::lowest()};
+    uint32_t behindNearPlane = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::vec3 corner{(i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z};
+        glm::vec4 clip = modelViewProjection * glm::vec4(corner, 1.f);
+        if (clip.z < 0.f) {
+            behindNearPlane++;
+            continue;
+        }
+        glm::vec3 screen = toScreen(clip);
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+    }
+    if (behindNearPlane == 8) {
+        m_stats.outsideFrustum++;
+        return finish(false);
+    }
+    // the box reaches past the camera, its projection is unbounded
+    if (behindNearPlane > 0) {
+        return finish(true);
+    }
+    if (screenMax.x < 0.f || screenMin.x > WIDTH || screenMax.y < 0.f || screenMin.y > HEIGHT || screenMin.z > 1.f) {
+        m_stats.outsideFrustum++;
+        return finish(false);
+    }
+
+    // visible as soon as one covered pixel has no occluder in front of the box's nearest point. Tiles
+    // whose farthest occluder is still in front of it are hidden as a whole, only the rest are scanned.
+    int minX = std::clamp(static_cast<int>(std::floor(screenMin.x)), 0, static_cast<int>(WIDTH) - 1);
+    int maxX = std::clamp(static_cast<int>(std::floor(screenMax.x)), 0, static_cast<int>(WIDTH) - 1);
+    int minY = std::clamp(static_cast<int>(std::floor(screenMin.y)), 0, static_cast<int>(HEIGHT) - 1);
+    int maxY = std::clamp(static_cast<int>(std::floor(screenMax.y)), 0, static_cast<int>(HEIGHT) - 1);
+    float nearest = screenMin.z;
+    const int tileSize = static_cast<int>(TILE_SIZE);
+    for (int tileY = minY / tileSize; tileY <= maxY / tileSize; tileY++) {
+        for (int tileX = minX / tileSize; tileX <= maxX / tileSize; tileX++) {
+            if (nearest > m_tileDepth[tileY * TILES_X + tileX]) {
+                continue;
+            }
+            int tileMinX = std::max(minX, tileX * tileSize);
+            int tileMaxX = std::min(maxX, tileX * tileSize + tileSize - 1);
+            int tileMinY = std::max(minY, tileY * tileSize);
+            int tileMaxY = std::min(maxY, tileY * tileSize + tileSize - 1);
+            for (int y = tileMinY; y <= tileMaxY; y++) {
+                const float *row = m_depth.data() + y * WIDTH;
+#if GLORP_OCCLUSION_SSE2
+                // whole groups of four, the extra pixels at the ends can only make the box more visible
+                const __m128 boxDepth = _mm_set1_ps(nearest);
+                for (int x = tileMinX & ~3; x <= tileMaxX; x += 4) {
+                    if (_mm_movemask_ps(_mm_cmple_ps(boxDepth, _mm_loadu_ps(row + x))) != 0) {
+                        return finish(true);
+                    }
+                }
+#else
+                for (int x = tileMinX; x <= tileMaxX; x++) {
+                    if (nearest <= row[x]) {
+                        return finish(true);
+                    }
+                }
+#endif
+            }
+        }
+    }
+    m_stats.occluded++;
+    return finish(false);
+}
+}
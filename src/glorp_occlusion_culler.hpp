@@ -0,0 +1,166 @@
+#pragma once
+
+#include "glorp_thread_pool.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace Glorp {
+
+// Triangles an object occludes with, kept on the CPU next to its GPU buffers
+struct GlorpOccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    // per triangle edge (v0 v1, v1 v2, v2 v0) the triangle on its other side, NO_NEIGHBOUR where the
+    // edge is open or shared by more than two triangles
+    std::vector<uint32_t> neighbours;
+    // the first vertex at the same position as each vertex, so seams of the source mesh stay closed
+    std::vector<uint32_t> welded;
+
+    static constexpr uint32_t NO_NEIGHBOUR = ~0u;
+
+    uint32_t triangleCount() const { return static_cast<uint32_t>(indices.size() / 3); }
+    // Fills neighbours and welded from positions and indices. A mesh without them has every edge
+    // treated as a silhouette, which keeps it correct but leaves few pixels covered.
+    void buildAdjacency();
+
+    // cells along the longest side of the grid innerBoxes voxelizes on
+    static constexpr uint32_t INNER_BOX_RESOLUTION = 32;
+
+    // Returns the mesh itself when it has at most maxTriangles, otherwise innerBoxes of it, adjacency
+    // built either way. An occluder must never cover more than the surface it stands for.
+    static GlorpOccluderMesh fromTriangles(std::span<const glm::vec3> positions, std::span<const uint32_t> indices, uint32_t maxTriangles);
+    // Boxes entirely inside the closed volume of the mesh, found on a voxel grid and biggest first until
+    // maxTriangles is used up. Empty for meshes that do not enclose anything, like a single wall or one with holes.
+    static GlorpOccluderMesh innerBoxes(std::span<const glm::vec3> positions, std::span<const uint32_t> indices, uint32_t maxTriangles);
+};
+
+// Software occlusion culling. Occluders are rasterized into a small depth buffer on the CPU, then the
+// bounding boxes of the objects about to be drawn are tested against it, so whatever hides behind a
+// wall never reaches the GPU. The depth buffer is cut into horizontal bands rasterized by worker
+// threads side by side, four pixels at a time with SSE2 where available. Depth is NDC z of the Vulkan
+// projection, 0 at the near plane. Occluders are covered conservatively: pixels any silhouette edge
+// of an occluder touches are left out of it, so a pixel only counts when the occluder covers all of
+// it, and each pixel keeps the farthest depth the occluder has over it, bounded by the slopes of the
+// triangles around the one covering its center. Each band also keeps the farthest depth of its 8x8
+// pixel tiles, so boxes are tested a tile at a time before any pixel.
+//
+// Nothing here touches Vulkan, so it runs headless, see GlorpOcclusionBenchmark.
+class GlorpOcclusionCuller {
+    public:
+        static constexpr uint32_t WIDTH = 256;
+        static constexpr uint32_t HEIGHT = 128;
+        static constexpr uint32_t BAND_HEIGHT = 16;
+        static constexpr uint32_t BAND_COUNT = HEIGHT / BAND_HEIGHT;
+        static constexpr uint32_t TILE_SIZE = 8;
+        static constexpr uint32_t TILES_X = WIDTH / TILE_SIZE;
+        static constexpr uint32_t TILES_Y = HEIGHT / TILE_SIZE;
+        static_assert(WIDTH % 4 == 0 && HEIGHT % BAND_HEIGHT == 0);
+        static_assert(WIDTH % TILE_SIZE == 0 && BAND_HEIGHT % TILE_SIZE == 0 && TILE_SIZE % 4 == 0);
+
+        struct Stats {
+            uint32_t occluders = 0;
+            uint32_t occluderTriangles = 0;
+            // after near plane clipping and dropping those off screen
+            uint32_t rasterizedTriangles = 0;
+            uint32_t tested = 0;
+            uint32_t outsideFrustum = 0;
+            uint32_t occluded = 0;
+            float setupTimeMs = 0.f;
+            float rasterizeTimeMs = 0.f;
+            float testTimeMs = 0.f;
+
+            float cullRate() const { return tested == 0 ? 0.f : static_cast<float>(outsideFrustum + occluded) / tested; }
+        };
+
+        // workerCount 0 rasterizes on the calling thread
+        explicit GlorpOcclusionCuller(uint32_t workerCount = BAND_COUNT);
+        ~GlorpOcclusionCuller();
+
+        GlorpOcclusionCuller(const GlorpOcclusionCuller&) = delete;
+        GlorpOcclusionCuller &operator=(const GlorpOcclusionCuller&) = delete;
+
+        // Clears the depth buffer and the queued occluders
+        void beginFrame(const glm::mat4 &viewProjection);
+        // mesh has to stay alive until rasterize returns
+        void addOccluder(const GlorpOccluderMesh &mesh, const glm::mat4 &model);
+        void rasterize();
+        // False when the model space box is outside the view or behind the rasterized occluders
+        bool isVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &model);
+
+        const Stats &getStats() const { return m_stats; }
+        std::span<const float> getDepth() const { return m_depth; }
+    private:
+        struct Occluder {
+            const GlorpOccluderMesh *mesh;
+            glm::mat4 modelViewProjection;
+        };
+
+        // screen space x and y in pixels, z in NDC
+        struct Triangle {
+            glm::vec3 vertices[3];
+            // added to the depth at pixel centers to get the farthest over the pixel
+            float depthOffset;
+            // index of the mesh triangle it was clipped from
+            uint32_t source;
+            int minX;
+            int maxX;
+            int minY;
+            int maxY;
+        };
+
+        // screen space edge the coverage of an occluder ends at
+        struct Silhouette {
+            glm::vec2 from;
+            glm::vec2 to;
+        };
+
+        // triangles and silhouettes of one occluder, and the pixels they cover
+        struct OccluderSpan {
+            size_t firstTriangle;
+            size_t endTriangle;
+            size_t firstSilhouette;
+            size_t endSilhouette;
+            int minX;
+            int maxX;
+            int minY;
+            int maxY;
+        };
+
+        void setupTriangles();
+        void setupOccluder(const Occluder &occluder);
+        // Returns the depth slopes of the triangle on screen, zero when none of it is left
+        glm::vec2 addClippedTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c, uint32_t source);
+        glm::vec2 addScreenTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c, uint32_t source);
+        void addSilhouette(glm::vec4 from, glm::vec4 to);
+        void rasterizeBand(uint32_t band);
+        void rasterizeTriangle(const Triangle &triangle, int bandMinY, int bandMaxY);
+        // Empties every pixel of the coverage buffer the silhouette touches
+        void clearSilhouette(const Silhouette &silhouette, const OccluderSpan &span, int bandMinY, int bandMaxY);
+        // Farthest depth of every tile in band, once its pixels are final
+        void updateTileDepth(uint32_t band);
+        glm::vec3 toScreen(const glm::vec4 &clip) const;
+    private:
+        std::unique_ptr<GlorpThreadPool> m_threadPool;
+
+        glm::mat4 m_viewProjection{1.f};
+        std::vector<float> m_depth;
+        // one occluder at a time before it is merged into m_depth, 1 everywhere in between
+        std::vector<float> m_coverage;
+        std::vector<float> m_tileDepth;
+        std::vector<Occluder> m_occluders;
+        std::vector<glm::vec4> m_clipVertices;
+        std::vector<uint8_t> m_onScreen;
+        std::vector<glm::vec2> m_vertexSlopes;
+        std::vector<Triangle> m_triangles;
+        std::vector<Silhouette> m_silhouettes;
+        std::vector<OccluderSpan> m_spans;
+
+        Stats m_stats;
+};
+}
@@ -0,0 +1,293 @@
+#include "glorp_occlusion_queries.hpp"
+#include "glorp_pipeline_registry.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace Glorp {
+
+struct OcclusionProxyPushConstantData {
+    glm::mat4 modelMatrix{1.f};
+    glm::vec4 boundsMin{0.f};
+    glm::vec4 boundsMax{0.f};
+};
+
+GlorpOcclusionQueries::GlorpOcclusionQueries(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
+    : m_glorpDevice{device}, m_conditionalRendering{device.conditionalRendering().supported} {
+    createPipelineLayout(globalSetLayout);
+    createPipeline(renderPass);
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+    poolInfo.queryCount = MAX_QUERIES;
+    for (auto &pool : m_queryPools) {
+        if (vkCreateQueryPool(m_glorpDevice.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create occlusion query pool");
+        }
+    }
+    if (m_conditionalRendering) {
+        m_predicateBuffer = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(uint32_t), MAX_QUERIES,
+            VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    m_slotObjects.resize(MAX_QUERIES);
+    m_acquiredFrames.resize(MAX_QUERIES, 0);
+    m_usedFrames.resize(MAX_QUERIES, 0);
+    m_queriedFrames.resize(MAX_QUERIES, 0);
+    m_resultFrames.resize(MAX_QUERIES, 0);
+    m_resultVisible.resize(MAX_QUERIES, 1);
+}
+
+GlorpOcclusionQueries::~GlorpOcclusionQueries() {
+    for (VkQueryPool pool : m_queryPools) {
+        vkDestroyQueryPool(m_glorpDevice.device(), pool, nullptr);
+    }
+    vkDestroyPipelineLayout(m_glorpDevice.device(), m_pipelineLayout, nullptr);
+}
+
+void GlorpOcclusionQueries::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(OcclusionProxyPushConstantData);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &globalSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if(vkCreatePipelineLayout(m_glorpDevice.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Could not create pipeline layout");
+    }
+}
+
+void GlorpOcclusionQueries::createPipeline(VkRenderPass renderPass) {
+    PipelineConfigInfo pipelineConfig{};
+    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig, m_glorpDevice);
+    pipelineConfig.multisampleInfo.rasterizationSamples = m_glorpDevice.getSupportedSampleCount();
+    // the box only has to pass the depth test somewhere, it leaves the framebuffer as it was
+    pipelineConfig.colorBlendAttachment.colorWriteMask = 0;
+    pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+    pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    pipelineConfig.bindingDescriptions.clear();
+    pipelineConfig.attributeDescriptions.clear();
+    pipelineConfig.renderPass = renderPass;
+    pipelineConfig.pipelineLayout = m_pipelineLayout;
+    m_proxyPipeline = m_glorpDevice.getPipelineRegistry().getPipeline(
+        std::string(RESOURCE_LOCATIONS) + "shaders/occlusion_proxy.vert.spv",
+        std::string(RESOURCE_LOCATIONS) + "shaders/depth_prepass.frag.spv",
+        pipelineConfig
+    );
+    m_dynamicState = PipelineDynamicState::fromConfig(pipelineConfig);
+}
+
+uint32_t GlorpOcclusionQueries::acquireSlot(GlorpGameObject::id_t id) {
+    auto it = m_slots.find(id);
+    if (it != m_slots.end()) {
+        return it->second;
+    }
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else if (m_slotCount < MAX_QUERIES) {
+        slot = m_slotCount++;
+    } else {
+        return INVALID_SLOT;
+    }
+    m_slots.emplace(id, slot);
+    m_slotObjects[slot] = id;
+    m_acquiredFrames[slot] = m_frame;
+    m_queriedFrames[slot] = 0;
+    m_resultFrames[slot] = 0;
+    return slot;
+}
+
+void GlorpOcclusionQueries::releaseUnusedSlots() {
+    // objects that were neither drawn nor queried last frame have left the scene or the policy
+    for (uint32_t slot = 0; slot < m_slotCount; slot++) {
+        if (m_usedFrames[slot] == 0 || m_usedFrames[slot] + 1 >= m_frame) continue;
+        m_slots.erase(m_slotObjects[slot]);
+        m_freeSlots.push_back(slot);
+        m_usedFrames[slot] = 0;
+    }
+}
+
+void GlorpOcclusionQueries::beginFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+    m_frame++;
+    m_frameIndex = frameIndex;
+    m_stats = {};
+    releaseUnusedSlots();
+
+    // the fence of the frame that filled this pool has been waited on, the results are final
+    auto &issued = m_issuedSlots[frameIndex];
+    if (!issued.empty()) {
+        uint32_t queryCount = *std::max_element(issued.begin(), issued.end()) + 1;
+        // sample count and availability of every query up to the last issued one
+        std::vector<uint64_t> results(2 * queryCount);
+        vkGetQueryPoolResults(m_glorpDevice.device(), m_queryPools[frameIndex], 0, queryCount, results.size() * sizeof(uint64_t),
+            results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        for (uint32_t slot : issued) {
+            // dropped when the slot changed hands since the query was issued
+            if (results[2 * slot + 1] == 0 || m_acquiredFrames[slot] > m_issuedFrames[frameIndex]) continue;
+            bool visible = results[2 * slot] > 0;
+            m_resultFrames[slot] = m_frame;
+            m_resultVisible[slot] = visible;
+            m_stats.resultsRead++;
+            m_stats.occluded += visible ? 0 : 1;
+        }
+        issued.clear();
+    }
+    vkCmdResetQueryPool(commandBuffer, m_queryPools[frameIndex], 0, MAX_QUERIES);
+}
+
+bool GlorpOcclusionQueries::beginDraw(FrameInfo &frameInfo, GlorpGameObject &obj) {
+    m_predicated = false;
+    uint32_t slot = acquireSlot(obj.getId());
+    if (slot == INVALID_SLOT) {
+        return true;
+    }
+    m_usedFrames[slot] = m_frame;
+    bool cameraNear = isCameraNear(obj, obj.transform.mat4(), frameInfo.camera.getPosition());
+    if (!beginSlot(frameInfo.commandBuffer, slot, cameraNear)) {
+        m_stats.skipped++;
+        return false;
+    }
+    return true;
+}
+
+bool GlorpOcclusionQueries::beginPrepassDraw(FrameInfo &frameInfo, const GlorpGameObject &obj) {
+    m_predicated = false;
+    // an object without a slot has no result yet, and beginDraw will draw it unconditionally too
+    auto it = m_slots.find(obj.getId());
+    if (it == m_slots.end()) {
+        return true;
+    }
+    bool cameraNear = isCameraNear(obj, obj.transform.mat4(), frameInfo.camera.getPosition());
+    return beginSlot(frameInfo.commandBuffer, it->second, cameraNear);
+}
+
+bool GlorpOcclusionQueries::beginSlot(VkCommandBuffer commandBuffer, uint32_t slot, bool cameraNear) {
+    // the camera may have come close since the last query, what it found says nothing about the object now
+    if (cameraNear) {
+        return true;
+    }
+    if (m_conditionalRendering) {
+        // last frame's end copied its query's result into the predicate
+        if (m_queriedFrames[slot] != 0 && m_queriedFrames[slot] + 1 == m_frame) {
+            VkConditionalRenderingBeginInfoEXT beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+            beginInfo.buffer = m_predicateBuffer->getBuffer();
+            beginInfo.offset = slot * sizeof(uint32_t);
+            m_glorpDevice.conditionalRendering().begin(commandBuffer, &beginInfo);
+            m_predicated = true;
+        }
+        return true;
+    }
+    // only a result read back this frame is recent enough to skip on, older ones have newer queries
+    // pending. And only while the object was queried last frame too, a gap means the camera came near it
+    // after the query whose result this is.
+    bool recent = m_resultFrames[slot] == m_frame && m_queriedFrames[slot] != 0 && m_queriedFrames[slot] + 1 == m_frame;
+    return !(recent && !m_resultVisible[slot]);
+}
+
+bool GlorpOcclusionQueries::isCameraNear(const GlorpGameObject &obj, const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition) const {
+    glm::vec3 boundsMin = obj.model->getBoundsMin();
+    glm::vec3 boundsMax = obj.model->getBoundsMax();
+    glm::vec3 worldMin{std::numeric_limits<float>::max()};
+    glm::vec3 worldMax{std::numeric_limits<float>::lowest()};
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner{(i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z};
+        glm::vec3 world = glm::vec3(modelMatrix * glm::vec4(corner, 1.f));
+        worldMin = glm::min(worldMin, world);
+        worldMax = glm::max(worldMax, world);
+    }
+    return glm::all(glm::greaterThanEqual(cameraPosition, worldMin - PROXY_NEAR_MARGIN)) &&
+        glm::all(glm::lessThanEqual(cameraPosition, worldMax + PROXY_NEAR_MARGIN));
+}
+
+void GlorpOcclusionQueries::endDraw(VkCommandBuffer commandBuffer) {
+    if (m_predicated) {
+        m_glorpDevice.conditionalRendering().end(commandBuffer);
+        m_predicated = false;
+    }
+}
+
+void GlorpOcclusionQueries::drawProxies(FrameInfo &frameInfo) {
+    auto &issued = m_issuedSlots[m_frameIndex];
+    m_issuedFrames[m_frameIndex] = m_frame;
+    glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+    bool bound = false;
+    for (auto &kv : frameInfo.gameObjects) {
+        auto &obj = kv.second;
+        if (obj.model == nullptr || obj.occlusionPolicy != GlorpGameObject::OcclusionPolicy::Query) continue;
+        uint32_t slot = acquireSlot(obj.getId());
+        if (slot == INVALID_SLOT) continue;
+        m_usedFrames[slot] = m_frame;
+
+        glm::mat4 modelMatrix = obj.transform.mat4();
+        if (isCameraNear(obj, modelMatrix, cameraPosition)) {
+            continue;
+        }
+
+        if (!bound) {
+            m_proxyPipeline->bind(frameInfo.commandBuffer);
+            m_proxyPipeline->setDynamicState(frameInfo.commandBuffer, m_dynamicState);
+            vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1,
+                &frameInfo.globalDescriptorSet, 0, nullptr);
+            bound = true;
+        }
+        OcclusionProxyPushConstantData push{};
+        push.modelMatrix = modelMatrix;
+        push.boundsMin = glm::vec4(obj.model->getBoundsMin(), 0.f);
+        push.boundsMax = glm::vec4(obj.model->getBoundsMax(), 0.f);
+        vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(OcclusionProxyPushConstantData), &push);
+
+        vkCmdBeginQuery(frameInfo.commandBuffer, m_queryPools[m_frameIndex], slot, 0);
+        vkCmdDraw(frameInfo.commandBuffer, 36, 1, 0, 0);
+        vkCmdEndQuery(frameInfo.commandBuffer, m_queryPools[m_frameIndex], slot);
+        issued.push_back(slot);
+        m_queriedFrames[slot] = m_frame;
+    }
+    m_stats.queried = static_cast<uint32_t>(issued.size());
+}
+
+void GlorpOcclusionQueries::endFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+    auto &issued = m_issuedSlots[frameIndex];
+    if (!m_conditionalRendering || issued.empty()) {
+        return;
+    }
+    std::sort(issued.begin(), issued.end());
+
+    // this frame's predicated draws read the values about to be overwritten
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+
+    // one copy per run of consecutive slots, a copy over a query that was never issued would wait forever
+    for (size_t first = 0; first < issued.size();) {
+        size_t last = first;
+        while (last + 1 < issued.size() && issued[last + 1] == issued[last] + 1) {
+            last++;
+        }
+        uint32_t firstSlot = issued[first];
+        vkCmdCopyQueryPoolResults(commandBuffer, m_queryPools[frameIndex], firstSlot, static_cast<uint32_t>(last - first + 1),
+            m_predicateBuffer->getBuffer(), firstSlot * sizeof(uint32_t), sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+        first = last + 1;
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+}
+}
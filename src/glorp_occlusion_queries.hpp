@@ -0,0 +1,120 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_buffer.hpp"
+#include "glorp_frame_info.hpp"
+#include "glorp_game_object.hpp"
+#include "glorp_pipeline.hpp"
+#include "glorp_swap_chain.hpp"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#ifndef RESOURCE_LOCATIONS
+#define RESOURCE_LOCATIONS ""
+#endif
+
+namespace Glorp {
+
+// Hardware occlusion queries for objects with OcclusionPolicy::Query. After the opaque objects, each
+// one's bounding box is drawn without writing color or depth inside an occlusion query, and the object
+// is drawn in later frames only while the query found samples:
+//   with VK_EXT_conditional_rendering  the results are copied into a predicate buffer at the end of the
+//                                      frame and the next frame's draw is skipped by the GPU
+//   without it                         the results are read back once the frame slot's fence has passed,
+//                                      MAX_FRAMES_IN_FLIGHT frames late, and the draw is skipped on the CPU
+// Neither path waits on the queries. An object drawn without a result from last frame's query is drawn
+// unconditionally, and so is one the camera is inside of or close to, whose box would be clipped away by
+// the near plane and whose last result may predate the camera coming close.
+class GlorpOcclusionQueries {
+    public:
+        static constexpr uint32_t MAX_QUERIES = 1024;
+
+        struct Stats {
+            // queries issued this frame, of MAX_QUERIES per frame slot
+            uint32_t queried = 0;
+            // results read back this frame, MAX_FRAMES_IN_FLIGHT frames after their queries, and how many
+            // of them found no samples
+            uint32_t resultsRead = 0;
+            uint32_t occluded = 0;
+            // draws skipped on the CPU, zero with conditional rendering
+            uint32_t skipped = 0;
+
+            float hitRate() const { return resultsRead > 0 ? static_cast<float>(occluded) / static_cast<float>(resultsRead) : 0.f; }
+        };
+
+        GlorpOcclusionQueries(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+        ~GlorpOcclusionQueries();
+
+        GlorpOcclusionQueries(const GlorpOcclusionQueries&) = delete;
+        GlorpOcclusionQueries &operator=(const GlorpOcclusionQueries&) = delete;
+
+        bool usesConditionalRendering() const { return m_conditionalRendering; }
+
+        // Outside a render pass, every frame whether or not queries are used. Reads back what this frame
+        // slot's queries found and resets its pool.
+        void beginFrame(VkCommandBuffer commandBuffer, int frameIndex);
+        // Around obj's draw. beginDraw returns false when the draw should be skipped, endDraw has to follow
+        // every beginDraw that returned true.
+        bool beginDraw(FrameInfo &frameInfo, GlorpGameObject &obj);
+        // Skips or predicates the depth pre-pass draw of obj the way beginDraw will its main draw, without
+        // touching slots or stats. Ended with endDraw as well.
+        bool beginPrepassDraw(FrameInfo &frameInfo, const GlorpGameObject &obj);
+        void endDraw(VkCommandBuffer commandBuffer);
+        // Inside the render pass, after every opaque object has been drawn
+        void drawProxies(FrameInfo &frameInfo);
+        // Outside a render pass, after the one drawProxies recorded into
+        void endFrame(VkCommandBuffer commandBuffer, int frameIndex);
+
+        const Stats &getStats() const { return m_stats; }
+        uint32_t getSlotCount() const { return static_cast<uint32_t>(m_slots.size()); }
+    private:
+        void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+        void createPipeline(VkRenderPass renderPass);
+        uint32_t acquireSlot(GlorpGameObject::id_t id);
+        // Begins predication of slot's draw when its query result is on the GPU, false when the CPU
+        // result says to skip it. Neither happens while the camera is near the object.
+        bool beginSlot(VkCommandBuffer commandBuffer, uint32_t slot, bool cameraNear);
+        // Whether the camera is inside obj's world space bounds grown by PROXY_NEAR_MARGIN
+        bool isCameraNear(const GlorpGameObject &obj, const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition) const;
+        void releaseUnusedSlots();
+    private:
+        static constexpr uint32_t INVALID_SLOT = ~0u;
+        // world space distance from its bounds inside of which the camera may clip an object's box
+        static constexpr float PROXY_NEAR_MARGIN = 0.25f;
+
+        GlorpDevice &m_glorpDevice;
+        bool m_conditionalRendering = false;
+
+        std::shared_ptr<GlorpPipeline> m_proxyPipeline;
+        PipelineDynamicState m_dynamicState;
+        VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+
+        std::array<VkQueryPool, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_queryPools{};
+        // slots each frame slot's pool holds a query for, until it has been read back
+        std::array<std::vector<uint32_t>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_issuedSlots;
+        std::array<uint64_t, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_issuedFrames{};
+        // one 32 bit sample count per slot, zero skips the slot's draw
+        std::unique_ptr<GlorpBuffer> m_predicateBuffer;
+
+        // slots are stable so results follow the object from frame to frame
+        std::unordered_map<GlorpGameObject::id_t, uint32_t> m_slots;
+        std::vector<GlorpGameObject::id_t> m_slotObjects;
+        std::vector<uint32_t> m_freeSlots;
+        uint32_t m_slotCount = 0;
+        // frame each slot was handed out in, last drawn or queried in, last queried in, and last read back in
+        std::vector<uint64_t> m_acquiredFrames;
+        std::vector<uint64_t> m_usedFrames;
+        std::vector<uint64_t> m_queriedFrames;
+        std::vector<uint64_t> m_resultFrames;
+        std::vector<uint8_t> m_resultVisible;
+        uint64_t m_frame = 0;
+        int m_frameIndex = 0;
+        // whether the draw between beginDraw or beginPrepassDraw and endDraw is predicated
+        bool m_predicated = false;
+
+        Stats m_stats;
+};
+}
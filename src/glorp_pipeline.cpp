@@ -1,56 +1,173 @@
 #include "glorp_pipeline.hpp"
 #include "glorp_model.hpp"
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_pipeline_registry.hpp"
 
-#include <fstream>
+#include <chrono>
 #include <stdexcept>
+#include <utility>
 #include <iostream>
 #include <cassert>
 
 namespace Glorp {
-    GlorpPipeline::GlorpPipeline(GlorpDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo) : m_glorpDevice(device)
+    GlorpShaderModule::GlorpShaderModule(GlorpDevice &device, std::span<const std::byte> code) : m_glorpDevice{device} {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        if(vkCreateShaderModule(m_glorpDevice.device(), &createInfo, nullptr, &m_module) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module");
+        }
+    }
+
+    GlorpShaderModule::~GlorpShaderModule() {
+        vkDestroyShaderModule(m_glorpDevice.device(), m_module, nullptr);
+    }
+
+    GlorpPipeline::GlorpPipeline(GlorpDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo)
+        : GlorpPipeline(device, device.getPipelineRegistry().getShaderModule(vertFilepath), device.getPipelineRegistry().getShaderModule(fragFilepath), configInfo)
     {
-        createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
+        compile();
     }
-    std::vector<char> GlorpPipeline::readFile(const std::string& filePath) {
-        std::ifstream file{filePath, std::ios::ate | std::ios::binary};
-        
-        if(!file.is_open()) {
-            throw std::runtime_error("Failed to open file " + filePath);
-        }
-        size_t fileSize = static_cast<size_t>(file.tellg());
-        std::vector<char> buffer(fileSize);
 
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
-        return buffer;
+    GlorpPipeline::GlorpPipeline(GlorpDevice& device, std::shared_ptr<GlorpShaderModule> vertShaderModule, std::shared_ptr<GlorpShaderModule> fragShaderModule,
+        const PipelineConfigInfo& configInfo)
+        : m_glorpDevice(device), m_vertShaderModule{std::move(vertShaderModule)}, m_fragShaderModule{std::move(fragShaderModule)}, m_configInfo{configInfo}
+    {
+        // the copied create infos still point into the caller's config
+        m_configInfo.colorBlendInfo.pAttachments = &m_configInfo.colorBlendAttachment;
+        m_configInfo.dynamicStateInfo.pDynamicStates = m_configInfo.dynamicStateEnables.data();
+        m_configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(m_configInfo.dynamicStateEnables.size());
     }
+
     GlorpPipeline::~GlorpPipeline() {
-        vkDestroyShaderModule(m_glorpDevice.device(), m_fragShaderModule, nullptr);
-        vkDestroyShaderModule(m_glorpDevice.device(), m_vertShaderModule, nullptr);
+        // variant compiles hold a reference to the pipeline, so every one of them has finished here
+        for (auto &[specialization, variant] : m_variants) {
+            vkDestroyPipeline(m_glorpDevice.device(), variant.get(), nullptr);
+        }
         vkDestroyPipeline(m_glorpDevice.device(), m_graphicsPipeline, nullptr);
     }
     
     void GlorpPipeline::bind(VkCommandBuffer commandBuffer) {
+        assert(isCompiled() && "Pipeline bound before GlorpPipelineRegistry::compilePending()");
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
     }
 
+    void GlorpPipeline::bind(VkCommandBuffer commandBuffer, const std::vector<uint32_t> &specialization) {
+        std::shared_future<VkPipeline> variant;
+        bool failed = false;
+        {
+            std::lock_guard<std::mutex> lock{m_variantMutex};
+            if (auto it = m_variants.find(specialization); it != m_variants.end()) {
+                variant = it->second;
+            }
+            failed = m_failedVariants.contains(specialization);
+        }
+        // a variant nobody queued is compiled right here, one still compiling on a worker is stood in for
+        // by the default variant, which handles every material just without skipping unused features
+        VkPipeline pipeline = m_graphicsPipeline;
+        if (!failed) {
+            if (!variant.valid()) {
+                variant = compileVariant(specialization);
+            }
+            if (pipeline == VK_NULL_HANDLE || variant.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                pipeline = variant.get() != VK_NULL_HANDLE ? variant.get() : m_graphicsPipeline;
+            }
+        }
+        if (pipeline == VK_NULL_HANDLE) {
+            throw std::runtime_error("No pipeline to bind in place of a variant that failed to compile");
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    }
 
-    void GlorpPipeline::createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo configInfo) {
-        assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided");
-        assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided");
+    std::shared_future<VkPipeline> GlorpPipeline::compileVariant(const std::vector<uint32_t> &specialization) {
+        std::promise<VkPipeline> promise;
+        std::shared_future<VkPipeline> variant = promise.get_future().share();
+        {
+            std::lock_guard<std::mutex> lock{m_variantMutex};
+            if (auto it = m_variants.find(specialization); it != m_variants.end()) {
+                return it->second;
+            }
+            if (m_failedVariants.contains(specialization)) {
+                promise.set_value(VK_NULL_HANDLE);
+                return variant;
+            }
+            m_variants.emplace(specialization, variant);
+        }
+        try {
+            promise.set_value(createGraphicsPipeline(specialization));
+        } catch (const std::exception &e) {
+            // not retried, binds use the default variant from now on
+            std::cerr << "Failed to compile pipeline variant: " << e.what() << std::endl;
+            {
+                std::lock_guard<std::mutex> lock{m_variantMutex};
+                m_variants.erase(specialization);
+                m_failedVariants.insert(specialization);
+            }
+            promise.set_value(VK_NULL_HANDLE);
+        }
+        return variant;
+    }
 
+    size_t GlorpPipeline::variantCount() {
+        std::lock_guard<std::mutex> lock{m_variantMutex};
+        return m_variants.size();
+    }
+
+    void GlorpPipeline::setDynamicState(VkCommandBuffer commandBuffer, const PipelineDynamicState &state) const {
+        if (!m_configInfo.extendedDynamicState) {
+            return;
+        }
+        const auto &eds = m_glorpDevice.extendedDynamicState();
+        eds.setCullMode(commandBuffer, state.cullMode);
+        eds.setFrontFace(commandBuffer, state.frontFace);
+        eds.setDepthTestEnable(commandBuffer, state.depthTestEnable);
+        eds.setDepthWriteEnable(commandBuffer, state.depthWriteEnable);
+        eds.setDepthCompareOp(commandBuffer, state.depthCompareOp);
+        if (m_configInfo.dynamicRasterizationSamples) {
+            eds.setRasterizationSamples(commandBuffer, state.rasterizationSamples);
+        }
+    }
 
-        auto vertCode = readFile(vertFilepath);
-        auto fragCode = readFile(fragFilepath);
+    PipelineDynamicState PipelineDynamicState::fromConfig(const PipelineConfigInfo &configInfo) {
+        PipelineDynamicState state{};
+        state.cullMode = configInfo.rasterizationInfo.cullMode;
+        state.frontFace = configInfo.rasterizationInfo.frontFace;
+        state.depthTestEnable = configInfo.depthStencilInfo.depthTestEnable;
+        state.depthWriteEnable = configInfo.depthStencilInfo.depthWriteEnable;
+        state.depthCompareOp = configInfo.depthStencilInfo.depthCompareOp;
+        state.rasterizationSamples = configInfo.multisampleInfo.rasterizationSamples;
+        return state;
+    }
+
+    void GlorpPipeline::compile() {
+        if (isCompiled()) {
+            return;
+        }
+        m_graphicsPipeline = createGraphicsPipeline({});
+    }
+
+    VkPipeline GlorpPipeline::createGraphicsPipeline(const std::vector<uint32_t> &specialization) {
+        // read only, variants are compiled on several threads at once
+        const auto &configInfo = m_configInfo;
+        assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided");
+        assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided");
 
-        createShaderModule(vertCode, &m_vertShaderModule);
-        createShaderModule(fragCode, &m_fragShaderModule);
+        std::vector<VkSpecializationMapEntry> specializationEntries;
+        for (uint32_t i = 0; i < specialization.size(); i++) {
+            specializationEntries.push_back({i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t)});
+        }
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+        specializationInfo.pMapEntries = specializationEntries.data();
+        specializationInfo.dataSize = specialization.size() * sizeof(uint32_t);
+        specializationInfo.pData = specialization.data();
 
         VkPipelineShaderStageCreateInfo shaderStages[2];
         shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shaderStages[0].module = m_vertShaderModule;
+        shaderStages[0].module = m_vertShaderModule->getModule();
         shaderStages[0].pName = "main";
         shaderStages[0].flags = 0;
         shaderStages[0].pSpecializationInfo = nullptr;
@@ -58,10 +175,10 @@ namespace Glorp {
 
         shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        shaderStages[1].module = m_fragShaderModule;
+        shaderStages[1].module = m_fragShaderModule->getModule();
         shaderStages[1].pName = "main";
         shaderStages[1].flags = 0;
-        shaderStages[1].pSpecializationInfo = nullptr;
+        shaderStages[1].pSpecializationInfo = specialization.empty() ? nullptr : &specializationInfo;
         shaderStages[1].pNext = nullptr;
 
 
@@ -95,24 +212,17 @@ namespace Glorp {
         pipelineInfo.basePipelineIndex = -1;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-        if(vkCreateGraphicsPipelines(m_glorpDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) {
+        auto &pipelineCache = m_glorpDevice.getPipelineCache();
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline;
+        if(vkCreateGraphicsPipelines(m_glorpDevice.device(), pipelineCache.getCache(), 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create graphics pipelines");
         }
+        pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+        return pipeline;
     }
 
-    void GlorpPipeline::createShaderModule(const std::vector<char>& shaderCode, VkShaderModule* shaderModule) 
-    {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = shaderCode.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
-        
-        if(vkCreateShaderModule(m_glorpDevice.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create shader module");
-        }   
-    }
-
-    void GlorpPipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
+    void GlorpPipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo, const GlorpDevice &device) {
         configInfo.inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
         configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
         configInfo.inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
@@ -176,6 +286,21 @@ namespace Glorp {
         configInfo.depthStencilInfo.back = {};   // Optional
 
         configInfo.dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        const auto &eds = device.extendedDynamicState();
+        configInfo.extendedDynamicState = eds.supported;
+        configInfo.dynamicRasterizationSamples = eds.rasterizationSamples;
+        if (configInfo.extendedDynamicState) {
+            configInfo.dynamicStateEnables.insert(configInfo.dynamicStateEnables.end(), {
+                VK_DYNAMIC_STATE_CULL_MODE_EXT,
+                VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+                VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+                VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+                VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT
+            });
+        }
+        if (configInfo.dynamicRasterizationSamples) {
+            configInfo.dynamicStateEnables.push_back(VK_DYNAMIC_STATE_RASTERIZATION_SAMPLES_EXT);
+        }
         configInfo.dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
         configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
         configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
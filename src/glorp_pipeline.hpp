@@ -2,7 +2,13 @@
 
 #include "glorp_device.hpp"
 
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <span>
 #include <vector>
 
 namespace Glorp {
@@ -24,31 +30,81 @@ struct PipelineConfigInfo {
     VkPipelineLayout pipelineLayout = nullptr;
     VkRenderPass renderPass = nullptr;
     uint32_t subpass = 0;
+    // cull, front face and depth state come from GlorpPipeline::setDynamicState instead of the fields above
+    bool extendedDynamicState = false;
+    bool dynamicRasterizationSamples = false;
+};
+
+// The state set at record time on pipelines built with extended dynamic state
+struct PipelineDynamicState {
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    VkBool32 depthTestEnable = VK_TRUE;
+    VkBool32 depthWriteEnable = VK_TRUE;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    static PipelineDynamicState fromConfig(const PipelineConfigInfo &configInfo);
+};
+
+class GlorpShaderModule {
+    public:
+        GlorpShaderModule(GlorpDevice &device, std::span<const std::byte> code);
+        ~GlorpShaderModule();
+
+        GlorpShaderModule(const GlorpShaderModule&) = delete;
+        GlorpShaderModule &operator=(const GlorpShaderModule&) = delete;
+
+        VkShaderModule getModule() const { return m_module; }
+    private:
+        GlorpDevice &m_glorpDevice;
+        VkShaderModule m_module = VK_NULL_HANDLE;
 };
 
 class GlorpPipeline {
     public:
+        // Compiled right away, shader modules come from the device's pipeline registry
         GlorpPipeline(GlorpDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo);
+        // Left uncompiled until compile(), used by GlorpPipelineRegistry to build pipelines on workers
+        GlorpPipeline(GlorpDevice& device, std::shared_ptr<GlorpShaderModule> vertShaderModule, std::shared_ptr<GlorpShaderModule> fragShaderModule,
+            const PipelineConfigInfo& configInfo);
         ~GlorpPipeline();
 
         GlorpPipeline(const GlorpPipeline&) = delete;
         GlorpPipeline &operator=(const GlorpPipeline&) = delete;
 
-        static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo);
+        // Makes cull, front face and depth state dynamic when the device supports extended dynamic state
+        static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo, const GlorpDevice &device);
         void bind(VkCommandBuffer commandBuffer);
+        // Binds the variant with fragment specialization constant i set to specialization[i], every
+        // constant is 32 bits wide. Variants not queued through GlorpPipelineRegistry::compileVariantAsync
+        // are compiled on first use, all of them are kept for the pipeline's lifetime. The default variant
+        // is bound while the requested one is still compiling on a worker, or when it failed to compile.
+        void bind(VkCommandBuffer commandBuffer, const std::vector<uint32_t> &specialization);
+        // Compiles the variant unless it exists or is being compiled already, safe from any thread. The
+        // future holds VK_NULL_HANDLE when compiling failed, which is logged once and never retried.
+        std::shared_future<VkPipeline> compileVariant(const std::vector<uint32_t> &specialization);
+        void compile();
+        bool isCompiled() const { return m_graphicsPipeline != VK_NULL_HANDLE; }
+        size_t variantCount();
+        // Has to follow every bind, a shared pipeline keeps the static state of whoever created it.
+        // Does nothing on pipelines built without extended dynamic state.
+        void setDynamicState(VkCommandBuffer commandBuffer, const PipelineDynamicState &state) const;
 
         static void enableAlphaBlending(PipelineConfigInfo &configInfo);
 
     private:
-        static std::vector<char> readFile(const std::string& filePath);
-
-        void createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo configInfo);
-
-        void createShaderModule(const std::vector<char>& shaderCode, VkShaderModule* shaderModule);
+        VkPipeline createGraphicsPipeline(const std::vector<uint32_t> &specialization);
     private:
         GlorpDevice &m_glorpDevice;
-        VkPipeline m_graphicsPipeline;
-        VkShaderModule m_vertShaderModule;
-        VkShaderModule m_fragShaderModule;
+        // the variant with the shaders' default specialization constants
+        VkPipeline m_graphicsPipeline = VK_NULL_HANDLE;
+        std::mutex m_variantMutex;
+        std::map<std::vector<uint32_t>, std::shared_future<VkPipeline>> m_variants;
+        std::set<std::vector<uint32_t>> m_failedVariants;
+        // kept for the variants compiled later on
+        std::shared_ptr<GlorpShaderModule> m_vertShaderModule;
+        std::shared_ptr<GlorpShaderModule> m_fragShaderModule;
+        PipelineConfigInfo m_configInfo;
 };
 }
\ No newline at end of file
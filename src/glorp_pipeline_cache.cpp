@@ -0,0 +1,150 @@
+#include "glorp_pipeline_cache.hpp"
+#include "glorp_file_io.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+namespace Glorp {
+
+namespace {
+constexpr char MAGIC[4] = {'G', 'L', 'P', 'C'};
+constexpr uint32_t VERSION = 1;
+
+// written in front of the driver's blob, which carries its own VkPipelineCacheHeaderVersionOne
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint32_t reserved;
+    uint64_t dataSize;
+    uint64_t checksum;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+uint64_t checksum(std::span<const std::byte> data) {
+    // FNV-1a, only meant to catch truncated or corrupted files
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::byte b : data) {
+        hash = (hash ^ static_cast<uint8_t>(b)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+}
+
+GlorpPipelineCache::GlorpPipelineCache(GlorpDevice &device, std::string path) : m_device{device}, m_path{std::move(path)} {
+    auto initialData = loadValidated();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = initialData.size();
+    cacheInfo.pInitialData = initialData.data();
+    if (vkCreatePipelineCache(m_device.device(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS) {
+        // drivers may still reject data that passed the header checks, start cold instead
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        if (vkCreatePipelineCache(m_device.device(), &cacheInfo, nullptr, &m_cache) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline cache.");
+        }
+        initialData.clear();
+    }
+    m_loadedSize = initialData.size();
+}
+
+GlorpPipelineCache::~GlorpPipelineCache() {
+    try {
+        save();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    vkDestroyPipelineCache(m_device.device(), m_cache, nullptr);
+}
+
+std::vector<std::byte> GlorpPipelineCache::loadValidated() {
+    auto result = GlorpFileIo::shared().readAsync(m_path, GlorpFileIo::Priority::High).get();
+    if (!result.ok()) {
+        return {};
+    }
+    auto bytes = result.data.bytes();
+    const auto &properties = m_device.properties;
+
+    FileHeader header{};
+    if (bytes.size() < sizeof(header)) {
+        std::cout << "Ignoring pipeline cache " << m_path << ", file is truncated" << std::endl;
+        return {};
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    auto data = bytes.subspan(sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.dataSize != data.size() ||
+        header.checksum != checksum(data)) {
+        std::cout << "Ignoring pipeline cache " << m_path << ", file is corrupt" << std::endl;
+        return {};
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+        header.driverVersion != properties.driverVersion ||
+        std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "Ignoring pipeline cache " << m_path << ", it was written by another device or driver" << std::endl;
+        return {};
+    }
+
+    // the driver's own header has to agree as well
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader)) {
+        return {};
+    }
+    std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    if (driverHeader.headerSize < sizeof(driverHeader) || driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.vendorID != properties.vendorID || driverHeader.deviceID != properties.deviceID ||
+        std::memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        std::cout << "Ignoring pipeline cache " << m_path << ", driver header does not match" << std::endl;
+        return {};
+    }
+    return {data.begin(), data.end()};
+}
+
+void GlorpPipelineCache::save() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_device.device(), m_cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<std::byte> data(size);
+    if (vkGetPipelineCacheData(m_device.device(), m_cache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+    data.resize(size);
+
+    const auto &properties = m_device.properties;
+    FileHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    header.dataSize = data.size();
+    header.checksum = checksum(data);
+    std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    GlorpFileIo::writeFileAtomically(m_path, [&](std::ostream &out) {
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    });
+}
+
+void GlorpPipelineCache::recordCreation(std::chrono::steady_clock::duration duration) {
+    m_pipelinesCreated++;
+    m_creationTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+GlorpPipelineCache::Stats GlorpPipelineCache::getStats() const {
+    Stats stats{};
+    stats.pipelinesCreated = m_pipelinesCreated.load();
+    stats.creationTimeMs = m_creationTimeNs.load() / 1e6;
+    stats.loadedSize = m_loadedSize;
+    return stats;
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "glorp_device.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Glorp {
+
+// Device wide VkPipelineCache persisted between runs. The file is only handed to the driver when it
+// was written by the same vendor, device, driver version and cache UUID, and its payload checksum
+// still matches, so a driver update or a truncated write just starts an empty cache. Every pipeline
+// and ImGui is created through it; the data is written back atomically when the device goes away.
+class GlorpPipelineCache {
+    public:
+        // next to the working directory, the resource directory may be read only
+        static constexpr const char *DEFAULT_PATH = "glorp_pipeline_cache.bin";
+
+        struct Stats {
+            uint32_t pipelinesCreated = 0;
+            double creationTimeMs = 0.0;
+            // size of the data the driver accepted at startup, 0 for a cold cache
+            size_t loadedSize = 0;
+        };
+
+        GlorpPipelineCache(GlorpDevice &device, std::string path = DEFAULT_PATH);
+        ~GlorpPipelineCache();
+
+        GlorpPipelineCache(const GlorpPipelineCache&) = delete;
+        GlorpPipelineCache &operator=(const GlorpPipelineCache&) = delete;
+
+        VkPipelineCache getCache() const { return m_cache; }
+
+        // Callers report how long vkCreate*Pipelines took so cache hits show up in the startup log
+        void recordCreation(std::chrono::steady_clock::duration duration);
+        Stats getStats() const;
+        void save();
+    private:
+        std::vector<std::byte> loadValidated();
+    private:
+        GlorpDevice &m_device;
+        std::string m_path;
+        VkPipelineCache m_cache = VK_NULL_HANDLE;
+        size_t m_loadedSize = 0;
+
+        std::atomic<uint32_t> m_pipelinesCreated = 0;
+        std::atomic<int64_t> m_creationTimeNs = 0;
+};
+}
@@ -0,0 +1,212 @@
+#include "glorp_pipeline_registry.hpp"
+#include "glorp_file_io.hpp"
+#include "glorp_thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+namespace Glorp {
+
+namespace {
+template <typename T>
+void append(std::string &key, const T &value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void append(std::string &key, const std::string &value) {
+    append(key, value.size());
+    key.append(value);
+}
+}
+
+GlorpPipelineRegistry::GlorpPipelineRegistry(GlorpDevice &device) : m_device{device} {
+    // a couple of workers, variants trickle in as materials stream and the render thread keeps its core
+    m_variantWorkers = std::make_unique<GlorpThreadPool>(std::clamp(std::thread::hardware_concurrency() / 4, 1u, 2u));
+}
+
+GlorpPipelineRegistry::~GlorpPipelineRegistry() {}
+
+std::shared_ptr<GlorpShaderModule> GlorpPipelineRegistry::getShaderModule(const std::string &filepath) {
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (auto it = m_shaderModules.find(filepath); it != m_shaderModules.end()) {
+            return it->second;
+        }
+    }
+
+    auto code = GlorpFileIo::shared().readAsync(filepath, GlorpFileIo::Priority::High).get();
+    if (!code.ok()) {
+        throw std::runtime_error("Failed to open file " + filepath);
+    }
+    auto module = std::make_shared<GlorpShaderModule>(m_device, code.data.bytes());
+
+    // another thread may have loaded the same file meanwhile, keep the first one
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_shaderModules.try_emplace(filepath, std::move(module)).first->second;
+}
+
+std::shared_ptr<GlorpPipeline> GlorpPipelineRegistry::getPipeline(const std::string &vertFilepath, const std::string &fragFilepath,
+    const PipelineConfigInfo &configInfo) {
+    std::string key = pipelineKey(vertFilepath, fragFilepath, configInfo);
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (auto it = m_pipelines.find(key); it != m_pipelines.end()) {
+            if (auto pipeline = it->second.lock()) {
+                return pipeline;
+            }
+        }
+    }
+
+    auto vertShaderModule = getShaderModule(vertFilepath);
+    auto fragShaderModule = getShaderModule(fragFilepath);
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto &entry = m_pipelines[key];
+    if (auto pipeline = entry.lock()) {
+        return pipeline;
+    }
+    auto pipeline = std::make_shared<GlorpPipeline>(m_device, std::move(vertShaderModule), std::move(fragShaderModule), configInfo);
+    entry = pipeline;
+    m_pending.push_back(pipeline);
+    return pipeline;
+}
+
+void GlorpPipelineRegistry::compilePending() {
+    std::vector<std::shared_ptr<GlorpPipeline>> pending;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        pending.swap(m_pending);
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    // the pipeline cache is internally synchronized, so workers can share it
+    uint32_t workerCount = std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<uint32_t>(pending.size()));
+    {
+        GlorpThreadPool threadPool{workerCount};
+        std::vector<std::future<void>> compiles;
+        for (auto &pipeline : pending) {
+            compiles.push_back(threadPool.submit([pipeline] { pipeline->compile(); }));
+        }
+        // rethrows the first failure once every compile has finished
+        for (auto &compile : compiles) {
+            compile.wait();
+        }
+        for (auto &compile : compiles) {
+            compile.get();
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Compiled " << pending.size() << " pipelines on " << workerCount << " workers in "
+        << std::chrono::duration<float, std::milli>(end - start).count() << "ms" << std::endl;
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+    std::erase_if(m_pipelines, [](const auto &entry) { return entry.second.expired(); });
+}
+
+void GlorpPipelineRegistry::compileVariantAsync(std::shared_ptr<GlorpPipeline> pipeline, std::vector<uint32_t> specialization) {
+    // compileVariant logs its own failures, binds fall back to the default variant
+    m_variantWorkers->submit([pipeline = std::move(pipeline), specialization = std::move(specialization)] {
+        pipeline->compileVariant(specialization);
+    });
+}
+
+size_t GlorpPipelineRegistry::pipelineCount() {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return std::count_if(m_pipelines.begin(), m_pipelines.end(), [](const auto &entry) { return !entry.second.expired(); });
+}
+
+std::string GlorpPipelineRegistry::pipelineKey(const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo) {
+    // every field that reaches vkCreateGraphicsPipelines, create info pointers excluded. State set at
+    // record time is left out, so configs differing only in it share a pipeline.
+    std::string key;
+    append(key, vertFilepath);
+    append(key, fragFilepath);
+
+    append(key, configInfo.bindingDescriptions.size());
+    for (const auto &binding : configInfo.bindingDescriptions) {
+        append(key, binding.binding);
+        append(key, binding.stride);
+        append(key, binding.inputRate);
+    }
+    append(key, configInfo.attributeDescriptions.size());
+    for (const auto &attribute : configInfo.attributeDescriptions) {
+        append(key, attribute.location);
+        append(key, attribute.binding);
+        append(key, attribute.format);
+        append(key, attribute.offset);
+    }
+
+    append(key, configInfo.viewportInfo.viewportCount);
+    append(key, configInfo.viewportInfo.scissorCount);
+
+    append(key, configInfo.inputAssemblyInfo.topology);
+    append(key, configInfo.inputAssemblyInfo.primitiveRestartEnable);
+
+    const auto &rasterization = configInfo.rasterizationInfo;
+    append(key, rasterization.depthClampEnable);
+    append(key, rasterization.rasterizerDiscardEnable);
+    append(key, rasterization.polygonMode);
+    if (!configInfo.extendedDynamicState) {
+        append(key, rasterization.cullMode);
+        append(key, rasterization.frontFace);
+    }
+    append(key, rasterization.depthBiasEnable);
+    append(key, rasterization.depthBiasConstantFactor);
+    append(key, rasterization.depthBiasClamp);
+    append(key, rasterization.depthBiasSlopeFactor);
+    append(key, rasterization.lineWidth);
+
+    const auto &multisample = configInfo.multisampleInfo;
+    if (!configInfo.dynamicRasterizationSamples) {
+        append(key, multisample.rasterizationSamples);
+    }
+    append(key, multisample.sampleShadingEnable);
+    append(key, multisample.minSampleShading);
+    append(key, multisample.alphaToCoverageEnable);
+    append(key, multisample.alphaToOneEnable);
+
+    const auto &blend = configInfo.colorBlendAttachment;
+    append(key, blend.blendEnable);
+    append(key, blend.srcColorBlendFactor);
+    append(key, blend.dstColorBlendFactor);
+    append(key, blend.colorBlendOp);
+    append(key, blend.srcAlphaBlendFactor);
+    append(key, blend.dstAlphaBlendFactor);
+    append(key, blend.alphaBlendOp);
+    append(key, blend.colorWriteMask);
+    append(key, configInfo.colorBlendInfo.logicOpEnable);
+    append(key, configInfo.colorBlendInfo.logicOp);
+    append(key, configInfo.colorBlendInfo.blendConstants);
+
+    const auto &depthStencil = configInfo.depthStencilInfo;
+    if (!configInfo.extendedDynamicState) {
+        append(key, depthStencil.depthTestEnable);
+        append(key, depthStencil.depthWriteEnable);
+        append(key, depthStencil.depthCompareOp);
+    }
+    append(key, depthStencil.depthBoundsTestEnable);
+    append(key, depthStencil.stencilTestEnable);
+    append(key, depthStencil.front);
+    append(key, depthStencil.back);
+    append(key, depthStencil.minDepthBounds);
+    append(key, depthStencil.maxDepthBounds);
+
+    append(key, configInfo.dynamicStateEnables.size());
+    for (auto state : configInfo.dynamicStateEnables) {
+        append(key, state);
+    }
+
+    append(key, configInfo.pipelineLayout);
+    append(key, configInfo.renderPass);
+    append(key, configInfo.subpass);
+    return key;
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_pipeline.hpp"
+#include "glorp_thread_pool.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Glorp {
+
+// Device wide registry of shader modules and graphics pipelines. A pipeline is keyed by its shaders
+// and every field of its PipelineConfigInfo, so render systems asking for the same state share one
+// VkPipeline, and every SPIR-V file is turned into a module once. Pipelines are handed out
+// uncompiled; compilePending() builds all of them at once on worker threads, so startup waits for
+// the slowest pipeline rather than the sum of all of them.
+class GlorpPipelineRegistry {
+    public:
+        explicit GlorpPipelineRegistry(GlorpDevice &device);
+        ~GlorpPipelineRegistry();
+
+        GlorpPipelineRegistry(const GlorpPipelineRegistry&) = delete;
+        GlorpPipelineRegistry &operator=(const GlorpPipelineRegistry&) = delete;
+
+        std::shared_ptr<GlorpShaderModule> getShaderModule(const std::string &filepath);
+        // The returned pipeline may not be bound before the next compilePending()
+        std::shared_ptr<GlorpPipeline> getPipeline(const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+        // Compiles every pipeline handed out since the last call and waits for them
+        void compilePending();
+        // Compiles a specialization variant of pipeline in the background, so the bind that first
+        // needs it does not compile it on the render thread
+        void compileVariantAsync(std::shared_ptr<GlorpPipeline> pipeline, std::vector<uint32_t> specialization);
+
+        size_t pipelineCount();
+    private:
+        static std::string pipelineKey(const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+    private:
+        GlorpDevice &m_device;
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<GlorpShaderModule>> m_shaderModules;
+        // weak so pipelines are destroyed with the last render system using them
+        std::unordered_map<std::string, std::weak_ptr<GlorpPipeline>> m_pipelines;
+        std::vector<std::shared_ptr<GlorpPipeline>> m_pending;
+        // joined before the device is destroyed, pipelines queued on it are still compiled
+        std::unique_ptr<GlorpThreadPool> m_variantWorkers;
+};
+}
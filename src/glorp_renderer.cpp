@@ -18,7 +18,7 @@ void GlorpRenderer::recreateSwapChain() {
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(m_glorpDevice.device());
+    m_glorpDevice.waitIdle();
 
     if(m_glorpSwapChain == nullptr) {
         m_glorpSwapChain = std::make_unique<GlorpSwapChain>(m_glorpDevice, extent);
@@ -93,13 +93,13 @@ void GlorpRenderer::endFrame() {
     m_isFrameStarted = false;
     m_currentFrameIndex = (m_currentFrameIndex + 1) % GlorpSwapChain::MAX_FRAMES_IN_FLIGHT;
 }
-void GlorpRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+void GlorpRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, GlorpSwapChain::Pass pass) {
     assert(m_isFrameStarted && "Cannot begin swap chain render pass if frame is not started");
     assert(commandBuffer == getCurrentCommandBuffer() && "Cant begin render pass on a command buffer from a different frame");
 
     VkRenderPassBeginInfo renderPassInfo {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = m_glorpSwapChain->getRenderPass();
+    renderPassInfo.renderPass = m_glorpSwapChain->getRenderPass(pass);
     renderPassInfo.framebuffer = m_glorpSwapChain->getFrameBuffer(m_currentImageIndex);
 
     renderPassInfo.renderArea.offset = {0, 0};
@@ -108,6 +108,7 @@ void GlorpRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
     std::array<VkClearValue, 2> clearValues{};
     clearValues[0].color = {0.01f, 0.01f, 0.01f, 1.0f};
     clearValues[1].depthStencil = {1.0f, 0};
+    // ignored by the late pass, which loads both
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
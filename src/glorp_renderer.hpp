@@ -19,12 +19,18 @@ class GlorpRenderer {
 
         VkRenderPass getSwapChainRenderPass() const { return m_glorpSwapChain->getRenderPass(); }
         float getAspectRatio() const { return m_glorpSwapChain->extentAspectRatio(); }
+        VkExtent2D getSwapChainExtent() const { return m_glorpSwapChain->getSwapChainExtent(); }
         bool isFrameInProgress() const { return m_isFrameStarted; }
 
         VkCommandBuffer getCurrentCommandBuffer() const {
             assert(m_isFrameStarted && "Cannot get current command buffer while the frame is not in progress");
             return m_commandBuffers[m_currentFrameIndex];
         }
+        // depth attachment of the frame in progress
+        VkImageView getDepthImageView() const {
+            assert(m_isFrameStarted && "Cannot get the depth attachment while the frame is not in progress");
+            return m_glorpSwapChain->getDepthImageView(static_cast<int>(m_currentImageIndex));
+        }
         int getFrameIndex() const {
             assert(m_isFrameStarted && "Cannot get current frame index while the frame is not in progress");
             return m_currentFrameIndex;
@@ -32,7 +38,8 @@ class GlorpRenderer {
 
         VkCommandBuffer beginFrame();
         void endFrame();
-        void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+        // A frame either begins the Single pass once, or the Early pass and later the Late pass
+        void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, GlorpSwapChain::Pass pass = GlorpSwapChain::Pass::Single);
         void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
         void recreateSwapChain();
 
@@ -0,0 +1,126 @@
+#include "glorp_sampler_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+namespace Glorp {
+
+namespace {
+template <typename T>
+void hashCombine(size_t &seed, const T &value) {
+    seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+}
+
+GlorpSamplerCache::GlorpSamplerCache(GlorpDevice &device) : m_device{device} {
+    m_maxSupportedAnisotropy = m_device.properties.limits.maxSamplerAnisotropy;
+    m_maxSupportedLodBias = m_device.properties.limits.maxSamplerLodBias;
+}
+
+GlorpSamplerCache::~GlorpSamplerCache() {
+    for (auto &[samplerInfo, sampler] : m_samplers) {
+        vkDestroySampler(m_device.device(), sampler, nullptr);
+    }
+}
+
+size_t GlorpSamplerCache::SamplerInfoHash::operator()(const VkSamplerCreateInfo &info) const {
+    size_t seed = 0;
+    hashCombine(seed, static_cast<uint32_t>(info.flags));
+    hashCombine(seed, static_cast<int>(info.magFilter));
+    hashCombine(seed, static_cast<int>(info.minFilter));
+    hashCombine(seed, static_cast<int>(info.mipmapMode));
+    hashCombine(seed, static_cast<int>(info.addressModeU));
+    hashCombine(seed, static_cast<int>(info.addressModeV));
+    hashCombine(seed, static_cast<int>(info.addressModeW));
+    hashCombine(seed, info.mipLodBias);
+    hashCombine(seed, info.anisotropyEnable);
+    hashCombine(seed, info.maxAnisotropy);
+    hashCombine(seed, info.compareEnable);
+    hashCombine(seed, static_cast<int>(info.compareOp));
+    hashCombine(seed, info.minLod);
+    hashCombine(seed, info.maxLod);
+    hashCombine(seed, static_cast<int>(info.borderColor));
+    hashCombine(seed, info.unnormalizedCoordinates);
+    return seed;
+}
+
+bool GlorpSamplerCache::SamplerInfoEqual::operator()(const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b) const {
+    return a.flags == b.flags &&
+        a.magFilter == b.magFilter &&
+        a.minFilter == b.minFilter &&
+        a.mipmapMode == b.mipmapMode &&
+        a.addressModeU == b.addressModeU &&
+        a.addressModeV == b.addressModeV &&
+        a.addressModeW == b.addressModeW &&
+        a.mipLodBias == b.mipLodBias &&
+        a.anisotropyEnable == b.anisotropyEnable &&
+        a.maxAnisotropy == b.maxAnisotropy &&
+        a.compareEnable == b.compareEnable &&
+        a.compareOp == b.compareOp &&
+        a.minLod == b.minLod &&
+        a.maxLod == b.maxLod &&
+        a.borderColor == b.borderColor &&
+        a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+VkSamplerCreateInfo GlorpSamplerCache::applyQuality(VkSamplerCreateInfo samplerInfo) const {
+    if (samplerInfo.anisotropyEnable) {
+        float anisotropy = std::clamp(m_quality.maxAnisotropy, 1.0f, m_maxSupportedAnisotropy);
+        samplerInfo.anisotropyEnable = anisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+        samplerInfo.maxAnisotropy = anisotropy > 1.0f ? anisotropy : 0.0f;
+    } else {
+        samplerInfo.maxAnisotropy = 0.0f;
+    }
+    // bias only matters when there is more than one level to choose from
+    if (samplerInfo.maxLod > samplerInfo.minLod) {
+        samplerInfo.mipLodBias = std::clamp(samplerInfo.mipLodBias + m_quality.mipLodBias, -m_maxSupportedLodBias, m_maxSupportedLodBias);
+    }
+    return samplerInfo;
+}
+
+VkSampler GlorpSamplerCache::getSampler(const VkSamplerCreateInfo &samplerInfo) {
+    if (samplerInfo.pNext != nullptr) {
+        throw std::runtime_error("Sampler cache does not support pNext chains.");
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    VkSamplerCreateInfo info = applyQuality(samplerInfo);
+    auto it = m_samplers.find(info);
+    if (it != m_samplers.end()) {
+        return it->second;
+    }
+
+    VkSampler sampler;
+    if (vkCreateSampler(m_device.device(), &info, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture sampler.");
+    }
+    m_samplers.emplace(info, sampler);
+    return sampler;
+}
+
+GlorpSamplerCache::QualitySettings GlorpSamplerCache::getQuality() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_quality;
+}
+
+void GlorpSamplerCache::setQuality(QualitySettings quality) {
+    // snapped to a few discrete steps, every distinct value is a sampler that lives as long as the cache
+    quality.maxAnisotropy = std::exp2(std::round(std::log2(std::clamp(quality.maxAnisotropy, 1.0f, m_maxSupportedAnisotropy))));
+    quality.mipLodBias = std::round(quality.mipLodBias * 4.0f) / 4.0f;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (quality == m_quality) {
+        return;
+    }
+    m_quality = quality;
+    m_generation++;
+}
+
+size_t GlorpSamplerCache::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_samplers.size();
+}
+
+}
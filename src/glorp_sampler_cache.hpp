@@ -0,0 +1,59 @@
+#pragma once
+
+#include "glorp_device.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace Glorp {
+
+// Device wide VkSampler cache. Textures describe the sampler they want and share one handle per
+// distinct description. Anisotropy and LOD bias are global quality settings applied on lookup, so
+// changing them only creates new samplers; descriptor sets pick them up once they are rewritten.
+// Samplers live until the cache is destroyed, sets written before a change stay valid.
+class GlorpSamplerCache {
+    public:
+        struct QualitySettings {
+            float maxAnisotropy = 4.0f;
+            float mipLodBias = 0.0f;
+
+            bool operator==(const QualitySettings &other) const = default;
+        };
+
+        explicit GlorpSamplerCache(GlorpDevice &device);
+        ~GlorpSamplerCache();
+
+        GlorpSamplerCache(const GlorpSamplerCache&) = delete;
+        GlorpSamplerCache &operator=(const GlorpSamplerCache&) = delete;
+
+        // pNext chains are not supported
+        VkSampler getSampler(const VkSamplerCreateInfo &samplerInfo);
+
+        QualitySettings getQuality();
+        void setQuality(QualitySettings quality);
+        // Increments whenever the quality settings change, callers compare it to know when to rewrite descriptors
+        uint64_t getGeneration() const { return m_generation.load(); }
+        float getMaxSupportedAnisotropy() const { return m_maxSupportedAnisotropy; }
+
+        size_t size();
+    private:
+        struct SamplerInfoHash {
+            size_t operator()(const VkSamplerCreateInfo &info) const;
+        };
+        struct SamplerInfoEqual {
+            bool operator()(const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b) const;
+        };
+
+        VkSamplerCreateInfo applyQuality(VkSamplerCreateInfo samplerInfo) const;
+    private:
+        GlorpDevice &m_device;
+        float m_maxSupportedAnisotropy;
+        float m_maxSupportedLodBias;
+
+        std::mutex m_mutex;
+        QualitySettings m_quality;
+        std::atomic<uint64_t> m_generation = 0;
+        std::unordered_map<VkSamplerCreateInfo, VkSampler, SamplerInfoHash, SamplerInfoEqual> m_samplers;
+};
+}
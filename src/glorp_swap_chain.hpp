@@ -6,6 +6,7 @@
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <array>
 #include <vector>
 #include <memory>
 #include <vulkan/vulkan_core.h>
@@ -16,6 +17,15 @@ class GlorpSwapChain {
  public:
   static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+  // A frame is drawn in a single render pass, or in an early and a late one over the same framebuffer
+  // when work in between reads the early pass's depth, see GlorpHzbCuller. The passes only differ in
+  // load and store ops and layouts, so pipelines built for one work in all of them.
+  enum class Pass {
+    Single,
+    Early,
+    Late
+  };
+
   GlorpSwapChain(GlorpDevice &deviceRef, VkExtent2D windowExtent);
   GlorpSwapChain(GlorpDevice &deviceRef, VkExtent2D windowExtent, std::shared_ptr<GlorpSwapChain> previous);
 
@@ -25,8 +35,11 @@ class GlorpSwapChain {
   GlorpSwapChain &operator=(const GlorpSwapChain &) = delete;
 
   VkFramebuffer getFrameBuffer(int index) { return m_swapChainFramebuffers[index]; }
-  VkRenderPass getRenderPass() { return m_renderPass; }
+  VkRenderPass getRenderPass(Pass pass = Pass::Single) { return m_renderPasses[static_cast<size_t>(pass)]; }
   VkImageView getImageView(int index) { return m_swapChainImageViews[index]; }
+  // Sampleable, multisampled when MSAA is on. Holds the early pass's depth in
+  // DEPTH_STENCIL_READ_ONLY_OPTIMAL between the early and the late pass.
+  VkImageView getDepthImageView(int index) { return m_depthImageViews[index]; }
   size_t imageCount() { return m_swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return m_swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return m_swapChainExtent; }
@@ -49,7 +62,7 @@ class GlorpSwapChain {
   void createSwapChain();
   void createImageViews();
   void createDepthResources();
-  void createRenderPass();
+  VkRenderPass createRenderPass(Pass pass);
   void createFramebuffers();
   void createColorResources();
   void createSyncObjects();
@@ -68,7 +81,7 @@ class GlorpSwapChain {
   VkExtent2D m_swapChainExtent;
 
   std::vector<VkFramebuffer> m_swapChainFramebuffers;
-  VkRenderPass m_renderPass;
+  std::array<VkRenderPass, 3> m_renderPasses{};
 
   std::vector<VkImage> m_depthImages;
   std::vector<VkDeviceMemory> m_depthImageMemorys;
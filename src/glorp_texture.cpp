@@ -1,48 +1,128 @@
 #include "glorp_texture.hpp"
 
 #include "glorp_buffer.hpp"
+#include "glorp_image_decoder.hpp"
+#include "glorp_mip_generator.hpp"
+#include "glorp_sampler_cache.hpp"
+#include "glorp_texture_processing.hpp"
+#include <cstring>
 #include <iostream>
 
 #include <stdexcept>
 
 namespace Glorp {
-GlorpTexture::GlorpTexture(GlorpDevice &device, const tinygltf::Image &image) : m_device {device} {
-    createImageGLTF(image);
+GlorpTexture::GlorpTexture(GlorpDevice &device, const tinygltf::Image &image, VkFormat format) : m_device {device} {
+    auto &uploadContext = m_device.getUploadContext();
+    uploadContext.beginBatch();
+    createImageGLTF(image, format);
     createSampler();
     createImageView();
     generateMipMaps();
+    uploadContext.endBatch();
 }
 
-void GlorpTexture::createImageGLTF(const tinygltf::Image &image) {
+GlorpTexture::GlorpTexture(GlorpDevice &device, const void *pixels, int width, int height) : m_device {device} {
+    if (!pixels) {
+        throw std::runtime_error("Texture image data is null.");
+    }
+    auto &uploadContext = m_device.getUploadContext();
+    uploadContext.beginBatch();
+    createImage(uploadContext.stage(pixels, static_cast<VkDeviceSize>(width) * height * 4), width, height, VK_FORMAT_R8G8B8A8_SRGB);
+    createSampler();
+    createImageView();
+    generateMipMaps();
+    uploadContext.endBatch();
+}
+
+GlorpTexture::GlorpTexture(GlorpDevice &device, const GlorpUploadContext::StagingRegion &pixels, int width, int height, VkFormat format) : m_device {device} {
+    auto &uploadContext = m_device.getUploadContext();
+    uploadContext.beginBatch();
+    createImage(pixels, width, height, format);
+    createSampler();
+    createImageView();
+    generateMipMaps();
+    uploadContext.endBatch();
+}
+
+GlorpTexture::GlorpTexture(GlorpDevice &device, const GlorpKtx2File::Image &image) : m_device {device} {
+    auto &uploadContext = m_device.getUploadContext();
+    uploadContext.beginBatch();
+    createPrecomputedImage(image);
+    createSampler();
+    createImageView();
+    uploadContext.endBatch();
+}
+
+GlorpTexture::GlorpTexture(GlorpDevice &device, const std::string &sourcePath, const GlorpKtx2File::Image &layout, uint32_t baseLevel,
+    std::span<const std::byte> levels) : m_device {device}, m_sourcePath{sourcePath}, m_sourceLayout{layout}, m_baseLevel{baseLevel} {
+    m_sourceLayout.payload = {};
+    auto &uploadContext = m_device.getUploadContext();
+    uploadContext.beginBatch();
+    createPrecomputedImage(GlorpKtx2File::slice(layout, baseLevel, levels));
+    createSampler();
+    createImageView();
+    uploadContext.endBatch();
+}
+
+void GlorpTexture::swapImage(GlorpTexture &other) {
+    std::swap(m_image, other.m_image);
+    std::swap(m_imageMemory, other.m_imageMemory);
+    std::swap(m_imageView, other.m_imageView);
+    std::swap(m_imageLayout, other.m_imageLayout);
+    std::swap(m_width, other.m_width);
+    std::swap(m_height, other.m_height);
+    std::swap(m_mipLevels, other.m_mipLevels);
+    std::swap(m_samplerInfo, other.m_samplerInfo);
+    std::swap(m_residentSize, other.m_residentSize);
+    std::swap(m_baseLevel, other.m_baseLevel);
+}
+
+void GlorpTexture::createImageGLTF(const tinygltf::Image &image, VkFormat format) {
     std::cout << "Loaded texture: " << image.uri << std::endl;
     std::cout << "Image size: " << image.image.size() << " bytes" << std::endl;
-    if (!image.image.data()) {
-        throw std::runtime_error("Texture image data is null.");
+    if(image.image.empty()) {
+        throw std::runtime_error("Failed to load texture image data.");
+    }
+
+    auto &uploadContext = m_device.getUploadContext();
+    VkDeviceSize size = static_cast<VkDeviceSize>(image.width) * image.height * 4;
+    if (!image.as_is) {
+        createImage(uploadContext.stage(image.image.data(), size), image.width, image.height, format);
+        return;
     }
-    m_width = image.width;
-    m_height = image.height;
+
+    // Decoding was deferred at load time, the pixels go straight into the staging memory
+    auto staging = uploadContext.allocateStaging(size);
+    GlorpImageDecoder::Job job{};
+    job.encoded = std::as_bytes(std::span{image.image});
+    job.destination = staging.mapped;
+    job.destinationSize = static_cast<size_t>(size);
+    GlorpImageDecoder::shared().decode({&job, 1});
+    createImage(staging, image.width, image.height, format);
+}
+
+void GlorpTexture::createImage(const GlorpUploadContext::StagingRegion &pixels, int width, int height, VkFormat format) {
+    m_width = width;
+    m_height = height;
     if (m_width <= 0 || m_height <= 0) {
         throw std::runtime_error("Invalid image dimensions.");
     }
-    m_imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
-    if(image.image.empty()) {
-        throw std::runtime_error("Failed to load texture image data.");
+    if (pixels.size < static_cast<VkDeviceSize>(m_width) * m_height * 4) {
+        throw std::runtime_error("Texture staging region is smaller than the image.");
     }
 
     m_mipLevels = std::floor(std::log2(std::max(m_width, m_height))) + 1;
 
-    GlorpBuffer stagingBuffer {
-        m_device,
-        4,
-        static_cast<uint32_t>(m_width * m_height),
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    };
-
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *) image.image.data());
+    m_imageFormat = format;
 
-    m_imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    auto &mipGenerator = m_device.getMipGenerator();
+    if (mipGenerator.supports(m_imageFormat, m_mipLevels)) {
+        m_mipMode = MipMode::Compute;
+    } else if (supportsBlitMipMaps(m_imageFormat)) {
+        m_mipMode = MipMode::Blit;
+    } else {
+        m_mipMode = MipMode::Cpu;
+    }
 
     VkImageCreateInfo imageInfo {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -56,36 +136,126 @@ void GlorpTexture::createImageGLTF(const tinygltf::Image &image) {
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.extent = {static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), 1};
     imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (m_mipMode == MipMode::Compute) {
+        imageInfo.flags = mipGenerator.imageCreateFlags(m_imageFormat);
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_imageMemory);
+    m_residentSize = GlorpTextureProcessing::mipChainOffsets(m_width, m_height, m_mipLevels).back();
+
+    transitionImageLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    auto &uploadContext = m_device.getUploadContext();
+    if (m_mipMode == MipMode::Cpu) {
+        // No linear blit for this format, the mips are filtered on the CPU and go out with level 0
+        auto offsets = GlorpTextureProcessing::mipChainOffsets(m_width, m_height, m_mipLevels);
+        auto chain = uploadContext.allocateStaging(offsets.back());
+        auto *chainPixels = static_cast<uint8_t *>(chain.mapped);
+        std::memcpy(chainPixels, pixels.mapped, offsets[1]);
+        GlorpTextureProcessing::MipOptions options{};
+        options.filter = GlorpTextureProcessing::MipFilter::Box;
+        options.srgb = m_imageFormat == VK_FORMAT_R8G8B8A8_SRGB;
+        GlorpTextureProcessing::generateMipChain(chainPixels, m_width, m_height, m_mipLevels, options);
+
+        std::vector<VkBufferImageCopy> regions;
+        for (int i = 0; i < m_mipLevels; i++) {
+            VkBufferImageCopy region{};
+            region.bufferOffset = offsets[i];
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {std::max(static_cast<uint32_t>(m_width) >> i, 1u), std::max(static_cast<uint32_t>(m_height) >> i, 1u), 1};
+            regions.push_back(region);
+        }
+        uploadContext.copyBufferToImage(chain, m_image, regions);
+    } else {
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), 1};
+        uploadContext.copyBufferToImage(pixels, m_image, {region});
+    }
+    uploadContext.releaseImage(m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipLevels, 0, 1},
+        VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
 
+void GlorpTexture::createPrecomputedImage(const GlorpKtx2File::Image &image) {
+    m_width = static_cast<int>(image.width);
+    m_height = static_cast<int>(image.height);
+    m_mipLevels = static_cast<int>(image.levels.size());
+    m_imageFormat = image.format;
+    if (GlorpKtx2File::isBlockCompressed(m_imageFormat) && !m_device.supportsTextureCompressionBC()) {
+        throw std::runtime_error("Device does not support BC compressed textures.");
+    }
+
+    VkImageCreateInfo imageInfo {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = m_imageFormat;
+    imageInfo.mipLevels = m_mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.extent = {image.width, image.height, 1};
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
     m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_imageMemory);
+    m_residentSize = image.payload.size();
 
     transitionImageLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    m_device.copyBufferToImage(stagingBuffer.getBuffer(), m_image, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), 1);
+    // The mips are precomputed, every level goes out in the same copy
+    auto &uploadContext = m_device.getUploadContext();
+    auto staging = uploadContext.stage(image.payload.data(), image.payload.size());
+    std::vector<VkBufferImageCopy> regions;
+    for (uint32_t i = 0; i < image.levels.size(); i++) {
+        const auto &level = image.levels[i];
+        VkBufferImageCopy region{};
+        region.bufferOffset = level.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {level.width, level.height, 1};
+        regions.push_back(region);
+    }
+    uploadContext.copyBufferToImage(staging, m_image, regions);
+    uploadContext.releaseImage(m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, {VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(m_mipLevels), 0, 1},
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    transitionImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
 
 void GlorpTexture::createSampler() {
-    VkSamplerCreateInfo samplerInfo {};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = VK_FILTER_LINEAR;
-    samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = static_cast<float>(m_mipLevels);
-    samplerInfo.anisotropyEnable = VK_TRUE;
-    samplerInfo.maxAnisotropy = 4.0;
-    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-
-
-    if(vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create texture sampler.");
-    }
+    // Anisotropy and LOD bias are filled in by the sampler cache from the global quality settings
+    m_samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    m_samplerInfo.magFilter = VK_FILTER_LINEAR;
+    m_samplerInfo.minFilter = VK_FILTER_LINEAR;
+    m_samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    m_samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    m_samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    m_samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    m_samplerInfo.mipLodBias = 0.0f;
+    m_samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+    m_samplerInfo.minLod = 0.0f;
+    m_samplerInfo.maxLod = static_cast<float>(m_mipLevels);
+    m_samplerInfo.anisotropyEnable = VK_TRUE;
+    m_samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+    // created up front so a texture never hits vkCreateSampler for the first time while recording a frame
+    getSampler();
+}
+
+VkSampler GlorpTexture::getSampler() {
+    return m_device.getSamplerCache().getSampler(m_samplerInfo);
 }
 
 void GlorpTexture::createImageView() {
@@ -101,6 +271,14 @@ void GlorpTexture::createImageView() {
     imageViewInfo.subresourceRange.levelCount = m_mipLevels;
     imageViewInfo.image = m_image;
 
+    // The storage usage only applies to the generator's UNORM views
+    VkImageViewUsageCreateInfo usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (m_mipMode == MipMode::Compute && m_device.getMipGenerator().imageCreateFlags(m_imageFormat) != 0) {
+        imageViewInfo.pNext = &usageInfo;
+    }
+
     vkCreateImageView(m_device.device(), &imageViewInfo, nullptr, &m_imageView);
 }
 
@@ -108,11 +286,12 @@ GlorpTexture::~GlorpTexture() {
     vkDestroyImage(m_device.device(), m_image, nullptr);
     vkFreeMemory(m_device.device(), m_imageMemory, nullptr);
     vkDestroyImageView(m_device.device(), m_imageView, nullptr);
-    vkDestroySampler(m_device.device(), m_sampler, nullptr);
 }
 
 void GlorpTexture::transitionImageLayout(VkImageLayout oldLayout, VkImageLayout newLayout) {
-    VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
+    // The first transition happens on the queue that performs the copy
+    auto &uploadContext = m_device.getUploadContext();
+    VkCommandBuffer commandBuffer = oldLayout == VK_IMAGE_LAYOUT_UNDEFINED ? uploadContext.getTransferCommandBuffer() : uploadContext.getCommandBuffer();
 
     VkImageMemoryBarrier barrier {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -146,19 +325,34 @@ void GlorpTexture::transitionImageLayout(VkImageLayout oldLayout, VkImageLayout
         throw std::runtime_error("Unsupported layout transition");
     }
     vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    m_device.endSingleTimeCommands(commandBuffer);
 }
 
-void GlorpTexture::generateMipMaps() {
+bool GlorpTexture::supportsBlitMipMaps(VkFormat format) {
     VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(m_device.getPhysicalDevice(), m_imageFormat, &formatProperties);
+    vkGetPhysicalDeviceFormatProperties(m_device.getPhysicalDevice(), format, &formatProperties);
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & required) == required;
+}
 
-    if(!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-        throw std::runtime_error("texture image format does not support linear blitting");
+void GlorpTexture::generateMipMaps() {
+    if (m_mipMode == MipMode::Cpu || m_mipLevels == 1) {
+        transitionImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        return;
+    }
+    if (m_mipMode == MipMode::Compute) {
+        GlorpMipGenerator::Target target{};
+        target.image = m_image;
+        target.format = m_imageFormat;
+        target.width = static_cast<uint32_t>(m_width);
+        target.height = static_cast<uint32_t>(m_height);
+        target.levelCount = static_cast<uint32_t>(m_mipLevels);
+        m_device.getMipGenerator().generate(target);
+        m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        return;
     }
 
-    VkCommandBuffer commandBuffer = m_device.beginSingleTimeCommands();
+    VkCommandBuffer commandBuffer = m_device.getUploadContext().getCommandBuffer();
 
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -219,8 +413,6 @@ void GlorpTexture::generateMipMaps() {
 
     vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-    m_device.endSingleTimeCommands(commandBuffer);
-
     m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
 
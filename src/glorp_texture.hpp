@@ -1,30 +1,70 @@
 #pragma once
 
 #include "glorp_device.hpp"
-
+#include "glorp_upload_context.hpp"
+#include "glorp_ktx2_file.hpp"
 
 #include "tiny_gltf.h"
 
+#include <span>
+#include <string>
+
 namespace Glorp {
 class GlorpTexture {
     public:
-        GlorpTexture(GlorpDevice &device, const tinygltf::Image &image);
+        // format is the RGBA8 variant to upload as, UNORM for normal maps and other non color data
+        GlorpTexture(GlorpDevice &device, const tinygltf::Image &image, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+        // pixels are tightly packed RGBA8
+        GlorpTexture(GlorpDevice &device, const void *pixels, int width, int height);
+        // pixels were already written into staging memory of the current upload batch
+        GlorpTexture(GlorpDevice &device, const GlorpUploadContext::StagingRegion &pixels, int width, int height, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+        // Cooked image, uploaded with its stored mip chain in a single copy
+        GlorpTexture(GlorpDevice &device, const GlorpKtx2File::Image &image);
+        // Cooked image of which only the chain from baseLevel down is resident, the finer levels are
+        // streamed in from sourcePath later. layout is the parsed header, levels the bytes of
+        // GlorpKtx2File::levelRange() for baseLevel.
+        GlorpTexture(GlorpDevice &device, const std::string &sourcePath, const GlorpKtx2File::Image &layout, uint32_t baseLevel,
+            std::span<const std::byte> levels);
         ~GlorpTexture();
 
         GlorpTexture (const GlorpTexture&) = delete;
         GlorpTexture& operator= (const GlorpTexture&) = delete;
 
-        VkSampler getSampler() { return m_sampler; }
+        // Resolved through the device sampler cache so the current quality settings apply
+        VkSampler getSampler();
 
         VkImageView getImageView() { return m_imageView; }
         VkImageLayout getImageLayout() { return m_imageLayout; }
+
+        bool isStreamable() const { return !m_sourcePath.empty(); }
+        const std::string &getSourcePath() const { return m_sourcePath; }
+        // Header of the source file, level offsets are file offsets
+        const GlorpKtx2File::Image &getSourceLayout() const { return m_sourceLayout; }
+        // Finest level of the source chain that is resident, 0 when fully resident
+        uint32_t getBaseLevel() const { return m_baseLevel; }
+        VkDeviceSize getResidentSize() const { return m_residentSize; }
+        // Takes over the image of other and hands it this texture's current one. Descriptor sets
+        // written with the old view have to be rewritten.
+        void swapImage(GlorpTexture &other);
     private:
+        enum class MipMode : uint8_t {
+            // single dispatch through the device mip generator
+            Compute,
+            // a linear blit per level
+            Blit,
+            // the format cannot be blitted, the chain is filtered on the CPU and uploaded with level 0
+            Cpu
+        };
+
         void transitionImageLayout(VkImageLayout oldLayout, VkImageLayout newLayout);
         void createSampler();
         void createImageView();
         void generateMipMaps();
+        bool supportsBlitMipMaps(VkFormat format);
 
-        void createImageGLTF(const tinygltf::Image &image);
+        void createImageGLTF(const tinygltf::Image &image, VkFormat format);
+        void createImage(const GlorpUploadContext::StagingRegion &pixels, int width, int height, VkFormat format);
+        void createPrecomputedImage(const GlorpKtx2File::Image &image);
     private:
 
         int m_height, m_width, m_mipLevels;
@@ -32,8 +72,14 @@ class GlorpTexture {
         VkImage m_image;
         VkDeviceMemory m_imageMemory;
         VkImageView m_imageView;
-        VkSampler m_sampler;
+        VkSamplerCreateInfo m_samplerInfo{};
         VkFormat m_imageFormat;
         VkImageLayout m_imageLayout;
+        MipMode m_mipMode = MipMode::Blit;
+        VkDeviceSize m_residentSize = 0;
+
+        std::string m_sourcePath;
+        GlorpKtx2File::Image m_sourceLayout;
+        uint32_t m_baseLevel = 0;
 };
 }
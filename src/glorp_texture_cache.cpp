@@ -0,0 +1,61 @@
+#include "glorp_texture_cache.hpp"
+
+#include <string_view>
+
+namespace Glorp {
+
+GlorpTextureCache::Key GlorpTextureCache::makeKey(std::span<const std::byte> content, VkFormat format) {
+    Key key{};
+    key.contentHash = std::hash<std::string_view>{}({reinterpret_cast<const char *>(content.data()), content.size()});
+    key.contentSize = content.size();
+    key.format = format;
+    return key;
+}
+
+GlorpTextureCache::Key GlorpTextureCache::makeKey(std::initializer_list<std::span<const std::byte>> parts, VkFormat format) {
+    Key key{};
+    key.format = format;
+    for (auto part : parts) {
+        uint64_t partHash = part.empty() ? 0 : makeKey(part, format).contentHash;
+        key.contentHash ^= partHash + 0x9e3779b97f4a7c15 + (key.contentHash << 6) + (key.contentHash >> 2);
+        key.contentSize += part.size();
+    }
+    return key;
+}
+
+size_t GlorpTextureCache::KeyHash::operator()(const Key &key) const {
+    size_t seed = static_cast<size_t>(key.contentHash);
+    seed ^= std::hash<size_t>{}(key.contentSize) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= std::hash<int>{}(static_cast<int>(key.format)) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+}
+
+std::shared_ptr<GlorpTexture> GlorpTextureCache::find(const Key &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_textures.find(key);
+    return it != m_textures.end() ? it->second.lock() : nullptr;
+}
+
+std::shared_ptr<GlorpTexture> GlorpTextureCache::insert(const Key &key, std::shared_ptr<GlorpTexture> texture) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // inserts only happen while loading, a good time to forget the textures freed since
+    std::erase_if(m_textures, [](const auto &entry) { return entry.second.expired(); });
+    auto &entry = m_textures[key];
+    if (auto existing = entry.lock()) {
+        return existing;
+    }
+    entry = texture;
+    return texture;
+}
+
+void GlorpTextureCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_textures.clear();
+}
+
+size_t GlorpTextureCache::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_textures.size();
+}
+
+}
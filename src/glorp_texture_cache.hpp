@@ -0,0 +1,53 @@
+#pragma once
+
+#include "glorp_texture.hpp"
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+namespace Glorp {
+
+// Device wide cache of textures keyed by the hash of their source bytes and the format they are
+// uploaded in, so every image referenced by several material slots or several models is decoded
+// and resident only once. The cache does not own its textures, one is freed with the last material
+// holding it and its entry is dropped by a later insert.
+class GlorpTextureCache {
+    public:
+        struct Key {
+            uint64_t contentHash = 0;
+            size_t contentSize = 0;
+            VkFormat format = VK_FORMAT_UNDEFINED;
+
+            bool operator==(const Key &other) const = default;
+        };
+
+        GlorpTextureCache() = default;
+        ~GlorpTextureCache() = default;
+
+        GlorpTextureCache(const GlorpTextureCache&) = delete;
+        GlorpTextureCache &operator=(const GlorpTextureCache&) = delete;
+
+        static Key makeKey(std::span<const std::byte> content, VkFormat format);
+        // Key of a texture packed from several source images, an empty part stands for a missing input
+        static Key makeKey(std::initializer_list<std::span<const std::byte>> parts, VkFormat format);
+
+        std::shared_ptr<GlorpTexture> find(const Key &key);
+        // Returns the texture that is cached under key afterwards, which is the existing one when
+        // another loader inserted the same image first. Only insert textures whose upload has been submitted.
+        std::shared_ptr<GlorpTexture> insert(const Key &key, std::shared_ptr<GlorpTexture> texture);
+
+        void clear();
+        size_t size();
+    private:
+        struct KeyHash {
+            size_t operator()(const Key &key) const;
+        };
+
+        std::mutex m_mutex;
+        std::unordered_map<Key, std::weak_ptr<GlorpTexture>, KeyHash> m_textures;
+};
+}
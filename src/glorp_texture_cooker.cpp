@@ -0,0 +1,209 @@
+#include "glorp_texture_cooker.hpp"
+#include "glorp_ktx2_file.hpp"
+#include "glorp_file_io.hpp"
+#include "glorp_image_decoder.hpp"
+#include "glorp_texture_processing.hpp"
+#include "glorp_virtual_texture_file.hpp"
+
+#include "json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+namespace Glorp {
+
+GlorpBcEncoder::Format GlorpTextureCooker::formatFor(Usage usage) {
+    switch (usage) {
+        case Usage::Color:
+        case Usage::OcclusionRoughnessMetallic:
+            return GlorpBcEncoder::Format::BC7;
+        case Usage::Normal:
+            return GlorpBcEncoder::Format::BC5;
+    }
+    throw std::runtime_error("Unknown texture usage.");
+}
+
+bool GlorpTextureCooker::isSrgb(Usage usage) {
+    return usage == Usage::Color;
+}
+
+std::string GlorpTextureCooker::cookedPath(const std::string &imagePath) {
+    return imagePath + ".ktx2";
+}
+
+std::string GlorpTextureCooker::cookedOrmPath(const std::string &occlusionPath, const std::string &metallicRoughnessPath) {
+    return (metallicRoughnessPath.empty() ? occlusionPath : metallicRoughnessPath) + ".orm.ktx2";
+}
+
+void GlorpTextureCooker::cookGltf(const std::string &gltfPath) {
+    auto gltfFile = GlorpFileIo::shared().readFile(gltfPath);
+    const char *gltfText = reinterpret_cast<const char *>(gltfFile.data());
+    auto json = nlohmann::json::parse(gltfText, gltfText + gltfFile.size());
+    std::string baseDir = gltfPath.substr(0, gltfPath.find_last_of("/\\") + 1);
+
+    const auto &textures = json.value("textures", nlohmann::json::array());
+    const auto &images = json.value("images", nlohmann::json::array());
+    // empty for embedded images, those are never cooked
+    auto imagePath = [&](const nlohmann::json &textureInfo) -> std::string {
+        size_t imageIndex = textures.at(textureInfo.at("index").get<size_t>()).at("source").get<size_t>();
+        std::string uri = images.at(imageIndex).value("uri", "");
+        if (uri.empty() || uri.starts_with("data:")) {
+            std::cout << "Skipping embedded image " << imageIndex << std::endl;
+            return "";
+        }
+        return baseDir + uri;
+    };
+
+    std::map<std::string, Usage> imageUsages;
+    std::set<std::pair<std::string, std::string>> ormImages;
+    auto use = [&](const nlohmann::json &textureInfo, Usage usage) {
+        std::string path = imagePath(textureInfo);
+        if (path.empty()) {
+            return;
+        }
+        auto [it, inserted] = imageUsages.try_emplace(path, usage);
+        if (!inserted && it->second != usage) {
+            std::cout << "Image " << path << " is used in different roles, cooking it for the first one" << std::endl;
+        }
+    };
+
+    for (const auto &material : json.value("materials", nlohmann::json::array())) {
+        std::string metallicRoughnessPath;
+        bool embedded = false;
+        if (material.contains("pbrMetallicRoughness")) {
+            const auto &pbr = material.at("pbrMetallicRoughness");
+            if (pbr.contains("baseColorTexture")) {
+                use(pbr.at("baseColorTexture"), Usage::Color);
+            }
+            if (pbr.contains("metallicRoughnessTexture")) {
+                metallicRoughnessPath = imagePath(pbr.at("metallicRoughnessTexture"));
+                embedded = metallicRoughnessPath.empty();
+            }
+        }
+        if (material.contains("emissiveTexture")) {
+            use(material.at("emissiveTexture"), Usage::Color);
+        }
+        if (material.contains("normalTexture")) {
+            use(material.at("normalTexture"), Usage::Normal);
+        }
+
+        std::string occlusionPath;
+        if (material.contains("occlusionTexture")) {
+            occlusionPath = imagePath(material.at("occlusionTexture"));
+            embedded = embedded || occlusionPath.empty();
+        }
+        if (embedded) {
+            continue;
+        }
+        if (occlusionPath == metallicRoughnessPath) {
+            // occlusion already lives in the red channel of the metallic roughness image
+            if (!metallicRoughnessPath.empty()) {
+                use(material.at("occlusionTexture"), Usage::OcclusionRoughnessMetallic);
+            }
+        } else {
+            ormImages.emplace(occlusionPath, metallicRoughnessPath);
+        }
+    }
+
+    for (const auto &[path, usage] : imageUsages) {
+        cookImage(path, usage);
+    }
+    for (const auto &[occlusionPath, metallicRoughnessPath] : ormImages) {
+        cookOrm(occlusionPath, metallicRoughnessPath);
+    }
+}
+
+void GlorpTextureCooker::cookImage(const std::string &imagePath, Usage usage) {
+    uint32_t width, height;
+    auto pixels = decodeImage(imagePath, width, height);
+    writeCooked(cookedPath(imagePath), std::move(pixels), width, height, usage);
+}
+
+void GlorpTextureCooker::cookVirtual(const std::string &imagePath, const std::string &outputPath) {
+    uint32_t width, height;
+    auto pixels = decodeImage(imagePath, width, height);
+    auto start = std::chrono::high_resolution_clock::now();
+    GlorpVirtualTextureFile::write(outputPath, pixels.data(), width, height, true);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    std::cout << "Cooked " << outputPath << " (" << width << "x" << height << ", "
+        << GlorpVirtualTextureFile::levelLayout(width, height).size() << " paged levels) in " << duration.count() << " seconds" << std::endl;
+}
+
+void GlorpTextureCooker::cookOrm(const std::string &occlusionPath, const std::string &metallicRoughnessPath) {
+    GlorpTextureProcessing::Source occlusion{};
+    GlorpTextureProcessing::Source metallicRoughness{};
+    std::vector<uint8_t> occlusionPixels, metallicRoughnessPixels;
+    if (!occlusionPath.empty()) {
+        occlusionPixels = decodeImage(occlusionPath, occlusion.width, occlusion.height);
+        occlusion.rgba = occlusionPixels.data();
+    }
+    if (!metallicRoughnessPath.empty()) {
+        metallicRoughnessPixels = decodeImage(metallicRoughnessPath, metallicRoughness.width, metallicRoughness.height);
+        metallicRoughness.rgba = metallicRoughnessPixels.data();
+    }
+
+    // the larger input decides the size of the packed image
+    uint32_t width = std::max(occlusion.width, metallicRoughness.width);
+    uint32_t height = std::max(occlusion.height, metallicRoughness.height);
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    GlorpTextureProcessing::packOrm(occlusion, metallicRoughness, width, height, pixels.data());
+    writeCooked(cookedOrmPath(occlusionPath, metallicRoughnessPath), std::move(pixels), width, height, Usage::OcclusionRoughnessMetallic);
+}
+
+std::vector<uint8_t> GlorpTextureCooker::decodeImage(const std::string &imagePath, uint32_t &width, uint32_t &height) {
+    auto encoded = GlorpFileIo::shared().readFile(imagePath);
+    int imageWidth, imageHeight;
+    if (!GlorpImageDecoder::getInfo(encoded.bytes(), imageWidth, imageHeight)) {
+        throw std::runtime_error("Unknown image format: " + imagePath);
+    }
+    width = static_cast<uint32_t>(imageWidth);
+    height = static_cast<uint32_t>(imageHeight);
+
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    GlorpImageDecoder::Job job{};
+    job.encoded = encoded.bytes();
+    job.destination = pixels.data();
+    job.destinationSize = pixels.size();
+    GlorpImageDecoder::shared().decode({&job, 1});
+    return pixels;
+}
+
+void GlorpTextureCooker::writeCooked(const std::string &outputPath, std::vector<uint8_t> pixels, uint32_t width, uint32_t height, Usage usage) {
+    auto start = std::chrono::high_resolution_clock::now();
+    GlorpBcEncoder::Format format = formatFor(usage);
+    GlorpKtx2File::Image image{};
+    image.format = GlorpKtx2File::blockCompressedFormat(format, isSrgb(usage));
+    image.width = width;
+    image.height = height;
+    uint32_t levelCount = GlorpTextureProcessing::mipLevelCount(width, height);
+    image.levels = GlorpKtx2File::levelLayout(image.format, width, height, levelCount);
+
+    GlorpTextureProcessing::MipOptions mipOptions{};
+    mipOptions.filter = GlorpTextureProcessing::MipFilter::Kaiser;
+    mipOptions.srgb = isSrgb(usage);
+    mipOptions.normalMap = usage == Usage::Normal;
+    auto mipOffsets = GlorpTextureProcessing::mipChainOffsets(width, height, levelCount);
+    pixels.resize(mipOffsets.back());
+    GlorpTextureProcessing::generateMipChain(pixels.data(), width, height, levelCount, mipOptions);
+
+    std::vector<std::byte> payload(image.levels.back().offset + image.levels.back().size);
+    auto &encoder = GlorpBcEncoder::shared();
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const auto &level = image.levels[i];
+        encoder.encode(format, pixels.data() + mipOffsets[i], level.width, level.height, payload.data() + level.offset);
+    }
+    image.payload = payload;
+    GlorpKtx2File::write(outputPath, image);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    std::cout << "Cooked " << outputPath << " (" << width << "x" << height << ", " << image.levels.size()
+        << " levels) in " << duration.count() << " seconds" << std::endl;
+}
+
+}
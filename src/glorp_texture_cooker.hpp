@@ -0,0 +1,43 @@
+#pragma once
+
+#include "glorp_bc_encoder.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Glorp {
+
+// Offline step that turns the source images of a glTF into block compressed KTX2 files with a full
+// mip chain, written next to each image as <image>.ktx2. The loaders pick the cooked file up when
+// the device supports BC formats and fall back to decoding the source image otherwise.
+class GlorpTextureCooker {
+    public:
+        enum class Usage : uint8_t {
+            // albedo and emissive, BC7 sRGB
+            Color,
+            // tangent space XY in BC5, the shader rebuilds Z
+            Normal,
+            // occlusion in R, roughness in G and metalness in B, BC7 linear
+            OcclusionRoughnessMetallic
+        };
+
+        static GlorpBcEncoder::Format formatFor(Usage usage);
+        static bool isSrgb(Usage usage);
+        static std::string cookedPath(const std::string &imagePath);
+        // Occlusion packed from a separate image is cooked next to the metallic roughness image, or
+        // next to the occlusion image when the material has no metallic roughness texture
+        static std::string cookedOrmPath(const std::string &occlusionPath, const std::string &metallicRoughnessPath);
+
+        // Cooks every image referenced by the materials of a .gltf with external images
+        static void cookGltf(const std::string &gltfPath);
+        static void cookImage(const std::string &imagePath, Usage usage);
+        // Either path may be empty when the material lacks that texture
+        static void cookOrm(const std::string &occlusionPath, const std::string &metallicRoughnessPath);
+        // Cuts a color image into the paged .gvt layout GlorpVirtualTexture streams from
+        static void cookVirtual(const std::string &imagePath, const std::string &outputPath);
+    private:
+        static std::vector<uint8_t> decodeImage(const std::string &imagePath, uint32_t &width, uint32_t &height);
+        static void writeCooked(const std::string &outputPath, std::vector<uint8_t> pixels, uint32_t width, uint32_t height, Usage usage);
+};
+}
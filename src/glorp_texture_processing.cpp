@@ -0,0 +1,220 @@
+#include "glorp_texture_processing.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <numbers>
+
+namespace {
+using Texel = std::array<float, 4>;
+
+constexpr uint32_t KAISER_TAPS = 8;
+constexpr float KAISER_ALPHA = 4.0f;
+constexpr uint32_t LINEAR_TO_SRGB_STEPS = 16384;
+
+struct Tables {
+    std::array<float, 256> srgbToLinear;
+    std::array<float, 256> unormToFloat;
+    std::vector<uint8_t> linearToSrgb;
+    std::array<float, KAISER_TAPS> kaiser;
+};
+
+float besselI0(float x) {
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (int k = 1; k < 16; k++) {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+const Tables &tables() {
+    static const Tables instance = [] {
+        Tables t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            t.unormToFloat[i] = c;
+            t.srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        t.linearToSrgb.resize(LINEAR_TO_SRGB_STEPS + 1);
+        for (uint32_t i = 0; i <= LINEAR_TO_SRGB_STEPS; i++) {
+            float l = static_cast<float>(i) / LINEAR_TO_SRGB_STEPS;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            t.linearToSrgb[i] = static_cast<uint8_t>(std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f));
+        }
+
+        // Taps sit at -3.5 .. 3.5 source texels from the target texel center, which is two target
+        // texels of support on either side
+        float sum = 0.0f;
+        for (uint32_t i = 0; i < KAISER_TAPS; i++) {
+            float x = (static_cast<float>(i) - 3.5f) * 0.5f;
+            float sinc = std::sin(std::numbers::pi_v<float> * x) / (std::numbers::pi_v<float> * x);
+            float ratio = x / 2.0f;
+            float window = besselI0(KAISER_ALPHA * std::sqrt(std::max(1.0f - ratio * ratio, 0.0f))) / besselI0(KAISER_ALPHA);
+            t.kaiser[i] = sinc * window;
+            sum += t.kaiser[i];
+        }
+        for (float &weight : t.kaiser) {
+            weight /= sum;
+        }
+        return t;
+    }();
+    return instance;
+}
+
+void decodeRow(const uint8_t *rgba, uint32_t width, bool srgb, Texel *out) {
+    const auto &t = tables();
+    const auto &rgb = srgb ? t.srgbToLinear : t.unormToFloat;
+    for (uint32_t x = 0; x < width; x++) {
+        out[x] = {rgb[rgba[x * 4]], rgb[rgba[x * 4 + 1]], rgb[rgba[x * 4 + 2]], t.unormToFloat[rgba[x * 4 + 3]]};
+    }
+}
+
+void encodeRow(const Texel *texels, uint32_t width, const Glorp::GlorpTextureProcessing::MipOptions &options, uint8_t *out) {
+    const auto &t = tables();
+    for (uint32_t x = 0; x < width; x++) {
+        Texel texel = texels[x];
+        if (options.normalMap) {
+            float n[3] = {texel[0] * 2.0f - 1.0f, texel[1] * 2.0f - 1.0f, texel[2] * 2.0f - 1.0f};
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length > 1e-6f) {
+                for (int c = 0; c < 3; c++) {
+                    texel[c] = n[c] / length * 0.5f + 0.5f;
+                }
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            float value = std::clamp(texel[c], 0.0f, 1.0f);
+            out[x * 4 + c] = options.srgb && c < 3
+                ? t.linearToSrgb[static_cast<size_t>(value * LINEAR_TO_SRGB_STEPS + 0.5f)]
+                : static_cast<uint8_t>(value * 255.0f + 0.5f);
+        }
+    }
+}
+
+// Filters one decoded row down to the target width
+void filterRow(const Texel *source, uint32_t width, Glorp::GlorpTextureProcessing::MipFilter filter, Texel *target) {
+    uint32_t targetWidth = std::max(width / 2, 1u);
+    if (width == 1) {
+        target[0] = source[0];
+        return;
+    }
+    if (filter == Glorp::GlorpTextureProcessing::MipFilter::Box) {
+        for (uint32_t x = 0; x < targetWidth; x++) {
+            const Texel &a = source[std::min(x * 2, width - 1)];
+            const Texel &b = source[std::min(x * 2 + 1, width - 1)];
+            for (int c = 0; c < 4; c++) {
+                target[x][c] = (a[c] + b[c]) * 0.5f;
+            }
+        }
+        return;
+    }
+
+    const auto &kaiser = tables().kaiser;
+    for (uint32_t x = 0; x < targetWidth; x++) {
+        Texel sum{};
+        int64_t first = static_cast<int64_t>(x) * 2 - 3;
+        for (uint32_t i = 0; i < KAISER_TAPS; i++) {
+            const Texel &texel = source[std::clamp<int64_t>(first + i, 0, width - 1)];
+            for (int c = 0; c < 4; c++) {
+                sum[c] += texel[c] * kaiser[i];
+            }
+        }
+        target[x] = sum;
+    }
+}
+}
+
+namespace Glorp {
+
+uint32_t GlorpTextureProcessing::mipLevelCount(uint32_t width, uint32_t height) {
+    return std::bit_width(std::max({width, height, 1u}));
+}
+
+std::vector<size_t> GlorpTextureProcessing::mipChainOffsets(uint32_t width, uint32_t height, uint32_t levelCount) {
+    std::vector<size_t> offsets{0};
+    for (uint32_t i = 0; i < levelCount; i++) {
+        size_t levelSize = static_cast<size_t>(std::max(width >> i, 1u)) * std::max(height >> i, 1u) * 4;
+        offsets.push_back(offsets.back() + levelSize);
+    }
+    return offsets;
+}
+
+void GlorpTextureProcessing::generateMipChain(uint8_t *chain, uint32_t width, uint32_t height, uint32_t levelCount, const MipOptions &options) {
+    auto offsets = mipChainOffsets(width, height, levelCount);
+    for (uint32_t i = 1; i < levelCount; i++) {
+        downsample(chain + offsets[i - 1], std::max(width >> (i - 1), 1u), std::max(height >> (i - 1), 1u), chain + offsets[i], options);
+    }
+}
+
+void GlorpTextureProcessing::downsample(const uint8_t *source, uint32_t width, uint32_t height, uint8_t *target, const MipOptions &options) {
+    uint32_t targetWidth = std::max(width / 2, 1u);
+    uint32_t targetHeight = std::max(height / 2, 1u);
+
+    // Horizontally filtered source rows, the vertical window slides two rows per target row so each
+    // source row is decoded and filtered once
+    constexpr uint32_t RING_SIZE = KAISER_TAPS;
+    std::vector<Texel> ring(static_cast<size_t>(RING_SIZE) * targetWidth);
+    std::array<int64_t, RING_SIZE> ringRows;
+    ringRows.fill(-1);
+    std::vector<Texel> decoded(width);
+    auto filteredRow = [&](int64_t row) -> const Texel * {
+        row = std::clamp<int64_t>(row, 0, height - 1);
+        Texel *slot = ring.data() + static_cast<size_t>(row % RING_SIZE) * targetWidth;
+        if (ringRows[row % RING_SIZE] != row) {
+            decodeRow(source + static_cast<size_t>(row) * width * 4, width, options.srgb, decoded.data());
+            filterRow(decoded.data(), width, options.filter, slot);
+            ringRows[row % RING_SIZE] = row;
+        }
+        return slot;
+    };
+
+    const auto &kaiser = tables().kaiser;
+    std::vector<Texel> result(targetWidth);
+    for (uint32_t y = 0; y < targetHeight; y++) {
+        std::fill(result.begin(), result.end(), Texel{});
+        auto accumulate = [&](int64_t row, float weight) {
+            const Texel *texels = filteredRow(row);
+            for (uint32_t x = 0; x < targetWidth; x++) {
+                for (int c = 0; c < 4; c++) {
+                    result[x][c] += texels[x][c] * weight;
+                }
+            }
+        };
+        if (height == 1) {
+            accumulate(0, 1.0f);
+        } else if (options.filter == MipFilter::Box) {
+            accumulate(y * 2, 0.5f);
+            accumulate(y * 2 + 1, 0.5f);
+        } else {
+            for (uint32_t i = 0; i < KAISER_TAPS; i++) {
+                accumulate(static_cast<int64_t>(y) * 2 - 3 + i, kaiser[i]);
+            }
+        }
+        encodeRow(result.data(), targetWidth, options, target + static_cast<size_t>(y) * targetWidth * 4);
+    }
+}
+
+void GlorpTextureProcessing::packOrm(const Source &occlusion, const Source &metallicRoughness, uint32_t width, uint32_t height, uint8_t *out) {
+    auto sample = [](const Source &source, uint32_t x, uint32_t y, uint32_t width, uint32_t height, int channel) -> uint8_t {
+        if (!source.rgba) {
+            return 255;
+        }
+        uint32_t sx = static_cast<uint32_t>(static_cast<uint64_t>(x) * source.width / width);
+        uint32_t sy = static_cast<uint32_t>(static_cast<uint64_t>(y) * source.height / height);
+        return source.rgba[(static_cast<size_t>(sy) * source.width + sx) * 4 + channel];
+    };
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t *texel = out + (static_cast<size_t>(y) * width + x) * 4;
+            texel[0] = sample(occlusion, x, y, width, height, 0);
+            texel[1] = sample(metallicRoughness, x, y, width, height, 1);
+            texel[2] = sample(metallicRoughness, x, y, width, height, 2);
+            texel[3] = 255;
+        }
+    }
+}
+
+}
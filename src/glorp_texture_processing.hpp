@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Glorp {
+
+// CPU side texture processing shared by the texture cooker and the runtime upload path: mip chain
+// generation in linear space with a box or Kaiser windowed sinc filter, renormalization of normal
+// map mips and packing of occlusion, roughness and metalness into one ORM image. Every image is
+// tightly packed RGBA8. Filtering works on rows of float4 texels in plain loops the compiler
+// vectorizes.
+class GlorpTextureProcessing {
+    public:
+        enum class MipFilter : uint8_t {
+            // 2x2 average, matches what a linear blit produces
+            Box,
+            // 8 tap Kaiser windowed sinc, sharper mips for offline cooking
+            Kaiser
+        };
+
+        struct MipOptions {
+            MipFilter filter = MipFilter::Kaiser;
+            // RGB is filtered in linear space and stored as sRGB, alpha is always linear
+            bool srgb = false;
+            // RGB holds a tangent space normal that is renormalized in every level
+            bool normalMap = false;
+        };
+
+        struct Source {
+            const uint8_t *rgba = nullptr;
+            uint32_t width = 0;
+            uint32_t height = 0;
+        };
+
+        static uint32_t mipLevelCount(uint32_t width, uint32_t height);
+        // Byte offset of every level of a chain stored level 0 first, plus the total size at the end
+        static std::vector<size_t> mipChainOffsets(uint32_t width, uint32_t height, uint32_t levelCount);
+
+        // chain holds level 0 at its start, the remaining levels are written behind it
+        static void generateMipChain(uint8_t *chain, uint32_t width, uint32_t height, uint32_t levelCount, const MipOptions &options);
+        // Halves both dimensions, a dimension that is already 1 stays 1
+        static void downsample(const uint8_t *source, uint32_t width, uint32_t height, uint8_t *target, const MipOptions &options);
+
+        // Occlusion from the red channel of occlusion, roughness and metalness from green and blue of
+        // metallicRoughness. Inputs are resampled to width x height, a missing input counts as 1.
+        static void packOrm(const Source &occlusion, const Source &metallicRoughness, uint32_t width, uint32_t height, uint8_t *out);
+};
+}
@@ -0,0 +1,251 @@
+#include "glorp_texture_streamer.hpp"
+
+#include "glorp_file_io.hpp"
+#include "glorp_swap_chain.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace Glorp {
+
+namespace {
+// Replaced images may still be sampled by the frames in flight that were recorded before the swap
+constexpr uint64_t RETIRE_DELAY_FRAMES = GlorpSwapChain::MAX_FRAMES_IN_FLIGHT + 1;
+
+uint32_t levelForPixels(const GlorpKtx2File::Image &layout, float screenPixels) {
+    uint32_t lastLevel = static_cast<uint32_t>(layout.levels.size()) - 1;
+    if (screenPixels <= 1.f) {
+        return lastLevel;
+    }
+    float extent = static_cast<float>(std::max(layout.width, layout.height));
+    float level = std::floor(std::log2(extent / screenPixels));
+    return std::min(static_cast<uint32_t>(std::max(level, 0.f)), lastLevel);
+}
+}
+
+GlorpTextureStreamer::GlorpTextureStreamer(GlorpDevice &device) : m_device{device} {
+    m_loader = std::make_unique<GlorpAssetStreamer>(m_device, 1);
+}
+
+GlorpTextureStreamer::~GlorpTextureStreamer() {
+    m_loader.reset();
+}
+
+uint32_t GlorpTextureStreamer::initialBaseLevel(const GlorpKtx2File::Image &layout) {
+    for (uint32_t level = 0; level < layout.levels.size(); level++) {
+        const auto &info = layout.levels[level];
+        if (std::max(info.width, info.height) <= INITIAL_EXTENT) {
+            return level;
+        }
+    }
+    return static_cast<uint32_t>(layout.levels.size()) - 1;
+}
+
+VkDeviceSize GlorpTextureStreamer::chainSize(const GlorpKtx2File::Image &layout, uint32_t firstLevel) {
+    size_t offset, size;
+    GlorpKtx2File::levelRange(layout, firstLevel, offset, size);
+    return size;
+}
+
+void GlorpTextureStreamer::add(const std::shared_ptr<GlorpTexture> &texture) {
+    if (!texture || !texture->isStreamable()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &entry = m_entries[texture.get()];
+    if (!entry.texture.expired()) {
+        return;
+    }
+    // a texture that died and left its address to this one may still have a load in flight
+    if (entry.load.valid()) {
+        entry.load.wait();
+        m_loadsInFlight--;
+    }
+    entry = {};
+    entry.texture = texture;
+    entry.path = texture->getSourcePath();
+    entry.layout = texture->getSourceLayout();
+    entry.initialLevel = initialBaseLevel(entry.layout);
+    entry.wantedLevel = entry.initialLevel;
+    entry.lastRequestFrame = m_frame;
+}
+
+void GlorpTextureStreamer::request(const GlorpTexture *texture, float screenPixels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(texture);
+    if (it == m_entries.end()) {
+        return;
+    }
+    auto &entry = it->second;
+    uint32_t level = std::min(levelForPixels(entry.layout, screenPixels), entry.initialLevel);
+    if (entry.lastRequestFrame != m_frame) {
+        entry.wantedLevel = level;
+        entry.lastRequestFrame = m_frame;
+    } else {
+        entry.wantedLevel = std::min(entry.wantedLevel, level);
+    }
+}
+
+void GlorpTextureStreamer::commitLoads() {
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        auto &entry = it->second;
+        if (entry.load.valid() && entry.load.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            m_loadsInFlight--;
+            try {
+                auto replacement = entry.load.get();
+                if (auto texture = entry.texture.lock()) {
+                    texture->swapImage(*replacement);
+                    m_generation++;
+                }
+                m_retired.push_back({std::move(replacement), m_frame});
+            } catch (const std::exception &e) {
+                std::cerr << "Texture streaming failed: " << e.what() << std::endl;
+                entry.failed = true;
+            }
+        }
+        if (entry.texture.expired() && !entry.load.valid()) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void GlorpTextureStreamer::startLoad(Entry &entry, uint32_t level) {
+    entry.loadLevel = level;
+    m_loadsInFlight++;
+    entry.load = m_loader->stream([path = entry.path, layout = entry.layout, level](GlorpDevice &device) {
+        size_t offset, size;
+        GlorpKtx2File::levelRange(layout, level, offset, size);
+        auto file = GlorpFileIo::shared().readRangeAsync(path, offset, size, GlorpFileIo::Priority::Low).get();
+        if (!file.ok() || file.data.size() != size) {
+            throw std::runtime_error("Failed to read texture levels from " + path);
+        }
+        return std::make_unique<GlorpTexture>(device, path, layout, level, file.data.bytes());
+    });
+}
+
+void GlorpTextureStreamer::update() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    commitLoads();
+
+    std::erase_if(m_retired, [this](const Retired &retired) { return m_frame >= retired.frame + RETIRE_DELAY_FRAMES; });
+
+    struct Candidate {
+        Entry *entry;
+        uint32_t baseLevel;
+    };
+    std::vector<Candidate> grow;
+    std::vector<Candidate> shrink;
+    // loads in flight count with the larger of their current and target size
+    VkDeviceSize projected = 0;
+    for (auto &[key, entry] : m_entries) {
+        auto texture = entry.texture.lock();
+        if (!texture) {
+            continue;
+        }
+        uint32_t baseLevel = texture->getBaseLevel();
+        if (entry.load.valid()) {
+            projected += std::max(texture->getResidentSize(), chainSize(entry.layout, entry.loadLevel));
+            continue;
+        }
+        projected += texture->getResidentSize();
+        if (entry.failed) {
+            continue;
+        }
+        if (m_frame > entry.lastRequestFrame + EVICT_AFTER_FRAMES) {
+            entry.wantedLevel = entry.initialLevel;
+        }
+        if (entry.wantedLevel < baseLevel) {
+            grow.push_back({&entry, baseLevel});
+        } else if (baseLevel < entry.initialLevel) {
+            shrink.push_back({&entry, baseLevel});
+        }
+    }
+
+    // Least recently needed first. Stale textures drop back to their initial levels, the others only
+    // give up their finest level while over budget, and never one that was needed this frame.
+    std::sort(shrink.begin(), shrink.end(), [](const Candidate &a, const Candidate &b) {
+        return a.entry->lastRequestFrame < b.entry->lastRequestFrame;
+    });
+    for (auto &candidate : shrink) {
+        if (m_loadsInFlight >= MAX_LOADS_IN_FLIGHT) {
+            break;
+        }
+        auto &entry = *candidate.entry;
+        bool stale = m_frame > entry.lastRequestFrame + EVICT_AFTER_FRAMES;
+        bool needed = entry.lastRequestFrame == m_frame && entry.wantedLevel <= candidate.baseLevel;
+        if (!stale && (projected <= m_budget || needed)) {
+            continue;
+        }
+        uint32_t level = std::min(std::max(entry.wantedLevel, candidate.baseLevel + 1), entry.initialLevel);
+        projected -= chainSize(entry.layout, candidate.baseLevel) - chainSize(entry.layout, level);
+        startLoad(entry, level);
+    }
+
+    // most recently requested first, then the ones furthest from what they need
+    std::sort(grow.begin(), grow.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.entry->lastRequestFrame != b.entry->lastRequestFrame) {
+            return a.entry->lastRequestFrame > b.entry->lastRequestFrame;
+        }
+        return a.baseLevel - a.entry->wantedLevel > b.baseLevel - b.entry->wantedLevel;
+    });
+    for (auto &candidate : grow) {
+        if (m_loadsInFlight >= MAX_LOADS_IN_FLIGHT) {
+            break;
+        }
+        auto &entry = *candidate.entry;
+        VkDeviceSize current = chainSize(entry.layout, candidate.baseLevel);
+        // settle for a coarser level than wanted when the finest one does not fit
+        for (uint32_t level = entry.wantedLevel; level < candidate.baseLevel; level++) {
+            VkDeviceSize growth = chainSize(entry.layout, level) - current;
+            if (projected + growth <= m_budget) {
+                projected += growth;
+                startLoad(entry, level);
+                break;
+            }
+        }
+    }
+
+    m_frame++;
+}
+
+VkDeviceSize GlorpTextureStreamer::getResidentSize() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    VkDeviceSize total = 0;
+    for (auto &[key, entry] : m_entries) {
+        if (auto texture = entry.texture.lock()) {
+            total += texture->getResidentSize();
+        }
+    }
+    return total;
+}
+
+std::vector<GlorpTextureStreamer::Stats> GlorpTextureStreamer::getStats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Stats> stats;
+    stats.reserve(m_entries.size());
+    for (auto &[key, entry] : m_entries) {
+        auto texture = entry.texture.lock();
+        if (!texture) {
+            continue;
+        }
+        Stats stat{};
+        stat.path = entry.path;
+        stat.baseLevel = texture->getBaseLevel();
+        stat.wantedLevel = entry.wantedLevel;
+        stat.levelCount = static_cast<uint32_t>(entry.layout.levels.size());
+        stat.residentSize = texture->getResidentSize();
+        stat.fullSize = chainSize(entry.layout, 0);
+        stat.framesSinceRequest = m_frame - entry.lastRequestFrame;
+        stat.loading = entry.load.valid();
+        stats.push_back(std::move(stat));
+    }
+    std::sort(stats.begin(), stats.end(), [](const Stats &a, const Stats &b) { return a.residentSize > b.residentSize; });
+    return stats;
+}
+
+}
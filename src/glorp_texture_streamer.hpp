@@ -0,0 +1,98 @@
+#pragma once
+
+#include "glorp_asset_streamer.hpp"
+#include "glorp_texture.hpp"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Glorp {
+
+// Keeps cooked textures resident only down to the mip level their on screen size calls for. A
+// texture starts out with just its coarse levels, and every frame the renderer reports how many
+// pixels each texture covers. update() then reads the missing finer levels from the KTX2 file on a
+// background worker and swaps the texture over to the new image, and drops the finest levels of the
+// least recently needed textures again while the resident total is over budget. Every swap bumps the
+// generation, descriptor sets written with an older generation have to be rewritten before use.
+class GlorpTextureStreamer {
+    public:
+        // Largest extent of the levels that are loaded up front and never evicted
+        static constexpr uint32_t INITIAL_EXTENT = 128;
+        static constexpr VkDeviceSize DEFAULT_BUDGET = 256ull * 1024 * 1024;
+        static constexpr uint32_t MAX_LOADS_IN_FLIGHT = 4;
+        // Textures not requested for this many frames fall back to their initial levels
+        static constexpr uint64_t EVICT_AFTER_FRAMES = 120;
+
+        struct Stats {
+            std::string path;
+            uint32_t baseLevel = 0;
+            uint32_t wantedLevel = 0;
+            uint32_t levelCount = 0;
+            VkDeviceSize residentSize = 0;
+            VkDeviceSize fullSize = 0;
+            uint64_t framesSinceRequest = 0;
+            bool loading = false;
+        };
+
+        explicit GlorpTextureStreamer(GlorpDevice &device);
+        ~GlorpTextureStreamer();
+
+        GlorpTextureStreamer(const GlorpTextureStreamer&) = delete;
+        GlorpTextureStreamer &operator=(const GlorpTextureStreamer&) = delete;
+
+        // Level a streamable texture of this layout is first loaded with
+        static uint32_t initialBaseLevel(const GlorpKtx2File::Image &layout);
+
+        // Safe to call from the asset workers. Textures that are not streamable are ignored.
+        void add(const std::shared_ptr<GlorpTexture> &texture);
+        // screenPixels is the extent the texture covers on screen this frame, the largest request wins
+        void request(const GlorpTexture *texture, float screenPixels);
+        // Called once per frame on the render thread after the requests
+        void update();
+
+        uint64_t getGeneration() const { return m_generation; }
+        VkDeviceSize getBudget() const { return m_budget; }
+        void setBudget(VkDeviceSize budget) { m_budget = budget; }
+        VkDeviceSize getResidentSize();
+        std::vector<Stats> getStats();
+    private:
+        struct Entry {
+            std::weak_ptr<GlorpTexture> texture;
+            std::string path;
+            GlorpKtx2File::Image layout;
+            uint32_t initialLevel = 0;
+            uint32_t wantedLevel = 0;
+            uint64_t lastRequestFrame = 0;
+            uint32_t loadLevel = 0;
+            // set when a load failed, the texture keeps its resident levels from then on
+            bool failed = false;
+            std::future<std::unique_ptr<GlorpTexture>> load;
+        };
+
+        struct Retired {
+            std::unique_ptr<GlorpTexture> texture;
+            uint64_t frame;
+        };
+
+        static VkDeviceSize chainSize(const GlorpKtx2File::Image &layout, uint32_t firstLevel);
+        void commitLoads();
+        void startLoad(Entry &entry, uint32_t level);
+    private:
+        GlorpDevice &m_device;
+
+        std::mutex m_mutex;
+        std::unordered_map<const GlorpTexture *, Entry> m_entries;
+        std::vector<Retired> m_retired;
+        uint64_t m_frame = 0;
+        uint64_t m_generation = 0;
+        VkDeviceSize m_budget = DEFAULT_BUDGET;
+        uint32_t m_loadsInFlight = 0;
+
+        // declared last so pending loads finish before the entries go away
+        std::unique_ptr<GlorpAssetStreamer> m_loader;
+};
+}
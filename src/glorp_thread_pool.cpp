@@ -0,0 +1,58 @@
+#include "glorp_thread_pool.hpp"
+
+#include <algorithm>
+
+namespace Glorp {
+
+static thread_local int t_workerIndex = -1;
+
+GlorpThreadPool::GlorpThreadPool(uint32_t workerCount) {
+    workerCount = std::max(workerCount, 1u);
+    m_workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        m_workers.emplace_back([this, i]() { workerLoop(static_cast<int>(i)); });
+    }
+}
+
+GlorpThreadPool::~GlorpThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+}
+
+int GlorpThreadPool::currentWorkerIndex() {
+    return t_workerIndex;
+}
+
+void GlorpThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_tasks.push_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void GlorpThreadPool::workerLoop(int workerIndex) {
+    t_workerIndex = workerIndex;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+            // queued work is drained before shutting down so no future is left without a value
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+}
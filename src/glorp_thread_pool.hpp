@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Glorp {
+class GlorpThreadPool {
+    public:
+        explicit GlorpThreadPool(uint32_t workerCount = std::thread::hardware_concurrency());
+        ~GlorpThreadPool();
+
+        GlorpThreadPool(const GlorpThreadPool&) = delete;
+        GlorpThreadPool &operator=(const GlorpThreadPool&) = delete;
+
+        template <typename F>
+        auto submit(F &&task) -> std::future<std::invoke_result_t<F>> {
+            using Result = std::invoke_result_t<F>;
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            std::future<Result> future = packaged->get_future();
+            enqueue([packaged]() { (*packaged)(); });
+            return future;
+        }
+
+        uint32_t getWorkerCount() const { return static_cast<uint32_t>(m_workers.size()); }
+        // Index of the calling worker inside its pool, -1 when called from outside any pool
+        static int currentWorkerIndex();
+    private:
+        void enqueue(std::function<void()> task);
+        void workerLoop(int workerIndex);
+    private:
+        std::vector<std::thread> m_workers;
+        std::deque<std::function<void()>> m_tasks;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_stopping = false;
+};
+}
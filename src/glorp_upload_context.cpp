@@ -0,0 +1,399 @@
+#include "glorp_upload_context.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace Glorp {
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+GlorpUploadContext::GlorpUploadContext(GlorpDevice &device, VkDeviceSize ringSize) : m_device{device}, m_ringSize{ringSize} {
+    m_ringBuffer = std::make_unique<GlorpBuffer>(
+        m_device,
+        1,
+        static_cast<uint32_t>(m_ringSize),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+    m_ringBuffer->map();
+
+    QueueFamilyIndices indices = m_device.findPhysicalQueueFamilies();
+    m_dedicatedTransfer = m_device.hasDedicatedTransferQueue();
+    m_graphicsFamily = indices.graphicsFamily;
+    m_transferFamily = m_dedicatedTransfer ? indices.transferFamily : indices.graphicsFamily;
+    createCommandPools();
+}
+
+GlorpUploadContext::~GlorpUploadContext() {
+    submit();
+    waitIdle();
+    vkDestroyCommandPool(m_device.device(), m_commandPool, nullptr);
+    if (m_transferCommandPool != m_commandPool) {
+        vkDestroyCommandPool(m_device.device(), m_transferCommandPool, nullptr);
+    }
+}
+
+void GlorpUploadContext::createCommandPools() {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_graphicsFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    if (vkCreateCommandPool(m_device.device(), &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload command pool!");
+    }
+
+    if (!m_dedicatedTransfer) {
+        m_transferCommandPool = m_commandPool;
+        return;
+    }
+
+    poolInfo.queueFamilyIndex = m_transferFamily;
+    if (vkCreateCommandPool(m_device.device(), &poolInfo, nullptr, &m_transferCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transfer command pool!");
+    }
+}
+
+void GlorpUploadContext::beginBatch() {
+    m_batchDepth++;
+}
+
+uint64_t GlorpUploadContext::endBatch() {
+    assert(m_batchDepth > 0 && "endBatch called without a matching beginBatch");
+    m_batchDepth--;
+    if (m_batchDepth > 0) {
+        return m_submittedTicket + 1;
+    }
+    return submit();
+}
+
+VkCommandBuffer GlorpUploadContext::getCommandBuffer() {
+    if (m_commandBuffer == VK_NULL_HANDLE) {
+        m_commandBuffer = beginRecording(m_commandPool);
+    }
+    return m_commandBuffer;
+}
+
+VkCommandBuffer GlorpUploadContext::getTransferCommandBuffer() {
+    if (!m_dedicatedTransfer) {
+        return getCommandBuffer();
+    }
+    if (m_transferCommandBuffer == VK_NULL_HANDLE) {
+        m_transferCommandBuffer = beginRecording(m_transferCommandPool);
+    }
+    return m_transferCommandBuffer;
+}
+
+VkCommandBuffer GlorpUploadContext::beginRecording(VkCommandPool commandPool) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    return commandBuffer;
+}
+
+GlorpUploadContext::StagingRegion GlorpUploadContext::allocateStaging(VkDeviceSize size, VkDeviceSize alignment) {
+    alignment = std::max(alignment, m_device.properties.limits.optimalBufferCopyOffsetAlignment);
+    if (size > m_ringSize) {
+        return allocateTransient(size);
+    }
+
+    retireCompleted();
+
+    while (true) {
+        // an idle ring can be rewound to a clean boundary so large requests do not straddle the end
+        if (m_inFlight.empty() && m_tail == m_head) {
+            m_head = m_tail = alignUp(m_head, m_ringSize);
+        }
+
+        VkDeviceSize offset = alignUp(m_head, alignment);
+        if (offset % m_ringSize + size > m_ringSize) {
+            offset = alignUp(offset + 1, m_ringSize);
+        }
+
+        if (offset + size - m_tail <= m_ringSize) {
+            m_head = offset + size;
+            StagingRegion region{};
+            region.buffer = m_ringBuffer->getBuffer();
+            region.offset = offset % m_ringSize;
+            region.size = size;
+            region.mapped = static_cast<char *>(m_ringBuffer->getMappedMemory()) + region.offset;
+            return region;
+        }
+
+        // the space is held by the batch that is still being recorded, it cannot be recycled yet
+        if (m_inFlight.empty()) {
+            return allocateTransient(size);
+        }
+        retireOldest();
+    }
+}
+
+GlorpUploadContext::StagingRegion GlorpUploadContext::allocateTransient(VkDeviceSize size) {
+    auto buffer = std::make_unique<GlorpBuffer>(
+        m_device,
+        size,
+        1,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+    buffer->map();
+
+    StagingRegion region{};
+    region.buffer = buffer->getBuffer();
+    region.offset = 0;
+    region.size = size;
+    region.mapped = buffer->getMappedMemory();
+
+    m_pendingTransientBuffers.push_back(std::move(buffer));
+    return region;
+}
+
+GlorpUploadContext::StagingRegion GlorpUploadContext::stage(const void *data, VkDeviceSize size, VkDeviceSize alignment) {
+    StagingRegion region = allocateStaging(size, alignment);
+    std::memcpy(region.mapped, data, static_cast<size_t>(size));
+    return region;
+}
+
+void GlorpUploadContext::copyBuffer(const StagingRegion &src, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = src.offset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = src.size;
+    vkCmdCopyBuffer(getTransferCommandBuffer(), src.buffer, dstBuffer, 1, &copyRegion);
+}
+
+void GlorpUploadContext::copyBufferToImage(const StagingRegion &src, VkImage image, std::vector<VkBufferImageCopy> regions) {
+    for (auto &region : regions) {
+        region.bufferOffset += src.offset;
+    }
+    vkCmdCopyBufferToImage(
+        getTransferCommandBuffer(),
+        src.buffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(regions.size()),
+        regions.data()
+    );
+}
+
+void GlorpUploadContext::releaseBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    if (!m_dedicatedTransfer) {
+        vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        return;
+    }
+
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+
+    VkBufferMemoryBarrier release = barrier;
+    release.dstAccessMask = 0;
+    vkCmdPipelineBarrier(getTransferCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+
+    VkBufferMemoryBarrier acquire = barrier;
+    acquire.srcAccessMask = 0;
+    vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &acquire, 0, nullptr);
+}
+
+void GlorpUploadContext::releaseImage(VkImage image, VkImageLayout layout, const VkImageSubresourceRange &range, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = layout;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+
+    if (!m_dedicatedTransfer) {
+        vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        return;
+    }
+
+    barrier.srcQueueFamilyIndex = m_transferFamily;
+    barrier.dstQueueFamilyIndex = m_graphicsFamily;
+
+    VkImageMemoryBarrier release = barrier;
+    release.dstAccessMask = 0;
+    vkCmdPipelineBarrier(getTransferCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+
+    VkImageMemoryBarrier acquire = barrier;
+    acquire.srcAccessMask = 0;
+    vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &acquire);
+}
+
+VkSemaphore GlorpUploadContext::submitTransfer() {
+    if (vkEndCommandBuffer(m_transferCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record transfer command buffer!");
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(m_device.device(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create transfer semaphore!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_transferCommandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &semaphore;
+
+    std::lock_guard<std::mutex> lock{m_device.transferQueueMutex()};
+    if (vkQueueSubmit(m_device.transferQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit transfer command buffer!");
+    }
+    return semaphore;
+}
+
+void GlorpUploadContext::deferRelease(std::function<void()> release) {
+    m_pendingReleases.push_back(std::move(release));
+}
+
+uint64_t GlorpUploadContext::submit() {
+    if (m_commandBuffer == VK_NULL_HANDLE && m_transferCommandBuffer == VK_NULL_HANDLE) {
+        return m_submittedTicket;
+    }
+
+    // The copies run on the transfer queue; the graphics submission waits for them, performs the
+    // ownership acquires and carries the fence for the whole batch.
+    VkSemaphore transferSemaphore = VK_NULL_HANDLE;
+    if (m_transferCommandBuffer != VK_NULL_HANDLE) {
+        transferSemaphore = submitTransfer();
+    }
+
+    // Make every transfer write of this batch visible to whatever consumes it later on the queue,
+    // so the render loop never has to wait for the fence.
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        getCommandBuffer(),
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0,
+        1, &memoryBarrier,
+        0, nullptr,
+        0, nullptr
+    );
+
+    if (vkEndCommandBuffer(m_commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record upload command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if (vkCreateFence(m_device.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload fence!");
+    }
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_commandBuffer;
+    if (transferSemaphore != VK_NULL_HANDLE) {
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &transferSemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{m_device.graphicsQueueMutex()};
+        if (vkQueueSubmit(m_device.graphicsQueue(), 1, &submitInfo, fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+    }
+
+    InFlightBatch batch{};
+    batch.ticket = ++m_submittedTicket;
+    batch.fence = fence;
+    batch.commandBuffer = m_commandBuffer;
+    batch.transferCommandBuffer = m_transferCommandBuffer;
+    batch.transferSemaphore = transferSemaphore;
+    batch.ringEnd = m_head;
+    batch.transientBuffers = std::move(m_pendingTransientBuffers);
+    m_pendingTransientBuffers.clear();
+    batch.releases = std::move(m_pendingReleases);
+    m_pendingReleases.clear();
+    m_inFlight.push_back(std::move(batch));
+
+    m_commandBuffer = VK_NULL_HANDLE;
+    m_transferCommandBuffer = VK_NULL_HANDLE;
+    return m_submittedTicket;
+}
+
+void GlorpUploadContext::retireOldest() {
+    InFlightBatch &batch = m_inFlight.front();
+    vkWaitForFences(m_device.device(), 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+    for (auto &release : batch.releases) {
+        release();
+    }
+    vkDestroyFence(m_device.device(), batch.fence, nullptr);
+    vkFreeCommandBuffers(m_device.device(), m_commandPool, 1, &batch.commandBuffer);
+    if (batch.transferCommandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(m_device.device(), m_transferCommandPool, 1, &batch.transferCommandBuffer);
+        vkDestroySemaphore(m_device.device(), batch.transferSemaphore, nullptr);
+    }
+    m_tail = batch.ringEnd;
+    m_completedTicket = batch.ticket;
+    m_inFlight.pop_front();
+}
+
+void GlorpUploadContext::retireCompleted() {
+    while (!m_inFlight.empty() && vkGetFenceStatus(m_device.device(), m_inFlight.front().fence) == VK_SUCCESS) {
+        retireOldest();
+    }
+}
+
+void GlorpUploadContext::wait(uint64_t ticket) {
+    assert(ticket <= m_submittedTicket && "Cannot wait for a batch that has not been submitted");
+    while (m_completedTicket < ticket && !m_inFlight.empty()) {
+        retireOldest();
+    }
+}
+
+void GlorpUploadContext::waitIdle() {
+    wait(m_submittedTicket);
+}
+
+bool GlorpUploadContext::isComplete(uint64_t ticket) {
+    retireCompleted();
+    return m_completedTicket >= ticket;
+}
+
+}
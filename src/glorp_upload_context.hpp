@@ -0,0 +1,108 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_buffer.hpp"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Glorp {
+
+// Batches resource uploads into a single command buffer backed by a persistent staging ring.
+// Everything recorded between the outermost beginBatch()/endBatch() pair goes out in one
+// vkQueueSubmit, and its completion is tracked with a fence and a monotonically increasing ticket.
+// On devices with a dedicated transfer queue family the copies go to that queue and the graphics
+// queue acquires ownership of the results before anything samples or reads them.
+class GlorpUploadContext {
+    public:
+        static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64 * 1024 * 1024;
+
+        struct StagingRegion {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            void *mapped = nullptr;
+        };
+
+        GlorpUploadContext(GlorpDevice &device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+        ~GlorpUploadContext();
+
+        GlorpUploadContext(const GlorpUploadContext&) = delete;
+        GlorpUploadContext &operator=(const GlorpUploadContext&) = delete;
+
+        // Batches nest; only closing the outermost one submits. Returns the ticket of the submission.
+        void beginBatch();
+        uint64_t endBatch();
+
+        // Graphics queue commands: layout transitions, mip blits and ownership acquires
+        VkCommandBuffer getCommandBuffer();
+        // Transfer queue commands: staging copies. Same as getCommandBuffer() without a dedicated transfer family
+        VkCommandBuffer getTransferCommandBuffer();
+
+        // Regions stay valid until the batch they were allocated in has completed on the GPU.
+        StagingRegion allocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+        StagingRegion stage(const void *data, VkDeviceSize size, VkDeviceSize alignment = 16);
+
+        void copyBuffer(const StagingRegion &src, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+        // bufferOffset of every region is relative to the start of the staging region
+        void copyBufferToImage(const StagingRegion &src, VkImage image, std::vector<VkBufferImageCopy> regions);
+
+        // Hand a resource written on the transfer command buffer over to the graphics command buffer.
+        // Records a release/acquire pair across queue families, or a plain barrier when both are the same queue.
+        void releaseBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+        void releaseImage(VkImage image, VkImageLayout layout, const VkImageSubresourceRange &range, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+
+        // Runs release once the batch being recorded has completed, for objects its commands still reference
+        void deferRelease(std::function<void()> release);
+
+        uint64_t submit();
+        void wait(uint64_t ticket);
+        void waitIdle();
+        bool isComplete(uint64_t ticket);
+        uint64_t getCompletedTicket() const { return m_completedTicket; }
+    private:
+        struct InFlightBatch {
+            uint64_t ticket;
+            VkFence fence;
+            VkCommandBuffer commandBuffer;
+            VkCommandBuffer transferCommandBuffer;
+            VkSemaphore transferSemaphore;
+            VkDeviceSize ringEnd;
+            std::vector<std::unique_ptr<GlorpBuffer>> transientBuffers;
+            std::vector<std::function<void()>> releases;
+        };
+
+        void createCommandPools();
+        VkCommandBuffer beginRecording(VkCommandPool commandPool);
+        VkSemaphore submitTransfer();
+        void retireCompleted();
+        void retireOldest();
+        StagingRegion allocateTransient(VkDeviceSize size);
+    private:
+        GlorpDevice &m_device;
+
+        std::unique_ptr<GlorpBuffer> m_ringBuffer;
+        VkDeviceSize m_ringSize;
+        // head and tail are monotonically increasing byte counters, the ring offset is counter % m_ringSize
+        VkDeviceSize m_head = 0;
+        VkDeviceSize m_tail = 0;
+
+        bool m_dedicatedTransfer = false;
+        uint32_t m_graphicsFamily = 0;
+        uint32_t m_transferFamily = 0;
+        VkCommandPool m_commandPool = VK_NULL_HANDLE;
+        VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+        VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer m_transferCommandBuffer = VK_NULL_HANDLE;
+        int m_batchDepth = 0;
+
+        std::vector<std::unique_ptr<GlorpBuffer>> m_pendingTransientBuffers;
+        std::vector<std::function<void()>> m_pendingReleases;
+        std::deque<InFlightBatch> m_inFlight;
+
+        uint64_t m_submittedTicket = 0;
+        uint64_t m_completedTicket = 0;
+};
+}
@@ -0,0 +1,375 @@
+#include "glorp_virtual_texture.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace Glorp {
+
+namespace {
+using File = GlorpVirtualTextureFile;
+
+// std140 mirror of VirtualTextureInfo in shaders/virtual_texture.glsl
+struct VirtualTextureInfo {
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t cachePagesPerSide;
+    // pagesX, pagesY, firstPage, unused
+    uint32_t levels[File::MAX_LEVELS][4];
+};
+
+uint32_t packEntry(uint32_t slot, uint32_t cachePagesPerSide, uint32_t level) {
+    return (slot % cachePagesPerSide) | ((slot / cachePagesPerSide) << 8) | (level << 16);
+}
+}
+
+GlorpVirtualTexture::GlorpVirtualTexture(GlorpDevice &device, const std::string &path, uint32_t cachePagesPerSide)
+    : m_device{device}, m_path{path} {
+    // slot coordinates are packed into 8 bits each
+    uint32_t maxPagesPerSide = std::min(m_device.properties.limits.maxImageDimension2D / File::PAGE_SIZE, 255u);
+    m_cachePagesPerSide = std::clamp(cachePagesPerSide, 2u, maxPagesPerSide);
+    auto header = GlorpFileIo::shared().readRangeAsync(m_path, 0, File::HEADER_READ_SIZE, GlorpFileIo::Priority::High).get();
+    if (!header.ok() || !File::parseHeader(header.data.bytes(), m_header)) {
+        throw std::runtime_error("Failed to load virtual texture " + m_path);
+    }
+    const auto &last = m_header.levels.back();
+    if (last.pagesX != 1 || last.pagesY != 1 || m_header.pageCount > UINT32_MAX) {
+        throw std::runtime_error("Virtual texture is too large: " + m_path);
+    }
+
+    m_slots.resize(static_cast<size_t>(m_cachePagesPerSide) * m_cachePagesPerSide);
+    m_pageTable.resize(m_header.pageCount);
+    createCache();
+    createBuffers();
+
+    // the first update() uploads the pinned page before anything samples the cache
+    requestPage(last.firstPage, true);
+    m_pendingPages.at(last.firstPage).read.wait();
+    m_stats = {};
+
+    std::cout << "Loaded virtual texture " << m_path << " (" << m_header.width << "x" << m_header.height << ", "
+        << m_header.levels.size() << " levels, " << m_header.pageCount << " pages)" << std::endl;
+}
+
+GlorpVirtualTexture::~GlorpVirtualTexture() {
+    // reads still in flight complete into futures nobody waits for
+    for (auto &[page, pending] : m_pendingPages) {
+        pending.read.wait();
+    }
+    auto stats = getStats();
+    std::cout << "Virtual texture " << m_path << ": hit rate " << stats.hitRate() * 100.f << "%, " << stats.pageFaults
+        << " page faults, average fault latency " << stats.averageFaultLatencyMs << " ms, max " << stats.maxFaultLatencyMs << " ms" << std::endl;
+
+    vkDestroySampler(m_device.device(), m_cacheSampler, nullptr);
+    vkDestroyImageView(m_device.device(), m_cacheView, nullptr);
+    vkDestroyImage(m_device.device(), m_cacheImage, nullptr);
+    vkFreeMemory(m_device.device(), m_cacheMemory, nullptr);
+}
+
+std::unique_ptr<GlorpDescriptorSetLayout> GlorpVirtualTexture::createSetLayout(GlorpDevice &device) {
+    return GlorpDescriptorSetLayout::Builder(device)
+        .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .addBinding(3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .build();
+}
+
+void GlorpVirtualTexture::createCache() {
+    uint32_t extent = m_cachePagesPerSide * File::PAGE_SIZE;
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = m_header.srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = {extent, extent, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    m_device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_cacheImage, m_cacheMemory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = m_cacheImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_cacheView) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create virtual texture cache view.");
+    }
+
+    // pages are sampled at their own level only, the border covers the bilinear footprint
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = 0.f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    if (vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_cacheSampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create virtual texture sampler.");
+    }
+}
+
+void GlorpVirtualTexture::createBuffers() {
+    m_pageTableBuffer = std::make_unique<GlorpBuffer>(m_device, sizeof(uint32_t), static_cast<uint32_t>(m_header.pageCount),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VirtualTextureInfo info{};
+    info.width = m_header.width;
+    info.height = m_header.height;
+    info.levelCount = static_cast<uint32_t>(m_header.levels.size());
+    info.cachePagesPerSide = m_cachePagesPerSide;
+    for (size_t i = 0; i < m_header.levels.size(); i++) {
+        const auto &level = m_header.levels[i];
+        info.levels[i][0] = level.pagesX;
+        info.levels[i][1] = level.pagesY;
+        info.levels[i][2] = static_cast<uint32_t>(level.firstPage);
+    }
+    m_infoBuffer = std::make_unique<GlorpBuffer>(m_device, sizeof(VirtualTextureInfo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_infoBuffer->map();
+    m_infoBuffer->writeToBuffer(&info);
+
+    uint32_t feedbackWords = static_cast<uint32_t>((m_header.pageCount + 31) / 32);
+    VkDeviceSize stagingSize = MAX_UPLOADS_PER_FRAME * File::PAGE_BYTES + m_header.pageCount * sizeof(uint32_t);
+    for (int i = 0; i < GlorpSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        m_feedbackBuffers[i] = std::make_unique<GlorpBuffer>(m_device, sizeof(uint32_t), feedbackWords,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_feedbackBuffers[i]->map();
+        std::memset(m_feedbackBuffers[i]->getMappedMemory(), 0, feedbackWords * sizeof(uint32_t));
+
+        m_stagingBuffers[i] = std::make_unique<GlorpBuffer>(m_device, stagingSize, 1,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        m_stagingBuffers[i]->map();
+    }
+}
+
+void GlorpVirtualTexture::writeDescriptors(GlorpDescriptorSetLayout &setLayout, GlorpDescriptorPool &pool) {
+    VkDescriptorImageInfo cacheInfo{m_cacheSampler, m_cacheView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    auto pageTableInfo = m_pageTableBuffer->descriptorInfo();
+    auto info = m_infoBuffer->descriptorInfo();
+    for (int i = 0; i < GlorpSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+        auto feedbackInfo = m_feedbackBuffers[i]->descriptorInfo();
+        GlorpDescriptorWriter writer(setLayout, pool);
+        writer.writeImage(0, &cacheInfo)
+            .writeBuffer(1, &pageTableInfo)
+            .writeBuffer(2, &feedbackInfo)
+            .writeBuffer(3, &info);
+        if (!writer.build(m_descriptorSets[i])) {
+            throw std::runtime_error("Failed to allocate virtual texture descriptor set.");
+        }
+    }
+}
+
+void GlorpVirtualTexture::requestPage(uint64_t page, bool pinned) {
+    PendingPage pending{};
+    pending.read = GlorpFileIo::shared().readRangeAsync(m_path, File::pageOffset(m_header, page), File::PAGE_BYTES);
+    pending.requested = std::chrono::steady_clock::now();
+    pending.pinned = pinned;
+    m_pendingPages.emplace(page, std::move(pending));
+    m_stats.pageFaults++;
+}
+
+void GlorpVirtualTexture::readFeedback(int frameIndex) {
+    auto *words = static_cast<uint32_t *>(m_feedbackBuffers[frameIndex]->getMappedMemory());
+    uint32_t wordCount = m_feedbackBuffers[frameIndex]->getInstanceCount();
+    for (uint32_t i = 0; i < wordCount; i++) {
+        uint32_t bits = words[i];
+        while (bits != 0) {
+            uint64_t page = static_cast<uint64_t>(i) * 32 + std::countr_zero(bits);
+            bits &= bits - 1;
+            m_stats.requestedPages++;
+            if (auto it = m_residentPages.find(page); it != m_residentPages.end()) {
+                m_slots[it->second].lastUsedFrame = m_frame;
+                m_stats.cacheHits++;
+            } else if (!m_pendingPages.contains(page) && m_pendingPages.size() < MAX_READS_IN_FLIGHT) {
+                requestPage(page, false);
+            }
+        }
+    }
+    std::memset(words, 0, wordCount * sizeof(uint32_t));
+}
+
+uint32_t GlorpVirtualTexture::allocateSlot() {
+    uint32_t oldest = NO_SLOT;
+    for (uint32_t i = 0; i < m_slots.size(); i++) {
+        const auto &slot = m_slots[i];
+        if (slot.page == ~0ull) {
+            return i;
+        }
+        // pages the latest feedback asked for are never evicted for another one
+        if (!slot.pinned && slot.lastUsedFrame < m_frame && (oldest == NO_SLOT || slot.lastUsedFrame < m_slots[oldest].lastUsedFrame)) {
+            oldest = i;
+        }
+    }
+    if (oldest != NO_SLOT) {
+        m_residentPages.erase(m_slots[oldest].page);
+        m_slots[oldest].page = ~0ull;
+        m_stats.pagesEvicted++;
+        m_pageTableDirty = true;
+    }
+    return oldest;
+}
+
+std::vector<GlorpVirtualTexture::Upload> GlorpVirtualTexture::stagePages(int frameIndex) {
+    std::vector<Upload> uploads;
+    auto *staging = static_cast<std::byte *>(m_stagingBuffers[frameIndex]->getMappedMemory());
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_pendingPages.begin(); it != m_pendingPages.end() && uploads.size() < MAX_UPLOADS_PER_FRAME;) {
+        auto &pending = it->second;
+        if (pending.read.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        auto result = pending.read.get();
+        uint32_t slot = NO_SLOT;
+        if (!result.ok() || result.data.size() != File::PAGE_BYTES) {
+            std::cerr << "Failed to read page " << it->first << " of virtual texture " << m_path << std::endl;
+        } else {
+            slot = allocateSlot();
+        }
+        // without a free slot the page is dropped, the feedback asks for it again if still needed
+        if (slot != NO_SLOT) {
+            m_slots[slot] = {it->first, m_frame, pending.pinned};
+            m_residentPages[it->first] = slot;
+            std::memcpy(staging + uploads.size() * File::PAGE_BYTES, result.data.data(), File::PAGE_BYTES);
+            uploads.push_back({it->first, slot});
+            m_pageTableDirty = true;
+
+            double latency = std::chrono::duration<double, std::milli>(now - pending.requested).count();
+            m_totalFaultLatencyMs += latency;
+            m_resolvedFaults++;
+            m_stats.maxFaultLatencyMs = std::max(m_stats.maxFaultLatencyMs, latency);
+            m_stats.pagesUploaded++;
+        }
+        it = m_pendingPages.erase(it);
+    }
+    return uploads;
+}
+
+void GlorpVirtualTexture::rebuildPageTable() {
+    // coarsest level first, so every missing page inherits the entry of its parent
+    for (size_t l = m_header.levels.size(); l-- > 0;) {
+        const auto &level = m_header.levels[l];
+        for (uint32_t y = 0; y < level.pagesY; y++) {
+            for (uint32_t x = 0; x < level.pagesX; x++) {
+                uint64_t page = level.firstPage + static_cast<uint64_t>(y) * level.pagesX + x;
+                if (auto it = m_residentPages.find(page); it != m_residentPages.end()) {
+                    m_pageTable[page] = packEntry(it->second, m_cachePagesPerSide, static_cast<uint32_t>(l));
+                } else if (l + 1 < m_header.levels.size()) {
+                    const auto &parent = m_header.levels[l + 1];
+                    uint32_t parentX = std::min(x / 2, parent.pagesX - 1);
+                    uint32_t parentY = std::min(y / 2, parent.pagesY - 1);
+                    m_pageTable[page] = m_pageTable[parent.firstPage + static_cast<uint64_t>(parentY) * parent.pagesX + parentX];
+                }
+            }
+        }
+    }
+}
+
+void GlorpVirtualTexture::recordUploads(VkCommandBuffer commandBuffer, int frameIndex, const std::vector<Upload> &uploads) {
+    VkBuffer staging = m_stagingBuffers[frameIndex]->getBuffer();
+    if (!uploads.empty()) {
+        // earlier frames sampling the slots being replaced have to finish first
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = m_cacheLayout;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_cacheImage;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        VkPipelineStageFlags srcStage = m_cacheLayout == VK_IMAGE_LAYOUT_UNDEFINED ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        std::vector<VkBufferImageCopy> regions;
+        for (size_t i = 0; i < uploads.size(); i++) {
+            VkBufferImageCopy region{};
+            region.bufferOffset = i * File::PAGE_BYTES;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            region.imageOffset = {static_cast<int32_t>(uploads[i].slot % m_cachePagesPerSide * File::PAGE_SIZE),
+                static_cast<int32_t>(uploads[i].slot / m_cachePagesPerSide * File::PAGE_SIZE), 0};
+            region.imageExtent = {File::PAGE_SIZE, File::PAGE_SIZE, 1};
+            regions.push_back(region);
+        }
+        vkCmdCopyBufferToImage(commandBuffer, staging, m_cacheImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        m_cacheLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    if (m_pageTableDirty) {
+        rebuildPageTable();
+        m_pageTableDirty = false;
+        VkDeviceSize offset = MAX_UPLOADS_PER_FRAME * File::PAGE_BYTES;
+        VkDeviceSize size = m_pageTable.size() * sizeof(uint32_t);
+        std::memcpy(static_cast<std::byte *>(m_stagingBuffers[frameIndex]->getMappedMemory()) + offset, m_pageTable.data(), size);
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+        VkBufferCopy copy{offset, 0, size};
+        vkCmdCopyBuffer(commandBuffer, staging, m_pageTableBuffer->getBuffer(), 1, &copy);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = m_pageTableBuffer->getBuffer();
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+}
+
+void GlorpVirtualTexture::update(VkCommandBuffer commandBuffer, int frameIndex) {
+    readFeedback(frameIndex);
+    auto uploads = stagePages(frameIndex);
+    recordUploads(commandBuffer, frameIndex, uploads);
+    m_frame++;
+}
+
+void GlorpVirtualTexture::finishFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = m_feedbackBuffers[frameIndex]->getBuffer();
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+GlorpVirtualTexture::Stats GlorpVirtualTexture::getStats() const {
+    Stats stats = m_stats;
+    stats.averageFaultLatencyMs = m_resolvedFaults == 0 ? 0.0 : m_totalFaultLatencyMs / m_resolvedFaults;
+    stats.residentPages = static_cast<uint32_t>(m_residentPages.size());
+    stats.cachePages = static_cast<uint32_t>(m_slots.size());
+    stats.pendingPages = static_cast<uint32_t>(m_pendingPages.size());
+    return stats;
+}
+
+void GlorpVirtualTexture::resetStats() {
+    m_stats = {};
+    m_totalFaultLatencyMs = 0.0;
+    m_resolvedFaults = 0;
+}
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "glorp_device.hpp"
+#include "glorp_buffer.hpp"
+#include "glorp_descriptors.hpp"
+#include "glorp_file_io.hpp"
+#include "glorp_swap_chain.hpp"
+#include "glorp_virtual_texture_file.hpp"
+
+#include <array>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Glorp {
+
+// Texture far larger than what is kept in memory, sampled through a page table. Only the pages the
+// last frames touched live in a fixed size physical page cache image; the page table maps every page
+// of every level to the cache slot of itself or of its closest resident ancestor, so a missing page
+// samples a blurrier level instead of nothing. Fragments that sample the texture mark the pages they
+// wanted in a per frame feedback bitset, which the CPU reads back once the frame has finished to
+// queue the missing pages for loading from the tiled file. Page and page table updates are recorded
+// into the frame's command buffer ahead of the render pass, so frames in flight are never raced.
+//
+// Descriptor set layout, shared with the virtual variant of the simple shader:
+//   0 physical page cache, combined image sampler
+//   1 page table, storage buffer of one packed entry per page
+//   2 feedback bitset, storage buffer, one per frame in flight
+//   3 layout of the levels, uniform buffer
+class GlorpVirtualTexture {
+    public:
+        static constexpr uint32_t DEFAULT_CACHE_PAGES_PER_SIDE = 16;
+        static constexpr uint32_t MAX_UPLOADS_PER_FRAME = 16;
+        static constexpr uint32_t MAX_READS_IN_FLIGHT = 64;
+
+        struct Stats {
+            // pages marked in the feedback, counted once per frame
+            uint64_t requestedPages = 0;
+            uint64_t cacheHits = 0;
+            uint64_t pageFaults = 0;
+            uint64_t pagesUploaded = 0;
+            uint64_t pagesEvicted = 0;
+            // from the frame the feedback first asked for a page to the frame its upload was recorded
+            double averageFaultLatencyMs = 0.0;
+            double maxFaultLatencyMs = 0.0;
+            uint32_t residentPages = 0;
+            uint32_t cachePages = 0;
+            uint32_t pendingPages = 0;
+
+            float hitRate() const { return requestedPages == 0 ? 1.f : static_cast<float>(cacheHits) / requestedPages; }
+        };
+
+        GlorpVirtualTexture(GlorpDevice &device, const std::string &path, uint32_t cachePagesPerSide = DEFAULT_CACHE_PAGES_PER_SIDE);
+        ~GlorpVirtualTexture();
+
+        GlorpVirtualTexture(const GlorpVirtualTexture&) = delete;
+        GlorpVirtualTexture &operator=(const GlorpVirtualTexture&) = delete;
+
+        static std::unique_ptr<GlorpDescriptorSetLayout> createSetLayout(GlorpDevice &device);
+        // Allocates one set per frame in flight from pool
+        void writeDescriptors(GlorpDescriptorSetLayout &setLayout, GlorpDescriptorPool &pool);
+        VkDescriptorSet getDescriptorSet(int frameIndex) const { return m_descriptorSets[frameIndex]; }
+
+        // Reads back the feedback of the frame that last used this slot and records the page and page
+        // table uploads. Called after beginFrame and before the render pass.
+        void update(VkCommandBuffer commandBuffer, int frameIndex);
+        // Makes the feedback written by this frame visible to the host, called after the render pass
+        void finishFrame(VkCommandBuffer commandBuffer, int frameIndex);
+
+        const std::string &getPath() const { return m_path; }
+        const GlorpVirtualTextureFile::Header &getHeader() const { return m_header; }
+        Stats getStats() const;
+        void resetStats();
+    private:
+        static constexpr uint32_t NO_SLOT = ~0u;
+
+        struct Slot {
+            uint64_t page = ~0ull;
+            uint64_t lastUsedFrame = 0;
+            // the coarsest level stays resident so every lookup has something to fall back to
+            bool pinned = false;
+        };
+
+        struct PendingPage {
+            std::future<GlorpFileIo::ReadResult> read;
+            std::chrono::steady_clock::time_point requested;
+            bool pinned = false;
+        };
+
+        struct Upload {
+            uint64_t page;
+            uint32_t slot;
+        };
+
+        void createCache();
+        void createBuffers();
+        void requestPage(uint64_t page, bool pinned);
+        void readFeedback(int frameIndex);
+        uint32_t allocateSlot();
+        std::vector<Upload> stagePages(int frameIndex);
+        void rebuildPageTable();
+        void recordUploads(VkCommandBuffer commandBuffer, int frameIndex, const std::vector<Upload> &uploads);
+    private:
+        GlorpDevice &m_device;
+        std::string m_path;
+        GlorpVirtualTextureFile::Header m_header;
+
+        uint32_t m_cachePagesPerSide;
+        VkImage m_cacheImage = VK_NULL_HANDLE;
+        VkDeviceMemory m_cacheMemory = VK_NULL_HANDLE;
+        VkImageView m_cacheView = VK_NULL_HANDLE;
+        VkSampler m_cacheSampler = VK_NULL_HANDLE;
+        VkImageLayout m_cacheLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        std::vector<Slot> m_slots;
+        std::unordered_map<uint64_t, uint32_t> m_residentPages;
+        std::unordered_map<uint64_t, PendingPage> m_pendingPages;
+
+        // entry = slot x | slot y << 8 | resident level << 16
+        std::vector<uint32_t> m_pageTable;
+        bool m_pageTableDirty = true;
+        std::unique_ptr<GlorpBuffer> m_pageTableBuffer;
+        std::unique_ptr<GlorpBuffer> m_infoBuffer;
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_feedbackBuffers;
+        // page table copy and page texels of the uploads recorded in that frame
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_stagingBuffers;
+        std::array<VkDescriptorSet, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_descriptorSets{};
+
+        uint64_t m_frame = 0;
+        Stats m_stats;
+        double m_totalFaultLatencyMs = 0.0;
+        uint64_t m_resolvedFaults = 0;
+};
+}
@@ -0,0 +1,151 @@
+#include "glorp_virtual_texture_file.hpp"
+#include "glorp_file_io.hpp"
+#include "glorp_texture_processing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Glorp {
+
+namespace {
+constexpr char MAGIC[4] = {'G', 'L', 'V', 'T'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t FLAG_SRGB = 1;
+constexpr size_t HEADER_SIZE = 40;
+constexpr size_t LEVEL_ENTRY_SIZE = 24;
+
+template <typename T>
+T read(std::span<const std::byte> data, size_t offset) {
+    T value;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void append(std::vector<std::byte> &out, T value) {
+    size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+}
+
+std::vector<GlorpVirtualTextureFile::Level> GlorpVirtualTextureFile::levelLayout(uint32_t width, uint32_t height) {
+    std::vector<Level> levels;
+    uint64_t firstPage = 0;
+    for (uint32_t i = 0; i < MAX_LEVELS; i++) {
+        Level level{};
+        level.width = std::max(width >> i, 1u);
+        level.height = std::max(height >> i, 1u);
+        level.pagesX = (level.width + PAGE_PAYLOAD - 1) / PAGE_PAYLOAD;
+        level.pagesY = (level.height + PAGE_PAYLOAD - 1) / PAGE_PAYLOAD;
+        level.firstPage = firstPage;
+        firstPage += static_cast<uint64_t>(level.pagesX) * level.pagesY;
+        levels.push_back(level);
+        if (level.pagesX == 1 && level.pagesY == 1) {
+            break;
+        }
+    }
+    return levels;
+}
+
+bool GlorpVirtualTextureFile::parseHeader(std::span<const std::byte> data, Header &header) {
+    if (data.size() < HEADER_SIZE || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0 || read<uint32_t>(data, 4) != VERSION) {
+        return false;
+    }
+    header.width = read<uint32_t>(data, 8);
+    header.height = read<uint32_t>(data, 12);
+    uint32_t pageSize = read<uint32_t>(data, 16);
+    uint32_t border = read<uint32_t>(data, 20);
+    uint32_t levelCount = read<uint32_t>(data, 24);
+    header.srgb = (read<uint32_t>(data, 28) & FLAG_SRGB) != 0;
+    header.dataOffset = read<uint64_t>(data, 32);
+    if (pageSize != PAGE_SIZE || border != PAGE_BORDER || header.width == 0 || header.height == 0 ||
+        levelCount == 0 || levelCount > MAX_LEVELS || data.size() < HEADER_SIZE + levelCount * LEVEL_ENTRY_SIZE ||
+        header.dataOffset % DATA_ALIGNMENT != 0) {
+        return false;
+    }
+
+    // the stored layout has to match the one the page table is built from
+    header.levels = levelLayout(header.width, header.height);
+    if (header.levels.size() != levelCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < levelCount; i++) {
+        size_t offset = HEADER_SIZE + i * LEVEL_ENTRY_SIZE;
+        const auto &level = header.levels[i];
+        if (read<uint32_t>(data, offset) != level.width || read<uint32_t>(data, offset + 4) != level.height ||
+            read<uint32_t>(data, offset + 8) != level.pagesX || read<uint32_t>(data, offset + 12) != level.pagesY ||
+            read<uint64_t>(data, offset + 16) != level.firstPage) {
+            return false;
+        }
+    }
+    const auto &last = header.levels.back();
+    header.pageCount = last.firstPage + static_cast<uint64_t>(last.pagesX) * last.pagesY;
+    return true;
+}
+
+uint64_t GlorpVirtualTextureFile::pageOffset(const Header &header, uint64_t page) {
+    return header.dataOffset + page * PAGE_BYTES;
+}
+
+void GlorpVirtualTextureFile::write(const std::string &path, const uint8_t *rgba, uint32_t width, uint32_t height, bool srgb) {
+    auto levels = levelLayout(width, height);
+    uint32_t levelCount = static_cast<uint32_t>(levels.size());
+    size_t dataOffset = (HEADER_SIZE + levelCount * LEVEL_ENTRY_SIZE + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+    std::vector<std::byte> header;
+    for (char c : MAGIC) {
+        append(header, c);
+    }
+    append<uint32_t>(header, VERSION);
+    append<uint32_t>(header, width);
+    append<uint32_t>(header, height);
+    append<uint32_t>(header, PAGE_SIZE);
+    append<uint32_t>(header, PAGE_BORDER);
+    append<uint32_t>(header, levelCount);
+    append<uint32_t>(header, srgb ? FLAG_SRGB : 0);
+    append<uint64_t>(header, dataOffset);
+    for (const auto &level : levels) {
+        append<uint32_t>(header, level.width);
+        append<uint32_t>(header, level.height);
+        append<uint32_t>(header, level.pagesX);
+        append<uint32_t>(header, level.pagesY);
+        append<uint64_t>(header, level.firstPage);
+    }
+    header.resize(dataOffset);
+
+    // the chain only needs to reach the last level that is cut into pages
+    GlorpTextureProcessing::MipOptions mipOptions{};
+    mipOptions.srgb = srgb;
+    auto mipOffsets = GlorpTextureProcessing::mipChainOffsets(width, height, levelCount);
+    std::vector<uint8_t> chain(mipOffsets.back());
+    std::memcpy(chain.data(), rgba, static_cast<size_t>(width) * height * 4);
+    GlorpTextureProcessing::generateMipChain(chain.data(), width, height, levelCount, mipOptions);
+
+    GlorpFileIo::writeFileAtomically(path, [&](std::ostream &out) {
+        out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+
+        // borders repeat the edge texels of the level, neighbouring pages fill them everywhere else
+        std::vector<uint8_t> page(PAGE_BYTES);
+        for (uint32_t i = 0; i < levelCount; i++) {
+            const auto &level = levels[i];
+            const uint8_t *texels = chain.data() + mipOffsets[i];
+            for (uint32_t pageY = 0; pageY < level.pagesY; pageY++) {
+                for (uint32_t pageX = 0; pageX < level.pagesX; pageX++) {
+                    for (uint32_t y = 0; y < PAGE_SIZE; y++) {
+                        int64_t sourceY = std::clamp<int64_t>(static_cast<int64_t>(pageY) * PAGE_PAYLOAD + y - PAGE_BORDER, 0, level.height - 1);
+                        for (uint32_t x = 0; x < PAGE_SIZE; x++) {
+                            int64_t sourceX = std::clamp<int64_t>(static_cast<int64_t>(pageX) * PAGE_PAYLOAD + x - PAGE_BORDER, 0, level.width - 1);
+                            std::memcpy(page.data() + (static_cast<size_t>(y) * PAGE_SIZE + x) * 4,
+                                texels + (static_cast<size_t>(sourceY) * level.width + sourceX) * 4, 4);
+                        }
+                    }
+                    out.write(reinterpret_cast<const char *>(page.data()), static_cast<std::streamsize>(page.size()));
+                }
+            }
+        }
+    });
+}
+
+}
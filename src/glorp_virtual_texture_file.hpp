@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Glorp {
+
+// Tiled on disk format for virtual textures. Every level of the mip chain is cut into square RGBA8
+// pages that carry a border of neighbouring texels, so a page can be filtered on its own once it sits
+// in the physical page cache. Pages are stored uncompressed and back to back, level 0 first and row
+// major inside a level, so the file offset of any page follows from the header alone and every page
+// is a single aligned read. The chain ends at the first level that fits into one page.
+class GlorpVirtualTextureFile {
+    public:
+        // texels per page side, border included. The shaders use the same values.
+        static constexpr uint32_t PAGE_SIZE = 128;
+        static constexpr uint32_t PAGE_BORDER = 4;
+        static constexpr uint32_t PAGE_PAYLOAD = PAGE_SIZE - 2 * PAGE_BORDER;
+        static constexpr size_t PAGE_BYTES = static_cast<size_t>(PAGE_SIZE) * PAGE_SIZE * 4;
+        // page data starts at this alignment so page reads can bypass the page cache
+        static constexpr size_t DATA_ALIGNMENT = 4096;
+        static constexpr size_t HEADER_READ_SIZE = DATA_ALIGNMENT;
+        static constexpr uint32_t MAX_LEVELS = 16;
+
+        struct Level {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t pagesX = 0;
+            uint32_t pagesY = 0;
+            // index of the level's first page in the file, also its first entry in the page table
+            uint64_t firstPage = 0;
+        };
+
+        struct Header {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            bool srgb = false;
+            std::vector<Level> levels;
+            uint64_t pageCount = 0;
+            uint64_t dataOffset = 0;
+        };
+
+        // Returns false when the data is not a virtual texture this loader understands
+        static bool parseHeader(std::span<const std::byte> data, Header &header);
+        static uint64_t pageOffset(const Header &header, uint64_t page);
+        static std::vector<Level> levelLayout(uint32_t width, uint32_t height);
+
+        // Cuts a mip chain built from rgba into pages and writes them to path
+        static void write(const std::string &path, const uint8_t *rgba, uint32_t width, uint32_t height, bool srgb);
+};
+}
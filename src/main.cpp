@@ -1,9 +1,46 @@
 #include "first_app.hpp"
+#include "glorp_texture_cooker.hpp"
+#include "glorp_occlusion_benchmark.hpp"
 
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <string_view>
+
+int main(int argc, char **argv) {
+    // glorp --cook <file.gltf>... writes block compressed textures next to the source images
+    if (argc > 2 && std::string_view{argv[1]} == "--cook") {
+        try {
+            for (int i = 2; i < argc; i++) {
+                Glorp::GlorpTextureCooker::cookGltf(argv[i]);
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    // glorp --cook-virtual <image> <out.gvt> writes a paged virtual texture
+    if (argc == 4 && std::string_view{argv[1]} == "--cook-virtual") {
+        try {
+            Glorp::GlorpTextureCooker::cookVirtual(argv[2], argv[3]);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    // glorp --bench-occlusion [frames] times the software occlusion culler on a synthetic scene, no window needed
+    if (argc >= 2 && std::string_view{argv[1]} == "--bench-occlusion") {
+        try {
+            Glorp::GlorpOcclusionBenchmark::report(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 600);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
 
-int main() {
     Glorp::FirstApp app{};
 
     try {
@@ -1,4 +1,5 @@
 #include "cubemap_render_system.hpp"
+#include "glorp_pipeline_registry.hpp"
 #include "glorp_game_object.hpp"
 
 namespace Glorp {
@@ -16,11 +17,12 @@ CubeMapRenderSystem::~CubeMapRenderSystem() {
 
 void CubeMapRenderSystem::renderCubemap(FrameInfo &frameInfo) {
     m_glorpPipeline->bind(frameInfo.commandBuffer);
+    m_glorpPipeline->setDynamicState(frameInfo.commandBuffer, m_dynamicState);
     
     std::vector<VkDescriptorSet> descriptors = {frameInfo.globalDescriptorSet};
     
     vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, static_cast<uint32_t>(descriptors.size()), descriptors.data(), 0, nullptr);
-    m_skyboxCube->bind(frameInfo.commandBuffer);
+    m_skyboxCube->bind(frameInfo.commandBuffer, GlorpModel::Streams::Positions);
     m_skyboxCube->draw(frameInfo.commandBuffer);
 }
 
@@ -42,23 +44,21 @@ void CubeMapRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLa
 void CubeMapRenderSystem::createPipeline(VkRenderPass renderPass) {
     
     PipelineConfigInfo pipelineConfig{};
-    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig);
+    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig, m_glorpDevice);
     pipelineConfig.multisampleInfo.rasterizationSamples = m_glorpDevice.getSupportedSampleCount();
     pipelineConfig.renderPass = renderPass;
     pipelineConfig.pipelineLayout = m_pipelineLayout;
     pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
     pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    pipelineConfig.bindingDescriptions = {GlorpModel::Vertex::getBindingDescriptions()[0]};
-    pipelineConfig.attributeDescriptions = {
-        {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(GlorpModel::Vertex, position)}
-    };
+    pipelineConfig.bindingDescriptions = GlorpModel::Vertex::getBindingDescriptions(GlorpModel::Streams::Positions);
+    pipelineConfig.attributeDescriptions = GlorpModel::Vertex::getAttributeDescriptions(GlorpModel::Streams::Positions);
 
-    m_glorpPipeline = std::make_unique<GlorpPipeline>(
-            m_glorpDevice,
+    m_glorpPipeline = m_glorpDevice.getPipelineRegistry().getPipeline(
             std::string(RESOURCE_LOCATIONS) + "shaders/cubemap.vert.spv",
             std::string(RESOURCE_LOCATIONS) + "shaders/cubemap.frag.spv",
             pipelineConfig
     );
+    m_dynamicState = PipelineDynamicState::fromConfig(pipelineConfig);
 }
 void CubeMapRenderSystem::createSkyboxCube() {
     std::vector<GlorpModel::Vertex> vertices = {
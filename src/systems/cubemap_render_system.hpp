@@ -27,7 +27,8 @@ class CubeMapRenderSystem {
     private:
         GlorpDevice &m_glorpDevice;
 
-        std::unique_ptr<GlorpPipeline> m_glorpPipeline;
+        std::shared_ptr<GlorpPipeline> m_glorpPipeline;
+        PipelineDynamicState m_dynamicState;
         VkPipelineLayout m_pipelineLayout;
         std::unique_ptr<GlorpModel> m_skyboxCube;
 };
@@ -0,0 +1,99 @@
+#include "depth_prepass_system.hpp"
+#include "glorp_pipeline_registry.hpp"
+#include "glorp_occlusion_queries.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace Glorp {
+
+struct DepthPrepassPushConstantData {
+    glm::mat4 modelMatrix{1.f};
+};
+
+DepthPrepassSystem::DepthPrepassSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout): m_glorpDevice{device} {
+    createPipelineLayout(globalSetLayout);
+    createPipeline(renderPass);
+}
+DepthPrepassSystem::~DepthPrepassSystem() {
+    vkDestroyPipelineLayout(m_glorpDevice.device(), m_pipelineLayout, nullptr);
+}
+
+bool DepthPrepassSystem::writesDepth(const GlorpGameObject &obj) {
+    return obj.model != nullptr && (obj.material == nullptr || obj.material->alphaMode != MaterialComponent::AlphaMode::Mask);
+}
+
+void DepthPrepassSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    VkPushConstantRange pushConstantRange {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DepthPrepassPushConstantData);
+
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if(vkCreatePipelineLayout(m_glorpDevice.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Could not create pipeline layout");
+    }
+}
+
+void DepthPrepassSystem::createPipeline(VkRenderPass renderPass) {
+    assert(m_pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+    PipelineConfigInfo pipelineConfig{};
+    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig, m_glorpDevice);
+    pipelineConfig.multisampleInfo.rasterizationSamples = m_glorpDevice.getSupportedSampleCount();
+    pipelineConfig.colorBlendAttachment.colorWriteMask = 0;
+    pipelineConfig.bindingDescriptions = GlorpModel::Vertex::getBindingDescriptions(GlorpModel::Streams::Positions);
+    pipelineConfig.attributeDescriptions = GlorpModel::Vertex::getAttributeDescriptions(GlorpModel::Streams::Positions);
+    pipelineConfig.renderPass = renderPass;
+    pipelineConfig.pipelineLayout = m_pipelineLayout;
+    m_glorpPipeline = m_glorpDevice.getPipelineRegistry().getPipeline(
+        std::string(RESOURCE_LOCATIONS) + "shaders/depth_prepass.vert.spv",
+        std::string(RESOURCE_LOCATIONS) + "shaders/depth_prepass.frag.spv",
+        pipelineConfig
+    );
+    m_dynamicState = PipelineDynamicState::fromConfig(pipelineConfig);
+}
+
+void DepthPrepassSystem::render(FrameInfo &frameInfo) {
+    m_glorpPipeline->bind(frameInfo.commandBuffer);
+    m_glorpPipeline->setDynamicState(frameInfo.commandBuffer, m_dynamicState);
+
+    vkCmdBindDescriptorSets(
+        frameInfo.commandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        0, 1,
+        &frameInfo.globalDescriptorSet,
+        0, nullptr
+    );
+
+    for (auto &kv : frameInfo.gameObjects) {
+        auto &obj = kv.second;
+        if (!writesDepth(obj) || frameInfo.isCulled(obj.getId())) continue;
+        // depth of a queried object the main pass then skips would hide what is behind it with nothing
+        bool queried = frameInfo.occlusionQueries != nullptr && obj.occlusionPolicy == GlorpGameObject::OcclusionPolicy::Query;
+        if (queried && !frameInfo.occlusionQueries->beginPrepassDraw(frameInfo, obj)) continue;
+
+        DepthPrepassPushConstantData push{};
+        push.modelMatrix = obj.transform.mat4();
+        vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DepthPrepassPushConstantData), &push);
+
+        obj.model->bind(frameInfo.commandBuffer, GlorpModel::Streams::Positions);
+        frameInfo.drawModel(obj);
+        if (queried) {
+            frameInfo.occlusionQueries->endDraw(frameInfo.commandBuffer);
+        }
+    }
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "glorp_pipeline.hpp"
+#include "glorp_device.hpp"
+#include "glorp_frame_info.hpp"
+
+#include <memory>
+
+#ifndef RESOURCE_LOCATIONS
+#define RESOURCE_LOCATIONS ""
+#endif
+
+namespace Glorp {
+// Lays down the depth of every opaque object from its position stream alone, so the main pass can test
+// with EQUAL and shade each pixel once however much geometry overlaps it
+class DepthPrepassSystem {
+    public:
+        DepthPrepassSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+        ~DepthPrepassSystem();
+
+        DepthPrepassSystem(const DepthPrepassSystem&) = delete;
+        DepthPrepassSystem &operator=(const DepthPrepassSystem &) = delete;
+
+        // Objects whose depth the pre-pass writes. Alpha masked materials are left to the main pass, their
+        // holes are only known once the albedo has been sampled.
+        static bool writesDepth(const GlorpGameObject &obj);
+
+        void render(FrameInfo &frameInfo);
+    private:
+        void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+        void createPipeline(VkRenderPass renderPass);
+    private:
+        GlorpDevice &m_glorpDevice;
+
+        std::shared_ptr<GlorpPipeline> m_glorpPipeline;
+        PipelineDynamicState m_dynamicState;
+        VkPipelineLayout m_pipelineLayout;
+};
+
+}
@@ -1,7 +1,9 @@
 #include "point_light_system.hpp"
+#include "glorp_pipeline_registry.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
-#include <map>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -10,15 +12,35 @@
 
 namespace Glorp {
 
-struct PointLightPushConstants {
-    glm::vec4 position{};
-    glm::vec4 color{};
-    float radius;
-};
+namespace {
+static_assert(MAX_LIGHTS <= 0x10000, "Billboard instances are sorted by 16 bit indices");
+
+// LSD radix sort on the upper 16 bits of every entry, two stable byte passes
+void radixSortUpperHalf(std::vector<uint32_t> &entries, std::vector<uint32_t> &scratch) {
+    scratch.resize(entries.size());
+    for (uint32_t shift = 16; shift < 32; shift += 8) {
+        std::array<uint32_t, 256> offsets{};
+        for (uint32_t entry : entries) {
+            offsets[(entry >> shift) & 0xFF]++;
+        }
+        uint32_t sum = 0;
+        for (auto &offset : offsets) {
+            uint32_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (uint32_t entry : entries) {
+            scratch[offsets[(entry >> shift) & 0xFF]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
+}
 
 PointLightSystem::PointLightSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout): m_glorpDevice{device} {
     createPipelineLayout(globalSetLayout);
     createPipeline(renderPass);
+    createInstanceBuffers();
 }
 PointLightSystem::~PointLightSystem() {
     vkDestroyPipelineLayout(m_glorpDevice.device(), m_pipelineLayout, nullptr);
@@ -26,12 +48,6 @@ PointLightSystem::~PointLightSystem() {
 
 
 void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-
-    VkPushConstantRange pushConstantRange {};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(PointLightPushConstants);
-
     std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
 
 
@@ -39,33 +55,30 @@ void PointLightSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayou
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
     if(vkCreatePipelineLayout(m_glorpDevice.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error("Could not create pipeline layout");
     }
 }
 
-void PointLightSystem::update(FrameInfo &frameInfo, GlobalUbo &ubo) {
-    int lightIndex = 0;
+void PointLightSystem::update(FrameInfo &frameInfo, std::vector<PointLight> &lights) {
+    lights.clear();
 
     auto rotateLight = glm::rotate(glm::mat4(1.f), frameInfo.frameTime * frameInfo.lightRotationMultiplier, {0.f, -1.f, 0.f});
 
     for (auto& kv: frameInfo.gameObjects) {
         auto& obj = kv.second;
         if(obj.pointLight == nullptr) continue;
-        assert(lightIndex < MAX_LIGHTS && "The maximum amount of lights has been exceeded");
 
         obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
 
         obj.transform.translation.y = frameInfo.lightVerticalPosition;
 
-        ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
-        ubo.pointLights[lightIndex].color = glm::vec4(obj.color, frameInfo.lightIntensity);
-
-        lightIndex++;
+        PointLight &light = lights.emplace_back();
+        light.position = glm::vec4(obj.transform.translation, obj.pointLight->range);
+        light.color = glm::vec4(obj.color, frameInfo.lightIntensity);
     }
-    ubo.numLights = lightIndex;
 }
 
 void PointLightSystem::createPipeline(VkRenderPass renderPass) {
@@ -73,34 +86,71 @@ void PointLightSystem::createPipeline(VkRenderPass renderPass) {
 
     PipelineConfigInfo pipelineConfig{};
 
-    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig);
+    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig, m_glorpDevice);
     GlorpPipeline::enableAlphaBlending(pipelineConfig);
     pipelineConfig.multisampleInfo.rasterizationSamples = m_glorpDevice.getSupportedSampleCount();
-    pipelineConfig.attributeDescriptions.clear();
-    pipelineConfig.bindingDescriptions.clear();
+    // the quad's corners come from gl_VertexIndex, only the lights are vertex input
+    pipelineConfig.bindingDescriptions = {{0, sizeof(Instance), VK_VERTEX_INPUT_RATE_INSTANCE}};
+    pipelineConfig.attributeDescriptions = {
+        {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Instance, position)},
+        {1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Instance, color)}
+    };
     pipelineConfig.renderPass = renderPass;
     pipelineConfig.pipelineLayout = m_pipelineLayout;
-    m_glorpPipeline = std::make_unique<GlorpPipeline>(
-        m_glorpDevice,
+    m_glorpPipeline = m_glorpDevice.getPipelineRegistry().getPipeline(
         std::string(RESOURCE_LOCATIONS) + "shaders/point_light.vert.spv",
         std::string(RESOURCE_LOCATIONS) + "shaders/point_light.frag.spv",
         pipelineConfig
     );
+    m_dynamicState = PipelineDynamicState::fromConfig(pipelineConfig);
+}
+void PointLightSystem::createInstanceBuffers() {
+    for (auto &instanceBuffer : m_instanceBuffers) {
+        instanceBuffer = std::make_unique<GlorpBuffer>(m_glorpDevice, sizeof(Instance), MAX_LIGHTS, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        instanceBuffer->map();
+    }
 }
-void PointLightSystem::render(FrameInfo &frameInfo) {
-
-    std::map<float, GlorpGameObject::id_t> sorted;
 
+void PointLightSystem::render(FrameInfo &frameInfo) {
+    m_instances.clear();
+    m_distances.clear();
+    glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+    float maxDistance = 0.f;
     for (auto& kv: frameInfo.gameObjects) {
         auto& obj = kv.second;
         if(obj.pointLight == nullptr) continue;
+        if (m_instances.size() == MAX_LIGHTS) break;
+
+        m_instances.push_back({
+            glm::vec4(obj.transform.translation, obj.transform.scale.x),
+            glm::vec4(obj.color, obj.pointLight->lightIntensity)
+        });
+        float distance = glm::length(cameraPosition - obj.transform.translation);
+        m_distances.push_back(distance);
+        maxDistance = std::max(maxDistance, distance);
+    }
+    if (m_instances.empty()) {
+        return;
+    }
 
-        auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
-        float distSquared = glm::dot(offset, offset);
-        sorted[distSquared] = obj.getId();
+    // the farthest light gets key 0, so ascending keys draw back to front and equal distances keep both lights
+    m_sortEntries.clear();
+    float quantize = maxDistance > 0.f ? 65535.f / maxDistance : 0.f;
+    for (uint32_t i = 0; i < m_instances.size(); i++) {
+        uint32_t depth = 65535u - static_cast<uint32_t>(std::min(m_distances[i] * quantize, 65535.f));
+        m_sortEntries.push_back(depth << 16 | i);
+    }
+    radixSortUpperHalf(m_sortEntries, m_sortScratch);
+
+    auto &instanceBuffer = *m_instanceBuffers[frameInfo.frameIndex];
+    auto *instances = static_cast<Instance *>(instanceBuffer.getMappedMemory());
+    for (uint32_t i = 0; i < m_sortEntries.size(); i++) {
+        instances[i] = m_instances[m_sortEntries[i] & 0xFFFF];
     }
 
     m_glorpPipeline->bind(frameInfo.commandBuffer);
+    m_glorpPipeline->setDynamicState(frameInfo.commandBuffer, m_dynamicState);
 
     vkCmdBindDescriptorSets(
         frameInfo.commandBuffer,
@@ -111,26 +161,10 @@ void PointLightSystem::render(FrameInfo &frameInfo) {
         0, nullptr
     );
 
-
-
-    for (auto it = sorted.rbegin(); it != sorted.rend(); it++) {
-        auto& obj = frameInfo.gameObjects.at(it->second);
-
-        PointLightPushConstants push{};
-        push.position = glm::vec4(obj.transform.translation, 1.f);
-        push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-        push.radius = obj.transform.scale.x;
-
-        vkCmdPushConstants(
-            frameInfo.commandBuffer,
-            m_pipelineLayout,
-            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-            0,
-            sizeof(PointLightPushConstants),
-            &push
-        );
-        vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
-    }
-};
+    VkBuffer buffers[] = {instanceBuffer.getBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(frameInfo.commandBuffer, 0, 1, buffers, offsets);
+    vkCmdDraw(frameInfo.commandBuffer, 6, static_cast<uint32_t>(m_sortEntries.size()), 0, 0);
+}
 
 }
@@ -3,8 +3,12 @@
 #include "glorp_pipeline.hpp"
 #include "glorp_device.hpp"
 #include "glorp_frame_info.hpp"
+#include "glorp_buffer.hpp"
+#include "glorp_swap_chain.hpp"
 
+#include <array>
 #include <memory>
+#include <vector>
 
 #ifndef RESOURCE_LOCATIONS
 #define RESOURCE_LOCATIONS ""
@@ -19,16 +23,35 @@ class PointLightSystem {
         PointLightSystem(const PointLightSystem&) = delete;
         PointLightSystem &operator=(const PointLightSystem &) = delete;
 
-        void update(FrameInfo &frameInfo, GlobalUbo &ubo);
+        // Moves the lights and collects them for GlorpLightClusters
+        void update(FrameInfo &frameInfo, std::vector<PointLight> &lights);
+        // Draws every light's billboard back to front in one instanced draw
         void render(FrameInfo &frameInfo);
     private:
+        struct Instance {
+            // w is the billboard radius
+            glm::vec4 position;
+            // w is the intensity
+            glm::vec4 color;
+        };
+
         void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
         void createPipeline(VkRenderPass renderPass);
+        void createInstanceBuffers();
     private:
         GlorpDevice &m_glorpDevice;
 
-        std::unique_ptr<GlorpPipeline> m_glorpPipeline;
+        std::shared_ptr<GlorpPipeline> m_glorpPipeline;
+        PipelineDynamicState m_dynamicState;
         VkPipelineLayout m_pipelineLayout;
+
+        std::array<std::unique_ptr<GlorpBuffer>, GlorpSwapChain::MAX_FRAMES_IN_FLIGHT> m_instanceBuffers;
+        // reused every frame
+        std::vector<Instance> m_instances;
+        std::vector<float> m_distances;
+        // quantized depth << 16 | instance index
+        std::vector<uint32_t> m_sortEntries;
+        std::vector<uint32_t> m_sortScratch;
 };
 
 }
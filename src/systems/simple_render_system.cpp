@@ -1,6 +1,11 @@
 #include "simple_render_system.hpp"
+#include "glorp_pipeline_registry.hpp"
+#include "glorp_virtual_texture.hpp"
+#include "depth_prepass_system.hpp"
+#include "glorp_occlusion_queries.hpp"
 
 #include <stdexcept>
+#include <vector>
 
 
 #define GLM_FORCE_RADIANS
@@ -11,12 +16,47 @@ namespace Glorp {
 
 struct SimplePushConstantData {
     glm::mat4 modelMatrix{1.f};
+    // the shaders only read the upper 3x3, the last column's w carries the alpha cutoff so a cutoff
+    // is not a pipeline variant and the block stays within the guaranteed 128 bytes
     glm::mat4 normalMatrix{1.f};
-    glm::vec4 useMaps {1.f};
 };
 
-SimpleRenderSystem::SimpleRenderSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout): m_glorpDevice{device} {
-    createPipelineLayout(globalSetLayout, textureSetLayout);
+namespace {
+// fragment specialization constants of simple_shader.glsl, in constant_id order
+enum SpecializationConstant : uint32_t {
+    HAS_NORMAL_MAP,
+    HAS_ALBEDO_MAP,
+    HAS_EMISSIVE_MAP,
+    HAS_ORM_MAP,
+    USE_OCCLUSION,
+    ALPHA_MASK,
+    SPECIALIZATION_CONSTANT_COUNT
+};
+
+// the debug toggles of FrameInfo, all on unless the user turns a map off
+struct MapToggles {
+    bool normal = true;
+    bool albedo = true;
+    bool emissive = true;
+    bool ao = true;
+};
+
+void materialVariant(std::vector<uint32_t> &variant, const MaterialComponent *material, bool virtualAlbedo, const MapToggles &maps) {
+    variant.assign(SPECIALIZATION_CONSTANT_COUNT, VK_FALSE);
+    if (material != nullptr) {
+        variant[HAS_NORMAL_MAP] = material->normalTexture && maps.normal;
+        variant[HAS_ALBEDO_MAP] = (material->albedoTexture || virtualAlbedo) && maps.albedo;
+        variant[HAS_EMISSIVE_MAP] = material->emissiveTexture && maps.emissive;
+        variant[HAS_ORM_MAP] = material->ormTexture != nullptr;
+        variant[USE_OCCLUSION] = material->ormTexture && material->hasOcclusion && maps.ao;
+        variant[ALPHA_MASK] = material->alphaMode == MaterialComponent::AlphaMode::Mask;
+    }
+}
+}
+
+SimpleRenderSystem::SimpleRenderSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout,
+    VkDescriptorSetLayout virtualTextureSetLayout): m_glorpDevice{device} {
+    createPipelineLayout(globalSetLayout, textureSetLayout, virtualTextureSetLayout);
     createPipeline(renderPass);
 }
 SimpleRenderSystem::~SimpleRenderSystem() {
@@ -24,14 +64,14 @@ SimpleRenderSystem::~SimpleRenderSystem() {
 }
 
 
-void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout) {
+void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout, VkDescriptorSetLayout virtualTextureSetLayout) {
 
     VkPushConstantRange pushConstantRange {};
     pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     pushConstantRange.offset = 0;
     pushConstantRange.size = sizeof(SimplePushConstantData);
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout, textureSetLayout};
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout, textureSetLayout, virtualTextureSetLayout};
 
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
@@ -50,27 +90,79 @@ void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
 
     PipelineConfigInfo pipelineConfig{};
 
-    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig);
+    GlorpPipeline::defaultPipelineConfigInfo(pipelineConfig, m_glorpDevice);
     pipelineConfig.multisampleInfo.rasterizationSamples = m_glorpDevice.getSupportedSampleCount();
     pipelineConfig.multisampleInfo.sampleShadingEnable = VK_TRUE;
     pipelineConfig.multisampleInfo.minSampleShading = .2f;
 
     pipelineConfig.renderPass = renderPass;
     pipelineConfig.pipelineLayout = m_pipelineLayout;
-    m_glorpPipeline = std::make_unique<GlorpPipeline>(
-        m_glorpDevice,
-        std::string(RESOURCE_LOCATIONS) + "shaders/simple_shader.vert.spv",
-        std::string(RESOURCE_LOCATIONS) + "shaders/simple_shader.frag.spv",
-        pipelineConfig
-    );
+
+    auto &registry = m_glorpDevice.getPipelineRegistry();
+    const std::string vertPath = std::string(RESOURCE_LOCATIONS) + "shaders/simple_shader.vert.spv";
+    const std::string fragPath = std::string(RESOURCE_LOCATIONS) + "shaders/simple_shader.frag.spv";
+    const std::string virtualFragPath = std::string(RESOURCE_LOCATIONS) + "shaders/simple_shader_virtual.frag.spv";
+    bool virtualTextures = m_glorpDevice.supportsFragmentStoresAndAtomics();
+
+    m_glorpPipeline = registry.getPipeline(vertPath, fragPath, pipelineConfig);
+    if (virtualTextures) {
+        m_virtualPipeline = registry.getPipeline(vertPath, virtualFragPath, pipelineConfig);
+    }
+    m_dynamicState = PipelineDynamicState::fromConfig(pipelineConfig);
+
+    pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+    pipelineConfig.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    m_prepassedPipeline = registry.getPipeline(vertPath, fragPath, pipelineConfig);
+    if (virtualTextures) {
+        m_prepassedVirtualPipeline = registry.getPipeline(vertPath, virtualFragPath, pipelineConfig);
+    }
+    m_prepassedDynamicState = PipelineDynamicState::fromConfig(pipelineConfig);
 }
+void SimpleRenderSystem::queueMaterialVariants(const GlorpGameObject &obj) {
+    if (obj.model == nullptr) return;
+    auto &registry = m_glorpDevice.getPipelineRegistry();
+    bool virtualAlbedo = m_virtualPipeline && obj.material && obj.material->virtualAlbedo;
+    std::vector<uint32_t> variant;
+    materialVariant(variant, obj.material.get(), virtualAlbedo, MapToggles{});
+    registry.compileVariantAsync(virtualAlbedo ? m_virtualPipeline : m_glorpPipeline, variant);
+    // the pre-pass can be toggled at runtime, so objects it draws get both variants
+    if (DepthPrepassSystem::writesDepth(obj)) {
+        registry.compileVariantAsync(virtualAlbedo ? m_prepassedVirtualPipeline : m_prepassedPipeline, variant);
+    }
+}
+
 void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo) {
-    m_glorpPipeline->bind(frameInfo.commandBuffer);
+    const MapToggles maps{frameInfo.useNormalMap, frameInfo.useAlbedoMap, frameInfo.useEmissiveMap, frameInfo.useAOMap};
+    GlorpPipeline *boundPipeline = nullptr;
+    const PipelineDynamicState *boundDynamicState = nullptr;
+    std::vector<uint32_t> boundVariant;
+    std::vector<uint32_t> variant;
     for (auto &kv : frameInfo.gameObjects) {
         auto& obj = kv.second;
-        if (obj.model == nullptr) continue;
-
-        std::vector<VkDescriptorSet> descriptors{frameInfo.globalDescriptorSet, obj.descriptorSet};
+        if (obj.model == nullptr || frameInfo.isCulled(obj.getId())) continue;
+        bool queried = frameInfo.occlusionQueries != nullptr && obj.occlusionPolicy == GlorpGameObject::OcclusionPolicy::Query;
+        if (queried && !frameInfo.occlusionQueries->beginDraw(frameInfo, obj)) continue;
+
+        std::vector<VkDescriptorSet> descriptors{frameInfo.globalDescriptorSet, obj.descriptorSets[frameInfo.frameIndex]};
+        bool prepassed = frameInfo.depthPrepass && DepthPrepassSystem::writesDepth(obj);
+        GlorpPipeline *pipeline = prepassed ? m_prepassedPipeline.get() : m_glorpPipeline.get();
+        const PipelineDynamicState *dynamicState = prepassed ? &m_prepassedDynamicState : &m_dynamicState;
+        bool virtualAlbedo = m_virtualPipeline && obj.material && obj.material->virtualAlbedo;
+        if (virtualAlbedo) {
+            pipeline = prepassed ? m_prepassedVirtualPipeline.get() : m_virtualPipeline.get();
+            descriptors.push_back(obj.material->virtualAlbedo->getDescriptorSet(frameInfo.frameIndex));
+        }
+        materialVariant(variant, obj.material.get(), virtualAlbedo, maps);
+        if (pipeline != boundPipeline || variant != boundVariant) {
+            pipeline->bind(frameInfo.commandBuffer, variant);
+            pipeline->setDynamicState(frameInfo.commandBuffer, *dynamicState);
+            boundPipeline = pipeline;
+            boundDynamicState = dynamicState;
+            boundVariant = variant;
+        } else if (dynamicState != boundDynamicState) {
+            pipeline->setDynamicState(frameInfo.commandBuffer, *dynamicState);
+            boundDynamicState = dynamicState;
+        }
 
         vkCmdBindDescriptorSets(
             frameInfo.commandBuffer,
@@ -84,12 +176,19 @@ void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo) {
         SimplePushConstantData push{};
         push.modelMatrix = obj.transform.mat4();
         push.normalMatrix = obj.transform.normalMatrix();
-        push.useMaps = {frameInfo.useNormalMap, frameInfo.useAlbedoMap, frameInfo.useEmissiveMap, frameInfo.useAOMap};
+        push.normalMatrix[3][3] = obj.material != nullptr ? obj.material->alphaCutoff : 0.5f;
 
         vkCmdPushConstants(frameInfo.commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
 
         obj.model->bind(frameInfo.commandBuffer);
-        obj.model->draw(frameInfo.commandBuffer);
+        frameInfo.drawModel(obj);
+        if (queried) {
+            frameInfo.occlusionQueries->endDraw(frameInfo.commandBuffer);
+        }
+    }
+    // tested against the depth of every opaque object, decides what the next frames draw
+    if (frameInfo.occlusionQueries != nullptr) {
+        frameInfo.occlusionQueries->drawProxies(frameInfo);
     }
 }
 }
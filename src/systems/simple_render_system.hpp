@@ -13,20 +13,33 @@
 namespace Glorp {
 class SimpleRenderSystem {
     public:
-        SimpleRenderSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout);
+        SimpleRenderSystem(GlorpDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout,
+            VkDescriptorSetLayout virtualTextureSetLayout);
         ~SimpleRenderSystem();
 
         SimpleRenderSystem(const SimpleRenderSystem&) = delete;
         SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
+        // Queues the pipeline variants obj's material is drawn with on the registry's workers, so its
+        // first frame does not compile them. Call when obj is added to the scene.
+        void queueMaterialVariants(const GlorpGameObject &obj);
         void renderGameObjects(FrameInfo &frameInfo);
     private:
-        void createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout);
+        void createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout, VkDescriptorSetLayout virtualTextureSetLayout);
         void createPipeline(VkRenderPass renderPass);
     private:
         GlorpDevice &m_glorpDevice;
 
-        std::unique_ptr<GlorpPipeline> m_glorpPipeline;
+        std::shared_ptr<GlorpPipeline> m_glorpPipeline;
+        PipelineDynamicState m_dynamicState;
+        // samples the albedo of materials with a virtual texture, null when the device cannot write
+        // the page feedback from fragment shaders
+        std::shared_ptr<GlorpPipeline> m_virtualPipeline;
+        // for objects the depth pre-pass already drew, EQUAL depth test without writes. With dynamic depth
+        // state the registry hands out the same pipelines as above.
+        std::shared_ptr<GlorpPipeline> m_prepassedPipeline;
+        std::shared_ptr<GlorpPipeline> m_prepassedVirtualPipeline;
+        PipelineDynamicState m_prepassedDynamicState;
         VkPipelineLayout m_pipelineLayout;
 };
 